@@ -0,0 +1,1073 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include <ctime>
+#include <yarc_simple_client.h>
+#include <yarc_striped_client.h>
+#include <yarc_coalescing_client.h>
+#include <yarc_caching_client.h>
+#include <yarc_aggregating_client.h>
+#include <yarc_scripting_client.h>
+#include <yarc_executor.h>
+#include <yarc_protocol_data.h>
+#include <yarc_misc.h>
+#include <yarc_thread.h>
+
+// This is a little program for measuring the client against a locally running Redis server.
+// Usage: YarcBench <benchmark> [ip-address] [port] [count] [unix-socket-path]
+
+using namespace Yarc;
+
+struct Options
+{
+	Address address;
+	int count;
+	const char* unixSocketPath;
+};
+
+static void PrintLatencyReport(const char* label, std::vector<double>& sampleArray)
+{
+	if (sampleArray.size() == 0)
+	{
+		printf("%-24s no samples\n", label);
+		return;
+	}
+
+	std::sort(sampleArray.begin(), sampleArray.end());
+
+	auto percentile = [&sampleArray](double fraction) -> double {
+		size_t i = size_t(fraction * double(sampleArray.size() - 1));
+		return sampleArray[i] * 1e6;
+	};
+
+	printf("%-24s n=%-8d p50=%8.1fus  p99=%8.1fus  p999=%8.1fus  max=%8.1fus\n",
+		label, int(sampleArray.size()), percentile(0.5), percentile(0.99), percentile(0.999), sampleArray[sampleArray.size() - 1] * 1e6);
+}
+
+// Time a number of back-to-back round trips made by the given function.  The first few are
+// thrown away so that we're not measuring the connection being made or the pools warming up.
+template<typename F>
+static bool MeasureRoundTrips(const char* label, int count, F roundTrip)
+{
+	for (int i = 0; i < 100; i++)
+		if (!roundTrip())
+			return false;
+
+	std::vector<double> sampleArray;
+	sampleArray.reserve(count);
+
+	for (int i = 0; i < count; i++)
+	{
+		double startTime = GetMonotonicTimeSeconds();
+		if (!roundTrip())
+			return false;
+
+		sampleArray.push_back(GetMonotonicTimeSeconds() - startTime);
+	}
+
+	PrintLatencyReport(label, sampleArray);
+	return true;
+}
+
+// Compare the dedicated synchronous path against the general one, which is built
+// on an asynchronous request and repeated calls to Update().
+static bool RunSyncBenchmark(const Options& options)
+{
+	SimpleClient* client = new SimpleClient();
+	client->address = options.address;
+
+	auto syncRoundTrip = [client]() -> bool {
+		ProtocolData* responseData = nullptr;
+		bool success = client->MakeRequestSync(ProtocolData::ParseCommand("GET yarc_bench_key"), responseData);
+		delete responseData;
+		return success;
+	};
+
+	auto generalRoundTrip = [client]() -> bool {
+		ProtocolData* responseData = nullptr;
+		bool success = client->ClientInterface::MakeRequestSync(ProtocolData::ParseCommand("GET yarc_bench_key"), responseData);
+		delete responseData;
+		return success;
+	};
+
+	bool success = MeasureRoundTrips("sync (spin 50us)", options.count, syncRoundTrip);
+
+	if (success)
+	{
+		client->SetSyncSpinSeconds(0.0);
+		success = MeasureRoundTrips("sync (park only)", options.count, syncRoundTrip);
+	}
+
+	if (success)
+		success = MeasureRoundTrips("sync (via Update)", options.count, generalRoundTrip);
+
+	delete client;
+	return success;
+}
+
+// Push a batch of requests through as fast as possible with various pipeline windows, letting
+// backpressure (rather than periodic flushing) keep the queue in check.
+static bool RunPipelineBenchmark(const Options& options)
+{
+	struct Config
+	{
+		const char* label;
+		uint32_t windowSize;
+		bool adaptive;
+	};
+
+	Config configArray[] = {
+		{"window 16", 16, false},
+		{"window 128", 128, false},
+		{"window 1024", 1024, false},
+		{"window 8192", 8192, false},
+		{"adaptive 8..8192", 8192, true}
+	};
+
+	for (const Config& config : configArray)
+	{
+		SimpleClient* client = new SimpleClient();
+		client->address = options.address;
+		client->SetPipelineWindow(config.windowSize, config.adaptive);
+		client->SetMaxQueuedRequests(config.windowSize * 2, SimpleClient::BACKPRESSURE_BLOCK);
+
+		int numResponses = 0;
+		double startTime = GetMonotonicTimeSeconds();
+
+		for (int i = 0; i < options.count; i++)
+		{
+			if (0 == client->MakeRequestAsync(ProtocolData::ParseCommand("INCRBY yarc_bench_counter 1"), [&numResponses](const ProtocolData*) -> bool { numResponses++; return true; }))
+				break;
+
+			client->Update();
+		}
+
+		bool success = client->Flush(30.0) && numResponses == options.count;
+		double elapsedTime = GetMonotonicTimeSeconds() - startTime;
+
+		if (success)
+			printf("%-24s %10.0f req/s  final window=%-6u  srtt=%8.1fus\n", config.label, double(options.count) / elapsedTime, client->GetPipelineWindowSize(), client->GetSmoothedRoundTripSeconds() * 1e6);
+
+		delete client;
+
+		if (!success)
+			return false;
+	}
+
+	return true;
+}
+
+// Measure the time from making a request to having its callback called, for a program that
+// only calls Update() every so often (e.g., once per frame), with and without inline completion.
+static bool RunInlineBenchmark(const Options& options)
+{
+	double cadenceArray[] = { 0.0, 1.0, 4.0, 16.0 };
+
+	for (double cadenceMilliseconds : cadenceArray)
+	{
+		for (int inlineCompletion = 0; inlineCompletion < 2; inlineCompletion++)
+		{
+			SimpleClient* client = new SimpleClient();
+			client->address = options.address;
+			client->SetInlineCompletion(inlineCompletion != 0);
+
+			// Fewer samples at the slower cadences, or we'd be here all day.
+			int count = (cadenceMilliseconds > 0.0) ? int(2000.0 / cadenceMilliseconds) : options.count;
+			if (count > options.count)
+				count = options.count;
+
+			std::atomic<double> callbackTime(0.0);
+			std::vector<double> sampleArray;
+			bool success = true;
+
+			for (int i = 0; i < count + 10 && success; i++)
+			{
+				callbackTime = 0.0;
+				double startTime = GetMonotonicTimeSeconds();
+				if (0 == client->MakeRequestAsync(ProtocolData::ParseCommand("GET yarc_bench_key"), [&callbackTime](const ProtocolData*) -> bool {
+					callbackTime = GetMonotonicTimeSeconds();
+					return true;
+				}))
+				{
+					success = false;
+					break;
+				}
+
+				// The request goes out on this update, then we go about our business until the next one.
+				while (callbackTime == 0.0)
+				{
+					if (GetMonotonicTimeSeconds() - startTime > 5.0)
+					{
+						success = false;
+						break;
+					}
+
+					client->Update();
+					if (cadenceMilliseconds > 0.0 && callbackTime == 0.0)
+						Thread::Sleep(cadenceMilliseconds);
+				}
+
+				// The first few are thrown away, as they include making the connection.
+				if (success && i >= 10)
+					sampleArray.push_back(callbackTime - startTime);
+			}
+
+			if (success)
+			{
+				char label[64];
+				sprintf(label, "%s, %gms updates", inlineCompletion ? "inline" : "deferred", cadenceMilliseconds);
+				PrintLatencyReport(label, sampleArray);
+			}
+
+			delete client;
+
+			if (!success)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+// Run callbacks that do a fair bit of work (standing in for deserializing and indexing a big reply)
+// on the Update() thread, and then on executors of various sizes.
+static bool RunExecutorBenchmark(const Options& options)
+{
+	auto heavyCallback = [](const ProtocolData* responseData) -> bool {
+		double startTime = GetMonotonicTimeSeconds();
+		while (GetMonotonicTimeSeconds() - startTime < 50e-6)
+		{
+		}
+		return true;
+	};
+
+	uint32_t numThreadsArray[] = { 0, 1, 2, 4, 8 };
+
+	for (uint32_t numThreads : numThreadsArray)
+	{
+		Executor* executor = (numThreads > 0) ? new Executor(numThreads) : nullptr;
+
+		SimpleClient* client = new SimpleClient();
+		client->address = options.address;
+		if (executor)
+			client->SetExecutor(executor, Executor::ORDERING_PER_KEY);
+
+		int count = options.count / 10;
+		double startTime = GetMonotonicTimeSeconds();
+
+		for (int i = 0; i < count; i++)
+		{
+			// Spread the requests over a bunch of keys so that per-key ordering leaves room for parallelism.
+			if (0 == client->MakeRequestAsync(ProtocolData::ParseCommand("GET yarc_bench_key_%d", i % 64), heavyCallback))
+				break;
+
+			client->Update();
+		}
+
+		bool success = client->Flush(30.0);
+		double elapsedTime = GetMonotonicTimeSeconds() - startTime;
+
+		if (success)
+		{
+			char label[64];
+			if (executor)
+				sprintf(label, "executor, %u threads", numThreads);
+			else
+				sprintf(label, "Update() thread");
+
+			printf("%-24s %10.0f req/s\n", label, double(count) / elapsedTime);
+		}
+
+		delete client;
+		delete executor;
+
+		if (!success)
+			return false;
+	}
+
+	return true;
+}
+
+// Keep a deep pipeline full of big writes and watch how much memory the requests awaiting their
+// responses keep alive, both when the client owns the requests and when the caller holds onto them.
+static bool RunInFlightMemoryBenchmark(const Options& options)
+{
+	std::string value(1024 * 1024, 'x');
+
+	for (int callerOwned = 0; callerOwned < 2; callerOwned++)
+	{
+		SimpleClient* client = new SimpleClient();
+		client->address = options.address;
+		client->SetPipelineWindow(64);
+		client->SetMaxQueuedRequests(128, SimpleClient::BACKPRESSURE_BLOCK);
+
+		std::vector<const ProtocolData*> requestDataArray;
+		uint64_t peakInFlightBytes = 0;
+		int count = options.count / 500;
+		double startTime = GetMonotonicTimeSeconds();
+
+		for (int i = 0; i < count; i++)
+		{
+			// The value is too big to go through ParseCommand(), so we tack it on ourselves.
+			ArrayData* requestData = (ArrayData*)ProtocolData::ParseCommand("SET yarc_bench_big_key_%d", i % 64);
+			BlobStringData* valueData = new BlobStringData();
+			valueData->SetFromBuffer((const uint8_t*)value.c_str(), (uint32_t)value.length());
+			requestData->SetCount(3);
+			requestData->SetElement(2, valueData);
+
+			if (callerOwned)
+				requestDataArray.push_back(requestData);
+
+			if (0 == client->MakeRequestAsync(requestData, [](const ProtocolData*) -> bool { return true; }, callerOwned == 0))
+				break;
+
+			client->Update();
+
+			uint64_t inFlightBytes = client->GetInFlightMemoryBytes();
+			if (peakInFlightBytes < inFlightBytes)
+				peakInFlightBytes = inFlightBytes;
+		}
+
+		bool success = client->Flush(30.0);
+		double elapsedTime = GetMonotonicTimeSeconds() - startTime;
+
+		if (success)
+			printf("%-24s %10.0f req/s  peak in-flight=%8.1fKB\n", callerOwned ? "caller-owned requests" : "client-owned requests", double(count) / elapsedTime, double(peakInFlightBytes) / 1024.0);
+
+		delete client;
+
+		for (const ProtocolData* requestData : requestDataArray)
+			delete requestData;
+
+		if (!success)
+			return false;
+	}
+
+	return true;
+}
+
+// Measure the spread of synchronous round-trip times with the reception thread left to the scheduler,
+// pinned to a core of its own, busy-polling its socket, and both.  The tail is what we're after here.
+static bool RunJitterBenchmark(const Options& options)
+{
+	struct Config
+	{
+		const char* label;
+		bool pinned;
+		double busyPollSeconds;
+	};
+
+	Config configArray[] = {
+		{"default", false, 0.0},
+		{"pinned", true, 0.0},
+		{"busy-poll 100us", false, 100e-6},
+		{"pinned + busy-poll", true, 100e-6}
+	};
+
+	// Keep clear of core zero, which tends to get the most interrupts.
+	uint32_t numCores = std::thread::hardware_concurrency();
+	int cpu = (numCores > 1) ? int(numCores - 1) : 0;
+
+	for (const Config& config : configArray)
+	{
+		SimpleClient* client = new SimpleClient();
+		client->address = options.address;
+
+		Thread::Options threadOptions = client->GetThreadOptions();
+		if (config.pinned)
+			threadOptions.cpuAffinity = cpu;
+
+		client->SetThreadOptions(threadOptions);
+		client->SetBusyPollSeconds(config.busyPollSeconds);
+
+		bool success = MeasureRoundTrips(config.label, options.count, [client]() -> bool {
+			ProtocolData* responseData = nullptr;
+			bool success = client->MakeRequestSync(ProtocolData::ParseCommand("GET yarc_bench_key"), responseData);
+			delete responseData;
+			return success;
+		});
+
+		delete client;
+
+		if (!success)
+			return false;
+	}
+
+	return true;
+}
+
+// Push a batch of requests spread over a bunch of keys through one, then several connections.
+// Along the way, make sure every key's counter only ever goes up, which it wouldn't if requests
+// on the same key were allowed to go out on different connections.
+static bool RunStripesBenchmark(const Options& options)
+{
+	const uint32_t numKeys = 1024;
+	uint32_t stripeCountArray[] = {1, 2, 4, 8};
+
+	for (uint32_t numStripes : stripeCountArray)
+	{
+		StripedClient* client = new StripedClient(numStripes);
+		client->address = options.address;
+
+		for (uint32_t i = 0; i < client->GetNumStripes(); i++)
+			client->GetStripe(i)->SetMaxQueuedRequests(4096, SimpleClient::BACKPRESSURE_BLOCK);
+
+		std::vector<int64_t> lastValueArray(numKeys, 0);
+		int numResponses = 0;
+		int numOutOfOrder = 0;
+		double startTime = GetMonotonicTimeSeconds();
+
+		for (int i = 0; i < options.count; i++)
+		{
+			uint32_t key = uint32_t(i) % numKeys;
+			ProtocolData* requestData = ProtocolData::ParseCommand("INCRBY yarc_bench_stripe_%u 1", key);
+			if (0 == client->MakeRequestAsync(requestData, [&, key](const ProtocolData* responseData) -> bool {
+				const NumberData* numberData = dynamic_cast<const NumberData*>(responseData);
+				if (numberData)
+				{
+					if (numberData->GetValue() <= lastValueArray[key])
+						numOutOfOrder++;
+					lastValueArray[key] = numberData->GetValue();
+				}
+				numResponses++;
+				return true;
+			}))
+				break;
+
+			client->Update();
+		}
+
+		bool success = client->Flush(30.0) && numResponses == options.count;
+		double elapsedTime = GetMonotonicTimeSeconds() - startTime;
+
+		if (success)
+			printf("%u stripe(s) %20.0f req/s  out-of-order=%d\n", numStripes, double(options.count) / elapsedTime, numOutOfOrder);
+
+		delete client;
+
+		if (!success || numOutOfOrder > 0)
+			return false;
+	}
+
+	return true;
+}
+
+// Compare synchronous round-trip times over loopback TCP against those over a Unix domain socket to the same
+// server.  The server has to be listening on both (see the "unixsocket" option in redis.conf).
+static bool RunUnixSocketBenchmark(const Options& options)
+{
+	Address unixAddress;
+	unixAddress.SetUnixSocketPath((std::string("unix:") + options.unixSocketPath).c_str());
+
+	struct Config
+	{
+		const char* label;
+		const Address* address;
+	};
+
+	Config configArray[] = {
+		{"loopback TCP", &options.address},
+		{"Unix domain socket", &unixAddress}
+	};
+
+	for (const Config& config : configArray)
+	{
+		SimpleClient* client = new SimpleClient();
+		client->address = *config.address;
+
+		bool success = MeasureRoundTrips(config.label, options.count, [client]() -> bool {
+			ProtocolData* responseData = nullptr;
+			bool success = client->MakeRequestSync(ProtocolData::ParseCommand("GET yarc_bench_key"), responseData);
+			delete responseData;
+			return success;
+		});
+
+		delete client;
+
+		if (!success)
+			return false;
+	}
+
+	return true;
+}
+
+// Measure the time it takes a fresh connection to get its first response, when it has to be set up first: once
+// with a post-connect callback making the usual synchronous requests, and once with a connection profile.
+static bool RunHandshakeBenchmark(const Options& options)
+{
+	auto firstRoundTrip = [&options](bool useProfile) -> bool {
+		SimpleClient* client = new SimpleClient();
+		client->address = options.address;
+
+		if (useProfile)
+		{
+			SimpleClient::ConnectionProfile connectionProfile;
+			connectionProfile.password = "yarc_bench_password";
+			connectionProfile.clientName = "yarc-bench";
+			connectionProfile.database = 1;
+			client->SetConnectionProfile(connectionProfile);
+		}
+		else
+		{
+			client->SetPostConnectCallback([](SimpleClient* client) -> bool {
+				const char* commandArray[] = {"AUTH yarc_bench_password", "CLIENT SETNAME yarc-bench", "SELECT 1"};
+				for (const char* command : commandArray)
+				{
+					ProtocolData* responseData = nullptr;
+					client->MakeRequestSync(ProtocolData::ParseCommand(command), responseData);
+					delete responseData;
+				}
+				return true;
+			});
+		}
+
+		ProtocolData* responseData = nullptr;
+		bool success = client->MakeRequestSync(ProtocolData::ParseCommand("GET yarc_bench_key"), responseData);
+		delete responseData;
+
+		// Don't recycle the connection, or the next client wouldn't have to connect.
+		delete client;
+		return success;
+	};
+
+	if (!MeasureRoundTrips("post-connect callback", options.count, [&firstRoundTrip]() { return firstRoundTrip(false); }))
+		return false;
+
+	return MeasureRoundTrips("connection profile", options.count, [&firstRoundTrip]() { return firstRoundTrip(true); });
+}
+
+// Send a bunch of big values and see how much CPU time it takes per gigabyte: copied into each request as usual,
+// referred to by a shared buffer but still copied into the output buffer, and sent from the shared buffer with
+// zero-copy.  Note that over loopback the kernel copies anyway, so run this against a server on another machine.
+static bool RunZeroCopyBenchmark(const Options& options)
+{
+	struct Config
+	{
+		const char* label;
+		bool shared;
+		uint32_t zeroCopyThreshold;
+	};
+
+	Config configArray[] = {
+		{"copied value", false, 0},
+		{"shared buffer, copied", true, uint32_t(-1)},
+		{"shared buffer, zero-copy", true, 64 * 1024}
+	};
+
+	const uint32_t valueSize = 4 * 1024 * 1024;
+	SharedBuffer* sharedBuffer = SharedBuffer::Create(valueSize);
+	::memset(sharedBuffer->GetData(), 'x', valueSize);
+
+	int count = options.count / 1000;
+	if (count < 1)
+		count = 1;
+
+	bool success = true;
+	for (const Config& config : configArray)
+	{
+		SimpleClient* client = new SimpleClient();
+		client->address = options.address;
+		client->SetZeroCopyThreshold(config.zeroCopyThreshold);
+		client->SetMaxQueuedRequests(16, SimpleClient::BACKPRESSURE_BLOCK);
+
+		std::clock_t startClock = std::clock();
+		double startTime = GetMonotonicTimeSeconds();
+
+		for (int i = 0; i < count && success; i++)
+		{
+			ArrayData* requestData = (ArrayData*)ProtocolData::ParseCommand("SET yarc_bench_big_key_%d", i % 16);
+			BlobStringData* valueData = new BlobStringData();
+			if (config.shared)
+				valueData->SetFromSharedBuffer(sharedBuffer);
+			else
+				valueData->SetFromBuffer(sharedBuffer->GetData(), valueSize);
+			requestData->SetCount(3);
+			requestData->SetElement(2, valueData);
+
+			success = (0 != client->MakeRequestAsync(requestData));
+			client->Update();
+		}
+
+		success = success && client->Flush(60.0);
+
+		double cpuSeconds = double(std::clock() - startClock) / double(CLOCKS_PER_SEC);
+		double elapsedTime = GetMonotonicTimeSeconds() - startTime;
+		double gigabytes = double(count) * double(valueSize) / double(1024 * 1024 * 1024);
+
+		if (success)
+			printf("%-28s %8.3f CPU-s/GB  %8.1f MB/s\n", config.label, cpuSeconds / gigabytes, gigabytes * 1024.0 / elapsedTime);
+
+		delete client;
+
+		if (!success)
+			break;
+	}
+
+	sharedBuffer->Release();
+	return success;
+}
+
+// Upload a file-backed value over and over, once by reading the file in and copying it into the request,
+// the way it used to have to be done, and once by referring to the file and letting the kernel send it.
+static bool RunSendFileBenchmark(const Options& options)
+{
+	const uint32_t fileSize = 4 * 1024 * 1024;
+	std::vector<uint8_t> fileBuffer(fileSize, 'f');
+
+	FILE* file = tmpfile();
+	if (!file || fileSize != fwrite(fileBuffer.data(), 1, fileSize, file) || 0 != fflush(file))
+		return false;
+
+	int count = options.count / 1000;
+	if (count < 1)
+		count = 1;
+
+	bool success = true;
+	for (int fromFile = 0; fromFile < 2 && success; fromFile++)
+	{
+		SimpleClient* client = new SimpleClient();
+		client->address = options.address;
+		client->SetMaxQueuedRequests(16, SimpleClient::BACKPRESSURE_BLOCK);
+
+		std::clock_t startClock = std::clock();
+		double startTime = GetMonotonicTimeSeconds();
+
+		for (int i = 0; i < count && success; i++)
+		{
+			ArrayData* requestData = (ArrayData*)ProtocolData::ParseCommand("SET yarc_bench_file_key_%d", i % 16);
+			BlobStringData* valueData = new BlobStringData();
+			if (fromFile)
+				valueData->SetFromFile(fileno(file), 0, fileSize);
+			else
+			{
+				std::vector<uint8_t> readBuffer(fileSize);
+				success = (0 == fseek(file, 0, SEEK_SET) && fileSize == fread(readBuffer.data(), 1, fileSize, file));
+				valueData->SetFromBuffer(readBuffer.data(), fileSize);
+			}
+			requestData->SetCount(3);
+			requestData->SetElement(2, valueData);
+
+			success = success && (0 != client->MakeRequestAsync(requestData));
+			client->Update();
+		}
+
+		success = success && client->Flush(60.0);
+
+		double cpuSeconds = double(std::clock() - startClock) / double(CLOCKS_PER_SEC);
+		double elapsedTime = GetMonotonicTimeSeconds() - startTime;
+		double gigabytes = double(count) * double(fileSize) / double(1024 * 1024 * 1024);
+
+		if (success)
+			printf("%-28s %8.3f CPU-s/GB  %8.1f MB/s\n", fromFile ? "sent from file" : "read and copied", cpuSeconds / gigabytes, gigabytes * 1024.0 / elapsedTime);
+
+		delete client;
+	}
+
+	fclose(file);
+	return success;
+}
+
+// Compare making each request on its own with sending the same commands in pipelines of various sizes.
+static bool RunBatchBenchmark(const Options& options)
+{
+	uint32_t batchSizeArray[] = { 1, 16, 128, 1024 };
+
+	for (uint32_t batchSize : batchSizeArray)
+	{
+		SimpleClient* client = new SimpleClient();
+		client->address = options.address;
+		client->SetMaxQueuedRequests(8192 / batchSize + 1, SimpleClient::BACKPRESSURE_BLOCK);
+
+		int numReplies = 0;
+		int numErrors = 0;
+		double startTime = GetMonotonicTimeSeconds();
+
+		int i = 0;
+		while (i < options.count)
+		{
+			bool accepted = false;
+
+			if (batchSize == 1)
+			{
+				accepted = 0 != client->MakeRequestAsync(ProtocolData::ParseCommand("INCRBY yarc_bench_counter 1"), [&numReplies](const ProtocolData*) -> bool { numReplies++; return true; });
+				i++;
+			}
+			else
+			{
+				Pipeline* pipeline = new Pipeline();
+				for (uint32_t j = 0; j < batchSize && i < options.count; j++, i++)
+					pipeline->AddCommand(ProtocolData::ParseCommand("INCRBY yarc_bench_counter 1"));
+
+				accepted = client->MakePipelineRequestAsync(pipeline, [&numReplies, &numErrors](Pipeline* pipeline) -> bool {
+					numReplies += pipeline->GetCount();
+					numErrors += pipeline->GetNumErrors();
+					return true;
+				});
+
+				if (!accepted)
+					delete pipeline;
+			}
+
+			if (!accepted)
+				break;
+
+			client->Update();
+		}
+
+		bool success = client->Flush(30.0) && numReplies == options.count && numErrors == 0;
+		double elapsedTime = GetMonotonicTimeSeconds() - startTime;
+
+		if (success)
+			printf("batch of %-6u %10.0f req/s\n", batchSize, double(options.count) / elapsedTime);
+
+		delete client;
+
+		if (!success)
+			return false;
+	}
+
+	return true;
+}
+
+// Make a bunch of independent GETs each tick, as a game loop might, with and without coalescing them.
+static bool RunCoalesceBenchmark(const Options& options)
+{
+	const int numRequestsPerTick = 64;
+
+	for (int coalesce = 0; coalesce < 2; coalesce++)
+	{
+		SimpleClient* simpleClient = new SimpleClient();
+		simpleClient->address = options.address;
+		simpleClient->SetMaxQueuedRequests(8192, SimpleClient::BACKPRESSURE_BLOCK);
+
+		CoalescingClient* coalescingClient = coalesce ? new CoalescingClient(simpleClient) : nullptr;
+		ClientInterface* client = coalescingClient ? (ClientInterface*)coalescingClient : (ClientInterface*)simpleClient;
+
+		int numReplies = 0;
+		double startTime = GetMonotonicTimeSeconds();
+
+		int i = 0;
+		while (i < options.count)
+		{
+			for (int j = 0; j < numRequestsPerTick && i < options.count; j++, i++)
+				if (0 == client->MakeRequestAsync(ProtocolData::ParseCommand("GET yarc_bench_key_%d", i % 1000), [&numReplies](const ProtocolData*) -> bool { numReplies++; return true; }))
+					break;
+
+			client->Update();
+		}
+
+		bool success = client->Flush(30.0) && numReplies == options.count;
+		double elapsedTime = GetMonotonicTimeSeconds() - startTime;
+
+		if (success)
+		{
+			if (coalescingClient)
+				printf("coalesced     %10.0f req/s  (%.1f requests per command)\n", double(options.count) / elapsedTime, coalescingClient->GetCoalescingRatio());
+			else
+				printf("one at a time %10.0f req/s\n", double(options.count) / elapsedTime);
+		}
+
+		delete client;
+
+		if (!success)
+			return false;
+	}
+
+	return true;
+}
+
+// Have a crowd of callers all miss on the same few hot keys each tick, with and without single-flight.
+static bool RunSingleFlightBenchmark(const Options& options)
+{
+	const int numRequestsPerTick = 64;
+
+	for (int singleFlight = 0; singleFlight < 2; singleFlight++)
+	{
+		SimpleClient* simpleClient = new SimpleClient();
+		simpleClient->address = options.address;
+		simpleClient->SetMaxQueuedRequests(8192, SimpleClient::BACKPRESSURE_BLOCK);
+
+		CoalescingClient* client = new CoalescingClient(simpleClient);
+		client->SetSingleFlight(singleFlight != 0);
+
+		int numReplies = 0;
+		double startTime = GetMonotonicTimeSeconds();
+
+		int i = 0;
+		while (i < options.count)
+		{
+			for (int j = 0; j < numRequestsPerTick && i < options.count; j++, i++)
+				if (0 == client->MakeRequestAsync(ProtocolData::ParseCommand("HGETALL yarc_bench_hot_%d", i % 4), [&numReplies](const ProtocolData*) -> bool { numReplies++; return true; }))
+					break;
+
+			client->Update();
+		}
+
+		bool success = client->Flush(30.0) && numReplies == options.count;
+		double elapsedTime = GetMonotonicTimeSeconds() - startTime;
+
+		if (success)
+			printf("single-flight %-3s %10.0f req/s  (%llu duplicates suppressed)\n", singleFlight ? "on" : "off", double(options.count) / elapsedTime, (unsigned long long)client->GetNumDuplicatesSuppressed());
+
+		delete client;
+
+		if (!success)
+			return false;
+	}
+
+	return true;
+}
+
+// Read a small working set of keys over and over, straight from the server, and then through a client-side cache.
+static bool RunCacheBenchmark(const Options& options)
+{
+	const int numKeys = 1000;
+	const int numRequestsPerTick = 64;
+
+	for (int caching = 0; caching < 2; caching++)
+	{
+		SimpleClient* simpleClient = new SimpleClient();
+		simpleClient->address = options.address;
+		simpleClient->SetMaxQueuedRequests(8192, SimpleClient::BACKPRESSURE_BLOCK);
+
+		CachingClient* cachingClient = caching ? new CachingClient(simpleClient) : nullptr;
+		ClientInterface* client = caching ? (ClientInterface*)cachingClient : (ClientInterface*)simpleClient;
+
+		// Let the handshake go through first, or nothing would be cached.
+		ProtocolData* responseData = nullptr;
+		if (!client->MakeRequestSync(ProtocolData::ParseCommand("PING"), responseData))
+		{
+			delete client;
+			return false;
+		}
+
+		delete responseData;
+
+		int numReplies = 0;
+		double startTime = GetMonotonicTimeSeconds();
+
+		int i = 0;
+		while (i < options.count)
+		{
+			for (int j = 0; j < numRequestsPerTick && i < options.count; j++, i++)
+				if (0 == client->MakeRequestAsync(ProtocolData::ParseCommand("GET yarc_bench_cached_%d", i % numKeys), [&numReplies](const ProtocolData*) -> bool { numReplies++; return true; }))
+					break;
+
+			client->Update();
+		}
+
+		bool success = client->Flush(30.0) && numReplies == options.count;
+		double elapsedTime = GetMonotonicTimeSeconds() - startTime;
+
+		if (success)
+		{
+			if (cachingClient)
+				printf("cache on   %10.0f req/s  (%llu hits, %llu misses)\n", double(options.count) / elapsedTime, (unsigned long long)cachingClient->GetNumHits(), (unsigned long long)cachingClient->GetNumMisses());
+			else
+				printf("cache off  %10.0f req/s\n", double(options.count) / elapsedTime);
+		}
+
+		delete client;
+
+		if (!success)
+			return false;
+	}
+
+	return true;
+}
+
+// Bump a handful of hot counters over and over, one command per update, and then merged behind a write-behind aggregator.
+static bool RunAggregateBenchmark(const Options& options)
+{
+	const int numKeys = 16;
+	const int numRequestsPerTick = 64;
+
+	for (int aggregating = 0; aggregating < 2; aggregating++)
+	{
+		SimpleClient* simpleClient = new SimpleClient();
+		simpleClient->address = options.address;
+		simpleClient->SetMaxQueuedRequests(8192, SimpleClient::BACKPRESSURE_BLOCK);
+
+		AggregatingClient* aggregatingClient = aggregating ? new AggregatingClient(simpleClient) : nullptr;
+		ClientInterface* client = aggregating ? (ClientInterface*)aggregatingClient : (ClientInterface*)simpleClient;
+
+		int numReplies = 0;
+		double startTime = GetMonotonicTimeSeconds();
+
+		int i = 0;
+		while (i < options.count)
+		{
+			for (int j = 0; j < numRequestsPerTick && i < options.count; j++, i++)
+				if (0 == client->MakeRequestAsync(ProtocolData::ParseCommand("INCRBY yarc_bench_counter_%d 1", i % numKeys), [&numReplies](const ProtocolData*) -> bool { numReplies++; return true; }))
+					break;
+
+			client->Update();
+		}
+
+		bool success = client->Flush(30.0) && numReplies == options.count;
+		double elapsedTime = GetMonotonicTimeSeconds() - startTime;
+
+		if (success)
+		{
+			if (aggregatingClient)
+				printf("aggregation on   %10.0f updates/s  (%llu commands sent, ratio %.1f)\n", double(options.count) / elapsedTime, (unsigned long long)aggregatingClient->GetNumCommandsSent(), aggregatingClient->GetAggregationRatio());
+			else
+				printf("aggregation off  %10.0f updates/s\n", double(options.count) / elapsedTime);
+		}
+
+		delete client;
+
+		if (!success)
+			return false;
+	}
+
+	return true;
+}
+
+// Call a script of a realistic size, first sending its body every time, and then by its SHA1.
+static bool RunScriptsBenchmark(const Options& options)
+{
+	const int numRequestsPerTick = 64;
+
+	std::string scriptBody = "local value = redis.call('GET', KEYS[1])\n";
+	while (scriptBody.length() < 1024)
+		scriptBody += "-- Padding, to stand in for the rest of a script that does real work.\n";
+	scriptBody += "return value";
+
+	// The bandwidth saved is what matters here, since how many calls a second a server can take depends on so much else.
+	auto makeCommand = [](const char* commandName, const std::string& scriptOrSha, int i) -> ProtocolData* {
+		ArrayData* commandArrayData = new ArrayData();
+		commandArrayData->SetCount(4);
+		commandArrayData->SetElement(0, new BlobStringData(commandName));
+		commandArrayData->SetElement(1, new BlobStringData(scriptOrSha));
+		commandArrayData->SetElement(2, new BlobStringData("1"));
+		commandArrayData->SetElement(3, new BlobStringData("yarc_bench_key_" + std::to_string(i % 1000)));
+		return commandArrayData;
+	};
+
+	for (int scripting = 0; scripting < 2; scripting++)
+	{
+		SimpleClient* simpleClient = new SimpleClient();
+		simpleClient->address = options.address;
+		simpleClient->SetMaxQueuedRequests(8192, SimpleClient::BACKPRESSURE_BLOCK);
+
+		ScriptingClient* scriptingClient = scripting ? new ScriptingClient(simpleClient) : nullptr;
+		ClientInterface* client = scripting ? (ClientInterface*)scriptingClient : (ClientInterface*)simpleClient;
+
+		int numReplies = 0;
+		double startTime = GetMonotonicTimeSeconds();
+
+		int i = 0;
+		while (i < options.count)
+		{
+			for (int j = 0; j < numRequestsPerTick && i < options.count; j++, i++)
+			{
+				ProtocolData* commandData = makeCommand("EVAL", scriptBody, i);
+				if (0 == client->MakeRequestAsync(commandData, [&numReplies](const ProtocolData*) -> bool { numReplies++; return true; }))
+				{
+					delete commandData;
+					break;
+				}
+			}
+
+			client->Update();
+		}
+
+		bool success = client->Flush(30.0) && numReplies == options.count;
+		double elapsedTime = GetMonotonicTimeSeconds() - startTime;
+
+		if (success)
+		{
+			// The script is already registered, so this just looks up its SHA1.
+			ProtocolData* commandData = makeCommand(scriptingClient ? "EVALSHA" : "EVAL", scriptingClient ? scriptingClient->RegisterScript(scriptBody) : scriptBody, 0);
+			std::string commandBytes;
+			StringStream stringStream(&commandBytes);
+			ProtocolData::PrintTree(&stringStream, commandData);
+			uint32_t commandSize = (uint32_t)commandBytes.length();
+			delete commandData;
+
+			if (scriptingClient)
+				printf("EVALSHA  %10.0f calls/s  %5u bytes per call  (%llu of %d calls sent by SHA1, %llu scripts reloaded)\n", double(options.count) / elapsedTime, commandSize, (unsigned long long)scriptingClient->GetNumEvalsRewritten(), options.count, (unsigned long long)scriptingClient->GetNumScriptsReloaded());
+			else
+				printf("EVAL     %10.0f calls/s  %5u bytes per call\n", double(options.count) / elapsedTime, commandSize);
+		}
+
+		delete client;
+
+		if (!success)
+			return false;
+	}
+
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		std::cout << "Usage: YarcBench <benchmark> [ip-address] [port] [count] [unix-socket-path]" << std::endl;
+		std::cout << "Benchmarks: sync, pipeline, inline, executor, inflight, jitter, stripes, unix, handshake, zerocopy, sendfile, batch, coalesce, singleflight, cache, aggregate, scripts" << std::endl;
+		return 1;
+	}
+
+	Options options;
+	options.address.SetIPAddress(argc >= 3 ? argv[2] : "127.0.0.1");
+	options.address.port = argc >= 4 ? atoi(argv[3]) : 6379;
+	options.count = argc >= 5 ? atoi(argv[4]) : 100000;
+	options.unixSocketPath = argc >= 6 ? argv[5] : "/tmp/redis.sock";
+
+	bool success = false;
+	if (0 == strcmp(argv[1], "sync"))
+		success = RunSyncBenchmark(options);
+	else if (0 == strcmp(argv[1], "pipeline"))
+		success = RunPipelineBenchmark(options);
+	else if (0 == strcmp(argv[1], "inline"))
+		success = RunInlineBenchmark(options);
+	else if (0 == strcmp(argv[1], "executor"))
+		success = RunExecutorBenchmark(options);
+	else if (0 == strcmp(argv[1], "inflight"))
+		success = RunInFlightMemoryBenchmark(options);
+	else if (0 == strcmp(argv[1], "jitter"))
+		success = RunJitterBenchmark(options);
+	else if (0 == strcmp(argv[1], "stripes"))
+		success = RunStripesBenchmark(options);
+	else if (0 == strcmp(argv[1], "unix"))
+		success = RunUnixSocketBenchmark(options);
+	else if (0 == strcmp(argv[1], "handshake"))
+		success = RunHandshakeBenchmark(options);
+	else if (0 == strcmp(argv[1], "zerocopy"))
+		success = RunZeroCopyBenchmark(options);
+	else if (0 == strcmp(argv[1], "sendfile"))
+		success = RunSendFileBenchmark(options);
+	else if (0 == strcmp(argv[1], "batch"))
+		success = RunBatchBenchmark(options);
+	else if (0 == strcmp(argv[1], "coalesce"))
+		success = RunCoalesceBenchmark(options);
+	else if (0 == strcmp(argv[1], "singleflight"))
+		success = RunSingleFlightBenchmark(options);
+	else if (0 == strcmp(argv[1], "cache"))
+		success = RunCacheBenchmark(options);
+	else if (0 == strcmp(argv[1], "aggregate"))
+		success = RunAggregateBenchmark(options);
+	else if (0 == strcmp(argv[1], "scripts"))
+		success = RunScriptsBenchmark(options);
+	else
+	{
+		std::cout << "Unknown benchmark: " << argv[1] << std::endl;
+		return 1;
+	}
+
+	if (!success)
+	{
+		std::cout << "Benchmark failed!  Is a Redis server running at " << options.address.GetIPAddressAndPort() << "?" << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
\ No newline at end of file
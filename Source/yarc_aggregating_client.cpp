@@ -0,0 +1,560 @@
+#include "yarc_aggregating_client.h"
+#include "yarc_protocol_data.h"
+#include "yarc_pipeline.h"
+#include "yarc_misc.h"
+#include <ctype.h>
+#include <errno.h>
+#include <stdlib.h>
+
+namespace Yarc
+{
+	AggregatingClient::AggregatingClient(ClientInterface* givenClient) : WrappingClient(givenClient)
+	{
+		this->entrySlab = new EntrySlab();
+		this->aggregateMap = new AggregateMap();
+		this->pendingAggregateArray = new DynamicArray<Aggregate*>();
+		this->pendingKeyCountMap = new KeyCountMap();
+		this->sentBatchList = new LinkedList<FlushedBatch*>();
+		this->maxPendingKeyLength = 0;
+		this->numPendingUpdates = 0;
+		this->firstPendingTime = 0.0;
+		this->flushIntervalSeconds = 0.1;
+		this->maxPendingUpdates = 10000;
+		this->numUpdatesAggregated = 0;
+		this->numCommandsSent = 0;
+	}
+
+	/*virtual*/ AggregatingClient::~AggregatingClient()
+	{
+		// Updates not yet flushed are lost, as documented.  That's what Flush() is for.
+		for (uint32_t i = 0; i < this->pendingAggregateArray->GetCount(); i++)
+			delete (*this->pendingAggregateArray)[i];
+
+		// The client drops the callbacks of requests passed through, which lets go of their entries, and of the pipelines
+		// we flushed, which only name their batches by a raw pointer, so we delete those ourselves once the client is gone.
+		delete this->client;
+
+		while (this->sentBatchList->GetCount() > 0)
+		{
+			FlushedBatch* flushedBatch = this->sentBatchList->GetHead()->value;
+			this->sentBatchList->Remove(this->sentBatchList->GetHead());
+			delete flushedBatch;
+		}
+
+		delete this->sentBatchList;
+		delete this->pendingKeyCountMap;
+		delete this->pendingAggregateArray;
+		delete this->aggregateMap;
+		delete this->entrySlab;
+	}
+
+	/*static*/ AggregatingClient* AggregatingClient::Create(ClientInterface* givenClient)
+	{
+		return new AggregatingClient(givenClient);
+	}
+
+	/*static*/ void AggregatingClient::Destroy(AggregatingClient* client)
+	{
+		delete client;
+	}
+
+	AggregatingClient::Entry::Entry(Callback givenCallback, AggregatingClient* givenAggregatingClient) : WrappingClient::Entry(std::move(givenCallback), givenAggregatingClient)
+	{
+		this->runningTotal = 0;
+	}
+
+	AggregatingClient::Aggregate::Aggregate(Kind givenKind, AggregatingClient* givenAggregatingClient)
+	{
+		this->kind = givenKind;
+		this->aggregatingClient = givenAggregatingClient;
+		this->total = 0;
+	}
+
+	AggregatingClient::Aggregate::~Aggregate()
+	{
+		for (uint32_t i = 0; i < this->entryArray.GetCount(); i++)
+			this->aggregatingClient->FreeEntry(this->entryArray[i]);
+	}
+
+	AggregatingClient::FlushedBatch::~FlushedBatch()
+	{
+		for (uint32_t i = 0; i < this->aggregateArray.GetCount(); i++)
+			delete this->aggregateArray[i];
+	}
+
+	/*virtual*/ WrappingClient::Entry* AggregatingClient::LookupEntry(RequestHandle requestHandle)
+	{
+		return this->entrySlab->Lookup(requestHandle);
+	}
+
+	/*virtual*/ void AggregatingClient::DeallocateEntry(WrappingClient::Entry* entry)
+	{
+		this->entrySlab->Deallocate((Entry*)entry);
+	}
+
+	/*virtual*/ bool AggregatingClient::Update(double timeoutMilliseconds /*= 0.0*/)
+	{
+		FlushedBatch* flushedBatch = nullptr;
+
+		{
+			MutexLocker locker(this->pendingMutex);
+			if (this->numPendingUpdates > 0)
+				if (this->flushIntervalSeconds <= 0.0 || GetMonotonicTimeSeconds() - this->firstPendingTime >= this->flushIntervalSeconds)
+					flushedBatch = this->TakePendingUpdates();
+		}
+
+		this->SendFlushedBatch(flushedBatch);
+		return this->PrepareClient()->Update(timeoutMilliseconds);
+	}
+
+	/*virtual*/ bool AggregatingClient::Flush(double timeoutSeconds /*= 5.0*/)
+	{
+		this->FlushUpdates();
+		return this->PrepareClient()->Flush(timeoutSeconds);
+	}
+
+	// Redis only takes plain decimal integers here, so we're just as strict.  Anything else goes to the server as it
+	// was given, to be turned down there.
+	static bool ParseInteger(const DynamicArray<uint8_t>& byteArray, int64_t& value)
+	{
+		if (byteArray.GetCount() == 0 || byteArray.GetCount() > 20)
+			return false;
+
+		char buffer[21];
+		for (uint32_t i = 0; i < byteArray.GetCount(); i++)
+		{
+			if (!isdigit(byteArray[i]) && !(i == 0 && byteArray[i] == '-' && byteArray.GetCount() > 1))
+				return false;
+
+			buffer[i] = (char)byteArray[i];
+		}
+
+		buffer[byteArray.GetCount()] = '\0';
+
+		// Nor does it take leading zeros, or a negative zero.  Zero itself is written just the one way.
+		uint32_t firstDigit = (buffer[0] == '-') ? 1 : 0;
+		if (buffer[firstDigit] == '0' && byteArray.GetCount() > 1)
+			return false;
+
+		errno = 0;
+		value = strtoll(buffer, nullptr, 10);
+		return errno == 0;
+	}
+
+	static std::string ArgumentString(const ArrayData* commandArrayData, uint32_t i)
+	{
+		const DynamicArray<uint8_t>& byteArray = ((const BlobStringData*)commandArrayData->GetElement(i))->GetByteArray();
+		return std::string((const char*)byteArray.GetBuffer(), byteArray.GetCount());
+	}
+
+	/*static*/ bool AggregatingClient::ClassifyRequest(const ProtocolData* requestData, ParsedUpdate& update)
+	{
+		if (!requestData)
+			return false;
+
+		const ArrayData* commandArrayData = Cast<ArrayData>(requestData);
+		if (!commandArrayData || commandArrayData->GetCount() < 2)
+			return false;
+
+		// Arguments referring to a shared buffer or a file are left alone, since we'd have to copy them to merge them.
+		for (uint32_t i = 0; i < commandArrayData->GetCount(); i++)
+		{
+			const ProtocolData* argData = commandArrayData->GetElement(i);
+			const BlobStringData* argStringData = argData ? Cast<BlobStringData>(argData) : nullptr;
+			if (!argStringData || argStringData->GetSharedBuffer() || argStringData->GetFileRegion())
+				return false;
+		}
+
+		const DynamicArray<uint8_t>& nameByteArray = ((const BlobStringData*)commandArrayData->GetElement(0))->GetByteArray();
+		uint32_t numArgs = commandArrayData->GetCount();
+
+		update.kind = KIND_NONE;
+		update.increment = 0;
+
+		if (numArgs == 2 && ProtocolData::IsCommandName(nameByteArray, "INCR"))
+		{
+			update.kind = KIND_INCRBY;
+			update.increment = 1;
+		}
+		else if (numArgs == 2 && ProtocolData::IsCommandName(nameByteArray, "DECR"))
+		{
+			update.kind = KIND_INCRBY;
+			update.increment = -1;
+		}
+		else if (numArgs == 3 && ProtocolData::IsCommandName(nameByteArray, "INCRBY"))
+		{
+			if (!ParseInteger(((const BlobStringData*)commandArrayData->GetElement(2))->GetByteArray(), update.increment))
+				return false;
+
+			update.kind = KIND_INCRBY;
+		}
+		else if (numArgs == 3 && ProtocolData::IsCommandName(nameByteArray, "DECRBY"))
+		{
+			if (!ParseInteger(((const BlobStringData*)commandArrayData->GetElement(2))->GetByteArray(), update.increment) || update.increment == INT64_MIN)
+				return false;
+
+			update.kind = KIND_INCRBY;
+			update.increment = -update.increment;
+		}
+		else if (numArgs == 4 && ProtocolData::IsCommandName(nameByteArray, "HINCRBY"))
+		{
+			if (!ParseInteger(((const BlobStringData*)commandArrayData->GetElement(3))->GetByteArray(), update.increment))
+				return false;
+
+			update.kind = KIND_HINCRBY;
+			update.field = ArgumentString(commandArrayData, 2);
+		}
+		else if (numArgs >= 3 && ProtocolData::IsCommandName(nameByteArray, "SADD"))
+			update.kind = KIND_SADD;
+		else if (ProtocolData::IsCommandName(nameByteArray, "PFADD"))
+			update.kind = KIND_PFADD;
+		else
+			return false;
+
+		update.key = ArgumentString(commandArrayData, 1);
+		return true;
+	}
+
+	/*virtual*/ AggregatingClient::RequestHandle AggregatingClient::MakeRequestAsync(const ProtocolData* requestData, Callback callback /*= [](const ProtocolData*) -> bool { return true; }*/, bool deleteData /*= true*/)
+	{
+		ParsedUpdate update;
+		if (ClassifyRequest(requestData, update))
+			return this->AggregateUpdate(requestData, update, std::move(callback), deleteData);
+
+		this->FlushIfNamed(requestData);
+
+		Entry* entry = this->entrySlab->Allocate(std::move(callback), this);
+		RequestHandle requestHandle = this->entrySlab->GetHandle(entry);
+		return this->PassRequestThrough(EntryPtr(entry), requestHandle, requestData, deleteData);
+	}
+
+	AggregatingClient::RequestHandle AggregatingClient::AggregateUpdate(const ProtocolData* requestData, const ParsedUpdate& update, Callback callback, bool deleteData)
+	{
+		std::string aggregateKey(1, char('0' + update.kind));
+		aggregateKey += update.key;
+		if (update.kind == KIND_HINCRBY)
+		{
+			aggregateKey += '\0';
+			aggregateKey += update.field;
+		}
+
+		// Whatever has to go out is only sent once we've let go of the lock, oldest first.
+		FlushedBatch* overflowedBatch = nullptr;
+		FlushedBatch* fullBatch = nullptr;
+		RequestHandle requestHandle = 0;
+
+		{
+			MutexLocker locker(this->pendingMutex);
+
+			AggregateMap::iterator iter = this->aggregateMap->find(aggregateKey);
+
+			// Should a counter's sum overflow, what we have so far goes out, and we start over.
+			if (iter != this->aggregateMap->end() && (update.kind == KIND_INCRBY || update.kind == KIND_HINCRBY))
+			{
+				int64_t total = iter->second->total;
+				if ((update.increment > 0 && total > INT64_MAX - update.increment) || (update.increment < 0 && total < INT64_MIN - update.increment))
+				{
+					overflowedBatch = this->TakePendingUpdates();
+					iter = this->aggregateMap->end();
+				}
+			}
+
+			if (this->numPendingUpdates == 0)
+				this->firstPendingTime = GetMonotonicTimeSeconds();
+
+			Aggregate* aggregate = nullptr;
+			if (iter != this->aggregateMap->end())
+				aggregate = iter->second;
+			else
+			{
+				aggregate = new Aggregate(update.kind, this);
+				aggregate->key = update.key;
+				aggregate->field = update.field;
+				(*this->aggregateMap)[aggregateKey] = aggregate;
+
+				uint32_t i = this->pendingAggregateArray->GetCount();
+				this->pendingAggregateArray->SetCount(i + 1);
+				(*this->pendingAggregateArray)[i] = aggregate;
+
+				(*this->pendingKeyCountMap)[update.key]++;
+				if (update.key.length() > this->maxPendingKeyLength)
+					this->maxPendingKeyLength = (uint32_t)update.key.length();
+			}
+
+			if (update.kind == KIND_SADD || update.kind == KIND_PFADD)
+			{
+				const ArrayData* commandArrayData = (const ArrayData*)requestData;
+				for (uint32_t i = 2; i < commandArrayData->GetCount(); i++)
+					aggregate->memberSet.insert(ArgumentString(commandArrayData, i));
+			}
+			else
+				aggregate->total += update.increment;
+
+			// We've taken all we need from the request.
+			if (deleteData)
+				delete requestData;
+
+			Entry* entry = this->entrySlab->Allocate(std::move(callback), this);
+			entry->runningTotal = aggregate->total;
+
+			uint32_t i = aggregate->entryArray.GetCount();
+			aggregate->entryArray.SetCount(i + 1);
+			aggregate->entryArray[i] = entry;
+
+			requestHandle = this->entrySlab->GetHandle(entry);
+
+			if (++this->numPendingUpdates >= this->maxPendingUpdates)
+				fullBatch = this->TakePendingUpdates();
+		}
+
+		this->SendFlushedBatch(overflowedBatch);
+		this->SendFlushedBatch(fullBatch);
+		return requestHandle;
+	}
+
+	// We don't know which arguments are keys, so we just take them all to be.  Flushing a little early does no harm.
+	void AggregatingClient::FlushIfNamed(const ProtocolData* requestData)
+	{
+		if (!requestData)
+			return;
+
+		const ArrayData* commandArrayData = Cast<ArrayData>(requestData);
+		if (!commandArrayData)
+			return;
+
+		FlushedBatch* flushedBatch = nullptr;
+
+		{
+			MutexLocker locker(this->pendingMutex);
+			if (this->numPendingUpdates == 0)
+				return;
+
+			for (uint32_t i = 1; i < commandArrayData->GetCount(); i++)
+			{
+				const ProtocolData* argData = commandArrayData->GetElement(i);
+				const BlobStringData* argStringData = argData ? Cast<BlobStringData>(argData) : nullptr;
+				if (!argStringData || argStringData->GetFileRegion())
+					continue;
+
+				// Anything longer than every key we're holding updates for can't be one of them.
+				const DynamicArray<uint8_t>& argByteArray = argStringData->GetByteArray();
+				if (argByteArray.GetCount() > this->maxPendingKeyLength)
+					continue;
+
+				std::string arg((const char*)argByteArray.GetBuffer(), argByteArray.GetCount());
+				if (this->pendingKeyCountMap->find(arg) != this->pendingKeyCountMap->end())
+				{
+					flushedBatch = this->TakePendingUpdates();
+					break;
+				}
+			}
+		}
+
+		this->SendFlushedBatch(flushedBatch);
+	}
+
+	ProtocolData* AggregatingClient::MakeAggregateCommand(const Aggregate* aggregate)
+	{
+		ArrayData* commandArrayData = new ArrayData();
+
+		switch (aggregate->kind)
+		{
+			case KIND_INCRBY:
+			{
+				commandArrayData->SetCount(3);
+				commandArrayData->SetElement(0, new BlobStringData("INCRBY"));
+				commandArrayData->SetElement(1, new BlobStringData(aggregate->key));
+				commandArrayData->SetElement(2, new BlobStringData(std::to_string(aggregate->total)));
+				break;
+			}
+			case KIND_HINCRBY:
+			{
+				commandArrayData->SetCount(4);
+				commandArrayData->SetElement(0, new BlobStringData("HINCRBY"));
+				commandArrayData->SetElement(1, new BlobStringData(aggregate->key));
+				commandArrayData->SetElement(2, new BlobStringData(aggregate->field));
+				commandArrayData->SetElement(3, new BlobStringData(std::to_string(aggregate->total)));
+				break;
+			}
+			case KIND_SADD:
+			case KIND_PFADD:
+			{
+				commandArrayData->SetCount((uint32_t)aggregate->memberSet.size() + 2);
+				commandArrayData->SetElement(0, new BlobStringData(aggregate->kind == KIND_SADD ? "SADD" : "PFADD"));
+				commandArrayData->SetElement(1, new BlobStringData(aggregate->key));
+				uint32_t i = 2;
+				for (const std::string& member : aggregate->memberSet)
+					commandArrayData->SetElement(i++, new BlobStringData(member));
+				break;
+			}
+			case KIND_NONE:
+			{
+				break;
+			}
+		}
+
+		return commandArrayData;
+	}
+
+	void AggregatingClient::FlushUpdates(void)
+	{
+		FlushedBatch* flushedBatch = nullptr;
+
+		{
+			MutexLocker locker(this->pendingMutex);
+			flushedBatch = this->TakePendingUpdates();
+		}
+
+		this->SendFlushedBatch(flushedBatch);
+	}
+
+	// The caller must have the pending updates locked.  Everything held back so far is taken, to go out together.
+	AggregatingClient::FlushedBatch* AggregatingClient::TakePendingUpdates(void)
+	{
+		if (this->pendingAggregateArray->GetCount() == 0)
+			return nullptr;
+
+		FlushedBatch* flushedBatch = new FlushedBatch();
+		flushedBatch->sentNode = nullptr;
+		flushedBatch->aggregateArray.SetCount(this->pendingAggregateArray->GetCount());
+		for (uint32_t i = 0; i < this->pendingAggregateArray->GetCount(); i++)
+			flushedBatch->aggregateArray[i] = (*this->pendingAggregateArray)[i];
+
+		this->numUpdatesAggregated += this->numPendingUpdates;
+		this->numCommandsSent += this->pendingAggregateArray->GetCount();
+
+		this->pendingAggregateArray->SetCount(0);
+		this->aggregateMap->clear();
+		this->pendingKeyCountMap->clear();
+		this->maxPendingKeyLength = 0;
+		this->numPendingUpdates = 0;
+
+		return flushedBatch;
+	}
+
+	// Nobody else can get at the batch's aggregates anymore, so none of this needs the pending updates locked.
+	void AggregatingClient::SendFlushedBatch(FlushedBatch* flushedBatch)
+	{
+		if (!flushedBatch)
+			return;
+
+		Pipeline* pipeline = new Pipeline();
+		for (uint32_t i = 0; i < flushedBatch->aggregateArray.GetCount(); i++)
+			pipeline->AddCommand(this->MakeAggregateCommand(flushedBatch->aggregateArray[i]));
+
+		{
+			MutexLocker locker(this->entryMutex);
+			this->sentBatchList->AddTail(flushedBatch);
+			flushedBatch->sentNode = this->sentBatchList->GetTail();
+		}
+
+		bool accepted = this->PrepareClient()->MakePipelineRequestAsync(pipeline, [this, flushedBatch](Pipeline* pipeline) -> bool {
+			return this->CompleteBatch(flushedBatch, pipeline);
+		});
+
+		if (!accepted)
+		{
+			// These updates were merged (and given handles) well before now, so a refused pipeline is an error for each.
+			for (uint32_t i = 0; i < flushedBatch->aggregateArray.GetCount(); i++)
+				this->CompleteAggregate(flushedBatch->aggregateArray[i], new SimpleErrorData("ERR yarc: request refused"));
+
+			{
+				MutexLocker locker(this->entryMutex);
+				this->sentBatchList->Remove(flushedBatch->sentNode);
+			}
+
+			delete flushedBatch;
+			delete pipeline;
+		}
+	}
+
+	bool AggregatingClient::CompleteBatch(FlushedBatch* flushedBatch, Pipeline* pipeline)
+	{
+		for (uint32_t i = 0; i < flushedBatch->aggregateArray.GetCount(); i++)
+			this->CompleteAggregate(flushedBatch->aggregateArray[i], pipeline->TakeReply(i));
+
+		{
+			MutexLocker locker(this->entryMutex);
+			this->sentBatchList->Remove(flushedBatch->sentNode);
+		}
+
+		delete flushedBatch;
+		return true;
+	}
+
+	// We own the given reply, and hand it (or what's worked out from it) out to everyone merged into the aggregate.
+	void AggregatingClient::CompleteAggregate(Aggregate* aggregate, ProtocolData* responseData)
+	{
+		if (!responseData)
+			responseData = new SimpleErrorData("ERR yarc: no reply");
+
+		// A counter's merged reply is its value after everyone's increments, so taking away those merged after
+		// a caller's gives what that caller would have gotten back on their own.  The sums can't have overflowed.
+		const NumberData* numberData = (aggregate->kind == KIND_INCRBY || aggregate->kind == KIND_HINCRBY) ? Cast<NumberData>(responseData) : nullptr;
+		if (numberData)
+		{
+			int64_t startValue = numberData->GetValue() - aggregate->total;
+			for (uint32_t i = 0; i < aggregate->entryArray.GetCount(); i++)
+			{
+				Callback callback = this->TakeCallback(aggregate->entryArray[i]);
+				if (!callback)
+					continue;
+
+				NumberData* valueData = new NumberData(startValue + aggregate->entryArray[i]->runningTotal);
+				if (callback(valueData))
+					delete valueData;
+			}
+
+			delete responseData;
+			return;
+		}
+
+		// Anything else (an error, say) can't be split up, so everyone gets the whole thing.  Each callback may keep
+		// what it's given, so all but the last get a copy.
+		uint32_t numEntries = aggregate->entryArray.GetCount();
+		for (uint32_t i = 0; i < numEntries; i++)
+		{
+			Callback callback = this->TakeCallback(aggregate->entryArray[i]);
+			if (!callback)
+				continue;
+
+			if (i == numEntries - 1)
+			{
+				if (callback(responseData))
+					delete responseData;
+				return;
+			}
+
+			ProtocolData* copyData = ProtocolData::CloneReply(responseData);
+			if (callback(copyData))
+				delete copyData;
+		}
+
+		delete responseData;
+	}
+
+	/*virtual*/ bool AggregatingClient::MakeRequestSync(const ProtocolData* requestData, ProtocolData*& responseData, bool deleteData /*= true*/, double timeoutSeconds /*= 5.0*/)
+	{
+		// Anyone waiting on a reply wants it now, so nothing is held back for them.
+		this->FlushUpdates();
+		return this->PrepareClient()->MakeRequestSync(requestData, responseData, deleteData, timeoutSeconds);
+	}
+
+	/*virtual*/ bool AggregatingClient::MakeTransactionRequestAsync(DynamicArray<const ProtocolData*>& requestDataArray, Callback callback /*= [](const ProtocolData*) -> bool { return true; }*/, bool deleteData /*= true*/)
+	{
+		this->FlushUpdates();
+		return this->PrepareClient()->MakeTransactionRequestAsync(requestDataArray, std::move(callback), deleteData);
+	}
+
+	/*virtual*/ bool AggregatingClient::MakeTransactionRequestSync(DynamicArray<const ProtocolData*>& requestDataArray, ProtocolData*& responseData, bool deleteData /*= true*/, double timeoutSeconds /*= 5.0*/)
+	{
+		this->FlushUpdates();
+		return this->PrepareClient()->MakeTransactionRequestSync(requestDataArray, responseData, deleteData, timeoutSeconds);
+	}
+
+	/*virtual*/ bool AggregatingClient::MakePipelineRequestAsync(Pipeline* pipeline, Pipeline::Callback callback /*= [](Pipeline*) -> bool { return true; }*/)
+	{
+		this->FlushUpdates();
+		return this->PrepareClient()->MakePipelineRequestAsync(pipeline, std::move(callback));
+	}
+}
\ No newline at end of file
@@ -0,0 +1,147 @@
+#pragma once
+
+#include "yarc_api.h"
+#include "yarc_wrapping_client.h"
+#include "yarc_dynamic_array.h"
+#include "yarc_linked_list.h"
+#include "yarc_mutex.h"
+#include "yarc_slab.h"
+#include <atomic>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace Yarc
+{
+	// This sits in front of any other client, and holds back updates that don't care what order they're applied in,
+	// merging those to the same key, so that a great many of them go out as a single command.  Counter updates (INCR,
+	// INCRBY, DECR, DECRBY) to a key become one INCRBY by their sum, as do HINCRBYs to the same field of a hash, and SADDs
+	// (or PFADDs) to a key become one SADD (or PFADD) of all their members.  Whatever's been merged goes out together in
+	// one pipeline, once the oldest update has been held for the flush interval, or once there are enough of them.
+	//
+	// Each caller still gets a reply.  A counter's reply is worked out from the merged one, so it's just what the caller
+	// would have seen had their update gone out right after the ones merged ahead of it.  SADD and PFADD only say how
+	// much the merged command changed, which can't be split up again, so everyone gets a copy of the merged reply.
+	//
+	// This is write-behind, so an update isn't applied until it's flushed.  Anything else made through us that names a
+	// key with updates held for it waits for them to be flushed first, so we always read our own writes, but others may
+	// not see them until then.  Call Flush() before shutting down, or whatever's still held back is lost.  Updates may be
+	// made from any thread (from callbacks run on an executor, say), as what's held back is kept under a lock of its own.
+	// Canceling a merged update only keeps its callback from being called, since it can't be taken back out again.
+	class YARC_API AggregatingClient : public WrappingClient
+	{
+	public:
+
+		// Merged updates, and whatever else we're given, go out through the given client.
+		AggregatingClient(ClientInterface* givenClient);
+		virtual ~AggregatingClient();
+
+		// When used as a DLL, these ensure that the client is allocated and freed in the proper heap.
+		static AggregatingClient* Create(ClientInterface* givenClient);
+		static void Destroy(AggregatingClient* client);
+
+		virtual bool Update(double timeoutMilliseconds = 0.0) override;
+		virtual bool Flush(double timeoutSeconds = 5.0) override;
+		virtual RequestHandle MakeRequestAsync(const ProtocolData* requestData, Callback callback = [](const ProtocolData*) -> bool { return true; }, bool deleteData = true) override;
+		virtual bool MakeRequestSync(const ProtocolData* requestData, ProtocolData*& responseData, bool deleteData = true, double timeoutSeconds = 5.0) override;
+		virtual bool MakeTransactionRequestAsync(DynamicArray<const ProtocolData*>& requestDataArray, Callback callback = [](const ProtocolData*) -> bool { return true; }, bool deleteData = true) override;
+		virtual bool MakeTransactionRequestSync(DynamicArray<const ProtocolData*>& requestDataArray, ProtocolData*& responseData, bool deleteData = true, double timeoutSeconds = 5.0) override;
+		virtual bool MakePipelineRequestAsync(Pipeline* pipeline, Pipeline::Callback callback = [](Pipeline*) -> bool { return true; }) override;
+
+		// Updates are held until the oldest has waited this long (100 milliseconds, by default), or until this many have
+		// been merged (10,000, by default), whichever comes first.  A zero interval holds them until the next update.
+		void SetFlushInterval(double givenFlushIntervalSeconds) { this->flushIntervalSeconds = givenFlushIntervalSeconds; }
+		void SetMaxPendingUpdates(uint32_t givenMaxPendingUpdates) { this->maxPendingUpdates = givenMaxPendingUpdates > 0 ? givenMaxPendingUpdates : 1; }
+
+		// Send whatever's held back right now, without waiting for it to be done.
+		void FlushUpdates(void);
+
+		// The aggregation ratio is how many updates were merged for every command that went out in their place.
+		uint64_t GetNumUpdatesAggregated(void) const { return this->numUpdatesAggregated; }
+		uint64_t GetNumCommandsSent(void) const { return this->numCommandsSent; }
+		double GetAggregationRatio(void) const { return this->numCommandsSent > 0 ? double(this->numUpdatesAggregated) / double(this->numCommandsSent) : 1.0; }
+
+	private:
+
+		enum Kind
+		{
+			KIND_NONE,
+			KIND_INCRBY,
+			KIND_HINCRBY,
+			KIND_SADD,
+			KIND_PFADD
+		};
+
+		// Every request we're given gets one of these, whether it's merged with others or passed straight through.
+		struct Entry : public WrappingClient::Entry
+		{
+			Entry(Callback givenCallback, AggregatingClient* givenAggregatingClient);
+
+			int64_t runningTotal;			// For a counter, the sum of this update and those merged ahead of it.
+		};
+
+		// All the updates merged for one key (or one field of a hash).
+		struct Aggregate
+		{
+			Aggregate(Kind givenKind, AggregatingClient* givenAggregatingClient);
+			~Aggregate();
+
+			Kind kind;
+			AggregatingClient* aggregatingClient;
+			std::string key;
+			std::string field;
+			int64_t total;
+			std::unordered_set<std::string> memberSet;
+			DynamicArray<Entry*> entryArray;
+		};
+
+		// The aggregates flushed together.  The callback of the pipeline we send for them owns this.
+		struct FlushedBatch
+		{
+			~FlushedBatch();
+
+			DynamicArray<Aggregate*> aggregateArray;
+			LinkedList<FlushedBatch*>::Node* sentNode;
+		};
+
+		struct ParsedUpdate
+		{
+			Kind kind;
+			std::string key;
+			std::string field;
+			int64_t increment;
+		};
+
+		typedef Slab<Entry> EntrySlab;
+		typedef std::unordered_map<std::string, Aggregate*> AggregateMap;
+		typedef std::unordered_map<std::string, uint32_t> KeyCountMap;
+
+		static bool ClassifyRequest(const ProtocolData* requestData, ParsedUpdate& update);
+
+		virtual WrappingClient::Entry* LookupEntry(RequestHandle requestHandle) override;
+		virtual void DeallocateEntry(WrappingClient::Entry* entry) override;
+
+		RequestHandle AggregateUpdate(const ProtocolData* requestData, const ParsedUpdate& update, Callback callback, bool deleteData);
+		void FlushIfNamed(const ProtocolData* requestData);
+		FlushedBatch* TakePendingUpdates(void);
+		void SendFlushedBatch(FlushedBatch* flushedBatch);
+		ProtocolData* MakeAggregateCommand(const Aggregate* aggregate);
+		void CompleteAggregate(Aggregate* aggregate, ProtocolData* responseData);
+		bool CompleteBatch(FlushedBatch* flushedBatch, Pipeline* pipeline);
+
+		EntrySlab* entrySlab;
+		Mutex pendingMutex;				// This covers everything held back.  The counts below are atomic so they can be read without it.
+		AggregateMap* aggregateMap;
+		DynamicArray<Aggregate*>* pendingAggregateArray;
+		KeyCountMap* pendingKeyCountMap;
+		LinkedList<FlushedBatch*>* sentBatchList;
+		uint32_t maxPendingKeyLength;
+		uint32_t numPendingUpdates;
+		double firstPendingTime;
+		double flushIntervalSeconds;
+		uint32_t maxPendingUpdates;
+		std::atomic<uint64_t> numUpdatesAggregated;
+		std::atomic<uint64_t> numCommandsSent;
+	};
+}
\ No newline at end of file
@@ -1,11 +1,40 @@
 #include "yarc_byte_stream.h"
+#include "yarc_shared_buffer.h"
 #include <cstdarg>
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#if defined __WINDOWS__
+#	include <io.h>
+#elif defined __LINUX__
+#	include <unistd.h>
+#	include <errno.h>
+#endif
 
 namespace Yarc
 {
+	//----------------------------------- FileRegion -----------------------------------
+
+	FileRegion::FileRegion()
+	{
+		this->fileDescriptor = -1;
+		this->offset = 0;
+		this->length = 0;
+		this->ownsFile = false;
+	}
+
+	/*virtual*/ FileRegion::~FileRegion()
+	{
+		if (this->ownsFile && this->fileDescriptor >= 0)
+		{
+#if defined __WINDOWS__
+			::_close(this->fileDescriptor);
+#elif defined __LINUX__
+			::close(this->fileDescriptor);
+#endif
+		}
+	}
+
 	//----------------------------------- ByteStream -----------------------------------
 
 	ByteStream::ByteStream()
@@ -65,6 +94,47 @@ namespace Yarc
 		return this->WriteBufferNow((const uint8_t*)buffer, (uint32_t)::strlen(buffer));
 	}
 
+	/*virtual*/ bool ByteStream::WriteSharedBuffer(SharedBuffer* sharedBuffer)
+	{
+		return this->WriteBufferNow(sharedBuffer->GetData(), sharedBuffer->GetSize());
+	}
+
+	/*virtual*/ bool ByteStream::WriteFileRegion(const FileRegion& fileRegion)
+	{
+		uint8_t buffer[16 * 1024];
+		uint64_t offset = fileRegion.offset;
+		uint32_t remainingBytes = fileRegion.length;
+
+#if defined __WINDOWS__
+		if (::_lseeki64(fileRegion.fileDescriptor, offset, SEEK_SET) < 0)
+			return false;
+#endif
+
+		while (remainingBytes > 0)
+		{
+			uint32_t chunkSize = (remainingBytes < sizeof(buffer)) ? remainingBytes : sizeof(buffer);
+
+#if defined __WINDOWS__
+			int readCount = ::_read(fileRegion.fileDescriptor, buffer, chunkSize);
+#elif defined __LINUX__
+			// A pipe can't be read at an offset, so it's just read from wherever it's at.
+			ssize_t readCount = ::pread(fileRegion.fileDescriptor, buffer, chunkSize, offset);
+			if (readCount < 0 && errno == ESPIPE)
+				readCount = ::read(fileRegion.fileDescriptor, buffer, chunkSize);
+#endif
+			if (readCount <= 0)
+				return false;	// The file is shorter than we were told, which leaves the stream in a bad state.
+
+			if (!this->WriteBufferNow(buffer, uint32_t(readCount)))
+				return false;
+
+			offset += readCount;
+			remainingBytes -= uint32_t(readCount);
+		}
+
+		return true;
+	}
+
 	bool ByteStream::ReadByte(uint8_t& byte)
 	{
 		return this->ReadBufferNow(&byte, 1);
@@ -104,11 +174,7 @@ namespace Yarc
 
 	/*virtual*/ uint32_t StringStream::WriteBuffer(const uint8_t* buffer, uint32_t bufferSize)
 	{
-		for (uint32_t i = 0; i < bufferSize; i++)
-		{
-			*this->stringBuffer += buffer[i];
-		}
-
+		this->stringBuffer->append((const char*)buffer, bufferSize);
 		return bufferSize;
 	}
 }
\ No newline at end of file
@@ -6,6 +6,20 @@
 
 namespace Yarc
 {
+	class SharedBuffer;
+
+	// This is a stretch of an open file (or the next so many bytes from a pipe, for which the offset is ignored).
+	struct YARC_API FileRegion
+	{
+		FileRegion();
+		virtual ~FileRegion();		// The file is closed here if it's ours.
+
+		int fileDescriptor;
+		uint64_t offset;
+		uint32_t length;
+		bool ownsFile;
+	};
+
 	class YARC_API ByteStream
 	{
 	public:
@@ -33,6 +47,14 @@ namespace Yarc
 
 		// Provided for convenience, this works just like printf or sprintf.
 		bool WriteFormat(const char* format, ...);
+
+		// Write out the contents of the given buffer.  A stream that can send the buffer without copying
+		// it can override this, taking a reference to the buffer for as long as it needs it.
+		virtual bool WriteSharedBuffer(SharedBuffer* sharedBuffer);
+
+		// Likewise, write out the given stretch of a file.  By default, it's read in a chunk at a time and written
+		// from there, but a stream that can have the kernel move the bytes over directly can override this.
+		virtual bool WriteFileRegion(const FileRegion& fileRegion);
 	};
 
 	class YARC_API StringStream : public ByteStream
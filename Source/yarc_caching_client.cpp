@@ -0,0 +1,602 @@
+#include "yarc_caching_client.h"
+#include "yarc_protocol_data.h"
+#include "yarc_socket_stream.h"
+#include "yarc_byte_stream.h"
+#include <memory>
+
+namespace Yarc
+{
+	CachingClient::CachingClient(SimpleClient* givenClient) : WrappingClient(givenClient)
+	{
+		this->simpleClient = givenClient;
+		this->cacheEntryMap = new CacheEntryMap();
+		this->keyMap = new CacheEntryMap();
+		this->evictionMap = new EvictionMap();
+		this->keyFetchStateMap = new KeyFetchStateMap();
+		this->broadcastPrefixArray = new std::vector<std::string>();
+		this->broadcast = false;
+		this->evictionPolicy = EVICTION_POLICY_LRU;
+		this->memoryBudgetBytes = 64 * 1024 * 1024;
+		this->memoryUsedBytes = 0;
+		this->useClock = 0;
+		this->maxKeyLength = 0;
+		this->numConnectionsMade = givenClient->GetNumConnectionsMade();
+		this->numHits = 0;
+		this->numMisses = 0;
+		this->numInvalidations = 0;
+		this->numEvictions = 0;
+
+		// Invalidations are only pushed to us in RESP3.
+		SimpleClient::ConnectionProfile connectionProfile = givenClient->GetConnectionProfile();
+		if (connectionProfile.protocolVersion < 3)
+			connectionProfile.protocolVersion = 3;
+		connectionProfile.tracking = true;
+		givenClient->SetConnectionProfile(connectionProfile);
+
+		givenClient->RegisterPushDataCallback([this](const ProtocolData* pushData) -> bool {
+			return this->HandlePushData(pushData);
+		});
+	}
+
+	/*virtual*/ CachingClient::~CachingClient()
+	{
+		// The client lets go of whatever fetches it was still working on, which come back to us as they go.
+		delete this->client;
+
+		this->FlushCache();
+
+		delete this->cacheEntryMap;
+		delete this->keyMap;
+		delete this->evictionMap;
+		delete this->keyFetchStateMap;
+		delete this->broadcastPrefixArray;
+	}
+
+	/*static*/ CachingClient* CachingClient::Create(SimpleClient* givenClient)
+	{
+		return new CachingClient(givenClient);
+	}
+
+	/*static*/ void CachingClient::Destroy(CachingClient* client)
+	{
+		delete client;
+	}
+
+	CachingClient::Fetch::Fetch(CachingClient* givenCachingClient, Callback givenCallback) : callback(std::move(givenCallback))
+	{
+		this->cachingClient = givenCachingClient;
+		this->invalidationCount = 0;
+		this->connectionNumber = 0;
+	}
+
+	void CachingClient::SetTrackingMode(bool broadcast, const std::vector<std::string>& prefixArray /*= std::vector<std::string>()*/)
+	{
+		SimpleClient::ConnectionProfile connectionProfile = this->simpleClient->GetConnectionProfile();
+		connectionProfile.trackingBroadcast = broadcast;
+		connectionProfile.trackingPrefixArray = prefixArray;
+		this->simpleClient->SetConnectionProfile(connectionProfile);
+
+		MutexLocker locker(this->cacheMutex);
+		this->broadcast = broadcast;
+		*this->broadcastPrefixArray = prefixArray;
+	}
+
+	void CachingClient::SetMemoryBudget(uint64_t givenMemoryBudgetBytes, EvictionPolicy givenEvictionPolicy /*= EVICTION_POLICY_LRU*/)
+	{
+		MutexLocker locker(this->cacheMutex);
+
+		// The scores mean something else under a different policy, so what's cached so far is just forgotten.
+		if (givenEvictionPolicy != this->evictionPolicy)
+		{
+			while (this->evictionMap->size() > 0)
+				this->RemoveEntry(this->evictionMap->begin()->second);
+
+			this->evictionPolicy = givenEvictionPolicy;
+		}
+
+		this->memoryBudgetBytes = givenMemoryBudgetBytes;
+		while (this->memoryUsedBytes > this->memoryBudgetBytes && this->evictionMap->size() > 0)
+		{
+			this->RemoveEntry(this->evictionMap->begin()->second);
+			this->numEvictions++;
+		}
+	}
+
+	void CachingClient::FlushCache(void)
+	{
+		MutexLocker locker(this->cacheMutex);
+
+		while (this->evictionMap->size() > 0)
+			this->RemoveEntry(this->evictionMap->begin()->second);
+
+		// Nothing being fetched right now can be trusted either.
+		for (auto& pair : *this->keyFetchStateMap)
+			pair.second.invalidationCount++;
+	}
+
+	// Whatever we cached on an old connection may have been changed since without our hearing about it.  This is done
+	// whenever the client may have connected, which is while it's updated or flushed, or while we wait on it.
+	void CachingClient::CheckConnection(void)
+	{
+		uint32_t numConnectionsMade = this->simpleClient->GetNumConnectionsMade();
+		if (numConnectionsMade != this->numConnectionsMade)
+		{
+			this->numConnectionsMade = numConnectionsMade;
+			this->FlushCache();
+		}
+	}
+
+	/*virtual*/ bool CachingClient::Update(double timeoutMilliseconds /*= 0.0*/)
+	{
+		bool result = this->PrepareClient()->Update(timeoutMilliseconds);
+		this->CheckConnection();
+		return result;
+	}
+
+	/*virtual*/ bool CachingClient::Flush(double timeoutSeconds /*= 5.0*/)
+	{
+		bool result = this->PrepareClient()->Flush(timeoutSeconds);
+		this->CheckConnection();
+		return result;
+	}
+
+	/*static*/ CachingClient::CommandClass CachingClient::ClassifyCommand(const ProtocolData* requestData)
+	{
+		// These all read just the one key, given first, and give the same answer every time until it's written.
+		static const char* cacheableCommandArray[] =
+		{
+			"GET", "GETRANGE", "STRLEN", "EXISTS", "TYPE", "GETBIT", "BITCOUNT",
+			"HGET", "HMGET", "HGETALL", "HKEYS", "HVALS", "HLEN", "HEXISTS", "HSTRLEN",
+			"LRANGE", "LLEN", "LINDEX", "SMEMBERS", "SISMEMBER", "SMISMEMBER", "SCARD",
+			"ZRANGE", "ZRANGEBYSCORE", "ZRANGEBYLEX", "ZREVRANGE", "ZREVRANGEBYSCORE", "ZREVRANGEBYLEX",
+			"ZSCORE", "ZMSCORE", "ZRANK", "ZREVRANK", "ZCARD", "ZCOUNT", "ZLEXCOUNT", "XLEN"
+		};
+
+		// These change nothing, but read several keys, or give a different answer as time goes by, or at random.
+		static const char* readCommandArray[] =
+		{
+			"MGET", "TTL", "PTTL", "EXPIRETIME", "PEXPIRETIME", "PING", "ECHO", "INFO", "TIME", "DBSIZE",
+			"SCAN", "HSCAN", "SSCAN", "ZSCAN", "KEYS", "RANDOMKEY", "SRANDMEMBER", "HRANDFIELD", "ZRANDMEMBER",
+			"XRANGE", "XREVRANGE", "XINFO", "XPENDING", "OBJECT", "MEMORY", "SUNION", "SINTER", "SDIFF", "ZUNION", "ZINTER", "ZDIFF"
+		};
+
+		if (!requestData)
+			return COMMAND_CLASS_WRITE;
+
+		const ArrayData* commandArrayData = Cast<ArrayData>(requestData);
+		if (!commandArrayData || commandArrayData->GetCount() == 0)
+			return COMMAND_CLASS_WRITE;
+
+		const ProtocolData* nameData = commandArrayData->GetElement(0);
+		const BlobStringData* nameStringData = nameData ? Cast<BlobStringData>(nameData) : nullptr;
+		if (!nameStringData)
+			return COMMAND_CLASS_WRITE;
+
+		const DynamicArray<uint8_t>& nameByteArray = nameStringData->GetByteArray();
+
+		for (const char* name : readCommandArray)
+			if (ProtocolData::IsCommandName(nameByteArray, name))
+				return COMMAND_CLASS_READ;
+
+		for (const char* name : cacheableCommandArray)
+		{
+			if (!ProtocolData::IsCommandName(nameByteArray, name))
+				continue;
+
+			// EXISTS can be given several keys, and then it's just another read.
+			if (commandArrayData->GetCount() < 2 || (commandArrayData->GetCount() > 2 && ProtocolData::IsCommandName(nameByteArray, "EXISTS")))
+				return COMMAND_CLASS_READ;
+
+			// The whole command is printed to make its cache key, so we steer clear of anything read from a file.
+			for (uint32_t i = 1; i < commandArrayData->GetCount(); i++)
+			{
+				const ProtocolData* argData = commandArrayData->GetElement(i);
+				const BlobStringData* argStringData = argData ? Cast<BlobStringData>(argData) : nullptr;
+				if (!argStringData || argStringData->GetFileRegion())
+					return COMMAND_CLASS_READ;
+			}
+
+			return COMMAND_CLASS_CACHEABLE;
+		}
+
+		return COMMAND_CLASS_WRITE;
+	}
+
+	bool CachingClient::IsCacheableKey(const std::string& key) const
+	{
+		// In broadcast mode, we're only told about keys with one of the prefixes we asked for.
+		if (!this->broadcast || this->broadcastPrefixArray->size() == 0)
+			return true;
+
+		for (const std::string& prefix : *this->broadcastPrefixArray)
+			if (key.compare(0, prefix.length(), prefix) == 0)
+				return true;
+
+		return false;
+	}
+
+	// We only trust the cache once the server has agreed to keep us informed, and only for as long as we're still connected.
+	bool CachingClient::IsCacheLive(void)
+	{
+		if (this->simpleClient->GetHandshakeStatus() != SimpleClient::HANDSHAKE_STATUS_SUCCEEDED)
+			return false;
+
+		if (this->simpleClient->GetNumConnectionsMade() != this->numConnectionsMade)
+			return false;
+
+		SocketStream* socketStream = this->simpleClient->GetSocketStream();
+		return socketStream && socketStream->IsConnected();
+	}
+
+	// Whatever the request writes is forgotten.  If it's a read we can cache right now, we work out the key it reads and
+	// what it's cached under.  Otherwise, it just goes to the client.
+	bool CachingClient::PrepareRequest(const ProtocolData* requestData, std::string& key, std::string& cacheKey)
+	{
+		CommandClass commandClass = ClassifyCommand(requestData);
+		if (commandClass == COMMAND_CLASS_WRITE)
+			this->InvalidateWrittenKeys(requestData);
+
+		if (commandClass != COMMAND_CLASS_CACHEABLE || !this->IsCacheLive())
+			return false;
+
+		const ArrayData* commandArrayData = (const ArrayData*)requestData;
+		const DynamicArray<uint8_t>& keyByteArray = ((const BlobStringData*)commandArrayData->GetElement(1))->GetByteArray();
+		key.assign((const char*)keyByteArray.GetBuffer(), keyByteArray.GetCount());
+
+		if (!this->IsCacheableKey(key))
+			return false;
+
+		StringStream stringStream(&cacheKey);
+		ProtocolData::PrintTree(&stringStream, requestData);
+		return true;
+	}
+
+	/*virtual*/ CachingClient::RequestHandle CachingClient::MakeRequestAsync(const ProtocolData* requestData, Callback callback /*= [](const ProtocolData*) -> bool { return true; }*/, bool deleteData /*= true*/)
+	{
+		std::string key, cacheKey;
+		if (!this->PrepareRequest(requestData, key, cacheKey))
+			return this->PrepareClient()->MakeRequestAsync(requestData, std::move(callback), deleteData);
+
+		ProtocolData* replyData = this->LookupReply(cacheKey);
+		if (replyData)
+		{
+			// The client hands our copy to the callback, and deletes it afterward, unless the callback keeps it.
+			if (deleteData)
+				delete requestData;
+
+			this->PrepareClient();
+			return this->simpleClient->MakeAnsweredRequestAsync(replyData, std::move(callback));
+		}
+
+		// The client owns the fetch from here on.  If it refuses the request, the fetch goes with the callback.
+		std::unique_ptr<Fetch, FetchDeleter> fetch(this->AllocFetch(std::move(callback), cacheKey, key));
+		return this->PrepareClient()->MakeRequestAsync(requestData, [fetch = std::move(fetch)](const ProtocolData* responseData) mutable -> bool {
+			return fetch->cachingClient->CompleteFetch(fetch.get(), responseData);
+		}, deleteData);
+	}
+
+	/*virtual*/ bool CachingClient::MakeRequestSync(const ProtocolData* requestData, ProtocolData*& responseData, bool deleteData /*= true*/, double timeoutSeconds /*= 5.0*/)
+	{
+		std::string key, cacheKey;
+		if (!this->PrepareRequest(requestData, key, cacheKey))
+		{
+			bool result = this->PrepareClient()->MakeRequestSync(requestData, responseData, deleteData, timeoutSeconds);
+			this->CheckConnection();
+			return result;
+		}
+
+		// A hit never has to wait, so it's answered here and now, rather than on the next update.
+		responseData = this->LookupReply(cacheKey);
+		if (responseData)
+		{
+			if (deleteData)
+				delete requestData;
+
+			return true;
+		}
+
+		// The fetch has no callback, but it's counted all the same, so that an invalidation while we wait keeps the reply out.
+		std::unique_ptr<Fetch, FetchDeleter> fetch(this->AllocFetch(Callback(), cacheKey, key));
+		bool result = this->PrepareClient()->MakeRequestSync(requestData, responseData, deleteData, timeoutSeconds);
+		if (result)
+			this->CompleteFetch(fetch.get(), responseData);
+
+		this->CheckConnection();
+		return result;
+	}
+
+	/*virtual*/ bool CachingClient::CancelAsyncRequest(RequestHandle requestHandle)
+	{
+		// Hits and misses alike are the client's requests, so it takes care of either.
+		return this->client->CancelAsyncRequest(requestHandle);
+	}
+
+	/*virtual*/ bool CachingClient::MakeTransactionRequestAsync(DynamicArray<const ProtocolData*>& requestDataArray, Callback callback /*= [](const ProtocolData*) -> bool { return true; }*/, bool deleteData /*= true*/)
+	{
+		for (uint32_t i = 0; i < requestDataArray.GetCount(); i++)
+			if (ClassifyCommand(requestDataArray[i]) == COMMAND_CLASS_WRITE)
+				this->InvalidateWrittenKeys(requestDataArray[i]);
+
+		return this->PrepareClient()->MakeTransactionRequestAsync(requestDataArray, std::move(callback), deleteData);
+	}
+
+	/*virtual*/ bool CachingClient::MakeTransactionRequestSync(DynamicArray<const ProtocolData*>& requestDataArray, ProtocolData*& responseData, bool deleteData /*= true*/, double timeoutSeconds /*= 5.0*/)
+	{
+		for (uint32_t i = 0; i < requestDataArray.GetCount(); i++)
+			if (ClassifyCommand(requestDataArray[i]) == COMMAND_CLASS_WRITE)
+				this->InvalidateWrittenKeys(requestDataArray[i]);
+
+		bool result = this->PrepareClient()->MakeTransactionRequestSync(requestDataArray, responseData, deleteData, timeoutSeconds);
+		this->CheckConnection();
+		return result;
+	}
+
+	/*virtual*/ bool CachingClient::MakePipelineRequestAsync(Pipeline* pipeline, Pipeline::Callback callback /*= [](Pipeline*) -> bool { return true; }*/)
+	{
+		for (uint32_t i = 0; i < pipeline->GetCount(); i++)
+			if (ClassifyCommand(pipeline->GetCommand(i)) == COMMAND_CLASS_WRITE)
+				this->InvalidateWrittenKeys(pipeline->GetCommand(i));
+
+		return this->PrepareClient()->MakePipelineRequestAsync(pipeline, std::move(callback));
+	}
+
+	/*virtual*/ bool CachingClient::RegisterPushDataCallback(Callback givenPushDataCallback)
+	{
+		// The client's push callback is ours, so we keep the caller's, and pass on whatever isn't an invalidation.
+		*this->pushDataCallback = std::move(givenPushDataCallback);
+		return true;
+	}
+
+	ProtocolData* CachingClient::LookupReply(const std::string& cacheKey)
+	{
+		MutexLocker locker(this->cacheMutex);
+
+		CacheEntryMap::iterator iter = this->cacheEntryMap->find(cacheKey);
+		if (iter == this->cacheEntryMap->end())
+		{
+			this->numMisses++;
+			return nullptr;
+		}
+
+		CacheEntry* cacheEntry = iter->second;
+		this->TouchEntry(cacheEntry);
+		this->numHits++;
+
+		return ProtocolData::CloneReply(cacheEntry->replyData);
+	}
+
+	void CachingClient::InsertReply(const std::string& cacheKey, const std::string& key, const ProtocolData* responseData)
+	{
+		// This is only a rough guess of what the entry costs us, but it's in proportion to the real thing.
+		uint64_t size = sizeof(CacheEntry) + 2 * cacheKey.length() + 2 * key.length() + 64;
+		std::string replyBuffer;
+		StringStream stringStream(&replyBuffer);
+		if (!ProtocolData::PrintTree(&stringStream, responseData))
+			return;
+
+		size += replyBuffer.length() * 2;
+		if (size > this->memoryBudgetBytes)
+			return;
+
+		// We keep a copy of our own, since the reply itself may be kept by the callback.  We've already printed it out,
+		// so we just parse that back in.
+		ProtocolData* replyData = nullptr;
+		if (!ProtocolData::ParseTree(&stringStream, replyData))
+			return;
+
+		CacheEntryMap::iterator iter = this->cacheEntryMap->find(cacheKey);
+		if (iter != this->cacheEntryMap->end())
+			this->RemoveEntry(iter->second);
+
+		while (this->memoryUsedBytes + size > this->memoryBudgetBytes && this->evictionMap->size() > 0)
+		{
+			this->RemoveEntry(this->evictionMap->begin()->second);
+			this->numEvictions++;
+		}
+
+		CacheEntry* cacheEntry = new CacheEntry();
+		cacheEntry->cacheKey = cacheKey;
+		cacheEntry->key = key;
+		cacheEntry->replyData = replyData;
+		cacheEntry->size = size;
+		cacheEntry->numUses = 0;
+		cacheEntry->evictionIter = this->evictionMap->insert(std::make_pair(0, cacheEntry));
+		this->TouchEntry(cacheEntry);
+
+		CacheEntry*& headEntry = (*this->keyMap)[key];
+		cacheEntry->prevForKey = nullptr;
+		cacheEntry->nextForKey = headEntry;
+		if (headEntry)
+			headEntry->prevForKey = cacheEntry;
+		headEntry = cacheEntry;
+
+		(*this->cacheEntryMap)[cacheKey] = cacheEntry;
+		this->memoryUsedBytes += size;
+	}
+
+	void CachingClient::TouchEntry(CacheEntry* cacheEntry)
+	{
+		cacheEntry->numUses++;
+
+		// Among entries with the same score, the one moved there first is evicted first.
+		EvictionMap::node_type node = this->evictionMap->extract(cacheEntry->evictionIter);
+		node.key() = (this->evictionPolicy == EVICTION_POLICY_LRU) ? ++this->useClock : cacheEntry->numUses;
+		cacheEntry->evictionIter = this->evictionMap->insert(std::move(node));
+	}
+
+	void CachingClient::RemoveEntry(CacheEntry* cacheEntry)
+	{
+		if (cacheEntry->prevForKey)
+			cacheEntry->prevForKey->nextForKey = cacheEntry->nextForKey;
+		else if (cacheEntry->nextForKey)
+			(*this->keyMap)[cacheEntry->key] = cacheEntry->nextForKey;
+		else
+			this->keyMap->erase(cacheEntry->key);
+
+		if (cacheEntry->nextForKey)
+			cacheEntry->nextForKey->prevForKey = cacheEntry->prevForKey;
+
+		this->evictionMap->erase(cacheEntry->evictionIter);
+		this->cacheEntryMap->erase(cacheEntry->cacheKey);
+		this->memoryUsedBytes -= cacheEntry->size;
+
+		delete cacheEntry->replyData;
+		delete cacheEntry;
+	}
+
+	void CachingClient::InvalidateKey(const std::string& key)
+	{
+		KeyFetchStateMap::iterator fetchIter = this->keyFetchStateMap->find(key);
+		if (fetchIter != this->keyFetchStateMap->end())
+			fetchIter->second.invalidationCount++;
+
+		CacheEntryMap::iterator iter = this->keyMap->find(key);
+		if (iter == this->keyMap->end())
+			return;
+
+		// Every read of the key goes, since they'd all be answered differently now.
+		while (iter != this->keyMap->end())
+		{
+			this->RemoveEntry(iter->second);
+			iter = this->keyMap->find(key);
+		}
+
+		this->numInvalidations++;
+	}
+
+	// We don't know which arguments of a write are keys, so we just take them all to be.  We'll hear about the keys
+	// from the server too, but not before the write is done, and a read made after it mustn't be answered from here.
+	// The cache key doesn't say which database a reply came from, so anything that changes that flushes the lot.
+	void CachingClient::InvalidateWrittenKeys(const ProtocolData* requestData)
+	{
+		static const char* flushCommandArray[] = { "SELECT", "SWAPDB", "FLUSHDB", "FLUSHALL" };
+
+		if (!requestData)
+			return;
+
+		const ArrayData* commandArrayData = Cast<ArrayData>(requestData);
+		if (!commandArrayData || commandArrayData->GetCount() == 0)
+			return;
+
+		const ProtocolData* nameData = commandArrayData->GetElement(0);
+		const BlobStringData* nameStringData = nameData ? Cast<BlobStringData>(nameData) : nullptr;
+		if (nameStringData)
+		{
+			for (const char* name : flushCommandArray)
+			{
+				if (ProtocolData::IsCommandName(nameStringData->GetByteArray(), name))
+				{
+					this->FlushCache();
+					return;
+				}
+			}
+		}
+
+		MutexLocker locker(this->cacheMutex);
+
+		if (this->keyMap->size() == 0 && this->keyFetchStateMap->size() == 0)
+			return;
+
+		for (uint32_t i = 1; i < commandArrayData->GetCount(); i++)
+		{
+			const ProtocolData* argData = commandArrayData->GetElement(i);
+			const BlobStringData* argStringData = argData ? Cast<BlobStringData>(argData) : nullptr;
+			if (!argStringData || argStringData->GetFileRegion())
+				continue;
+
+			// Anything longer than every key we know of can't be one of them, and that spares us copying big values.
+			const DynamicArray<uint8_t>& argByteArray = argStringData->GetByteArray();
+			if (argByteArray.GetCount() > this->maxKeyLength)
+				continue;
+
+			this->InvalidateKey(std::string((const char*)argByteArray.GetBuffer(), argByteArray.GetCount()));
+		}
+	}
+
+	bool CachingClient::HandlePushData(const ProtocolData* pushData)
+	{
+		const PushData* pushArrayData = Cast<PushData>(pushData);
+		const ProtocolData* kindData = (pushArrayData && pushArrayData->GetCount() == 2) ? pushArrayData->GetElement(0) : nullptr;
+		const BlobStringData* kindStringData = kindData ? Cast<BlobStringData>(kindData) : nullptr;
+
+		if (!kindStringData || !ProtocolData::IsCommandName(kindStringData->GetByteArray(), "INVALIDATE"))
+			return *this->pushDataCallback ? (*this->pushDataCallback)(pushData) : true;
+
+		// A null in place of the keys means everything has to go (after a FLUSHALL, say, or if the server ran out of room to track us).
+		const ProtocolData* keyArrayData = pushArrayData->GetElement(1);
+		const ArrayData* keyArray = keyArrayData ? Cast<ArrayData>(keyArrayData) : nullptr;
+		if (!keyArray)
+		{
+			this->FlushCache();
+			return true;
+		}
+
+		MutexLocker locker(this->cacheMutex);
+		for (uint32_t i = 0; i < keyArray->GetCount(); i++)
+		{
+			const ProtocolData* keyData = keyArray->GetElement(i);
+			const BlobStringData* keyStringData = keyData ? Cast<BlobStringData>(keyData) : nullptr;
+			if (keyStringData)
+			{
+				const DynamicArray<uint8_t>& keyByteArray = keyStringData->GetByteArray();
+				this->InvalidateKey(std::string((const char*)keyByteArray.GetBuffer(), keyByteArray.GetCount()));
+			}
+		}
+
+		return true;
+	}
+
+	CachingClient::Fetch* CachingClient::AllocFetch(Callback callback, const std::string& cacheKey, const std::string& key)
+	{
+		Fetch* fetch = new Fetch(this, std::move(callback));
+		fetch->cacheKey = cacheKey;
+		fetch->key = key;
+		fetch->connectionNumber = this->simpleClient->GetNumConnectionsMade();
+
+		MutexLocker locker(this->cacheMutex);
+
+		KeyFetchStateMap::iterator iter = this->keyFetchStateMap->find(key);
+		if (iter == this->keyFetchStateMap->end())
+			iter = this->keyFetchStateMap->insert(std::make_pair(key, KeyFetchState{0, 0})).first;
+
+		iter->second.numFetches++;
+		fetch->invalidationCount = iter->second.invalidationCount;
+
+		if (key.length() > this->maxKeyLength)
+			this->maxKeyLength = (uint32_t)key.length();
+
+		return fetch;
+	}
+
+	bool CachingClient::CompleteFetch(Fetch* fetch, const ProtocolData* responseData)
+	{
+		// A reply can only be cached if nothing could have changed the key since it was read, and we're still on the
+		// connection it came in on, which we know the server is tracking for us.
+		if (responseData && !responseData->IsError() && fetch->connectionNumber == this->simpleClient->GetNumConnectionsMade() &&
+			this->simpleClient->GetHandshakeStatus() == SimpleClient::HANDSHAKE_STATUS_SUCCEEDED)
+		{
+			MutexLocker locker(this->cacheMutex);
+			KeyFetchStateMap::iterator iter = this->keyFetchStateMap->find(fetch->key);
+			if (iter != this->keyFetchStateMap->end() && iter->second.invalidationCount == fetch->invalidationCount)
+				this->InsertReply(fetch->cacheKey, fetch->key, responseData);
+		}
+
+		// The cache has a copy of its own, so the reply is the callback's to keep, as usual.
+		return fetch->callback ? fetch->callback(responseData) : true;
+	}
+
+	void CachingClient::FreeFetch(Fetch* fetch)
+	{
+		// The callback may own something that comes back to us as it's freed, so it goes before we lock.
+		fetch->callback = nullptr;
+
+		{
+			MutexLocker locker(this->cacheMutex);
+			KeyFetchStateMap::iterator iter = this->keyFetchStateMap->find(fetch->key);
+			if (iter != this->keyFetchStateMap->end() && --iter->second.numFetches == 0)
+				this->keyFetchStateMap->erase(iter);
+		}
+
+		delete fetch;
+	}
+}
\ No newline at end of file
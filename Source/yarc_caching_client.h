@@ -0,0 +1,170 @@
+#pragma once
+
+#include "yarc_api.h"
+#include "yarc_wrapping_client.h"
+#include "yarc_simple_client.h"
+#include "yarc_mutex.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+
+namespace Yarc
+{
+	// This keeps the replies to single-key reads (GET, HGET, HGETALL, SMEMBERS, and the like) in memory, so that the
+	// same read made again is answered without a trip to the server.  The connection is put into RESP3 with client-side
+	// caching turned on (CLIENT TRACKING), so the server tells us whenever a key we've read may have changed, and we
+	// forget it.  Anything we write through here is forgotten straight away too, so we always read our own writes.  The
+	// cache is kept within a memory budget by evicting the least recently or least frequently used replies, and starts
+	// over every time we reconnect, since we can't know what we missed while disconnected.  Nothing is cached (or answered
+	// from the cache) until the server has agreed to track us, so a server that can't do it just gets every request.
+	// Replies are cached per database, in effect, since the cache is flushed by SELECT, SWAPDB, FLUSHDB and FLUSHALL.
+	//
+	// Every callback is given a copy of its own of a cached reply, to keep or not, as usual.  Note that a read answered
+	// from the cache is completed on the next update, possibly ahead of requests made before it.  A synchronous read
+	// answered from the cache returns straight away, without waiting on anything made before it.
+	//
+	// This wraps a simple client rather than any client, because the server only tells a connection about keys read
+	// on that very connection, so there's no putting this in front of a cluster client or a striped client.  For the
+	// same reason, don't turn tracking off by hand (with CLIENT TRACKING OFF or RESET) while this is in use.
+	class YARC_API CachingClient : public WrappingClient
+	{
+	public:
+
+		// The given client's connection profile is changed to turn tracking on, so set any other profile options first.
+		CachingClient(SimpleClient* givenClient);
+		virtual ~CachingClient();
+
+		// When used as a DLL, these ensure that the client is allocated and freed in the proper heap.
+		static CachingClient* Create(SimpleClient* givenClient);
+		static void Destroy(CachingClient* client);
+
+		virtual bool Update(double timeoutMilliseconds = 0.0) override;
+		virtual bool Flush(double timeoutSeconds = 5.0) override;
+		virtual RequestHandle MakeRequestAsync(const ProtocolData* requestData, Callback callback = [](const ProtocolData*) -> bool { return true; }, bool deleteData = true) override;
+		virtual bool MakeRequestSync(const ProtocolData* requestData, ProtocolData*& responseData, bool deleteData = true, double timeoutSeconds = 5.0) override;
+		virtual bool CancelAsyncRequest(RequestHandle requestHandle) override;
+		virtual bool MakeTransactionRequestAsync(DynamicArray<const ProtocolData*>& requestDataArray, Callback callback = [](const ProtocolData*) -> bool { return true; }, bool deleteData = true) override;
+		virtual bool MakeTransactionRequestSync(DynamicArray<const ProtocolData*>& requestDataArray, ProtocolData*& responseData, bool deleteData = true, double timeoutSeconds = 5.0) override;
+		virtual bool MakePipelineRequestAsync(Pipeline* pipeline, Pipeline::Callback callback = [](Pipeline*) -> bool { return true; }) override;
+		virtual bool RegisterPushDataCallback(Callback givenPushDataCallback) override;
+
+		SimpleClient* GetClient(void) { return this->simpleClient; }
+
+		// By default, the server remembers which keys we've read, and only tells us about those.  In broadcast mode, it
+		// instead tells us about every key starting with one of the given prefixes (or every key at all, if none are given),
+		// which costs the server nothing per key read, but then only keys with one of the prefixes can be cached.  This
+		// goes into the client's connection profile, so set it before making any requests.
+		void SetTrackingMode(bool broadcast, const std::vector<std::string>& prefixArray = std::vector<std::string>());
+
+		enum EvictionPolicy
+		{
+			EVICTION_POLICY_LRU,	// Evict whatever was used longest ago.
+			EVICTION_POLICY_LFU		// Evict whatever has been used the fewest times (the longest ago, among equals).
+		};
+
+		// This is roughly how much memory the cached replies (and their commands) may take up.  The default is 64 MB.
+		void SetMemoryBudget(uint64_t givenMemoryBudgetBytes, EvictionPolicy givenEvictionPolicy = EVICTION_POLICY_LRU);
+
+		// Forget everything.  This is done for us when we reconnect, or when the server says to (e.g., after a FLUSHALL).
+		void FlushCache(void);
+
+		uint64_t GetNumHits(void) const { return this->numHits; }
+		uint64_t GetNumMisses(void) const { return this->numMisses; }
+		uint64_t GetNumInvalidations(void) const { return this->numInvalidations; }
+		uint64_t GetNumEvictions(void) const { return this->numEvictions; }
+		uint64_t GetMemoryUsed(void) const { return this->memoryUsedBytes; }
+		uint32_t GetNumCachedReplies(void) const { return (uint32_t)this->cacheEntryMap->size(); }
+
+	private:
+
+		struct CacheEntry;
+
+		// Entries are ordered for eviction by a score: the time of last use for LRU, or the number of uses for LFU.
+		typedef std::multimap<uint64_t, CacheEntry*> EvictionMap;
+
+		struct CacheEntry
+		{
+			std::string cacheKey;			// The whole command, printed, so that only the very same read is answered from here.
+			std::string key;				// The key it reads, which is what invalidations name.
+			ProtocolData* replyData;		// Our own copy, which nobody else ever sees.
+			uint64_t size;
+			uint64_t numUses;
+			EvictionMap::iterator evictionIter;
+			CacheEntry* nextForKey;			// All the entries reading the same key are listed together.
+			CacheEntry* prevForKey;
+		};
+
+		// A read on its way to the server.  Should its key be invalidated in the meantime, its reply is passed on but not cached.
+		struct Fetch
+		{
+			Fetch(CachingClient* givenCachingClient, Callback givenCallback);
+
+			CachingClient* cachingClient;
+			Callback callback;
+			std::string cacheKey;
+			std::string key;
+			uint64_t invalidationCount;
+			uint32_t connectionNumber;
+		};
+
+		struct FetchDeleter
+		{
+			void operator()(Fetch* fetch) const { fetch->cachingClient->FreeFetch(fetch); }
+		};
+
+		// For each key being fetched, how many fetches there are, and how many times it's been invalidated since the first.
+		struct KeyFetchState
+		{
+			uint32_t numFetches;
+			uint64_t invalidationCount;
+		};
+
+		typedef std::unordered_map<std::string, CacheEntry*> CacheEntryMap;
+		typedef std::unordered_map<std::string, KeyFetchState> KeyFetchStateMap;
+
+		enum CommandClass
+		{
+			COMMAND_CLASS_WRITE,		// Or anything else we don't know about, to be safe.
+			COMMAND_CLASS_READ,			// A read we don't cache (it reads several keys, or its answer changes with time).
+			COMMAND_CLASS_CACHEABLE
+		};
+
+		static CommandClass ClassifyCommand(const ProtocolData* requestData);
+
+		bool IsCacheableKey(const std::string& key) const;
+		bool IsCacheLive(void);
+		void CheckConnection(void);
+		bool PrepareRequest(const ProtocolData* requestData, std::string& key, std::string& cacheKey);
+		ProtocolData* LookupReply(const std::string& cacheKey);
+		void InsertReply(const std::string& cacheKey, const std::string& key, const ProtocolData* responseData);
+		void TouchEntry(CacheEntry* cacheEntry);
+		void RemoveEntry(CacheEntry* cacheEntry);
+		void InvalidateKey(const std::string& key);
+		void InvalidateWrittenKeys(const ProtocolData* requestData);
+		bool HandlePushData(const ProtocolData* pushData);
+		Fetch* AllocFetch(Callback callback, const std::string& cacheKey, const std::string& key);
+		bool CompleteFetch(Fetch* fetch, const ProtocolData* responseData);
+		void FreeFetch(Fetch* fetch);
+
+		SimpleClient* simpleClient;		// The very same as our client, for what only a simple client can tell us.
+		Mutex cacheMutex;
+		CacheEntryMap* cacheEntryMap;
+		CacheEntryMap* keyMap;
+		EvictionMap* evictionMap;
+		KeyFetchStateMap* keyFetchStateMap;
+		std::vector<std::string>* broadcastPrefixArray;
+		bool broadcast;
+		EvictionPolicy evictionPolicy;
+		uint64_t memoryBudgetBytes;
+		uint64_t memoryUsedBytes;
+		uint64_t useClock;
+		uint32_t maxKeyLength;
+		uint32_t numConnectionsMade;
+		uint64_t numHits;
+		uint64_t numMisses;
+		uint64_t numInvalidations;
+		uint64_t numEvictions;
+	};
+}
\ No newline at end of file
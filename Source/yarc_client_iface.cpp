@@ -1,11 +1,14 @@
 #include "yarc_client_iface.h"
 #include "yarc_protocol_data.h"
+#include "yarc_misc.h"
+#include "yarc_mutex.h"
 #if defined __WINDOWS__
 #	include <WS2tcpip.h>
 #elif defined __LINUX__
 #	include <sys/socket.h>
 #endif
 #include <time.h>
+#include <memory>
 
 namespace Yarc
 {
@@ -14,6 +17,8 @@ namespace Yarc
 	ClientInterface::ClientInterface()
 	{
 		this->pushDataCallback = new Callback;
+		this->executor = nullptr;
+		this->executorOrdering = Executor::ORDERING_NONE;
 	}
 
 	/*virtual*/ ClientInterface::~ClientInterface()
@@ -24,30 +29,70 @@ namespace Yarc
 	/*virtual*/ bool ClientInterface::MakeRequestSync(const ProtocolData* requestData, ProtocolData*& responseData, bool deleteData /*= true*/, double timeoutSeconds /*= 5.0*/)
 	{
 		responseData = nullptr;
-		bool requestServiced = false;
 
-		Callback callback = [&](const ProtocolData* givenResponseData) {
-			responseData = const_cast<ProtocolData*>(givenResponseData);
-			requestServiced = true;
+		// With an executor, our callback may be run on another thread, and even after we've given up waiting on it, so what
+		// it hands back is kept where it can still find it, rather than on our stack.
+		struct SyncResult
+		{
+			Mutex mutex;
+			ProtocolData* responseData = nullptr;
+			bool serviced = false;
+			bool abandoned = false;
+		};
+
+		std::shared_ptr<SyncResult> syncResult = std::make_shared<SyncResult>();
+
+		Callback callback = [syncResult](const ProtocolData* givenResponseData) {
+			MutexLocker locker(syncResult->mutex);
+			if (syncResult->abandoned)
+				return true;
+			syncResult->responseData = const_cast<ProtocolData*>(givenResponseData);
+			syncResult->serviced = true;
 			return false;
 		};
 
-		int requestID = this->MakeRequestAsync(requestData, callback, deleteData);
-		clock_t startTime = ::clock();
-		while (!requestServiced)
+		RequestHandle requestHandle = this->MakeRequestAsync(requestData, std::move(callback), deleteData);
+		if (requestHandle == 0)
+		{
+			// The request was refused, so it's still ours to clean up.
+			if (deleteData)
+				delete requestData;
+
+			return false;
+		}
+
+		double deadlineSeconds = GetMonotonicTimeSeconds() + timeoutSeconds;
+		while (true)
 		{
-			this->Update(timeoutSeconds);
-			
-			clock_t currentTime = ::clock();
-			double elapsedTimeSeconds = double(currentTime - startTime) / double(CLOCKS_PER_SEC);
-			if (elapsedTimeSeconds >= timeoutSeconds)
+			{
+				MutexLocker locker(syncResult->mutex);
+				if (syncResult->serviced)
+				{
+					responseData = syncResult->responseData;
+					return true;
+				}
+			}
+
+			double remainingSeconds = deadlineSeconds - GetMonotonicTimeSeconds();
+			if (remainingSeconds <= 0.0)
 				break;
+
+			this->Update(remainingSeconds * 1000.0);
 		}
 
-		if (!requestServiced)
-			this->CancelAsyncRequest(requestID);
+		this->CancelAsyncRequest(requestHandle);
+
+		// The callback may have been on its way anyway, in which case the reply is ours after all.  Otherwise, it's
+		// left to let go of whatever comes too late.
+		MutexLocker locker(syncResult->mutex);
+		if (syncResult->serviced)
+		{
+			responseData = syncResult->responseData;
+			return true;
+		}
 
-		return requestServiced;
+		syncResult->abandoned = true;
+		return false;
 	}
 
 	/*virtual*/ bool ClientInterface::MakeTransactionRequestSync(DynamicArray<const ProtocolData*>& requestDataArray, ProtocolData*& responseData, bool deleteData /*= true*/, double timeoutSeconds /*= 5.0*/)
@@ -55,9 +100,48 @@ namespace Yarc
 		return false;
 	}
 
+	/*virtual*/ bool ClientInterface::MakePipelineRequestAsync(Pipeline* pipeline, Pipeline::Callback callback /*= [](Pipeline*) -> bool { return true; }*/)
+	{
+		if (pipeline->GetCount() == 0)
+			return false;
+
+		pipeline->Begin(std::move(callback));
+
+		for (uint32_t i = 0; i < pipeline->GetCount(); i++)
+		{
+			// The pipeline keeps its commands, and takes the replies.
+			RequestHandle requestHandle = this->MakeRequestAsync(pipeline->GetCommand(i), [pipeline, i](const ProtocolData* responseData) {
+				if (pipeline->SetReply(i, const_cast<ProtocolData*>(responseData)))
+					pipeline->Complete();
+				return false;
+			}, false);
+
+			if (requestHandle == 0)
+			{
+				// If none of it went out, the caller can have it back.  Otherwise, what didn't go out fails,
+				// but the pipeline isn't complete until what did go out has come back.
+				if (i == 0)
+					return false;
+
+				for (uint32_t j = i; j < pipeline->GetCount(); j++)
+					if (pipeline->SetReply(j, new SimpleErrorData("ERR yarc: request refused")))
+						pipeline->Complete();
+				break;
+			}
+		}
+
+		return true;
+	}
+
 	/*virtual*/ bool ClientInterface::RegisterPushDataCallback(Callback givenPushDataCallback)
 	{
-		*this->pushDataCallback = givenPushDataCallback;
+		*this->pushDataCallback = std::move(givenPushDataCallback);
 		return true;
 	}
+
+	/*virtual*/ void ClientInterface::SetExecutor(Executor* givenExecutor, Executor::Ordering givenExecutorOrdering /*= Executor::ORDERING_NONE*/)
+	{
+		this->executor = givenExecutor;
+		this->executorOrdering = givenExecutorOrdering;
+	}
 }
\ No newline at end of file
@@ -3,6 +3,9 @@
 #include "yarc_api.h"
 #include "yarc_dynamic_array.h"
 #include "yarc_socket_stream.h"
+#include "yarc_inline_function.h"
+#include "yarc_executor.h"
+#include "yarc_pipeline.h"
 #include <functional>
 #include <string>
 #include <map>
@@ -10,8 +13,10 @@
 namespace Yarc
 {
 	class ProtocolData;
+	class RequestAwaiter;
+	class TransactionRequestAwaiter;
 
-	// TODO: Not sold on this interface at all.  Would be much better to use something like promises or async/await.
+	// TODO: Not sold on this interface at all.  For async/await, see yarc_coroutine.h.
 	class YARC_API ClientInterface
 	{
 	public:
@@ -26,8 +31,15 @@ namespace Yarc
 		// persistent connection in the face of connection interruptions.
 		Address address;
 
+		// Asynchronous requests are named by a handle made from a slot index and a generation
+		// count, so that they can be found again in constant time.  A stale handle (one whose
+		// request has already been fulfilled or canceled) is simply ignored.  Zero is never valid.
+		typedef uint64_t RequestHandle;
+
 		// The return value indicates whether the callback takes ownership of the memory.
-		typedef std::function<bool(const ProtocolData* responseData)> Callback;
+		// Callbacks are move-only and stored inline, so capturing a handful of pointers or
+		// a string costs no heap allocation.  Anything bigger than that spills to the heap.
+		typedef InlineFunction<bool(const ProtocolData* responseData)> Callback;
 
 		// This should be called in the same thread where requests are made; it is where
 		// callbacks will be called and where the connection is managed.  Programs will
@@ -35,15 +47,16 @@ namespace Yarc
 		// no such loop, just use the Flush() method.
 		virtual bool Update(double timeoutMilliseconds = 0.0) = 0;
 
-		// Wait for all pending requests to get responses.  When pipelining, flush should
-		// be called periodically to prevent server overload.  The server can queue up
-		// a great deal many requests, but a flush should be called if the queue size
-		// reaches somewhere around ~1000 requests.
+		// Wait for all pending requests to get responses.  There is no need to flush
+		// periodically just to keep from overloading the server while pipelining, since
+		// the number of requests awaiting responses is kept within a window.  See
+		// SimpleClient::SetPipelineWindow() and SimpleClient::SetMaxQueuedRequests().
 		virtual bool Flush(double timeoutSeconds = 5.0) = 0;
 
 		// In the asynchronous case, the caller takes owership of the data if the callback returns false.
-		// The returned identifier can be used when canceling the request.  See below.
-		virtual int MakeRequestAsync(const ProtocolData* requestData, Callback callback = [](const ProtocolData*) -> bool { return true; }, bool deleteData = true) = 0;
+		// The returned handle can be used when canceling the request.  See below.  A null handle
+		// means the request was refused (e.g., the queue is full) and the caller keeps the request data.
+		virtual RequestHandle MakeRequestAsync(const ProtocolData* requestData, Callback callback = [](const ProtocolData*) -> bool { return true; }, bool deleteData = true) = 0;
 		
 		// In the synchronous case, the caller takes ownership of the response data.
 		virtual bool MakeRequestSync(const ProtocolData* requestData, ProtocolData*& responseData, bool deleteData = true, double timeoutSeconds = 5.0);
@@ -51,8 +64,9 @@ namespace Yarc
 		// There is no way to cancel a request given to the Redis server, but it is
 		// sometimes important that we cancel the calling of the request's callback before
 		// the said request is fulfilled.  Internally, the response will still be
-		// gathered from the server, but the callback won't get called.
-		virtual bool CancelAsyncRequest(int requestID) = 0;
+		// gathered from the server, but the callback won't get called.  Cancellation does not
+		// search or block, but it must be done on the thread that calls Update().
+		virtual bool CancelAsyncRequest(RequestHandle requestHandle) = 0;
 
 		// This is a convenience routine for issuing a sequence of commands that are executed
 		// by the database server as a single atomic operation that fails or succeeds as a whole.
@@ -65,6 +79,18 @@ namespace Yarc
 		virtual bool MakeTransactionRequestAsync(DynamicArray<const ProtocolData*>& requestDataArray, Callback callback = [](const ProtocolData*) -> bool { return true; }, bool deleteData = true) = 0;
 		virtual bool MakeTransactionRequestSync(DynamicArray<const ProtocolData*>& requestDataArray, ProtocolData*& responseData, bool deleteData = true, double timeoutSeconds = 5.0);
 
+		// This sends all of the pipeline's commands together, and calls the callback once they all have replies.
+		// See Pipeline.  The client takes ownership of the pipeline, and frees it once the callback returns (unless
+		// the callback says otherwise), but if the pipeline is refused (e.g., the queue is full), false is returned,
+		// and the caller keeps it.  This general implementation just makes a request of each command in turn.
+		virtual bool MakePipelineRequestAsync(Pipeline* pipeline, Pipeline::Callback callback = [](Pipeline*) -> bool { return true; });
+
+#if defined __cpp_impl_coroutine
+		// These are for use with co_await from within a coroutine.  They are defined in yarc_coroutine.h.
+		RequestAwaiter AwaitRequest(const ProtocolData* requestData, bool deleteData = true);
+		TransactionRequestAwaiter AwaitTransactionRequest(DynamicArray<const ProtocolData*>& requestDataArray, bool deleteData = true);
+#endif
+
 		// This callback is used in conjunction with the pub-sub mechanism.  The client can be
 		// thought of as always in pipelining mode.  However, when it receives a message from the
 		// server (which is not in response to any request), then it is dispatched to this
@@ -75,8 +101,17 @@ namespace Yarc
 		// In any case, you can use multiple clients to overcome this limitation.
 		virtual bool RegisterPushDataCallback(Callback givenPushDataCallback);
 
+		// By default, callbacks are called one at a time on the thread calling Update().  Given an
+		// executor, they are instead run on its pool of threads, and so must be thread-safe.  They
+		// may then run out of order, unless ordered by key or by connection.  Pass null to go back
+		// to the default.  The executor must outlive the client, and this should be set before any
+		// requests are made.  Synchronous requests and pushed data are unaffected.
+		virtual void SetExecutor(Executor* givenExecutor, Executor::Ordering givenExecutorOrdering = Executor::ORDERING_NONE);
+
 	protected:
 
 		Callback* pushDataCallback;
+		Executor* executor;
+		Executor::Ordering executorOrdering;
 	};
 }
\ No newline at end of file
@@ -10,16 +10,31 @@ namespace Yarc
 	{
 		this->clusterNodeList = new ReductionObjectList();
 		this->requestList = new ReductionObjectList();
+		this->requestList->SetMaxFreeNodes(1024);
+		this->singleRequestSlab = new SingleRequestSlab();
+		this->multiRequestSlab = new MultiRequestSlab();
 		this->state = STATE_CLUSTER_CONFIG_DIRTY;
 		this->retryClusterConfigCountdown = 0;
+		this->stripesPerNode = 1;
+		this->nodeAddedCallback = new NodeCallback();
 	}
 
 	/*virtual*/ ClusterClient::~ClusterClient()
 	{
 		DeleteList<ReductionObject*>(*this->clusterNodeList);
 		delete this->clusterNodeList;
-		DeleteList<ReductionObject*>(*this->requestList);
+
+		while (this->requestList->GetCount() > 0)
+		{
+			ReductionObjectList::Node* node = this->requestList->GetHead();
+			node->value->Release();
+			this->requestList->Remove(node);
+		}
+
 		delete this->requestList;
+		delete this->singleRequestSlab;
+		delete this->multiRequestSlab;
+		delete this->nodeAddedCallback;
 	}
 
 	/*static*/ ClusterClient* ClusterClient::Create()
@@ -47,11 +62,7 @@ namespace Yarc
 			case STATE_CLUSTER_CONFIG_DIRTY:
 			{
 				if (this->clusterNodeList->GetCount() == 0)
-				{
-					ClusterNode* clusterNode = new ClusterNode();
-					clusterNode->client->address = this->address;
-					this->clusterNodeList->AddTail(clusterNode);
-				}
+					this->AddClusterNode(this->address);
 
 				// TODO: Instead of picking a random node, we might choose the node that gave the MOVED error.
 				ClusterNode* clusterNode = this->GetRandomClusterNode();
@@ -122,11 +133,12 @@ namespace Yarc
 		{
 			bool combined = false;
 
-			for (LinkedList<ClusterNode::SlotRange>::Node* nodeA = slotRangeList.GetHead(); nodeA && !combined; nodeA = nodeA->GetNext())
+			// Note that we break out of both loops as soon as we combine, since the nodes they're on are gone.
+			for (LinkedList<ClusterNode::SlotRange>::Node* nodeA = slotRangeList.GetHead(); nodeA; nodeA = nodeA->GetNext())
 			{
 				ClusterNode::SlotRange& slotRangeA = nodeA->value;
 
-				for (LinkedList<ClusterNode::SlotRange>::Node* nodeB = nodeA->GetNext(); nodeB && !combined; nodeB = nodeB->GetNext())
+				for (LinkedList<ClusterNode::SlotRange>::Node* nodeB = nodeA->GetNext(); nodeB; nodeB = nodeB->GetNext())
 				{
 					ClusterNode::SlotRange& slotRangeB = nodeB->value;
 
@@ -137,8 +149,12 @@ namespace Yarc
 						slotRangeList.Remove(nodeB);
 						slotRangeList.AddTail(combinedSlotRange);
 						combined = true;
+						break;
 					}
 				}
+
+				if (combined)
+					break;
 			}
 
 			if (!combined)
@@ -159,23 +175,42 @@ namespace Yarc
 	{
 		while (this->requestList->GetCount() > 0)
 			this->Update(timeoutSeconds);
+
+		// Responses handed off to an executor aren't done with until their callbacks have run.
+		if (this->executor)
+			return this->executor->WaitForIdle(timeoutSeconds);
 		
 		return true;
 	}
 
-	/*virtual*/ int ClusterClient::MakeRequestAsync(const ProtocolData* requestData, Callback callback /*= [](const ProtocolData*) -> bool { return true; }*/, bool deleteData /*= true*/)
+	/*virtual*/ ClusterClient::RequestHandle ClusterClient::MakeRequestAsync(const ProtocolData* requestData, Callback callback /*= [](const ProtocolData*) -> bool { return true; }*/, bool deleteData /*= true*/)
 	{
-		SingleRequest* request = new SingleRequest(callback, this);
+		SingleRequest* request = this->singleRequestSlab->Allocate(std::move(callback), this);
 		request->requestData = requestData;
 		request->deleteData = deleteData;
 		this->requestList->AddTail(request);
-		return 0;
+
+		// The handle names our request rather than any request we make of a particular
+		// node, so it stays good no matter how many times the request gets redirected.
+		return this->singleRequestSlab->GetHandle(request);
 	}
 
-	/*virtual*/ bool ClusterClient::CancelAsyncRequest(int requestID)
+	/*virtual*/ bool ClusterClient::CancelAsyncRequest(RequestHandle requestHandle)
 	{
-		// TODO: Write this.
-		return false;
+		SingleRequest* request = this->singleRequestSlab->Lookup(requestHandle);
+		if (!request || request->canceled)
+			return false;
+
+		request->canceled = true;
+		request->callback = nullptr;
+
+		// If it hasn't gone out yet, it can be discarded on the next update.  Otherwise,
+		// the node client still refers to it, so it has to wait for its response (or
+		// redirection) to come back, at which point it will be quietly discarded.
+		if (request->state == Request::STATE_UNSENT)
+			request->state = Request::STATE_NONE;
+
+		return true;
 	}
 
 	/*virtual*/ bool ClusterClient::MakeTransactionRequestAsync(DynamicArray<const ProtocolData*>& requestDataArray, Callback callback /*= [](const ProtocolData*) -> bool { return true; }*/, bool deleteData /*= true*/)
@@ -185,11 +220,11 @@ namespace Yarc
 
 		if (requestDataArray.GetCount() == 1)
 		{
-			this->MakeRequestAsync(requestDataArray[0], callback);
+			this->MakeRequestAsync(requestDataArray[0], std::move(callback));
 			return true;
 		}
 
-		MultiRequest* request = new MultiRequest(callback, this);
+		MultiRequest* request = this->multiRequestSlab->Allocate(std::move(callback), this);
 		request->requestDataArray = requestDataArray;
 		request->deleteData = deleteData;
 
@@ -204,7 +239,7 @@ namespace Yarc
 
 		if (i != requestDataArray.GetCount())
 		{
-			delete request;
+			request->Release();
 			return false;
 		}
 
@@ -212,6 +247,16 @@ namespace Yarc
 		return true;
 	}
 
+	/*virtual*/ bool ClusterClient::MakePipelineRequestAsync(Pipeline* pipeline, Pipeline::Callback callback /*= [](Pipeline*) -> bool { return true; }*/)
+	{
+		if (pipeline->GetCount() == 0)
+			return false;
+
+		pipeline->Begin(std::move(callback));
+		this->requestList->AddTail(new PipelineRequest(pipeline, this));
+		return true;
+	}
+
 	void ClusterClient::ProcessClusterConfig(const ProtocolData* responseData)
 	{
 		const ArrayData* clusterNodeArrayData = Cast<ArrayData>(responseData);
@@ -252,11 +297,7 @@ namespace Yarc
 
 						ClusterNode* clusterNode = this->FindClusterNodeForAddress(address);
 						if (!clusterNode)
-						{
-							clusterNode = new ClusterNode();
-							clusterNode->client->address = address;
-							this->clusterNodeList->AddTail(clusterNode);
-						}
+							clusterNode = this->AddClusterNode(address);
 
 						if (clusterNode)
 						{
@@ -286,14 +327,38 @@ namespace Yarc
 	}
 
 	/*virtual*/ bool ClusterClient::RegisterPushDataCallback(Callback givenPushDataCallback)
+	{
+		// Callbacks can't be copied, so we keep the one and only copy here and have
+		// every node forward to it.  See AddClusterNode().
+		*this->pushDataCallback = std::move(givenPushDataCallback);
+		return true;
+	}
+
+	ClusterClient::ClusterNode* ClusterClient::AddClusterNode(const Address& address)
+	{
+		ClusterNode* clusterNode = new ClusterNode(this->stripesPerNode);
+		clusterNode->client->address = address;
+		clusterNode->client->RegisterPushDataCallback([this](const ProtocolData* messageData) -> bool {
+			if (*this->pushDataCallback)
+				return (*this->pushDataCallback)(messageData);
+			return true;
+		});
+
+		this->clusterNodeList->AddTail(clusterNode);
+
+		if (*this->nodeAddedCallback)
+			(*this->nodeAddedCallback)(clusterNode->client);
+
+		return clusterNode;
+	}
+
+	void ClusterClient::ForEachNode(NodeCallback nodeCallback)
 	{
 		for (ReductionObjectList::Node* node = this->clusterNodeList->GetHead(); node; node = node->GetNext())
 		{
 			ClusterNode* clusterNode = (ClusterNode*)node->value;
-			clusterNode->client->RegisterPushDataCallback(givenPushDataCallback);
+			nodeCallback(clusterNode->client);
 		}
-
-		return true;
 	}
 
 	//----------------------------------------- Request -----------------------------------------
@@ -301,11 +366,12 @@ namespace Yarc
 	ClusterClient::Request::Request(Callback givenCallback, ClusterClient* givenClusterClient)
 	{
 		this->responseData = nullptr;
-		this->callback = givenCallback;
+		this->callback = std::move(givenCallback);
 		this->clusterClient = givenClusterClient;
 		this->state = STATE_UNSENT;
 		this->deleteData = false;
 		this->redirectCount = 0;
+		this->canceled = false;
 	}
 
 	/*virtual*/ ClusterClient::Request::~Request()
@@ -328,16 +394,8 @@ namespace Yarc
 					this->clusterClient->SignalClusterConfigDirty();
 					result = RESULT_BAIL;
 				}
-				else
-				{
-					this->MakeRequestAsync(clusterNode, [this](const ProtocolData* responseData) {
-						this->responseData = responseData;
-						this->state = STATE_READY;
-						return false;	// We've taken ownership of the memory.
-					});
-
-					this->state = STATE_PENDING;
-				}
+				else if (!this->SendToNode(clusterNode))
+					result = RESULT_BAIL;	// Don't let anything behind us go out ahead of us.
 				
 				break;
 			}
@@ -348,13 +406,22 @@ namespace Yarc
 			}
 			case STATE_READY:
 			{
+				// There's no point in following a redirect for a request nobody wants anymore.
+				if (this->canceled)
+				{
+					result = RESULT_DELETE;
+					break;
+				}
+
 				const SimpleErrorData* errorData = Cast<SimpleErrorData>(this->responseData);
 				if (errorData)
 					if (this->HandleError(errorData, result))
 						break;
 				
 				// If we get here, the client gets to handle the response.
-				if (!this->callback(this->responseData))
+				if (this->clusterClient->executor)
+					this->Dispatch();
+				else if (!this->callback(this->responseData))
 					this->responseData = nullptr;	// The callback took ownership of the memory.
 
 				result = RESULT_DELETE;
@@ -371,6 +438,25 @@ namespace Yarc
 		return result;
 	}
 
+	// Hand our callback and response off to the executor, since we're about to go away.
+	void ClusterClient::Request::Dispatch(void)
+	{
+		uint64_t orderingKey = 0;
+
+		if (this->clusterClient->executorOrdering == Executor::ORDERING_PER_KEY)
+			orderingKey = uint64_t(this->CalcHashSlot()) + 1;
+		else if (this->clusterClient->executorOrdering == Executor::ORDERING_PER_CONNECTION)
+			orderingKey = uint64_t(uintptr_t(this->clusterClient->FindClusterNodeForSlot(this->CalcHashSlot())));
+
+		const ProtocolData* givenResponseData = this->responseData;
+		this->responseData = nullptr;
+
+		this->clusterClient->executor->Submit([callback = std::move(this->callback), givenResponseData]() {
+			if (callback(givenResponseData))
+				delete givenResponseData;
+		}, orderingKey);
+	}
+
 	bool ClusterClient::Request::HandleError(const SimpleErrorData* errorData, ReductionResult& result)
 	{
 		// There are two kinds of redirections we need to handle here: -ASK and -MOVED.
@@ -405,28 +491,30 @@ namespace Yarc
 				return true;
 			}
 
+			this->state = STATE_PENDING;
+
 			ProtocolData* askingCommandData = ProtocolData::ParseCommand("ASKING");
-			clusterNode->client->MakeRequestAsync(askingCommandData, [this](const ProtocolData* askingResponseData) {
+			RequestHandle askingRequestHandle = clusterNode->client->MakeRequestAsync(askingCommandData, [this](const ProtocolData* askingResponseData) {
 
 				// Note that we re-find the cluster node here just to be sure it hasn't gone stale on us.
 				ClusterNode* clusterNode = this->clusterClient->FindClusterNodeForAddress(this->redirectAddress);
-				if (!clusterNode)
+				if (this->canceled)
+					this->state = STATE_READY;
+				else if (!clusterNode)
 					this->state = STATE_UNSENT;
 				else
-				{
-					this->MakeRequestAsync(clusterNode, [this](const ProtocolData* responseData) {
-						this->responseData = responseData;
-						this->state = STATE_READY;
-						return false;
-					});
-
-					this->state = STATE_PENDING;
-				}
+					this->SendToNode(clusterNode);
 
 				return true;
 			});
 
-			this->state = STATE_PENDING;
+			// Without the ASKING ahead of it, the request would just be redirected again, so start over next time.
+			if (askingRequestHandle == 0)
+			{
+				delete askingCommandData;
+				this->state = STATE_UNSENT;
+			}
+
 			return true;
 		}
 		else if (errorCode == "MOVED")
@@ -450,15 +538,7 @@ namespace Yarc
 			if (!clusterNode)
 				this->state = STATE_UNSENT;
 			else
-			{
-				this->MakeRequestAsync(clusterNode, [this](const ProtocolData* responseData) {
-					this->responseData = responseData;
-					this->state = STATE_READY;
-					return false;
-				});
-
-				this->state = STATE_PENDING;
-			}
+				this->SendToNode(clusterNode);
 
 			return true;
 		}
@@ -466,20 +546,45 @@ namespace Yarc
 		return false;
 	}
 
+	bool ClusterClient::Request::SendToNode(ClusterNode* clusterNode)
+	{
+		// The reply could come back before we hear that it was sent, so we're pending first.
+		this->state = STATE_PENDING;
+
+		bool accepted = this->MakeRequestAsync(clusterNode, [this](const ProtocolData* responseData) {
+			this->responseData = responseData;
+			this->state = STATE_READY;
+			return false;	// We've taken ownership of the memory.
+		});
+
+		if (!accepted)
+			this->state = STATE_UNSENT;
+
+		return accepted;
+	}
+
 	bool ClusterClient::Request::ParseRedirectAddressAndPort(const char* errorMessage)
 	{
 		char buffer[512];
 		strcpy(buffer, errorMessage);
 
+		// The error looks like "MOVED <slot> <ip>:<port>".  We split on the last colon,
+		// since an IPv6 address has colons of its own.
 		uint32_t i = 0;
-		char* token = ::strtok(buffer, " :");
+		char* token = ::strtok(buffer, " ");
 		while (token)
 		{
 			if (i == 2)
+			{
+				char* colon = ::strrchr(token, ':');
+				if (!colon)
+					return false;
+
+				*colon = '\0';
 				this->redirectAddress.SetIPAddress(token);
-			else if (i == 3)
-				this->redirectAddress.port = ::atoi(token);
-			token = ::strtok(nullptr, " :");
+				this->redirectAddress.port = ::atoi(colon + 1);
+			}
+			token = ::strtok(nullptr, " ");
 			i++;
 		}
 
@@ -488,7 +593,7 @@ namespace Yarc
 
 	//----------------------------------------- SingleRequest -----------------------------------------
 
-	ClusterClient::SingleRequest::SingleRequest(Callback givenCallback, ClusterClient* givenClusterClient) : Request(givenCallback, givenClusterClient)
+	ClusterClient::SingleRequest::SingleRequest(Callback givenCallback, ClusterClient* givenClusterClient) : Request(std::move(givenCallback), givenClusterClient)
 	{
 		this->requestData = nullptr;
 	}
@@ -499,6 +604,11 @@ namespace Yarc
 			delete this->requestData;
 	}
 
+	/*virtual*/ void ClusterClient::SingleRequest::Release(void)
+	{
+		this->clusterClient->singleRequestSlab->Deallocate(this);
+	}
+
 	uint16_t ClusterClient::SingleRequest::CalcHashSlot()
 	{
 		return ProtocolData::CalcCommandHashSlot(this->requestData);
@@ -506,13 +616,12 @@ namespace Yarc
 
 	/*virtual*/ bool ClusterClient::SingleRequest::MakeRequestAsync(ClusterNode* clusterNode, Callback callback)
 	{
-		clusterNode->client->MakeRequestAsync(this->requestData, callback, false);
-		return true;
+		return 0 != clusterNode->client->MakeRequestAsync(this->requestData, std::move(callback), false);
 	}
 
 	//----------------------------------------- MultiRequest -----------------------------------------
 
-	ClusterClient::MultiRequest::MultiRequest(Callback givenCallback, ClusterClient* givenClusterClient) : Request(givenCallback, givenClusterClient)
+	ClusterClient::MultiRequest::MultiRequest(Callback givenCallback, ClusterClient* givenClusterClient) : Request(std::move(givenCallback), givenClusterClient)
 	{
 	}
 
@@ -523,6 +632,11 @@ namespace Yarc
 				delete this->requestDataArray[i];
 	}
 
+	/*virtual*/ void ClusterClient::MultiRequest::Release(void)
+	{
+		this->clusterClient->multiRequestSlab->Deallocate(this);
+	}
+
 	uint16_t ClusterClient::MultiRequest::CalcHashSlot()
 	{
 		// It's already been verified that all commands in the array hash to the same slot.
@@ -531,15 +645,163 @@ namespace Yarc
 
 	/*virtual*/ bool ClusterClient::MultiRequest::MakeRequestAsync(ClusterNode* clusterNode, Callback callback)
 	{
-		clusterNode->client->MakeTransactionRequestAsync(this->requestDataArray, callback, false);
+		return clusterNode->client->MakeTransactionRequestAsync(this->requestDataArray, std::move(callback), false);
+	}
+
+	//----------------------------------------- PipelineRequest -----------------------------------------
+
+	ClusterClient::PipelineRequest::PipelineRequest(Pipeline* givenPipeline, ClusterClient* givenClusterClient)
+	{
+		this->pipeline = givenPipeline;
+		this->clusterClient = givenClusterClient;
+		this->numPartsPending = 0;
+		this->sent = false;
+	}
+
+	/*virtual*/ ClusterClient::PipelineRequest::~PipelineRequest()
+	{
+		delete this->pipeline;
+	}
+
+	/*virtual*/ ReductionObject::ReductionResult ClusterClient::PipelineRequest::Reduce(void* userData)
+	{
+		if (!this->sent)
+		{
+			if (!this->Send())
+			{
+				this->clusterClient->SignalClusterConfigDirty();
+				return RESULT_BAIL;
+			}
+
+			this->sent = true;
+		}
+
+		if (this->numPartsPending > 0)
+			return RESULT_NONE;
+
+		this->Complete();
+		return RESULT_DELETE;
+	}
+
+	// Nothing goes out until we know where all of it goes.
+	bool ClusterClient::PipelineRequest::Send(void)
+	{
+		DynamicArray<ClusterNode*> clusterNodeArray;
+		this->partArray.SetCount(this->pipeline->GetCount());
+
+		for (uint32_t i = 0; i < this->pipeline->GetCount(); i++)
+		{
+			ClusterNode* clusterNode = this->clusterClient->FindClusterNodeForSlot(ProtocolData::CalcCommandHashSlot(this->pipeline->GetCommand(i)));
+			if (!clusterNode)
+				return false;
+
+			uint32_t part = 0;
+			while (part < clusterNodeArray.GetCount() && clusterNodeArray[part] != clusterNode)
+				part++;
+
+			if (part == clusterNodeArray.GetCount())
+			{
+				clusterNodeArray.SetCount(part + 1);
+				clusterNodeArray[part] = clusterNode;
+			}
+
+			this->partArray[i] = part;
+		}
+
+		this->numPartsPending = clusterNodeArray.GetCount();
+
+		for (uint32_t part = 0; part < clusterNodeArray.GetCount(); part++)
+		{
+			// The parts only borrow our commands.
+			Pipeline* partPipeline = new Pipeline(false);
+			for (uint32_t i = 0; i < this->pipeline->GetCount(); i++)
+				if (this->partArray[i] == part)
+					partPipeline->AddCommand(this->pipeline->GetCommand(i));
+
+			bool accepted = clusterNodeArray[part]->client->MakePipelineRequestAsync(partPipeline, [this, part](Pipeline* partPipeline) {
+				this->CompletePart(part, partPipeline);
+				return true;
+			});
+
+			if (!accepted)
+			{
+				for (uint32_t i = 0; i < this->pipeline->GetCount(); i++)
+					if (this->partArray[i] == part)
+						this->pipeline->SetReply(i, new SimpleErrorData("ERR yarc: request refused"));
+
+				this->numPartsPending--;
+				delete partPipeline;
+			}
+		}
+
 		return true;
 	}
 
+	// The replies in a part are in the same order as the commands they came from.
+	void ClusterClient::PipelineRequest::CompletePart(uint32_t part, Pipeline* partPipeline)
+	{
+		uint32_t j = 0;
+		for (uint32_t i = 0; i < this->pipeline->GetCount(); i++)
+		{
+			if (this->partArray[i] != part)
+				continue;
+
+			ProtocolData* replyData = partPipeline->TakeReply(j++);
+
+			const SimpleErrorData* errorData = Cast<SimpleErrorData>(replyData);
+			std::string errorCode = errorData ? errorData->GetErrorCode() : "";
+			if (errorCode == "MOVED" || errorCode == "ASK")
+			{
+				delete replyData;
+
+				this->numPartsPending++;
+				this->clusterClient->MakeRequestAsync(this->pipeline->GetCommand(i), [this, i](const ProtocolData* responseData) {
+					this->pipeline->SetReply(i, const_cast<ProtocolData*>(responseData));
+					this->numPartsPending--;
+					return false;
+				}, false);
+			}
+			else
+				this->pipeline->SetReply(i, replyData);
+		}
+
+		this->numPartsPending--;
+	}
+
+	// We're about to go away, so the pipeline is handed off to the callback (and maybe the executor).
+	void ClusterClient::PipelineRequest::Complete(void)
+	{
+		Pipeline* givenPipeline = this->pipeline;
+		this->pipeline = nullptr;
+
+		Executor* executor = this->clusterClient->executor;
+		if (!executor)
+		{
+			givenPipeline->Complete();
+			return;
+		}
+
+		uint64_t orderingKey = 0;
+		uint16_t hashSlot = ProtocolData::CalcCommandHashSlot(givenPipeline->GetCommand(0));
+
+		if (this->clusterClient->executorOrdering == Executor::ORDERING_PER_KEY)
+			orderingKey = uint64_t(hashSlot) + 1;
+		else if (this->clusterClient->executorOrdering == Executor::ORDERING_PER_CONNECTION)
+			orderingKey = uint64_t(uintptr_t(this->clusterClient->FindClusterNodeForSlot(hashSlot)));
+
+		executor->Submit([givenPipeline]() {
+			givenPipeline->Complete();
+		}, orderingKey);
+	}
+
 	//----------------------------------------- ClusterNode -----------------------------------------
 
-	ClusterClient::ClusterNode::ClusterNode()
+	ClusterClient::ClusterNode::ClusterNode(uint32_t numStripes)
 	{
-		this->client = new SimpleClient();
+		if (numStripes > 1)
+			this->client = new StripedClient(numStripes);
+		else
+			this->client = new SimpleClient();
 	}
 
 	/*virtual*/ ClusterClient::ClusterNode::~ClusterNode()
@@ -2,11 +2,13 @@
 
 #include "yarc_client_iface.h"
 #include "yarc_simple_client.h"
+#include "yarc_striped_client.h"
 #include "yarc_linked_list.h"
 #include "yarc_dynamic_array.h"
 #include "yarc_socket_stream.h"
 #include "yarc_protocol_data.h"
 #include "yarc_reducer.h"
+#include "yarc_slab.h"
 
 namespace Yarc
 {
@@ -28,11 +30,29 @@ namespace Yarc
 
 		virtual bool Update(double timeoutSeconds = 0.0) override;
 		virtual bool Flush(double timeoutSeconds = 5.0) override;
-		virtual int MakeRequestAsync(const ProtocolData* requestData, Callback callback = [](const ProtocolData*) -> bool { return true; }, bool deleteData = true) override;
-		virtual bool CancelAsyncRequest(int requestID) override;
+		virtual RequestHandle MakeRequestAsync(const ProtocolData* requestData, Callback callback = [](const ProtocolData*) -> bool { return true; }, bool deleteData = true) override;
+		virtual bool CancelAsyncRequest(RequestHandle requestHandle) override;
 		virtual bool MakeTransactionRequestAsync(DynamicArray<const ProtocolData*>& requestDataArray, Callback callback = [](const ProtocolData*) -> bool { return true; }, bool deleteData = true) override;
+
+		// The pipeline is split up by node, each node gets its share as a pipeline of its own, and the replies are
+		// put back together in the original order.  Any command that gets redirected is made again as a request
+		// of its own, which follows the redirect, so the callback isn't called until it too has its reply.
+		virtual bool MakePipelineRequestAsync(Pipeline* pipeline, Pipeline::Callback callback = [](Pipeline*) -> bool { return true; }) override;
+
 		virtual bool RegisterPushDataCallback(Callback givenPushDataCallback) override;
 
+		// Talk to each node over this many connections rather than just one.  See StripedClient.
+		// This only applies to nodes we haven't yet connected to, so set it before making any requests.
+		void SetStripesPerNode(uint32_t givenStripesPerNode) { this->stripesPerNode = givenStripesPerNode; }
+		uint32_t GetStripesPerNode(void) const { return this->stripesPerNode; }
+
+		// The client of each node we know about can be visited, say, to load a script everywhere.  The node-added callback
+		// is called for every node we find from here on, which includes those that show up after the topology changes,
+		// before any request is routed to it.  Both are only safe to use from the thread that updates us.
+		typedef std::function<void(ClientInterface* nodeClient)> NodeCallback;
+		void ForEachNode(NodeCallback nodeCallback);
+		void SetNodeAddedCallback(NodeCallback givenNodeAddedCallback) { *this->nodeAddedCallback = std::move(givenNodeAddedCallback); }
+
 	private:
 
 		enum State
@@ -55,13 +75,19 @@ namespace Yarc
 			virtual ~Request();
 
 			virtual ReductionResult Reduce(void* userData) override;
+			virtual void Release(void) override = 0;
 
 			virtual uint16_t CalcHashSlot() = 0;
 			virtual bool MakeRequestAsync(ClusterNode* clusterNode, Callback callback) = 0;
 
+			// Send the request to the given node, to await its reply.  If the node's client refuses it (its queue is full,
+			// say), the request is left unsent, to be tried again on the next update, and false is returned.
+			bool SendToNode(ClusterNode* clusterNode);
+
 			bool ParseRedirectAddressAndPort(const char* errorMessage);
 
 			bool HandleError(const SimpleErrorData* errorData, ReductionResult& result);
+			void Dispatch(void);
 
 			enum State
 			{
@@ -78,6 +104,7 @@ namespace Yarc
 			Address redirectAddress;
 			uint32_t redirectCount;
 			bool deleteData;
+			bool canceled;
 		};
 
 		class SingleRequest : public Request
@@ -86,6 +113,8 @@ namespace Yarc
 			SingleRequest(Callback givenCallback, ClusterClient* givenClusterClient);
 			virtual ~SingleRequest();
 
+			virtual void Release(void) override;
+
 			uint16_t CalcHashSlot() override;
 			virtual bool MakeRequestAsync(ClusterNode* clusterNode, Callback callback) override;
 
@@ -98,24 +127,45 @@ namespace Yarc
 			MultiRequest(Callback givenCallback, ClusterClient* givenClusterClient);
 			virtual ~MultiRequest();
 
+			virtual void Release(void) override;
+
 			uint16_t CalcHashSlot() override;
 			virtual bool MakeRequestAsync(ClusterNode* clusterNode, Callback callback) override;
 
 			DynamicArray<const ProtocolData*> requestDataArray;
 		};
 
+		class PipelineRequest : public ReductionObject
+		{
+		public:
+			PipelineRequest(Pipeline* givenPipeline, ClusterClient* givenClusterClient);
+			virtual ~PipelineRequest();
+
+			virtual ReductionResult Reduce(void* userData) override;
+
+			bool Send(void);
+			void CompletePart(uint32_t part, Pipeline* partPipeline);
+			void Complete(void);
+
+			ClusterClient* clusterClient;
+			Pipeline* pipeline;
+			DynamicArray<uint32_t> partArray;		// Which of the parts each command went out in.
+			std::atomic<uint32_t> numPartsPending;	// Redirected commands count as parts of their own.
+			bool sent;
+		};
+
 		class ClusterNode : public ReductionObject
 		{
 		public:
 
-			ClusterNode();
+			ClusterNode(uint32_t numStripes);
 			virtual ~ClusterNode();
 
 			virtual ReductionResult Reduce(void* userData) override;
 
 			bool HandlesSlot(uint16_t slot) const;
 
-			SimpleClient* client;
+			ClientInterface* client;
 			
 			struct SlotRange
 			{
@@ -127,6 +177,7 @@ namespace Yarc
 			DynamicArray<SlotRange> slotRangeArray;
 		};
 
+		ClusterNode* AddClusterNode(const Address& address);
 		ClusterNode* FindClusterNodeForSlot(uint16_t slot);
 		ClusterNode* FindClusterNodeForAddress(const Address& address);
 		ClusterNode* GetRandomClusterNode();
@@ -134,8 +185,16 @@ namespace Yarc
 		void SignalClusterConfigDirty(void);
 		bool ClusterConfigHasFullSlotCoverage(void);
 
+		typedef Slab<SingleRequest> SingleRequestSlab;
+		typedef Slab<MultiRequest> MultiRequestSlab;
+
+		SingleRequestSlab* singleRequestSlab;
+		MultiRequestSlab* multiRequestSlab;
+
 		ReductionObjectList* requestList;
 		ReductionObjectList* clusterNodeList;
 		uint32_t retryClusterConfigCountdown;
+		uint32_t stripesPerNode;
+		NodeCallback* nodeAddedCallback;
 	};
 }
\ No newline at end of file
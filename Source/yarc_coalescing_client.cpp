@@ -0,0 +1,615 @@
+#include "yarc_coalescing_client.h"
+#include "yarc_protocol_data.h"
+#include "yarc_misc.h"
+#include <memory>
+
+namespace Yarc
+{
+	CoalescingClient::CoalescingClient(ClientInterface* givenClient) : WrappingClient(givenClient)
+	{
+		this->entrySlab = new EntrySlab();
+		this->batchMap = new BatchMap();
+		this->pendingBatchArray = new DynamicArray<Batch*>();
+		this->sentBatchList = new LinkedList<Batch*>();
+		this->numPendingReads = 0;
+		this->numPendingWrites = 0;
+		this->firstPendingTime = 0.0;
+		this->coalescingWindowSeconds = 0.0;
+		this->maxBatchSize = 256;
+		this->groupByHashSlot = false;
+		this->numRequestsCoalesced = 0;
+		this->numBatchesSent = 0;
+		this->flightMap = new FlightMap();
+		this->singleFlight = false;
+		this->numDuplicatesSuppressed = 0;
+	}
+
+	/*virtual*/ CoalescingClient::~CoalescingClient()
+	{
+		// Batches not yet sent are dropped, callbacks and all.
+		for (uint32_t i = 0; i < this->pendingBatchArray->GetCount(); i++)
+			delete (*this->pendingBatchArray)[i];
+
+		// The client drops the callbacks of requests passed through, and of flights, which lets go of their entries.  Sent
+		// batches are only named by a raw pointer in their callbacks, so those we delete ourselves once the client is gone.
+		delete this->client;
+
+		while (this->sentBatchList->GetCount() > 0)
+		{
+			Batch* batch = this->sentBatchList->GetHead()->value;
+			this->sentBatchList->Remove(this->sentBatchList->GetHead());
+			delete batch;
+		}
+
+		delete this->sentBatchList;
+		delete this->pendingBatchArray;
+		delete this->batchMap;
+		delete this->flightMap;
+		delete this->entrySlab;
+	}
+
+	/*static*/ CoalescingClient* CoalescingClient::Create(ClientInterface* givenClient)
+	{
+		return new CoalescingClient(givenClient);
+	}
+
+	/*static*/ void CoalescingClient::Destroy(CoalescingClient* client)
+	{
+		delete client;
+	}
+
+	CoalescingClient::Entry::Entry(Callback givenCallback, CoalescingClient* givenCoalescingClient) : WrappingClient::Entry(std::move(givenCallback), givenCoalescingClient)
+	{
+		this->requestData = nullptr;
+		this->ownsRequestData = false;
+	}
+
+	CoalescingClient::Entry::~Entry()
+	{
+		if (this->ownsRequestData)
+			delete this->requestData;
+	}
+
+	CoalescingClient::Batch::Batch(Kind givenKind, CoalescingClient* givenCoalescingClient)
+	{
+		this->kind = givenKind;
+		this->coalescingClient = givenCoalescingClient;
+		this->pendingIndex = 0;
+		this->sentNode = nullptr;
+	}
+
+	CoalescingClient::Batch::~Batch()
+	{
+		for (uint32_t i = 0; i < this->entryArray.GetCount(); i++)
+			this->coalescingClient->FreeEntry(this->entryArray[i]);
+	}
+
+	CoalescingClient::Flight::Flight(const std::string& givenFlightKey, CoalescingClient* givenCoalescingClient) : flightKey(givenFlightKey)
+	{
+		this->coalescingClient = givenCoalescingClient;
+	}
+
+	CoalescingClient::Flight::~Flight()
+	{
+		for (uint32_t i = 0; i < this->entryArray.GetCount(); i++)
+			this->coalescingClient->FreeEntry(this->entryArray[i]);
+	}
+
+	/*virtual*/ WrappingClient::Entry* CoalescingClient::LookupEntry(RequestHandle requestHandle)
+	{
+		return this->entrySlab->Lookup(requestHandle);
+	}
+
+	/*virtual*/ void CoalescingClient::DeallocateEntry(WrappingClient::Entry* entry)
+	{
+		this->entrySlab->Deallocate((Entry*)entry);
+	}
+
+	/*static*/ CoalescingClient::Kind CoalescingClient::ClassifyRequest(const ProtocolData* requestData)
+	{
+		if (!requestData)
+			return KIND_NONE;
+
+		const ArrayData* commandArrayData = Cast<ArrayData>(requestData);
+		if (!commandArrayData || commandArrayData->GetCount() < 2 || commandArrayData->GetCount() > 3)
+			return KIND_NONE;
+
+		// Arguments referring to a shared buffer or a file are left alone.  They're big enough that
+		// combining them with others isn't going to save much, and we'd have to copy them to do it.
+		for (uint32_t i = 0; i < commandArrayData->GetCount(); i++)
+		{
+			const ProtocolData* argData = commandArrayData->GetElement(i);
+			const BlobStringData* argStringData = argData ? Cast<BlobStringData>(argData) : nullptr;
+			if (!argStringData || argStringData->GetSharedBuffer() || argStringData->GetFileRegion())
+				return KIND_NONE;
+		}
+
+		const DynamicArray<uint8_t>& nameByteArray = ((const BlobStringData*)commandArrayData->GetElement(0))->GetByteArray();
+
+		if (commandArrayData->GetCount() == 2)
+		{
+			if (ProtocolData::IsCommandName(nameByteArray, "GET"))
+				return KIND_GET;
+
+			if (ProtocolData::IsCommandName(nameByteArray, "EXISTS"))
+				return KIND_EXISTS;
+		}
+		else
+		{
+			// A SET with any options (EX, NX, GET, and so on) has more arguments than this, so it's never combined.
+			if (ProtocolData::IsCommandName(nameByteArray, "SET"))
+				return KIND_SET;
+
+			if (ProtocolData::IsCommandName(nameByteArray, "HGET"))
+				return KIND_HGET;
+		}
+
+		return KIND_NONE;
+	}
+
+	std::string CoalescingClient::MakeBatchKey(Kind kind, const ProtocolData* requestData)
+	{
+		std::string batchKey(1, char('0' + kind));
+
+		if (kind == KIND_HGET || kind == KIND_EXISTS)
+			batchKey += ProtocolData::FindCommandKey(requestData);	// All the same key, so all the same slot too.
+		else if (this->groupByHashSlot)
+		{
+			uint16_t hashSlot = ProtocolData::CalcCommandHashSlot(requestData);
+			batchKey.append((const char*)&hashSlot, sizeof(hashSlot));
+		}
+
+		return batchKey;
+	}
+
+	/*virtual*/ bool CoalescingClient::Update(double timeoutMilliseconds /*= 0.0*/)
+	{
+		if (this->pendingBatchArray->GetCount() > 0)
+			if (this->coalescingWindowSeconds <= 0.0 || GetMonotonicTimeSeconds() - this->firstPendingTime >= this->coalescingWindowSeconds)
+				this->SendAllBatches();
+
+		return this->PrepareClient()->Update(timeoutMilliseconds);
+	}
+
+	/*virtual*/ bool CoalescingClient::Flush(double timeoutSeconds /*= 5.0*/)
+	{
+		this->SendAllBatches();
+		return this->PrepareClient()->Flush(timeoutSeconds);
+	}
+
+	/*static*/ bool CoalescingClient::IsReadOnlyCommand(const ProtocolData* requestData)
+	{
+		// Only reads that give the same answer every time (until something is written) can be shared.
+		static const char* readOnlyCommandArray[] =
+		{
+			"GET", "MGET", "GETRANGE", "STRLEN", "EXISTS", "TYPE", "TTL", "PTTL", "GETBIT", "BITCOUNT",
+			"HGET", "HMGET", "HGETALL", "HKEYS", "HVALS", "HLEN", "HEXISTS", "HSTRLEN",
+			"LRANGE", "LLEN", "LINDEX", "SMEMBERS", "SISMEMBER", "SMISMEMBER", "SCARD",
+			"ZRANGE", "ZRANGEBYSCORE", "ZREVRANGE", "ZREVRANGEBYSCORE", "ZSCORE", "ZMSCORE", "ZRANK", "ZREVRANK", "ZCARD", "ZCOUNT",
+			"XRANGE", "XREVRANGE", "XLEN"
+		};
+
+		if (!requestData)
+			return false;
+
+		const ArrayData* commandArrayData = Cast<ArrayData>(requestData);
+		if (!commandArrayData || commandArrayData->GetCount() == 0)
+			return false;
+
+		for (uint32_t i = 0; i < commandArrayData->GetCount(); i++)
+		{
+			const ProtocolData* argData = commandArrayData->GetElement(i);
+			const BlobStringData* argStringData = argData ? Cast<BlobStringData>(argData) : nullptr;
+			if (!argStringData || argStringData->GetFileRegion())
+				return false;
+		}
+
+		const DynamicArray<uint8_t>& nameByteArray = ((const BlobStringData*)commandArrayData->GetElement(0))->GetByteArray();
+		for (const char* name : readOnlyCommandArray)
+			if (ProtocolData::IsCommandName(nameByteArray, name))
+				return true;
+
+		return false;
+	}
+
+	/*virtual*/ CoalescingClient::RequestHandle CoalescingClient::MakeRequestAsync(const ProtocolData* requestData, Callback callback /*= [](const ProtocolData*) -> bool { return true; }*/, bool deleteData /*= true*/)
+	{
+		if (this->singleFlight)
+		{
+			if (IsReadOnlyCommand(requestData))
+				return this->JoinFlight(requestData, std::move(callback), deleteData);
+
+			this->CloseFlights();
+		}
+
+		return this->MakeCoalescedRequestAsync(requestData, std::move(callback), deleteData);
+	}
+
+	CoalescingClient::RequestHandle CoalescingClient::MakeCoalescedRequestAsync(const ProtocolData* requestData, Callback callback, bool deleteData)
+	{
+		Kind kind = ClassifyRequest(requestData);
+		if (kind == KIND_NONE)
+		{
+			// Anything held back was made before this, so it has to go out first.
+			this->SendAllBatches();
+
+			Entry* entry = this->entrySlab->Allocate(std::move(callback), this);
+			RequestHandle requestHandle = this->entrySlab->GetHandle(entry);
+			return this->PassRequestThrough(EntryPtr(entry), requestHandle, requestData, deleteData);
+		}
+
+		// Reads among themselves can go out in any order, as can writes, but a read and a write can't pass one another.
+		if (IsReadKind(kind) ? this->numPendingWrites > 0 : this->numPendingReads > 0)
+			this->SendAllBatches();
+
+		if (this->pendingBatchArray->GetCount() == 0)
+			this->firstPendingTime = GetMonotonicTimeSeconds();
+
+		std::string batchKey = this->MakeBatchKey(kind, requestData);
+		Batch*& batch = (*this->batchMap)[batchKey];
+		if (!batch)
+		{
+			batch = new Batch(kind, this);
+			batch->batchKey = batchKey;
+			batch->pendingIndex = this->pendingBatchArray->GetCount();
+			this->pendingBatchArray->SetCount(batch->pendingIndex + 1);
+			(*this->pendingBatchArray)[batch->pendingIndex] = batch;
+		}
+
+		Entry* entry = this->entrySlab->Allocate(std::move(callback), this);
+		entry->requestData = requestData;
+		entry->ownsRequestData = deleteData;
+
+		uint32_t i = batch->entryArray.GetCount();
+		batch->entryArray.SetCount(i + 1);
+		batch->entryArray[i] = entry;
+
+		if (IsReadKind(kind))
+			this->numPendingReads++;
+		else
+			this->numPendingWrites++;
+
+		RequestHandle requestHandle = this->entrySlab->GetHandle(entry);
+
+		if (batch->entryArray.GetCount() >= this->maxBatchSize)
+			this->SendBatch(batch);
+
+		return requestHandle;
+	}
+
+	/*virtual*/ bool CoalescingClient::MakeRequestSync(const ProtocolData* requestData, ProtocolData*& responseData, bool deleteData /*= true*/, double timeoutSeconds /*= 5.0*/)
+	{
+		if (this->singleFlight && !IsReadOnlyCommand(requestData))
+			this->CloseFlights();
+
+		this->SendAllBatches();
+		return this->PrepareClient()->MakeRequestSync(requestData, responseData, deleteData, timeoutSeconds);
+	}
+
+	/*virtual*/ bool CoalescingClient::MakeTransactionRequestAsync(DynamicArray<const ProtocolData*>& requestDataArray, Callback callback /*= [](const ProtocolData*) -> bool { return true; }*/, bool deleteData /*= true*/)
+	{
+		this->CloseFlights();
+		this->SendAllBatches();
+		return this->client->MakeTransactionRequestAsync(requestDataArray, std::move(callback), deleteData);
+	}
+
+	/*virtual*/ bool CoalescingClient::MakeTransactionRequestSync(DynamicArray<const ProtocolData*>& requestDataArray, ProtocolData*& responseData, bool deleteData /*= true*/, double timeoutSeconds /*= 5.0*/)
+	{
+		this->CloseFlights();
+		this->SendAllBatches();
+		return this->PrepareClient()->MakeTransactionRequestSync(requestDataArray, responseData, deleteData, timeoutSeconds);
+	}
+
+	/*virtual*/ bool CoalescingClient::MakePipelineRequestAsync(Pipeline* pipeline, Pipeline::Callback callback /*= [](Pipeline*) -> bool { return true; }*/)
+	{
+		this->CloseFlights();
+		this->SendAllBatches();
+		return this->client->MakePipelineRequestAsync(pipeline, std::move(callback));
+	}
+
+	ProtocolData* CoalescingClient::TakeArgument(Entry* entry, uint32_t i)
+	{
+		const ArrayData* commandArrayData = (const ArrayData*)entry->requestData;
+
+		// If the request is ours, its argument can just be moved over.  Otherwise, it has to be copied.
+		if (entry->ownsRequestData)
+			return const_cast<ArrayData*>(commandArrayData)->TakeElement(i);
+
+		const DynamicArray<uint8_t>& byteArray = ((const BlobStringData*)commandArrayData->GetElement(i))->GetByteArray();
+		return new BlobStringData(byteArray.GetBuffer(), byteArray.GetCount());
+	}
+
+	ProtocolData* CoalescingClient::MakeBatchCommand(Batch* batch)
+	{
+		uint32_t numEntries = batch->entryArray.GetCount();
+		ArrayData* commandArrayData = new ArrayData();
+
+		switch (batch->kind)
+		{
+			case KIND_GET:
+			{
+				commandArrayData->SetCount(numEntries + 1);
+				commandArrayData->SetElement(0, new BlobStringData("MGET"));
+				for (uint32_t i = 0; i < numEntries; i++)
+					commandArrayData->SetElement(i + 1, this->TakeArgument(batch->entryArray[i], 1));
+				break;
+			}
+			case KIND_SET:
+			{
+				commandArrayData->SetCount(2 * numEntries + 1);
+				commandArrayData->SetElement(0, new BlobStringData("MSET"));
+				for (uint32_t i = 0; i < numEntries; i++)
+				{
+					commandArrayData->SetElement(2 * i + 1, this->TakeArgument(batch->entryArray[i], 1));
+					commandArrayData->SetElement(2 * i + 2, this->TakeArgument(batch->entryArray[i], 2));
+				}
+				break;
+			}
+			case KIND_HGET:
+			{
+				commandArrayData->SetCount(numEntries + 2);
+				commandArrayData->SetElement(0, new BlobStringData("HMGET"));
+				commandArrayData->SetElement(1, this->TakeArgument(batch->entryArray[0], 1));
+				for (uint32_t i = 0; i < numEntries; i++)
+					commandArrayData->SetElement(i + 2, this->TakeArgument(batch->entryArray[i], 2));
+				break;
+			}
+			case KIND_EXISTS:
+			{
+				commandArrayData->SetCount(2);
+				commandArrayData->SetElement(0, new BlobStringData("EXISTS"));
+				commandArrayData->SetElement(1, this->TakeArgument(batch->entryArray[0], 1));
+				break;
+			}
+			case KIND_NONE:
+			{
+				break;
+			}
+		}
+
+		// What's left of the original requests is of no more use.
+		for (uint32_t i = 0; i < numEntries; i++)
+		{
+			Entry* entry = batch->entryArray[i];
+			if (entry->ownsRequestData)
+				delete entry->requestData;
+
+			entry->requestData = nullptr;
+			entry->ownsRequestData = false;
+		}
+
+		return commandArrayData;
+	}
+
+	void CoalescingClient::SendBatch(Batch* batch)
+	{
+		this->batchMap->erase(batch->batchKey);
+		(*this->pendingBatchArray)[batch->pendingIndex] = nullptr;
+
+		if (IsReadKind(batch->kind))
+			this->numPendingReads -= batch->entryArray.GetCount();
+		else
+			this->numPendingWrites -= batch->entryArray.GetCount();
+
+		// Canceled requests needn't go out at all.
+		uint32_t numEntries = 0;
+		for (uint32_t i = 0; i < batch->entryArray.GetCount(); i++)
+		{
+			Entry* entry = batch->entryArray[i];
+			if (entry->canceled)
+				this->FreeEntry(entry);
+			else
+				batch->entryArray[numEntries++] = entry;
+		}
+
+		batch->entryArray.SetCount(numEntries);
+		if (numEntries == 0)
+		{
+			delete batch;
+			return;
+		}
+
+		this->numRequestsCoalesced += numEntries;
+		this->numBatchesSent++;
+
+		// A request with nothing to combine with goes out just as it was given to us.
+		const ProtocolData* commandData = nullptr;
+		bool deleteCommand = true;
+		if (numEntries > 1)
+			commandData = this->MakeBatchCommand(batch);
+		else
+		{
+			Entry* entry = batch->entryArray[0];
+			commandData = entry->requestData;
+			deleteCommand = entry->ownsRequestData;
+			entry->requestData = nullptr;
+			entry->ownsRequestData = false;
+		}
+
+		{
+			MutexLocker locker(this->entryMutex);
+			this->sentBatchList->AddTail(batch);
+			batch->sentNode = this->sentBatchList->GetTail();
+		}
+
+		RequestHandle clientHandle = this->client->MakeRequestAsync(commandData, [this, batch](const ProtocolData* responseData) -> bool {
+			return this->CompleteBatch(batch, responseData);
+		}, deleteCommand);
+
+		if (clientHandle == 0)
+		{
+			// The callers were given handles when their requests were held back, so it's too late to refuse them.  Each
+			// is answered with an error instead.
+			if (deleteCommand)
+				delete commandData;
+
+			ProtocolData* errorData = new SimpleErrorData("ERR yarc: request refused");
+			if (this->CompleteBatch(batch, errorData))
+				delete errorData;
+		}
+	}
+
+	void CoalescingClient::SendAllBatches(void)
+	{
+		for (uint32_t i = 0; i < this->pendingBatchArray->GetCount(); i++)
+		{
+			Batch* batch = (*this->pendingBatchArray)[i];
+			if (batch)
+				this->SendBatch(batch);
+		}
+
+		this->pendingBatchArray->SetCount(0);
+	}
+
+	bool CoalescingClient::CompleteBatch(Batch* batch, const ProtocolData* responseData)
+	{
+		uint32_t numEntries = batch->entryArray.GetCount();
+		bool result = true;
+
+		// An MGET or HMGET gives us back an array with a reply for each key, in order.  Anything else (an error
+		// for the lot of them, say) isn't split up, so each request gets the whole thing.
+		const ArrayData* replyArrayData = nullptr;
+		if (numEntries > 1 && responseData && (batch->kind == KIND_GET || batch->kind == KIND_HGET))
+		{
+			replyArrayData = Cast<ArrayData>(responseData);
+			if (replyArrayData && replyArrayData->GetCount() != numEntries)
+				replyArrayData = nullptr;
+		}
+
+		if (replyArrayData)
+		{
+			for (uint32_t i = 0; i < numEntries; i++)
+			{
+				Callback callback = this->TakeCallback(batch->entryArray[i]);
+				if (callback && !callback(replyArrayData->GetElement(i)))
+					const_cast<ArrayData*>(replyArrayData)->TakeElement(i);
+			}
+		}
+		else
+		{
+			// Each callback may take ownership of what it's given, so all but the last get a copy.
+			for (uint32_t i = 0; i < numEntries; i++)
+			{
+				Callback callback = this->TakeCallback(batch->entryArray[i]);
+				if (!callback)
+					continue;
+
+				if (i == numEntries - 1)
+					result = callback(responseData);
+				else
+				{
+					ProtocolData* copyData = ProtocolData::CloneReply(responseData);
+					if (callback(copyData))
+						delete copyData;
+				}
+			}
+		}
+
+		{
+			MutexLocker locker(this->entryMutex);
+			this->sentBatchList->Remove(batch->sentNode);
+		}
+
+		delete batch;
+		return result;
+	}
+
+	CoalescingClient::RequestHandle CoalescingClient::JoinFlight(const ProtocolData* requestData, Callback callback, bool deleteData)
+	{
+		std::string flightKey;
+		StringStream stringStream(&flightKey);
+		ProtocolData::PrintTree(&stringStream, requestData);
+
+		{
+			MutexLocker locker(this->entryMutex);
+
+			FlightMap::iterator iter = this->flightMap->find(flightKey);
+			if (iter != this->flightMap->end())
+			{
+				Flight* flight = iter->second;
+				Entry* entry = this->entrySlab->Allocate(std::move(callback), this);
+				uint32_t i = flight->entryArray.GetCount();
+				flight->entryArray.SetCount(i + 1);
+				flight->entryArray[i] = entry;
+				this->numDuplicatesSuppressed++;
+
+				if (deleteData)
+					delete requestData;
+
+				return this->entrySlab->GetHandle(entry);
+			}
+		}
+
+		// Nobody is waiting on this read yet, so we make it, and wait on it ourselves.
+		Flight* flight = new Flight(flightKey, this);
+		Entry* entry = this->entrySlab->Allocate(std::move(callback), this);
+		flight->entryArray.SetCount(1);
+		flight->entryArray[0] = entry;
+		RequestHandle requestHandle = this->entrySlab->GetHandle(entry);
+
+		{
+			MutexLocker locker(this->entryMutex);
+			(*this->flightMap)[flightKey] = flight;
+		}
+
+		std::unique_ptr<Flight, FlightDeleter> flightOwner(flight);
+		if (0 == this->MakeCoalescedRequestAsync(requestData, [flightOwner = std::move(flightOwner)](const ProtocolData* responseData) mutable -> bool {
+			return flightOwner->coalescingClient->CompleteFlight(flightOwner.get(), responseData);
+		}, deleteData))
+			return 0;	// The flight went with the refused request.
+
+		return requestHandle;
+	}
+
+	bool CoalescingClient::CompleteFlight(Flight* flight, const ProtocolData* responseData)
+	{
+		{
+			MutexLocker locker(this->entryMutex);
+			FlightMap::iterator iter = this->flightMap->find(flight->flightKey);
+			if (iter != this->flightMap->end() && iter->second == flight)
+				this->flightMap->erase(iter);
+		}
+
+		// Nobody can join us now, so our entries are settled.  Each callback may take ownership of what it's given,
+		// so, just as with a batch, all but the last get a copy.  If nobody joined at all, there's nothing to copy.
+		uint32_t numEntries = flight->entryArray.GetCount();
+		bool result = true;
+
+		for (uint32_t i = 0; i < numEntries; i++)
+		{
+			Callback callback = this->TakeCallback(flight->entryArray[i]);
+			if (!callback)
+				continue;
+
+			if (i == numEntries - 1)
+				result = callback(responseData);
+			else
+			{
+				ProtocolData* copyData = ProtocolData::CloneReply(responseData);
+				if (callback(copyData))
+					delete copyData;
+			}
+		}
+
+		return result;
+	}
+
+	void CoalescingClient::CloseFlights(void)
+	{
+		// Flights already under way still complete, but can't be joined anymore.
+		MutexLocker locker(this->entryMutex);
+		this->flightMap->clear();
+	}
+
+	void CoalescingClient::FreeFlight(Flight* flight)
+	{
+		{
+			MutexLocker locker(this->entryMutex);
+			FlightMap::iterator iter = this->flightMap->find(flight->flightKey);
+			if (iter != this->flightMap->end() && iter->second == flight)
+				this->flightMap->erase(iter);
+		}
+
+		delete flight;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,162 @@
+#pragma once
+
+#include "yarc_api.h"
+#include "yarc_wrapping_client.h"
+#include "yarc_dynamic_array.h"
+#include "yarc_linked_list.h"
+#include "yarc_mutex.h"
+#include "yarc_slab.h"
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+
+namespace Yarc
+{
+	// This sits in front of any other client, and holds on to single-key reads and writes made between updates (or
+	// for up to a given window of time), so that compatible ones can go out together as one command: GETs as an MGET,
+	// plain SETs as an MSET, and HGETs of the same hash as an HMGET.  Each reply is then handed back out to the callback
+	// of the request it answers, so callers can't tell the difference, apart from getting fewer round-trips and less
+	// load on the server.  A multi-key EXISTS only gives back a count, which can't be split up again, so EXISTS is only
+	// ever combined with EXISTS of the very same key.  Anything else goes straight through, but only once everything
+	// held before it has gone out, so nothing is ever reordered.  Reads held back behind one another don't care which
+	// goes out first, nor do writes, but reads and writes are never held back together.  When this is put in front of
+	// a cluster client, turn on grouping by hash slot, so that each combined command can be served by a single node.
+	// There is one difference callers can see: MGET answers nil for a key holding something other than a string, where
+	// GET would have answered with a WRONGTYPE error, so don't put this in front of reads that count on that error.
+	// Optionally, identical reads can also be folded into one while one of them is awaiting its reply (see below).
+	// Canceling a request that's being held back doesn't keep it from going out with the others, only its callback from
+	// being called.
+	class YARC_API CoalescingClient : public WrappingClient
+	{
+	public:
+
+		// Combined commands, and whatever can't be combined, go out through the given client.  In front of a cluster
+		// client, see SetGroupByHashSlot().
+		CoalescingClient(ClientInterface* givenClient);
+		virtual ~CoalescingClient();
+
+		// When used as a DLL, these ensure that the client is allocated and freed in the proper heap.
+		static CoalescingClient* Create(ClientInterface* givenClient);
+		static void Destroy(CoalescingClient* client);
+
+		virtual bool Update(double timeoutMilliseconds = 0.0) override;
+		virtual bool Flush(double timeoutSeconds = 5.0) override;
+		virtual RequestHandle MakeRequestAsync(const ProtocolData* requestData, Callback callback = [](const ProtocolData*) -> bool { return true; }, bool deleteData = true) override;
+		virtual bool MakeRequestSync(const ProtocolData* requestData, ProtocolData*& responseData, bool deleteData = true, double timeoutSeconds = 5.0) override;
+		virtual bool MakeTransactionRequestAsync(DynamicArray<const ProtocolData*>& requestDataArray, Callback callback = [](const ProtocolData*) -> bool { return true; }, bool deleteData = true) override;
+		virtual bool MakeTransactionRequestSync(DynamicArray<const ProtocolData*>& requestDataArray, ProtocolData*& responseData, bool deleteData = true, double timeoutSeconds = 5.0) override;
+		virtual bool MakePipelineRequestAsync(Pipeline* pipeline, Pipeline::Callback callback = [](Pipeline*) -> bool { return true; }) override;
+
+		// Zero (the default) holds requests until the next update.  Otherwise, they're held across updates until
+		// the oldest of them has waited this long, which gives more of them a chance to be combined, at some cost
+		// in latency.  Either way, a combined command goes out as soon as it has the maximum number of keys.
+		void SetCoalescingWindow(double givenCoalescingWindowSeconds) { this->coalescingWindowSeconds = givenCoalescingWindowSeconds; }
+		void SetMaxBatchSize(uint32_t givenMaxBatchSize) { this->maxBatchSize = givenMaxBatchSize > 0 ? givenMaxBatchSize : 1; }
+
+		// Only combine keys that hash to the same slot.  This is needed in front of a cluster client.
+		void SetGroupByHashSlot(bool givenGroupByHashSlot) { this->groupByHashSlot = givenGroupByHashSlot; }
+
+		// The coalescing ratio is how many requests were combined for every command that went out in their place.
+		uint64_t GetNumRequestsCoalesced(void) const { return this->numRequestsCoalesced; }
+		uint64_t GetNumBatchesSent(void) const { return this->numBatchesSent; }
+		double GetCoalescingRatio(void) const { return this->numBatchesSent > 0 ? double(this->numRequestsCoalesced) / double(this->numBatchesSent) : 1.0; }
+
+		// With single-flight on, a read (GET, HGETALL, LRANGE, and the like) made while a byte-for-byte identical read is
+		// still awaiting its reply doesn't go out again, but is given the very same reply once it comes back.  This turns a
+		// stampede of callers missing their cache on the same hot key into a single request.  Any request other than such
+		// a read closes the flights so far to newcomers, so that a read never gets an answer from before a write made ahead
+		// of it.  Every callback is given a reply of its own, to keep or not, as usual.
+		void SetSingleFlight(bool givenSingleFlight) { this->singleFlight = givenSingleFlight; }
+		uint64_t GetNumDuplicatesSuppressed(void) const { return this->numDuplicatesSuppressed; }
+
+	private:
+
+		enum Kind
+		{
+			KIND_NONE,
+			KIND_GET,
+			KIND_SET,
+			KIND_HGET,
+			KIND_EXISTS
+		};
+
+		// Every request we're given gets one of these.  A request held back to be combined keeps its command here
+		// until the combined command is made, which then takes its arguments.
+		struct Entry : public WrappingClient::Entry
+		{
+			Entry(Callback givenCallback, CoalescingClient* givenCoalescingClient);
+			~Entry();
+
+			const ProtocolData* requestData;
+			bool ownsRequestData;
+		};
+
+		struct Batch
+		{
+			Batch(Kind givenKind, CoalescingClient* givenCoalescingClient);
+			~Batch();
+
+			Kind kind;
+			CoalescingClient* coalescingClient;
+			DynamicArray<Entry*> entryArray;
+			std::string batchKey;
+			uint32_t pendingIndex;
+			LinkedList<Batch*>::Node* sentNode;
+		};
+
+		// A read that others have joined.  The request we make for it owns it, so it goes when that request's callback goes.
+		struct Flight
+		{
+			Flight(const std::string& givenFlightKey, CoalescingClient* givenCoalescingClient);
+			~Flight();
+
+			std::string flightKey;
+			CoalescingClient* coalescingClient;
+			DynamicArray<Entry*> entryArray;
+		};
+
+		struct FlightDeleter
+		{
+			void operator()(Flight* flight) const { flight->coalescingClient->FreeFlight(flight); }
+		};
+
+		typedef Slab<Entry> EntrySlab;
+		typedef std::unordered_map<std::string, Batch*> BatchMap;
+		typedef std::unordered_map<std::string, Flight*> FlightMap;
+
+		static Kind ClassifyRequest(const ProtocolData* requestData);
+		static bool IsReadKind(Kind kind) { return kind != KIND_SET; }
+		static bool IsReadOnlyCommand(const ProtocolData* requestData);
+
+		virtual WrappingClient::Entry* LookupEntry(RequestHandle requestHandle) override;
+		virtual void DeallocateEntry(WrappingClient::Entry* entry) override;
+
+		std::string MakeBatchKey(Kind kind, const ProtocolData* requestData);
+		ProtocolData* TakeArgument(Entry* entry, uint32_t i);
+		ProtocolData* MakeBatchCommand(Batch* batch);
+		bool CompleteBatch(Batch* batch, const ProtocolData* responseData);
+		void SendBatch(Batch* batch);
+		void SendAllBatches(void);
+		RequestHandle MakeCoalescedRequestAsync(const ProtocolData* requestData, Callback callback, bool deleteData);
+		RequestHandle JoinFlight(const ProtocolData* requestData, Callback callback, bool deleteData);
+		bool CompleteFlight(Flight* flight, const ProtocolData* responseData);
+		void CloseFlights(void);
+		void FreeFlight(Flight* flight);
+
+		EntrySlab* entrySlab;
+		BatchMap* batchMap;
+		DynamicArray<Batch*>* pendingBatchArray;
+		LinkedList<Batch*>* sentBatchList;
+		uint32_t numPendingReads;
+		uint32_t numPendingWrites;
+		double firstPendingTime;
+		double coalescingWindowSeconds;
+		uint32_t maxBatchSize;
+		bool groupByHashSlot;
+		uint64_t numRequestsCoalesced;
+		uint64_t numBatchesSent;
+		FlightMap* flightMap;
+		bool singleFlight;
+		uint64_t numDuplicatesSuppressed;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,118 @@
+#include "yarc_completion_slot.h"
+#include "yarc_misc.h"
+#if defined __WINDOWS__
+#	if !defined WIN32_LEAN_AND_MEAN
+#		define WIN32_LEAN_AND_MEAN
+#	endif
+#	include <Windows.h>
+#	pragma comment(lib, "Synchronization.lib")
+#elif defined __LINUX__
+#	include <linux/futex.h>
+#	include <sys/syscall.h>
+#	include <unistd.h>
+#	include <time.h>
+#	include <limits.h>
+#endif
+
+namespace Yarc
+{
+	CompletionSlot::CompletionSlot()
+	{
+		this->state.store(STATE_IDLE, std::memory_order_relaxed);
+	}
+
+	/*virtual*/ CompletionSlot::~CompletionSlot()
+	{
+	}
+
+	void CompletionSlot::Arm(void)
+	{
+		this->state.store(STATE_WAITING, std::memory_order_relaxed);
+	}
+
+	bool CompletionSlot::IsArmed(void) const
+	{
+		uint32_t currentState = this->state.load(std::memory_order_acquire);
+		return currentState == STATE_WAITING || currentState == STATE_PARKED || currentState == STATE_ABANDONED;
+	}
+
+	bool CompletionSlot::Complete(void)
+	{
+		uint32_t previousState = this->state.load(std::memory_order_acquire);
+		while (true)
+		{
+			if (previousState == STATE_ABANDONED)
+				return false;
+
+			if (this->state.compare_exchange_weak(previousState, STATE_DONE, std::memory_order_acq_rel, std::memory_order_acquire))
+				break;
+		}
+
+		if (previousState == STATE_PARKED)
+			this->Wake();
+
+		return true;
+	}
+
+	bool CompletionSlot::Wait(double deadlineSeconds, double spinSeconds)
+	{
+		double spinDeadlineSeconds = GetMonotonicTimeSeconds() + spinSeconds;
+		if (spinDeadlineSeconds > deadlineSeconds)
+			spinDeadlineSeconds = deadlineSeconds;
+
+		// Note that we only consult the clock every so often while spinning, because it isn't free.
+		uint32_t i = 0;
+		while (this->state.load(std::memory_order_acquire) != STATE_DONE)
+		{
+			CpuRelax();
+
+			if ((++i & 63) == 0 && GetMonotonicTimeSeconds() >= spinDeadlineSeconds)
+				break;
+		}
+
+		while (true)
+		{
+			uint32_t expectedState = STATE_WAITING;
+			if (this->state.compare_exchange_strong(expectedState, STATE_PARKED, std::memory_order_acq_rel, std::memory_order_acquire) || expectedState == STATE_PARKED)
+			{
+				if (GetMonotonicTimeSeconds() < deadlineSeconds)
+				{
+					this->Park(deadlineSeconds);
+					continue;
+				}
+
+				// We've run out of time.  We lose the race only if the completer got there first.
+				expectedState = STATE_PARKED;
+				if (this->state.compare_exchange_strong(expectedState, STATE_ABANDONED, std::memory_order_acq_rel, std::memory_order_acquire))
+					return false;
+			}
+
+			return expectedState == STATE_DONE;
+		}
+	}
+
+	void CompletionSlot::Park(double deadlineSeconds)
+	{
+#if defined __WINDOWS__
+		double remainingMilliseconds = (deadlineSeconds - GetMonotonicTimeSeconds()) * 1000.0;
+		uint32_t expectedState = STATE_PARKED;
+		::WaitOnAddress(&this->state, &expectedState, sizeof(expectedState), (remainingMilliseconds > 0.0) ? DWORD(remainingMilliseconds) + 1 : 0);
+#elif defined __LINUX__
+		// FUTEX_WAIT_BITSET takes an absolute deadline measured against CLOCK_MONOTONIC, which is
+		// the same clock behind GetMonotonicTimeSeconds(), so spurious wake-ups don't stretch the time-out.
+		timespec deadline;
+		deadline.tv_sec = time_t(deadlineSeconds);
+		deadline.tv_nsec = long((deadlineSeconds - double(deadline.tv_sec)) * 1e9);
+		syscall(SYS_futex, (uint32_t*)&this->state, FUTEX_WAIT_BITSET_PRIVATE, uint32_t(STATE_PARKED), &deadline, nullptr, FUTEX_BITSET_MATCH_ANY);
+#endif
+	}
+
+	void CompletionSlot::Wake(void)
+	{
+#if defined __WINDOWS__
+		::WakeByAddressSingle(&this->state);
+#elif defined __LINUX__
+		syscall(SYS_futex, (uint32_t*)&this->state, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#endif
+	}
+}
\ No newline at end of file
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "yarc_api.h"
+#include <stdint.h>
+#include <atomic>
+
+namespace Yarc
+{
+	// This is a one-shot rendezvous between a thread waiting for something to finish and the
+	// thread that finishes it.  The waiter first spins for a little while, since a round-trip
+	// to a nearby server often completes in less time than it takes the scheduler to put us
+	// to sleep and wake us back up.  Only then does it park in the kernel (a futex on Linux)
+	// until a deadline on the monotonic clock.  The completer only pays for a wake-up call if
+	// the waiter actually parked.  If the waiter gives up, the slot is marked abandoned so that
+	// the completer knows nobody is coming for the result.
+	class YARC_API CompletionSlot
+	{
+	public:
+
+		CompletionSlot();
+		virtual ~CompletionSlot();
+
+		enum State : uint32_t
+		{
+			STATE_IDLE,
+			STATE_WAITING,
+			STATE_PARKED,
+			STATE_DONE,
+			STATE_ABANDONED
+		};
+
+		// Get ready to be waited on.
+		void Arm(void);
+
+		// Return true if the slot is being waited on or was abandoned; i.e., it was armed but not yet completed.
+		bool IsArmed(void) const;
+
+		// Called by the completing thread.  False is returned if the waiter gave up on us.
+		bool Complete(void);
+
+		// Called by the waiting thread.  True is returned if the slot was completed before the
+		// given deadline, as measured by GetMonotonicTimeSeconds().  Otherwise, the slot is abandoned.
+		bool Wait(double deadlineSeconds, double spinSeconds);
+
+	private:
+
+		void Park(double deadlineSeconds);
+		void Wake(void);
+
+		std::atomic<uint32_t> state;
+	};
+}
\ No newline at end of file
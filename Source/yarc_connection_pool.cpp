@@ -1,4 +1,6 @@
 #include "yarc_connection_pool.h"
+#include "yarc_misc.h"
+#include <functional>
 #include <assert.h>
 
 namespace Yarc
@@ -12,7 +14,12 @@ namespace Yarc
 
 	ConnectionPool::ConnectionPool()
 	{
-		this->socketStreamMap = new SocketStreamMap;
+		for (uint32_t i = 0; i < NUM_SHARDS; i++)
+			this->shardArray[i].endpointMap = new EndpointMap;
+
+		this->maxConnectionsPerEndpoint = 0;
+		this->maxIdleConnectionsPerEndpoint = 64;
+		this->idleTimeoutSeconds = 60.0;
 
 #if defined __WINDOWS__
 		WSADATA data;
@@ -22,70 +29,281 @@ namespace Yarc
 
 	/*virtual*/ ConnectionPool::~ConnectionPool()
 	{
-		for (SocketStreamMap::iterator mapIter = this->socketStreamMap->begin(); mapIter != this->socketStreamMap->end(); mapIter++)
+		for (uint32_t i = 0; i < NUM_SHARDS; i++)
 		{
-			SocketStreamList* socketStreamList = mapIter->second;
-			for (SocketStreamList::iterator listIter = socketStreamList->begin(); listIter != socketStreamList->end(); listIter++)
+			EndpointMap* endpointMap = this->shardArray[i].endpointMap;
+			for (EndpointMap::iterator mapIter = endpointMap->begin(); mapIter != endpointMap->end(); mapIter++)
 			{
-				SocketStream* socketStream = *listIter;
-				delete socketStream;
+				Endpoint* endpoint = mapIter->second;
+				for (IdleSocketStreamList::iterator listIter = endpoint->idleList->begin(); listIter != endpoint->idleList->end(); listIter++)
+					delete listIter->socketStream;
+
+				delete endpoint->idleList;
+				delete endpoint;
 			}
 
-			delete socketStreamList;
+			delete endpointMap;
 		}
 
-		delete this->socketStreamMap;
-
 #if defined __WINDOWS__
 		::WSACleanup();
 #endif
 	}
 
-	SocketStream* ConnectionPool::CheckoutSocketStream(const Address& address, double connectionTimeoutSeconds /*= 0.5*/)
+	// Note that we don't resolve the hostname here, as that could mean a trip to a DNS server on every checkout.
+	/*static*/ std::string ConnectionPool::MakeEndpointKey(const Address& address)
+	{
+		if (address.IsUnixSocket())
+			return address.GetIPAddressAndPort();
+
+		char endpointKey[128];
+		sprintf(endpointKey, "%s:%d", (address.hostname[0] != '\0') ? address.hostname : address.ipAddress, address.port);
+		return endpointKey;
+	}
+
+	ConnectionPool::Shard* ConnectionPool::FindShard(const std::string& endpointKey)
+	{
+		return &this->shardArray[std::hash<std::string>()(endpointKey) % NUM_SHARDS];
+	}
+
+	// The caller must have the shard locked.
+	ConnectionPool::Endpoint* ConnectionPool::FindEndpoint(Shard* shard, const std::string& endpointKey)
+	{
+		EndpointMap::iterator mapIter = shard->endpointMap->find(endpointKey);
+		if (mapIter != shard->endpointMap->end())
+			return mapIter->second;
+
+		Endpoint* endpoint = new Endpoint;
+		endpoint->idleList = new IdleSocketStreamList;
+		endpoint->numOpen = 0;
+		shard->endpointMap->insert(std::pair<std::string, Endpoint*>(endpointKey, endpoint));
+		return endpoint;
+	}
+
+	// The caller must have the shard locked.  Since connections are checked in at the back, the ones idle the longest are up front.
+	void ConnectionPool::EvictIdleSocketStreams(Endpoint* endpoint, double currentTime)
+	{
+		if (this->idleTimeoutSeconds <= 0.0)
+			return;
+
+		while (endpoint->idleList->size() > 0)
+		{
+			IdleSocketStream& idleSocketStream = endpoint->idleList->front();
+			if (currentTime - idleSocketStream.idleSinceTime < this->idleTimeoutSeconds)
+				break;
+
+			delete idleSocketStream.socketStream;
+			endpoint->idleList->pop_front();
+			endpoint->numOpen--;
+		}
+	}
+
+	// The caller must have the shard locked.  The connection must already be counted as open.
+	void ConnectionPool::AddIdleSocketStream(Endpoint* endpoint, SocketStream* socketStream, const std::string& profileKey)
+	{
+		if (this->maxIdleConnectionsPerEndpoint > 0 && endpoint->idleList->size() >= this->maxIdleConnectionsPerEndpoint)
+		{
+			delete socketStream;
+			endpoint->numOpen--;
+			return;
+		}
+
+		IdleSocketStream idleSocketStream;
+		idleSocketStream.socketStream = socketStream;
+		idleSocketStream.idleSinceTime = GetMonotonicTimeSeconds();
+		idleSocketStream.profileKey = profileKey;
+		endpoint->idleList->push_back(idleSocketStream);
+	}
+
+	// The caller must have the shard locked.  The most recently used connection is the least likely to have been dropped
+	// on us, so we take the last one set up with the given profile, or failing that, the last one never set up at all.
+	ConnectionPool::IdleSocketStreamList::iterator ConnectionPool::FindIdleSocketStream(Endpoint* endpoint, const std::string& profileKey)
+	{
+		IdleSocketStreamList::iterator foundIter = endpoint->idleList->end();
+		IdleSocketStreamList::iterator bareIter = endpoint->idleList->end();
+
+		for (IdleSocketStreamList::iterator listIter = endpoint->idleList->begin(); listIter != endpoint->idleList->end(); listIter++)
+		{
+			if (listIter->profileKey == profileKey)
+				foundIter = listIter;
+			else if (listIter->profileKey.length() == 0)
+				bareIter = listIter;
+		}
+
+		return (foundIter != endpoint->idleList->end()) ? foundIter : bareIter;
+	}
+
+	SocketStream* ConnectionPool::CheckoutSocketStream(const Address& address, double connectionTimeoutSeconds /*= 0.5*/, bool wait /*= true*/, const std::string& profileKey /*= std::string()*/)
+	{
+		std::string endpointKey = MakeEndpointKey(address);
+		Shard* shard = this->FindShard(endpointKey);
+
+		while (true)
+		{
+			SocketStream* socketStream = nullptr;
+			SocketStream* unwantedSocketStream = nullptr;
+
+			{
+				MutexLocker locker(shard->mutex);
+				Endpoint* endpoint = this->FindEndpoint(shard, endpointKey);
+				this->EvictIdleSocketStreams(endpoint, GetMonotonicTimeSeconds());
+
+				IdleSocketStreamList::iterator listIter = this->FindIdleSocketStream(endpoint, profileKey);
+				if (listIter != endpoint->idleList->end())
+				{
+					socketStream = listIter->socketStream;
+					endpoint->idleList->erase(listIter);
+				}
+				else if (this->maxConnectionsPerEndpoint > 0 && endpoint->numOpen >= this->maxConnectionsPerEndpoint)
+				{
+					if (endpoint->idleList->size() == 0)
+						return nullptr;
+
+					// Our new connection takes the place of the one idle the longest, so the count stays as it is.
+					unwantedSocketStream = endpoint->idleList->front().socketStream;
+					endpoint->idleList->pop_front();
+				}
+				else
+				{
+					// Count it now, so that others can't blow past the limit while we connect.
+					endpoint->numOpen++;
+				}
+			}
+
+			// Connecting, closing and checking liveness all take system calls, so none of it is done under the lock.
+			delete unwantedSocketStream;
+
+			if (socketStream)
+			{
+				if (socketStream->IsAlive())
+					return socketStream;
+
+				this->DiscardSocketStream(socketStream);
+				continue;
+			}
+
+			socketStream = new SocketStream();
+			bool connected = wait ? socketStream->Connect(address, connectionTimeoutSeconds) : socketStream->BeginConnect(address, connectionTimeoutSeconds);
+			if (!connected)
+			{
+				this->DiscardSocketStream(socketStream);
+				return nullptr;
+			}
+
+			return socketStream;
+		}
+	}
+
+	void ConnectionPool::CheckinSocketStream(SocketStream* socketStream, const std::string& profileKey /*= std::string()*/)
+	{
+		if (!socketStream->IsConnected())
+		{
+			this->DiscardSocketStream(socketStream);
+			return;
+		}
+
+		// Whoever checks it out next can decide for themselves whether to spin on it.
+		socketStream->SetBusyPollSeconds(0.0);
+
+		std::string endpointKey = MakeEndpointKey(socketStream->GetAddress());
+		Shard* shard = this->FindShard(endpointKey);
+
+		MutexLocker locker(shard->mutex);
+		Endpoint* endpoint = this->FindEndpoint(shard, endpointKey);
+		this->EvictIdleSocketStreams(endpoint, GetMonotonicTimeSeconds());
+		this->AddIdleSocketStream(endpoint, socketStream, profileKey);
+	}
+
+	void ConnectionPool::DiscardSocketStream(SocketStream* socketStream)
 	{
-		SocketStream* socketStream = nullptr;
+		std::string endpointKey = MakeEndpointKey(socketStream->GetAddress());
+		Shard* shard = this->FindShard(endpointKey);
 
-		std::string ipPort = address.GetIPAddressAndPort();
+		delete socketStream;
+
+		MutexLocker locker(shard->mutex);
+		Endpoint* endpoint = this->FindEndpoint(shard, endpointKey);
+		if (endpoint->numOpen > 0)
+			endpoint->numOpen--;
+	}
+
+	bool ConnectionPool::Prewarm(const Address& address, uint32_t numConnections, double connectionTimeoutSeconds /*= 0.5*/)
+	{
+		std::string endpointKey = MakeEndpointKey(address);
+		Shard* shard = this->FindShard(endpointKey);
+
+		uint32_t numToOpen = 0;
+		bool success = true;
 
-		SocketStreamMap::iterator mapIter = this->socketStreamMap->find(ipPort);
-		if (mapIter != this->socketStreamMap->end())
 		{
-			SocketStreamList* socketStreamList = mapIter->second;
-			if (socketStreamList->size() > 0)
+			MutexLocker locker(shard->mutex);
+			Endpoint* endpoint = this->FindEndpoint(shard, endpointKey);
+
+			uint32_t numIdle = (uint32_t)endpoint->idleList->size();
+			if (numIdle < numConnections)
+				numToOpen = numConnections - numIdle;
+
+			if (this->maxIdleConnectionsPerEndpoint > 0 && numIdle + numToOpen > this->maxIdleConnectionsPerEndpoint)
 			{
-				SocketStreamList::iterator listIter = socketStreamList->begin();
-				socketStream = *listIter;
-				socketStreamList->erase(listIter);
+				numToOpen = (numIdle < this->maxIdleConnectionsPerEndpoint) ? this->maxIdleConnectionsPerEndpoint - numIdle : 0;
+				success = false;
 			}
+
+			if (this->maxConnectionsPerEndpoint > 0 && endpoint->numOpen + numToOpen > this->maxConnectionsPerEndpoint)
+			{
+				numToOpen = (endpoint->numOpen < this->maxConnectionsPerEndpoint) ? this->maxConnectionsPerEndpoint - endpoint->numOpen : 0;
+				success = false;
+			}
+
+			endpoint->numOpen += numToOpen;
 		}
-		
-		if (!socketStream)
+
+		for (uint32_t i = 0; i < numToOpen; i++)
 		{
-			socketStream = new SocketStream();
+			SocketStream* socketStream = new SocketStream();
 			if (!socketStream->Connect(address, connectionTimeoutSeconds))
 			{
-				delete socketStream;
-				socketStream = nullptr;
+				this->DiscardSocketStream(socketStream);
+				success = false;
+				continue;
 			}
+
+			MutexLocker locker(shard->mutex);
+			Endpoint* endpoint = this->FindEndpoint(shard, endpointKey);
+			this->AddIdleSocketStream(endpoint, socketStream, std::string());
 		}
 
-		return socketStream;
+		return success;
 	}
 
-	void ConnectionPool::CheckinSocketStream(SocketStream* socketStream)
+	void ConnectionPool::EvictIdleSocketStreams(void)
 	{
-		std::string ipPort = socketStream->GetAddress().GetIPAddressAndPort();
+		double currentTime = GetMonotonicTimeSeconds();
 
-		SocketStreamList* socketStreamList = nullptr;
-		SocketStreamMap::iterator mapIter = this->socketStreamMap->find(ipPort);
-		if (mapIter != this->socketStreamMap->end())
-			socketStreamList = mapIter->second;
-		else
+		for (uint32_t i = 0; i < NUM_SHARDS; i++)
 		{
-			socketStreamList = new SocketStreamList;
-			this->socketStreamMap->insert(std::pair<std::string, SocketStreamList*>(ipPort, socketStreamList));
+			Shard* shard = &this->shardArray[i];
+			MutexLocker locker(shard->mutex);
+			for (EndpointMap::iterator mapIter = shard->endpointMap->begin(); mapIter != shard->endpointMap->end(); mapIter++)
+				this->EvictIdleSocketStreams(mapIter->second, currentTime);
 		}
+	}
+
+	uint32_t ConnectionPool::GetNumIdleSocketStreams(const Address& address)
+	{
+		std::string endpointKey = MakeEndpointKey(address);
+		Shard* shard = this->FindShard(endpointKey);
+
+		MutexLocker locker(shard->mutex);
+		return (uint32_t)this->FindEndpoint(shard, endpointKey)->idleList->size();
+	}
+
+	uint32_t ConnectionPool::GetNumOpenSocketStreams(const Address& address)
+	{
+		std::string endpointKey = MakeEndpointKey(address);
+		Shard* shard = this->FindShard(endpointKey);
 
-		socketStreamList->push_back(socketStream);
+		MutexLocker locker(shard->mutex);
+		return this->FindEndpoint(shard, endpointKey)->numOpen;
 	}
 }
\ No newline at end of file
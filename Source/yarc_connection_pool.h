@@ -1,11 +1,21 @@
 #pragma once
 
 #include "yarc_socket_stream.h"
+#include "yarc_mutex.h"
+#include <stdint.h>
 #include <map>
 #include <list>
+#include <string>
 
 namespace Yarc
 {
+	// Connections are pooled per endpoint so that clients that come and go can reuse them rather than pay
+	// for a new TCP handshake every time.  The pool may be used from any number of threads at once.  To keep
+	// them from all contending for one lock, endpoints are spread over a number of shards, each with its own.
+	//
+	// A connection keeps whatever state was set up on it (protocol version, user, database, tracking, and so on),
+	// so each idle connection is tagged with a profile key naming that state, and is only handed to a caller
+	// asking for the same key, or to any caller if it was never set up at all (an empty key).
 	class ConnectionPool
 	{
 	public:
@@ -14,13 +24,83 @@ namespace Yarc
 
 		static ConnectionPool* Get();
 
-		SocketStream* CheckoutSocketStream(const Address& address, double connectionTimeoutSeconds = 0.5);
-		void CheckinSocketStream(SocketStream* socketStream);
+		// Hand out an idle connection to the given endpoint, or make a new one if there are none.  Idle
+		// connections are checked to be alive before they're handed out.  Null is returned if we couldn't
+		// connect, or if the endpoint already has as many connections open as we'll allow.  If we're told
+		// not to wait, a new connection is handed out while still connecting (see SocketStream::IsConnecting()),
+		// and it's up to the caller to finish it with SocketStream::PollConnect(), or discard it if that fails.
+		// If the endpoint is at its limit, but has idle connections set up for someone else, one of those is
+		// closed to make room.  A connection with a different profile key is never handed out.
+		SocketStream* CheckoutSocketStream(const Address& address, double connectionTimeoutSeconds = 0.5, bool wait = true, const std::string& profileKey = std::string());
+
+		// Give back a connection that has nothing more coming back on it, along with the key of the profile
+		// it was set up with.  It's closed instead if it has been disconnected, or if its endpoint already
+		// has as many idle connections as we'll keep.
+		void CheckinSocketStream(SocketStream* socketStream, const std::string& profileKey = std::string());
+
+		// Close a connection that was checked out, rather than give it back.
+		void DiscardSocketStream(SocketStream* socketStream);
+
+		// Open connections ahead of time until the given endpoint has this many sitting idle, so that a
+		// burst of new clients doesn't have to wait on them.  True is returned if they were all opened.
+		// These aren't set up in any way, so any client can have them.
+		bool Prewarm(const Address& address, uint32_t numConnections, double connectionTimeoutSeconds = 0.5);
+
+		// Idle connections that have been idle too long are closed as we come across them, but this
+		// will go find them all.  It might be worth calling every so often from a long-running program.
+		void EvictIdleSocketStreams(void);
+
+		// Zero means no limit.  This counts connections checked out as well as those sitting idle.
+		void SetMaxConnectionsPerEndpoint(uint32_t givenMaxConnectionsPerEndpoint) { this->maxConnectionsPerEndpoint = givenMaxConnectionsPerEndpoint; }
+		uint32_t GetMaxConnectionsPerEndpoint(void) const { return this->maxConnectionsPerEndpoint; }
+
+		void SetMaxIdleConnectionsPerEndpoint(uint32_t givenMaxIdleConnectionsPerEndpoint) { this->maxIdleConnectionsPerEndpoint = givenMaxIdleConnectionsPerEndpoint; }
+		uint32_t GetMaxIdleConnectionsPerEndpoint(void) const { return this->maxIdleConnectionsPerEndpoint; }
+
+		// Servers often close connections that sit idle for long, so we'd rather close them first.  Zero means never.
+		void SetIdleTimeoutSeconds(double givenIdleTimeoutSeconds) { this->idleTimeoutSeconds = givenIdleTimeoutSeconds; }
+		double GetIdleTimeoutSeconds(void) const { return this->idleTimeoutSeconds; }
+
+		uint32_t GetNumIdleSocketStreams(const Address& address);
+		uint32_t GetNumOpenSocketStreams(const Address& address);
 
 	private:
 
-		typedef std::list<SocketStream*> SocketStreamList;
-		typedef std::map<std::string, SocketStreamList*> SocketStreamMap;
-		SocketStreamMap* socketStreamMap;
+		struct IdleSocketStream
+		{
+			SocketStream* socketStream;
+			double idleSinceTime;
+			std::string profileKey;
+		};
+
+		typedef std::list<IdleSocketStream> IdleSocketStreamList;
+
+		struct Endpoint
+		{
+			IdleSocketStreamList* idleList;		// Most recently checked in at the back.
+			uint32_t numOpen;
+		};
+
+		typedef std::map<std::string, Endpoint*> EndpointMap;
+
+		struct Shard
+		{
+			Mutex mutex;
+			EndpointMap* endpointMap;
+		};
+
+		enum { NUM_SHARDS = 16 };
+
+		static std::string MakeEndpointKey(const Address& address);
+		Shard* FindShard(const std::string& endpointKey);
+		Endpoint* FindEndpoint(Shard* shard, const std::string& endpointKey);
+		void EvictIdleSocketStreams(Endpoint* endpoint, double currentTime);
+		void AddIdleSocketStream(Endpoint* endpoint, SocketStream* socketStream, const std::string& profileKey);
+		IdleSocketStreamList::iterator FindIdleSocketStream(Endpoint* endpoint, const std::string& profileKey);
+
+		Shard shardArray[NUM_SHARDS];
+		uint32_t maxConnectionsPerEndpoint;
+		uint32_t maxIdleConnectionsPerEndpoint;
+		double idleTimeoutSeconds;
 	};
 }
\ No newline at end of file
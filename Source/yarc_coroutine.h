@@ -0,0 +1,253 @@
+#pragma once
+
+#include "yarc_client_iface.h"
+#include "yarc_protocol_data.h"
+
+// Everything here is header-only so that the library itself can still be built
+// by a compiler without coroutine support.  With GCC 10, add -fcoroutines.
+#if defined __cpp_impl_coroutine
+
+#include <coroutine>
+#include <exception>
+
+namespace Yarc
+{
+	// This lets a coroutine write "ProtocolData* responseData = co_await client->AwaitRequest(commandData);"
+	// in place of a callback.  The coroutine is resumed from within the client's Update() call,
+	// on whatever thread drives it, just as a callback would be called there.  The awaiter lives
+	// in the coroutine frame, and the callback we hand the client only captures a couple of
+	// pointers, so no allocation is made per await.  As with MakeRequestSync(), the caller takes
+	// ownership of the response data.  If the client refuses the request outright, the coroutine
+	// isn't suspended and null is returned.  Note that the request must not be canceled, since then
+	// the coroutine would never be resumed.
+	class RequestAwaiter
+	{
+	public:
+
+		RequestAwaiter(ClientInterface* givenClient, const ProtocolData* givenRequestData, bool givenDeleteData)
+		{
+			this->client = givenClient;
+			this->requestData = givenRequestData;
+			this->responseData = nullptr;
+			this->deleteData = givenDeleteData;
+		}
+
+		bool await_ready() const noexcept
+		{
+			return false;
+		}
+
+		bool await_suspend(std::coroutine_handle<> coroutineHandle)
+		{
+			// Be careful not to touch the awaiter once the coroutine is resumed, because it may then run to completion and free its frame.
+			ClientInterface::RequestHandle requestHandle = this->client->MakeRequestAsync(this->requestData, [this, coroutineHandle](const ProtocolData* givenResponseData) -> bool {
+				this->responseData = const_cast<ProtocolData*>(givenResponseData);
+				coroutineHandle.resume();
+				return false;
+			}, this->deleteData);
+
+			// If the client refuses the request (e.g., its queue is full), our callback is never called, so rather than
+			// suspend forever, we carry right on with a null result.  The request data is then ours to free, if asked to.
+			if (requestHandle == 0)
+			{
+				if (this->deleteData)
+					delete this->requestData;
+
+				return false;
+			}
+
+			return true;
+		}
+
+		ProtocolData* await_resume() noexcept
+		{
+			return this->responseData;
+		}
+
+	private:
+
+		ClientInterface* client;
+		const ProtocolData* requestData;
+		ProtocolData* responseData;
+		bool deleteData;
+	};
+
+	// This is the same as above, but for transactions.  The result is the response to EXEC.
+	// If the client refuses the transaction outright, the coroutine isn't suspended and null is returned.
+	class TransactionRequestAwaiter
+	{
+	public:
+
+		TransactionRequestAwaiter(ClientInterface* givenClient, DynamicArray<const ProtocolData*>& givenRequestDataArray, bool givenDeleteData)
+		{
+			this->client = givenClient;
+			this->requestDataArray = &givenRequestDataArray;
+			this->responseData = nullptr;
+			this->deleteData = givenDeleteData;
+		}
+
+		bool await_ready() const noexcept
+		{
+			return false;
+		}
+
+		bool await_suspend(std::coroutine_handle<> coroutineHandle)
+		{
+			return this->client->MakeTransactionRequestAsync(*this->requestDataArray, [this, coroutineHandle](const ProtocolData* givenResponseData) -> bool {
+				this->responseData = const_cast<ProtocolData*>(givenResponseData);
+				coroutineHandle.resume();
+				return false;
+			}, this->deleteData);
+		}
+
+		ProtocolData* await_resume() noexcept
+		{
+			return this->responseData;
+		}
+
+	private:
+
+		ClientInterface* client;
+		DynamicArray<const ProtocolData*>* requestDataArray;
+		ProtocolData* responseData;
+		bool deleteData;
+	};
+
+	inline RequestAwaiter ClientInterface::AwaitRequest(const ProtocolData* requestData, bool deleteData /*= true*/)
+	{
+		return RequestAwaiter(this, requestData, deleteData);
+	}
+
+	inline TransactionRequestAwaiter ClientInterface::AwaitTransactionRequest(DynamicArray<const ProtocolData*>& requestDataArray, bool deleteData /*= true*/)
+	{
+		return TransactionRequestAwaiter(this, requestDataArray, deleteData);
+	}
+
+	// The standard library doesn't yet give us a coroutine type, so here is a minimal one.
+	// A task doesn't run until it is either awaited by another coroutine or spawned.  Once
+	// spawned, it runs on its own and frees itself when it finishes, which is how a program
+	// would typically kick off each of its many concurrent logical operations, e.g...
+	//
+	//    Task IncrementCounter(ClientInterface* client) { ProtocolData* responseData = co_await client->AwaitRequest(...); ... }
+	//    IncrementCounter(client).Spawn();
+	//
+	// ...after which the program just keeps calling client->Update() as it always has.
+	class Task
+	{
+	public:
+
+		struct promise_type;
+
+		typedef std::coroutine_handle<promise_type> Handle;
+
+		struct FinalAwaiter
+		{
+			bool await_ready() const noexcept
+			{
+				return false;
+			}
+
+			std::coroutine_handle<> await_suspend(Handle handle) noexcept
+			{
+				promise_type& promise = handle.promise();
+				if (promise.detached)
+				{
+					handle.destroy();
+					return std::noop_coroutine();
+				}
+
+				if (promise.continuation)
+					return promise.continuation;
+
+				return std::noop_coroutine();
+			}
+
+			void await_resume() noexcept
+			{
+			}
+		};
+
+		struct promise_type
+		{
+			std::coroutine_handle<> continuation;
+			bool detached = false;
+
+			Task get_return_object()
+			{
+				return Task(Handle::from_promise(*this));
+			}
+
+			std::suspend_always initial_suspend() noexcept
+			{
+				return {};
+			}
+
+			FinalAwaiter final_suspend() noexcept
+			{
+				return {};
+			}
+
+			void return_void()
+			{
+			}
+
+			void unhandled_exception()
+			{
+				std::terminate();
+			}
+		};
+
+		Task(Task&& task)
+		{
+			this->handle = task.handle;
+			task.handle = nullptr;
+		}
+
+		Task(const Task&) = delete;
+
+		~Task()
+		{
+			if (this->handle)
+				this->handle.destroy();
+		}
+
+		// Start the task running on its own.  It runs until its first suspension before we return.
+		void Spawn()
+		{
+			Handle spawnedHandle = this->handle;
+			this->handle = nullptr;
+
+			if (spawnedHandle)
+			{
+				spawnedHandle.promise().detached = true;
+				spawnedHandle.resume();
+			}
+		}
+
+		bool await_ready() const noexcept
+		{
+			return !this->handle || this->handle.done();
+		}
+
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaitingHandle) noexcept
+		{
+			this->handle.promise().continuation = awaitingHandle;
+			return this->handle;
+		}
+
+		void await_resume() noexcept
+		{
+		}
+
+	private:
+
+		Task(Handle givenHandle)
+		{
+			this->handle = givenHandle;
+		}
+
+		Handle handle;
+	};
+}
+
+#endif //__cpp_impl_coroutine
\ No newline at end of file
@@ -0,0 +1,249 @@
+#include "yarc_executor.h"
+#include "yarc_misc.h"
+#if defined __LINUX__
+#	include <unistd.h>
+#endif
+
+namespace Yarc
+{
+	// This is how a worker finds its own queue when a task it's running submits another task.
+	static thread_local Executor* currentExecutor = nullptr;
+	static thread_local uint32_t currentWorkerIndex = 0;
+
+	static uint32_t GetNumProcessors(void)
+	{
+#if defined __WINDOWS__
+		SYSTEM_INFO systemInfo;
+		::GetSystemInfo(&systemInfo);
+		return systemInfo.dwNumberOfProcessors;
+#elif defined __LINUX__
+		long numProcessors = sysconf(_SC_NPROCESSORS_ONLN);
+		return numProcessors > 0 ? uint32_t(numProcessors) : 1;
+#endif
+	}
+
+	Executor::Executor(uint32_t numThreads /*= 0*/) : jobSemaphore(INT32_MAX)
+	{
+		if (numThreads == 0)
+			numThreads = GetNumProcessors();
+
+		this->strandArray = new Strand[NUM_STRANDS];
+		for (uint32_t i = 0; i < NUM_STRANDS; i++)
+		{
+			this->strandArray[i].scheduled = false;
+			this->strandArray[i].jobList.SetMaxFreeNodes(64);
+		}
+
+		this->jobSlab = new Slab<Job>();
+		this->nextWorkerIndex = 0;
+		this->numPendingTasks = 0;
+		this->shutdownSignal = false;
+
+		this->workerArray.SetCount(numThreads);
+		for (uint32_t i = 0; i < numThreads; i++)
+		{
+			Worker& worker = this->workerArray[i];
+			worker.jobList = new JobList();
+			worker.jobList->SetMaxFreeNodes(1024);
+			worker.thread = nullptr;
+		}
+
+		Thread::Options threadOptions;
+		threadOptions.name = "yarc-executor";
+
+		// Don't start any thread until every worker has a queue, since they may steal from one another right away.
+		for (uint32_t i = 0; i < numThreads; i++)
+		{
+			Worker& worker = this->workerArray[i];
+			worker.thread = new Thread();
+			if (!worker.thread->SpawnThread([this, i]() { this->WorkerFunc(i); }, &threadOptions))
+			{
+				delete worker.thread;
+				worker.thread = nullptr;
+			}
+		}
+	}
+
+	/*virtual*/ Executor::~Executor()
+	{
+		this->WaitForIdle();
+
+		this->shutdownSignal = true;
+		for (uint32_t i = 0; i < this->workerArray.GetCount(); i++)
+			this->jobSemaphore.Increment();
+
+		for (uint32_t i = 0; i < this->workerArray.GetCount(); i++)
+		{
+			Worker& worker = this->workerArray[i];
+			if (worker.thread)
+			{
+				worker.thread->WaitForThreadExit();
+				delete worker.thread;
+			}
+		}
+
+		// Workers steal from each other's lists, so none of them can go until all of the workers have.
+		for (uint32_t i = 0; i < this->workerArray.GetCount(); i++)
+			delete this->workerArray[i].jobList;
+
+		delete[] this->strandArray;
+		delete this->jobSlab;
+	}
+
+	void Executor::Submit(Task task, uint64_t orderingKey /*= 0*/)
+	{
+		this->numPendingTasks++;
+
+		Job* job = this->jobSlab->Allocate();
+		job->task = std::move(task);
+		job->runsStrand = false;
+
+		if (orderingKey == 0)
+		{
+			this->Schedule(job);
+			return;
+		}
+
+		// Mix the key up a bit so that keys differing only in their high bits don't all land in the same strand.
+		uint64_t hash = orderingKey * 0x9E3779B97F4A7C15ull;
+		Strand* strand = &this->strandArray[(hash >> 32) % NUM_STRANDS];
+
+		bool scheduleStrand = false;
+
+		{
+			MutexLocker locker(strand->mutex);
+			strand->jobList.AddTail(job);
+			if (!strand->scheduled)
+			{
+				strand->scheduled = true;
+				scheduleStrand = true;
+			}
+		}
+
+		// Only one job at a time ever runs a given strand, which is what keeps its tasks in order.
+		if (scheduleStrand)
+		{
+			Job* strandJob = this->jobSlab->Allocate();
+			strandJob->task = [this, strand]() { this->RunStrand(strand); };
+			strandJob->runsStrand = true;
+			this->Schedule(strandJob);
+		}
+	}
+
+	void Executor::Schedule(Job* job)
+	{
+		// A worker keeps what it submits for itself.  Anyone else deals jobs out to the workers in turn.
+		uint32_t workerIndex = 0;
+		if (currentExecutor == this)
+			workerIndex = currentWorkerIndex;
+		else
+			workerIndex = this->nextWorkerIndex++ % this->workerArray.GetCount();
+
+		this->workerArray[workerIndex].jobList->AddTail(job);
+		this->jobSemaphore.Increment();
+	}
+
+	Executor::Job* Executor::FindJob(uint32_t workerIndex)
+	{
+		// Our own newest job is the one most likely to still be in cache.
+		Job* job = this->workerArray[workerIndex].jobList->RemoveTail();
+		if (job)
+			return job;
+
+		// Failing that, steal the oldest job of someone else.
+		uint32_t numWorkers = this->workerArray.GetCount();
+		for (uint32_t i = 1; i < numWorkers; i++)
+		{
+			job = this->workerArray[(workerIndex + i) % numWorkers].jobList->RemoveHead();
+			if (job)
+				return job;
+		}
+
+		return nullptr;
+	}
+
+	void Executor::RunJob(Job* job)
+	{
+		bool runsStrand = job->runsStrand;
+
+		job->task();
+		this->jobSlab->Deallocate(job);
+
+		// A strand counts the tasks it runs itself.
+		if (!runsStrand)
+			this->numPendingTasks--;
+	}
+
+	void Executor::RunStrand(Strand* strand)
+	{
+		// Don't hog the worker forever if tasks keep coming.  Instead, get back in line after a while.
+		for (uint32_t i = 0; i < 64; i++)
+		{
+			Job* job = nullptr;
+
+			{
+				MutexLocker locker(strand->mutex);
+				if (strand->jobList.GetCount() == 0)
+				{
+					strand->scheduled = false;
+					return;
+				}
+
+				job = strand->jobList.GetHead()->value;
+				strand->jobList.Remove(strand->jobList.GetHead());
+			}
+
+			this->RunJob(job);
+		}
+
+		Job* strandJob = this->jobSlab->Allocate();
+		strandJob->task = [this, strand]() { this->RunStrand(strand); };
+		strandJob->runsStrand = true;
+		this->Schedule(strandJob);
+	}
+
+	void Executor::WorkerFunc(uint32_t workerIndex)
+	{
+		currentExecutor = this;
+		currentWorkerIndex = workerIndex;
+
+		while (true)
+		{
+			// Each count on the semaphore stands for a job sitting in some queue that nobody has yet
+			// claimed, so once we get one, we know there is a job out there for us to find.
+			this->jobSemaphore.Decrement(-1.0);
+
+			Job* job = nullptr;
+			while (true)
+			{
+				job = this->FindJob(workerIndex);
+				if (job || this->shutdownSignal)
+					break;
+
+				Thread::Sleep(0.0);
+			}
+
+			if (!job)
+				break;
+
+			this->RunJob(job);
+		}
+
+		currentExecutor = nullptr;
+	}
+
+	bool Executor::WaitForIdle(double timeoutSeconds /*= -1.0*/)
+	{
+		double startTime = GetMonotonicTimeSeconds();
+
+		while (this->numPendingTasks > 0)
+		{
+			if (timeoutSeconds >= 0.0 && GetMonotonicTimeSeconds() - startTime >= timeoutSeconds)
+				return false;
+
+			Thread::Sleep(1.0);
+		}
+
+		return true;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "yarc_api.h"
+#include "yarc_inline_function.h"
+#include "yarc_thread.h"
+#include "yarc_thread_safe_list.h"
+#include "yarc_semaphore.h"
+#include "yarc_slab.h"
+#include "yarc_mutex.h"
+#include <stdint.h>
+#include <atomic>
+
+namespace Yarc
+{
+	// A client can be given one of these to run its callbacks on a pool of worker threads rather than on
+	// the thread that calls Update().  Each worker has its own queue of tasks, taking its newest task first,
+	// while idle workers steal the oldest tasks of busy ones, so that heavy callbacks spread across all cores.
+	// Tasks given an ordering key are instead funneled through a strand for that key, where they run one at
+	// a time in the order given, though not necessarily all on the same thread.  Note that there are a limited
+	// number of strands, so unrelated keys may occasionally share one and be ordered with respect to each other.
+	class YARC_API Executor
+	{
+	public:
+
+		// Zero threads means one per processor.
+		Executor(uint32_t numThreads = 0);
+
+		// Any tasks still pending are run before we return.
+		virtual ~Executor();
+
+		// Big enough for a client callback plus a few pointers.
+		typedef InlineFunction<void(void), 96> Task;
+
+		// This is how a client orders the callbacks it hands us.  Per-connection ordering
+		// keeps callbacks in the order responses arrived on each connection.
+		enum Ordering
+		{
+			ORDERING_NONE,
+			ORDERING_PER_KEY,
+			ORDERING_PER_CONNECTION
+		};
+
+		// This may be called from any thread, including from within a task.
+		void Submit(Task task, uint64_t orderingKey = 0);
+
+		// Wait for every task submitted so far to finish.  Don't call this from within a task.
+		bool WaitForIdle(double timeoutSeconds = -1.0);
+
+		uint32_t GetNumThreads(void) const { return this->workerArray.GetCount(); }
+		uint32_t GetNumPendingTasks(void) const { return this->numPendingTasks; }
+
+	private:
+
+		struct Job
+		{
+			Task task;
+			bool runsStrand;
+		};
+
+		typedef ThreadSafeList<Job*> JobList;
+
+		struct Worker
+		{
+			JobList* jobList;
+			Thread* thread;
+		};
+
+		struct Strand
+		{
+			Mutex mutex;
+			LinkedList<Job*> jobList;
+			bool scheduled;
+		};
+
+		void WorkerFunc(uint32_t workerIndex);
+		Job* FindJob(uint32_t workerIndex);
+		void Schedule(Job* job);
+		void RunJob(Job* job);
+		void RunStrand(Strand* strand);
+
+		enum { NUM_STRANDS = 256 };
+
+		DynamicArray<Worker> workerArray;
+		Strand* strandArray;
+		Slab<Job>* jobSlab;
+		Semaphore jobSemaphore;
+		std::atomic<uint32_t> nextWorkerIndex;
+		std::atomic<uint32_t> numPendingTasks;
+		volatile bool shutdownSignal;
+	};
+}
\ No newline at end of file
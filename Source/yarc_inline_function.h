@@ -0,0 +1,197 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <new>
+#include <utility>
+#include <type_traits>
+
+namespace Yarc
+{
+	template<typename Signature, uint32_t inlineSize = 56>
+	class InlineFunction;
+
+	// This is a move-only replacement for std::function that stores the callable in
+	// a fixed-size buffer inside the object itself.  Lambdas with typical captures
+	// (a few pointers, an integer or two, a std::string) fit in the buffer, so no
+	// heap allocation is ever made for them.  Larger callables still work, but fall
+	// back to the heap.  Not being copyable is what lets us accept move-only captures
+	// and keeps us honest about where callbacks get duplicated.
+	template<typename R, typename... Args, uint32_t inlineSize>
+	class InlineFunction<R(Args...), inlineSize>
+	{
+	public:
+
+		InlineFunction()
+		{
+			this->ops = nullptr;
+		}
+
+		InlineFunction(std::nullptr_t)
+		{
+			this->ops = nullptr;
+		}
+
+		template<typename F, typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, InlineFunction>::value>::type>
+		InlineFunction(F&& func)
+		{
+			this->ops = nullptr;
+			this->Assign(std::forward<F>(func));
+		}
+
+		InlineFunction(InlineFunction&& other) noexcept
+		{
+			this->ops = nullptr;
+			this->MoveFrom(other);
+		}
+
+		InlineFunction(const InlineFunction&) = delete;
+
+		~InlineFunction()
+		{
+			this->Reset();
+		}
+
+		InlineFunction& operator=(InlineFunction&& other) noexcept
+		{
+			if (this != &other)
+			{
+				this->Reset();
+				this->MoveFrom(other);
+			}
+
+			return *this;
+		}
+
+		InlineFunction& operator=(const InlineFunction&) = delete;
+
+		InlineFunction& operator=(std::nullptr_t)
+		{
+			this->Reset();
+			return *this;
+		}
+
+		template<typename F, typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, InlineFunction>::value>::type>
+		InlineFunction& operator=(F&& func)
+		{
+			this->Reset();
+			this->Assign(std::forward<F>(func));
+			return *this;
+		}
+
+		R operator()(Args... args) const
+		{
+			return this->ops->invoke(const_cast<uint8_t*>(this->storage), std::forward<Args>(args)...);
+		}
+
+		explicit operator bool() const
+		{
+			return this->ops != nullptr;
+		}
+
+		void Reset()
+		{
+			if (this->ops)
+			{
+				this->ops->destroy(this->storage);
+				this->ops = nullptr;
+			}
+		}
+
+		// Tell whether the given callable type would be stored without touching the heap.
+		template<typename F>
+		static constexpr bool StoredInline()
+		{
+			return sizeof(F) <= inlineSize && alignof(F) <= alignof(max_align_t) && std::is_nothrow_move_constructible<F>::value;
+		}
+
+	private:
+
+		struct Ops
+		{
+			R (*invoke)(void* storage, Args&&... args);
+			void (*move)(void* destStorage, void* srcStorage);
+			void (*destroy)(void* storage);
+		};
+
+		template<typename F>
+		struct InlineOps
+		{
+			static R Invoke(void* storage, Args&&... args)
+			{
+				return (*(F*)storage)(std::forward<Args>(args)...);
+			}
+
+			static void Move(void* destStorage, void* srcStorage)
+			{
+				new (destStorage) F(std::move(*(F*)srcStorage));
+				((F*)srcStorage)->~F();
+			}
+
+			static void Destroy(void* storage)
+			{
+				((F*)storage)->~F();
+			}
+
+			static constexpr Ops table = { &Invoke, &Move, &Destroy };
+		};
+
+		template<typename F>
+		struct HeapOps
+		{
+			static R Invoke(void* storage, Args&&... args)
+			{
+				return (**(F**)storage)(std::forward<Args>(args)...);
+			}
+
+			static void Move(void* destStorage, void* srcStorage)
+			{
+				*(F**)destStorage = *(F**)srcStorage;
+				*(F**)srcStorage = nullptr;
+			}
+
+			static void Destroy(void* storage)
+			{
+				delete *(F**)storage;
+			}
+
+			static constexpr Ops table = { &Invoke, &Move, &Destroy };
+		};
+
+		template<typename F>
+		void Assign(F&& func)
+		{
+			typedef typename std::decay<F>::type Func;
+
+			if constexpr (std::is_pointer<Func>::value || std::is_member_pointer<Func>::value)
+			{
+				if (!func)
+					return;
+			}
+
+			if constexpr (StoredInline<Func>())
+			{
+				new (this->storage) Func(std::forward<F>(func));
+				this->ops = &InlineOps<Func>::table;
+			}
+			else
+			{
+				*(Func**)this->storage = new Func(std::forward<F>(func));
+				this->ops = &HeapOps<Func>::table;
+			}
+		}
+
+		void MoveFrom(InlineFunction& other)
+		{
+			if (other.ops)
+			{
+				other.ops->move(this->storage, other.storage);
+				this->ops = other.ops;
+				other.ops = nullptr;
+			}
+		}
+
+		alignas(max_align_t) uint8_t storage[inlineSize < sizeof(void*) ? sizeof(void*) : inlineSize];
+		const Ops* ops;
+	};
+}
\ No newline at end of file
@@ -14,11 +14,15 @@ namespace Yarc
 			this->head = nullptr;
 			this->tail = nullptr;
 			this->count = 0;
+			this->freeNodeList = nullptr;
+			this->numFreeNodes = 0;
+			this->maxFreeNodes = 0;
 		}
 
 		virtual ~LinkedList()
 		{
 			this->RemoveAll();
+			this->SetMaxFreeNodes(0);
 		}
 
 		class Node
@@ -28,6 +32,16 @@ namespace Yarc
 		public:
 
 			Node(T givenValue)
+			{
+				this->Reset(givenValue);
+			}
+
+			virtual ~Node()
+			{
+				this->SignalDelete();
+			}
+
+			void Reset(T givenValue)
 			{
 				this->next = nullptr;
 				this->prev = nullptr;
@@ -35,7 +49,7 @@ namespace Yarc
 				this->deleteFlag = nullptr;
 			}
 
-			virtual ~Node()
+			void SignalDelete()
 			{
 				if (this->deleteFlag)
 					*this->deleteFlag = true;
@@ -86,7 +100,7 @@ namespace Yarc
 
 		void InsertAfter(Node* after, T value)
 		{
-			Node* node = new Node(value);
+			Node* node = this->AllocNode(value);
 
 			if (!after)
 				this->head = this->tail = node;
@@ -104,7 +118,7 @@ namespace Yarc
 
 		void InsertBefore(Node* before, T value)
 		{
-			Node* node = new Node(value);
+			Node* node = this->AllocNode(value);
 
 			if (!before)
 				this->head = this->tail = node;
@@ -129,7 +143,7 @@ namespace Yarc
 				this->tail = this->tail->prev;
 
 			node->Decouple();
-			delete node;
+			this->FreeNode(node);
 			this->count--;
 		}
 
@@ -167,11 +181,59 @@ namespace Yarc
 
 		unsigned int GetCount() const { return this->count; }
 
+		// By default, every insertion allocates a node and every removal frees one.  Lists that
+		// see a lot of traffic can instead hang on to up to the given number of removed nodes
+		// so that, once warmed up, adding and removing values never touches the heap.
+		void SetMaxFreeNodes(unsigned int givenMaxFreeNodes)
+		{
+			this->maxFreeNodes = givenMaxFreeNodes;
+
+			while (this->numFreeNodes > this->maxFreeNodes)
+			{
+				Node* node = this->freeNodeList;
+				this->freeNodeList = node->next;
+				this->numFreeNodes--;
+				node->deleteFlag = nullptr;
+				delete node;
+			}
+		}
+
 	private:
 
+		Node* AllocNode(T value)
+		{
+			Node* node = this->freeNodeList;
+			if (!node)
+				return new Node(value);
+
+			this->freeNodeList = node->next;
+			this->numFreeNodes--;
+			node->Reset(value);
+			return node;
+		}
+
+		void FreeNode(Node* node)
+		{
+			if (this->numFreeNodes >= this->maxFreeNodes)
+			{
+				delete node;
+				return;
+			}
+
+			node->SignalDelete();
+			node->deleteFlag = nullptr;
+			node->prev = nullptr;
+			node->next = this->freeNodeList;
+			this->freeNodeList = node;
+			this->numFreeNodes++;
+		}
+
 		Node* head;
 		Node* tail;
 		unsigned int count;
+		Node* freeNodeList;
+		unsigned int numFreeNodes;
+		unsigned int maxFreeNodes;
 	};
 
 	template<typename T>
@@ -1,5 +1,14 @@
 #include "yarc_misc.h"
 #include <stdlib.h>
+#include <random>
+#if defined __WINDOWS__
+#	if !defined WIN32_LEAN_AND_MEAN
+#		define WIN32_LEAN_AND_MEAN
+#	endif
+#	include <Windows.h>
+#elif defined __LINUX__
+#	include <time.h>
+#endif
 
 namespace Yarc
 {
@@ -13,4 +22,33 @@ namespace Yarc
 			number = max;
 		return number;
 	}
+
+	double RandomFraction(void)
+	{
+		thread_local std::minstd_rand generator(std::random_device{}());
+		return std::uniform_real_distribution<double>(0.0, 1.0)(generator);
+	}
+
+	double GetMonotonicTimeSeconds(void)
+	{
+#if defined __WINDOWS__
+		LARGE_INTEGER frequency, counter;
+		::QueryPerformanceFrequency(&frequency);
+		::QueryPerformanceCounter(&counter);
+		return double(counter.QuadPart) / double(frequency.QuadPart);
+#elif defined __LINUX__
+		timespec timeSpec;
+		clock_gettime(CLOCK_MONOTONIC, &timeSpec);
+		return double(timeSpec.tv_sec) + double(timeSpec.tv_nsec) / 1e9;
+#endif
+	}
+
+	void CpuRelax(void)
+	{
+#if defined __WINDOWS__
+		YieldProcessor();
+#elif defined __x86_64__ || defined __i386__
+		__builtin_ia32_pause();
+#endif
+	}
 }
\ No newline at end of file
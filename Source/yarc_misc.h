@@ -6,4 +6,15 @@
 namespace Yarc
 {
 	extern YARC_API uint32_t RandomNumber(uint32_t min, uint32_t max);
+
+	// This gives a random number in [0,1).  Unlike rand(), it's seeded differently in every process (and thread),
+	// which matters when what we're after is keeping a crowd of clients from all doing the same thing at once.
+	extern YARC_API double RandomFraction(void);
+
+	// Unlike ::clock(), which measures CPU time used by the process, this measures wall time
+	// that never jumps backward, which is what you want when measuring time-outs and latencies.
+	extern YARC_API double GetMonotonicTimeSeconds(void);
+
+	// Call this in the body of a spin loop to tell the CPU that we're just waiting.
+	extern YARC_API void CpuRelax(void);
 }
\ No newline at end of file
@@ -0,0 +1,151 @@
+#include "yarc_pipeline.h"
+#include "yarc_protocol_data.h"
+#include "yarc_byte_stream.h"
+
+namespace Yarc
+{
+	Pipeline::Pipeline(bool givenOwnsCommands /*= true*/)
+	{
+		this->commandArray = new DynamicArray<const ProtocolData*>();
+		this->replyArray = new DynamicArray<ProtocolData*>();
+		this->callback = new Callback();
+		this->numRepliesPending = 0;
+		this->ownsCommands = givenOwnsCommands;
+	}
+
+	/*virtual*/ Pipeline::~Pipeline()
+	{
+		this->ClearReplies();
+
+		if (this->ownsCommands)
+			for (uint32_t i = 0; i < this->commandArray->GetCount(); i++)
+				delete (*this->commandArray)[i];
+
+		delete this->commandArray;
+		delete this->replyArray;
+		delete this->callback;
+	}
+
+	/*static*/ Pipeline* Pipeline::Create()
+	{
+		return new Pipeline();
+	}
+
+	/*static*/ void Pipeline::Destroy(Pipeline* pipeline)
+	{
+		delete pipeline;
+	}
+
+	uint32_t Pipeline::AddCommand(const ProtocolData* commandData)
+	{
+		uint32_t i = this->commandArray->GetCount();
+		this->commandArray->SetCount(i + 1);
+		(*this->commandArray)[i] = commandData;
+		return i;
+	}
+
+	ProtocolData* Pipeline::TakeReply(uint32_t i)
+	{
+		ProtocolData* replyData = (*this->replyArray)[i];
+		(*this->replyArray)[i] = nullptr;
+		return replyData;
+	}
+
+	bool Pipeline::IsError(uint32_t i) const
+	{
+		const ProtocolData* replyData = this->GetReply(i);
+		return replyData && replyData->IsError();
+	}
+
+	std::string Pipeline::GetError(uint32_t i) const
+	{
+		const ProtocolData* replyData = this->GetReply(i);
+
+		const SimpleErrorData* simpleErrorData = Cast<SimpleErrorData>(replyData);
+		if (simpleErrorData)
+			return simpleErrorData->GetValue();
+
+		const BlobErrorData* blobErrorData = Cast<BlobErrorData>(replyData);
+		if (blobErrorData)
+			return blobErrorData->GetValue();
+
+		return "";
+	}
+
+	uint32_t Pipeline::GetNumErrors(void) const
+	{
+		uint32_t numErrors = 0;
+		for (uint32_t i = 0; i < this->replyArray->GetCount(); i++)
+			if (this->IsError(i))
+				numErrors++;
+
+		return numErrors;
+	}
+
+	void Pipeline::ClearReplies(void)
+	{
+		for (uint32_t i = 0; i < this->replyArray->GetCount(); i++)
+			delete (*this->replyArray)[i];
+
+		this->replyArray->SetCount(0);
+	}
+
+	void Pipeline::Begin(Callback givenCallback)
+	{
+		this->ClearReplies();
+
+		// The reply array is sized up front, so that replies can be set in any order, from any thread.
+		this->replyArray->SetCount(this->commandArray->GetCount());
+		for (uint32_t i = 0; i < this->replyArray->GetCount(); i++)
+			(*this->replyArray)[i] = nullptr;
+
+		*this->callback = std::move(givenCallback);
+		this->numRepliesPending = this->commandArray->GetCount();
+	}
+
+	bool Pipeline::SetReply(uint32_t i, ProtocolData* replyData)
+	{
+		delete (*this->replyArray)[i];
+		(*this->replyArray)[i] = replyData;
+		return --this->numRepliesPending == 0;
+	}
+
+	bool Pipeline::Fail(const char* error)
+	{
+		if (this->numRepliesPending == 0)
+			return false;
+
+		for (uint32_t i = 0; i < this->replyArray->GetCount(); i++)
+			if (!(*this->replyArray)[i])
+				(*this->replyArray)[i] = new SimpleErrorData(error);
+
+		this->numRepliesPending = 0;
+		return true;
+	}
+
+	// Note that we may be deleted here, so the caller mustn't touch us afterward.
+	void Pipeline::Complete(void)
+	{
+		Callback givenCallback = std::move(*this->callback);
+		if (!givenCallback || givenCallback(this))
+			delete this;
+	}
+
+	bool Pipeline::Print(ByteStream* byteStream) const
+	{
+		for (uint32_t i = 0; i < this->commandArray->GetCount(); i++)
+			if (!ProtocolData::PrintTree(byteStream, (*this->commandArray)[i]))
+				return false;
+
+		return true;
+	}
+
+	uint32_t Pipeline::CalcSize(void) const
+	{
+		uint32_t size = 0;
+		for (uint32_t i = 0; i < this->commandArray->GetCount(); i++)
+			size += ProtocolData::CalcCommandSize((*this->commandArray)[i]);
+
+		return size;
+	}
+}
\ No newline at end of file
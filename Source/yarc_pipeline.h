@@ -0,0 +1,74 @@
+#pragma once
+
+#include "yarc_api.h"
+#include "yarc_dynamic_array.h"
+#include "yarc_inline_function.h"
+#include <stdint.h>
+#include <atomic>
+#include <string>
+
+namespace Yarc
+{
+	class ProtocolData;
+	class ByteStream;
+
+	// This is a batch of commands that are sent all together, and whose replies all come back together, in the
+	// same order, in a single call to the callback.  It saves a request, a trip through the queue, and a callback
+	// per command.  Note that, unlike a transaction, other clients' commands can still be run between ours.
+	class YARC_API Pipeline
+	{
+	public:
+
+		// The return value indicates whether the pipeline (with its commands and replies) should be deleted
+		// once the callback returns.  Return false to hang on to it, to look at later, or to send again.
+		typedef InlineFunction<bool(Pipeline* pipeline)> Callback;
+
+		// A pipeline that doesn't own its commands leaves them for someone else to delete.
+		Pipeline(bool givenOwnsCommands = true);
+		virtual ~Pipeline();
+
+		// When used as a DLL, these ensure that the pipeline is allocated and freed in the proper heap.
+		static Pipeline* Create();
+		static void Destroy(Pipeline* pipeline);
+
+		// This takes ownership of the given command (unless we don't own commands) and returns its index.
+		uint32_t AddCommand(const ProtocolData* commandData);
+
+		uint32_t GetCount(void) const { return this->commandArray->GetCount(); }
+		const ProtocolData* GetCommand(uint32_t i) const { return (*this->commandArray)[i]; }
+
+		// Once the pipeline has completed, each command has a reply, even if it's only an error saying that
+		// the command never made it to the server.  The replies are an array of GetCount() of them, in order.
+		const ProtocolData* GetReply(uint32_t i) const { return (*this->replyArray)[i]; }
+		const ProtocolData* const* GetReplies(void) const { return this->replyArray->GetBuffer(); }
+
+		// The caller takes ownership of the reply, which leaves a null in its place.
+		ProtocolData* TakeReply(uint32_t i);
+
+		bool IsError(uint32_t i) const;
+		std::string GetError(uint32_t i) const;
+		uint32_t GetNumErrors(void) const;
+
+		// Let go of the replies, but keep the commands, so that the pipeline can be sent again.
+		void ClearReplies(void);
+
+		// The rest of this is for the clients.  A pipeline is begun when it's accepted by a client, and is
+		// complete once every command has a reply.  Setting the last of them returns true, as does failing
+		// whatever commands are still without one.  Either way, the caller then calls Complete().
+		void Begin(Callback givenCallback);
+		bool SetReply(uint32_t i, ProtocolData* replyData);
+		bool Fail(const char* error);
+		void Complete(void);
+
+		bool Print(ByteStream* byteStream) const;
+		uint32_t CalcSize(void) const;
+
+	private:
+
+		DynamicArray<const ProtocolData*>* commandArray;
+		DynamicArray<ProtocolData*>* replyArray;
+		Callback* callback;
+		std::atomic<uint32_t> numRepliesPending;
+		bool ownsCommands;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,71 @@
+#include "yarc_pipeline_window.h"
+
+namespace Yarc
+{
+	PipelineWindow::PipelineWindow()
+	{
+		this->Configure(1024, 1024, false);
+	}
+
+	/*virtual*/ PipelineWindow::~PipelineWindow()
+	{
+	}
+
+	void PipelineWindow::Configure(uint32_t givenMinSize, uint32_t givenMaxSize, bool givenAdaptive)
+	{
+		this->minSize = givenMinSize > 0 ? givenMinSize : 1;
+		this->maxSize = givenMaxSize > this->minSize ? givenMaxSize : this->minSize;
+		this->adaptive = givenAdaptive;
+		this->baseRoundTripSeconds = 0.0;
+		this->smoothedRoundTripSeconds = 0.0;
+		this->epochMinRoundTripSeconds = 0.0;
+		this->numEpochSamples = 0;
+		this->numEpochs = 0;
+
+		// An adaptive window starts small and opens up as it learns what the server can take.
+		this->size.store(this->adaptive ? this->minSize : this->maxSize, std::memory_order_relaxed);
+	}
+
+	void PipelineWindow::RecordRoundTrip(double roundTripSeconds)
+	{
+		if (this->smoothedRoundTripSeconds == 0.0)
+			this->smoothedRoundTripSeconds = roundTripSeconds;
+		else
+			this->smoothedRoundTripSeconds += (roundTripSeconds - this->smoothedRoundTripSeconds) / 8.0;
+
+		if (!this->adaptive)
+			return;
+
+		if (this->numEpochSamples == 0 || roundTripSeconds < this->epochMinRoundTripSeconds)
+			this->epochMinRoundTripSeconds = roundTripSeconds;
+
+		// We only adjust once per window's worth of responses, so that each adjustment gets to take effect before the next.
+		uint32_t currentSize = this->size.load(std::memory_order_relaxed);
+		if (++this->numEpochSamples < currentSize)
+			return;
+
+		// Every so often, forget the base round-trip time, in case the route to the server or its load has changed for good.
+		if (this->numEpochs++ % 32 == 0 || this->epochMinRoundTripSeconds < this->baseRoundTripSeconds)
+			this->baseRoundTripSeconds = this->epochMinRoundTripSeconds;
+
+		this->numEpochSamples = 0;
+
+		if (this->smoothedRoundTripSeconds <= 0.0)
+			return;
+
+		double numQueued = double(currentSize) * (1.0 - this->baseRoundTripSeconds / this->smoothedRoundTripSeconds);
+
+		uint32_t newSize = currentSize;
+		if (numQueued < double(currentSize) / 8.0)
+			newSize = currentSize + currentSize / 4 + 1;
+		else if (numQueued > double(currentSize) / 2.0)
+			newSize = currentSize - currentSize / 4;
+
+		if (newSize < this->minSize)
+			newSize = this->minSize;
+		else if (newSize > this->maxSize)
+			newSize = this->maxSize;
+
+		this->size.store(newSize, std::memory_order_relaxed);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "yarc_api.h"
+#include <stdint.h>
+#include <atomic>
+
+namespace Yarc
+{
+	// This limits how many requests a client may have out on the wire awaiting responses.
+	// A fixed window is just a number.  An adaptive window tunes itself between the given
+	// bounds in the manner of TCP Vegas: comparing the smoothed round-trip time against the
+	// best one seen lately tells us roughly how many of our requests are sitting in a queue at
+	// the server rather than being worked on.  While that number is small, a deeper pipeline
+	// still buys throughput, so the window grows.  Once it's a good fraction of the window,
+	// we're only filling up the server's buffers, so the window shrinks.
+	class YARC_API PipelineWindow
+	{
+	public:
+
+		PipelineWindow();
+		virtual ~PipelineWindow();
+
+		// This should be done before the window is put to use.
+		void Configure(uint32_t givenMinSize, uint32_t givenMaxSize, bool givenAdaptive);
+
+		uint32_t GetSize(void) const { return this->size.load(std::memory_order_relaxed); }
+		bool IsAdaptive(void) const { return this->adaptive; }
+		double GetSmoothedRoundTripSeconds(void) const { return this->smoothedRoundTripSeconds; }
+
+		// This is called by the reception thread for each response it receives.
+		void RecordRoundTrip(double roundTripSeconds);
+
+	private:
+
+		std::atomic<uint32_t> size;
+		uint32_t minSize;
+		uint32_t maxSize;
+		bool adaptive;
+		double baseRoundTripSeconds;
+		double smoothedRoundTripSeconds;
+		double epochMinRoundTripSeconds;
+		uint32_t numEpochSamples;
+		uint32_t numEpochs;
+	};
+}
\ No newline at end of file
@@ -19,12 +19,50 @@ namespace Yarc
 		delete this->attributeData;
 	}
 
+	/*static*/ bool ProtocolData::IsScriptCommand(const std::string& commandName)
+	{
+		static const char* scriptCommandArray[] = { "EVAL", "EVALSHA", "EVAL_RO", "EVALSHA_RO", "FCALL", "FCALL_RO" };
+
+		std::string upperName = commandName;
+		for (char& ch : upperName)
+			ch = ::toupper(ch);
+
+		for (const char* scriptCommand : scriptCommandArray)
+			if (upperName == scriptCommand)
+				return true;
+
+		return false;
+	}
+
+	/*static*/ bool ProtocolData::IsCommandName(const DynamicArray<uint8_t>& byteArray, const char* commandName)
+	{
+		uint32_t i;
+		for (i = 0; i < byteArray.GetCount() && commandName[i] != '\0'; i++)
+			if (::toupper(byteArray[i]) != commandName[i])
+				return false;
+
+		return i == byteArray.GetCount() && commandName[i] == '\0';
+	}
+
 	/*static*/ std::string ProtocolData::FindCommandKey(const ProtocolData* commandData)
 	{
 		// TODO: Not all command's syntax requires a first argument key.
 		const ArrayData* commandArrayData = Cast<ArrayData>(commandData);
 		if (commandArrayData && commandArrayData->GetCount() >= 2)
 		{
+			// Scripts and functions are given their script (or name) and a count of keys first, and then the keys.
+			// With no keys, they can be run anywhere, so they're given the empty key, like any other keyless command.
+			const BlobStringData* nameStringData = Cast<BlobStringData>(commandArrayData->GetElement(0));
+			if (nameStringData && IsScriptCommand(nameStringData->GetValue()))
+			{
+				const BlobStringData* numKeysStringData = commandArrayData->GetCount() >= 4 ? Cast<BlobStringData>(commandArrayData->GetElement(2)) : nullptr;
+				if (!numKeysStringData || ::atoi(numKeysStringData->GetValue().c_str()) <= 0)
+					return "";
+
+				const BlobStringData* keyStringData = Cast<BlobStringData>(commandArrayData->GetElement(3));
+				return keyStringData ? keyStringData->GetValue() : "";
+			}
+
 			const BlobStringData* keyStringData = Cast<BlobStringData>(commandArrayData->GetElement(1));
 			if (keyStringData)
 				return keyStringData->GetValue();
@@ -75,6 +113,26 @@ namespace Yarc
 		return crc16(key + s + 1, e - s - 1) & 16383;
 	}
 
+	/*static*/ uint32_t ProtocolData::CalcCommandSize(const ProtocolData* commandData)
+	{
+		// Every command is an array of blob strings.  We count their contents exactly,
+		// and just allow a little for the objects and allocations around them.
+		uint32_t size = sizeof(ArrayData);
+		const ArrayData* commandArrayData = Cast<ArrayData>(commandData);
+		if (commandArrayData)
+		{
+			for (uint32_t i = 0; i < commandArrayData->GetCount(); i++)
+			{
+				size += sizeof(BlobStringData) + 16;
+				const BlobStringData* argStringData = Cast<BlobStringData>(commandArrayData->GetElement(i));
+				if (argStringData && !argStringData->GetFileRegion())
+					size += argStringData->GetSize();	// A file-backed argument takes up no memory to speak of.
+			}
+		}
+
+		return size;
+	}
+
 	/*static*/ void ProtocolData::Destroy(ProtocolData* protocolData)
 	{
 		delete protocolData;
@@ -164,6 +222,37 @@ namespace Yarc
 		return ProtocolData::PrintDataType(byteStream, protocolData);
 	}
 
+	/*static*/ ProtocolData* ProtocolData::Clone(const ProtocolData* protocolData)
+	{
+		if (!protocolData)
+			return nullptr;
+
+		// This isn't the fastest way to copy a tree, but it's only used where one reply has to be handed
+		// out to more than one owner, and it handles every data type there is without any more code.
+		std::string buffer;
+		StringStream stringStream(&buffer);
+		if (!PrintTree(&stringStream, protocolData))
+			return nullptr;
+
+		ProtocolData* cloneData = nullptr;
+		if (!ParseTree(&stringStream, cloneData))
+			return nullptr;
+
+		return cloneData;
+	}
+
+	/*static*/ ProtocolData* ProtocolData::CloneReply(const ProtocolData* replyData)
+	{
+		if (!replyData)
+			return nullptr;
+
+		ProtocolData* cloneData = Clone(replyData);
+		if (!cloneData)
+			cloneData = new SimpleErrorData("ERR yarc: failed to copy reply");
+
+		return cloneData;
+	}
+
 	/*static*/ bool ProtocolData::ParseDataType(ByteStream* byteStream, ProtocolData*& protocolData)
 	{
 		protocolData = nullptr;
@@ -450,6 +539,16 @@ namespace Yarc
 		return true;
 	}
 
+	ProtocolData* ArrayData::TakeElement(uint32_t i)
+	{
+		if (i >= this->nestedDataArray->GetCount())
+			return nullptr;
+
+		ProtocolData* protocolData = (*this->nestedDataArray)[i];
+		(*this->nestedDataArray)[i] = nullptr;
+		return protocolData;
+	}
+
 	//-------------------------- EndData --------------------------
 
 	EndData::EndData()
@@ -483,12 +582,16 @@ namespace Yarc
 	BlobStringData::BlobStringData()
 	{
 		this->byteArray = new DynamicArray<uint8_t>();
+		this->sharedBuffer = nullptr;
+		this->fileRegion = nullptr;
 		this->isNull = false;
 	}
 
 	BlobStringData::BlobStringData(const std::string& value)
 	{
 		this->byteArray = new DynamicArray<uint8_t>();
+		this->sharedBuffer = nullptr;
+		this->fileRegion = nullptr;
 		this->isNull = false;
 		this->SetValue(value);
 	}
@@ -496,6 +599,8 @@ namespace Yarc
 	BlobStringData::BlobStringData(const char* value)
 	{
 		this->byteArray = new DynamicArray<uint8_t>();
+		this->sharedBuffer = nullptr;
+		this->fileRegion = nullptr;
 		this->isNull = false;
 		this->SetValue(value);
 	}
@@ -503,12 +608,15 @@ namespace Yarc
 	BlobStringData::BlobStringData(const uint8_t* buffer, uint32_t bufferSize)
 	{
 		this->byteArray = new DynamicArray<uint8_t>();
+		this->sharedBuffer = nullptr;
+		this->fileRegion = nullptr;
 		this->isNull = false;
 		this->SetFromBuffer(buffer, bufferSize);
 	}
 
 	/*virtual*/ BlobStringData::~BlobStringData()
 	{
+		this->ReleaseReferencedData();
 		delete this->byteArray;
 	}
 
@@ -581,10 +689,20 @@ namespace Yarc
 		if(this->isNull)
 			return byteStream->WriteFormat("-1\r\n");
 
-		if (!byteStream->WriteFormat("%d\r\n", this->byteArray->GetCount()))
+		if (!byteStream->WriteFormat("%d\r\n", this->GetSize()))
 			return false;
 
-		if (!byteStream->WriteBufferNow(this->byteArray->GetBuffer(), this->byteArray->GetCount()))
+		if (this->sharedBuffer)
+		{
+			if (!byteStream->WriteSharedBuffer(this->sharedBuffer))
+				return false;
+		}
+		else if (this->fileRegion)
+		{
+			if (!byteStream->WriteFileRegion(*this->fileRegion))
+				return false;
+		}
+		else if (!byteStream->WriteBufferNow(this->byteArray->GetBuffer(), this->byteArray->GetCount()))
 			return false;
 
 		if (!byteStream->WriteFormat("\r\n"))
@@ -603,8 +721,76 @@ namespace Yarc
 		return *this->byteArray;
 	}
 
+	uint32_t BlobStringData::GetSize(void) const
+	{
+		if (this->sharedBuffer)
+			return this->sharedBuffer->GetSize();
+
+		if (this->fileRegion)
+			return this->fileRegion->length;
+
+		return this->byteArray->GetCount();
+	}
+
+	void BlobStringData::ReleaseReferencedData(void)
+	{
+		if (this->sharedBuffer)
+		{
+			this->sharedBuffer->Release();
+			this->sharedBuffer = nullptr;
+		}
+
+		delete this->fileRegion;
+		this->fileRegion = nullptr;
+	}
+
+	bool BlobStringData::SetFromFile(int fileDescriptor, uint64_t offset, uint32_t length, bool ownsFile /*= false*/)
+	{
+		this->ReleaseReferencedData();
+		this->byteArray->SetCount(0);
+		this->isNull = false;
+
+		this->fileRegion = new FileRegion();
+		this->fileRegion->fileDescriptor = fileDescriptor;
+		this->fileRegion->offset = offset;
+		this->fileRegion->length = length;
+		this->fileRegion->ownsFile = ownsFile;
+		return true;
+	}
+
+	bool BlobStringData::SetFromSharedBuffer(SharedBuffer* givenSharedBuffer)
+	{
+		givenSharedBuffer->AddRef();
+		this->ReleaseReferencedData();
+		this->sharedBuffer = givenSharedBuffer;
+		this->byteArray->SetCount(0);
+		this->isNull = false;
+		return true;
+	}
+
 	bool BlobStringData::GetToBuffer(uint8_t* buffer, uint32_t& bufferSize) const
 	{
+		if (this->fileRegion)
+		{
+			std::string value = this->GetValue();
+			if (bufferSize < value.length())
+				return false;
+
+			::memcpy(buffer, value.c_str(), value.length());
+			bufferSize = (uint32_t)value.length();
+			return true;
+		}
+
+		if (this->sharedBuffer)
+		{
+			if (bufferSize < this->sharedBuffer->GetSize())
+				return false;
+
+			::memcpy(buffer, this->sharedBuffer->GetData(), this->sharedBuffer->GetSize());
+			bufferSize = this->sharedBuffer->GetSize();
+			return true;
+		}
+
 		if (bufferSize < this->byteArray->GetCount())
 			return false;
 
@@ -617,6 +803,7 @@ namespace Yarc
 
 	bool BlobStringData::SetFromBuffer(const uint8_t* buffer, uint32_t bufferSize)
 	{
+		this->ReleaseReferencedData();
 		this->byteArray->SetCount(bufferSize);
 
 		for (int i = 0; i < (signed)this->byteArray->GetCount(); i++)
@@ -627,6 +814,18 @@ namespace Yarc
 
 	std::string BlobStringData::GetValue() const
 	{
+		if (this->sharedBuffer)
+			return std::string((const char*)this->sharedBuffer->GetData(), this->sharedBuffer->GetSize());
+
+		// Nobody should really want the value of a file-backed blob, but here it is, read in the usual way.
+		if (this->fileRegion)
+		{
+			std::string value;
+			StringStream stringStream(&value);
+			stringStream.WriteFileRegion(*this->fileRegion);
+			return value;
+		}
+
 		std::string byteArrayStr;
 		for (int i = 0; i < (signed)this->byteArray->GetCount(); i++)
 			byteArrayStr += (*this->byteArray)[i];
@@ -646,6 +845,7 @@ namespace Yarc
 
 	bool BlobStringData::SetValue(const std::string& givenValue)
 	{
+		this->ReleaseReferencedData();
 		this->byteArray->SetCount((uint32_t)givenValue.length());
 		for (int i = 0; i < (signed)givenValue.length(); i++)
 			(*this->byteArray)[i] = givenValue[i];
@@ -655,6 +855,7 @@ namespace Yarc
 
 	bool BlobStringData::SetValue(const char* givenValue)
 	{
+		this->ReleaseReferencedData();
 		this->byteArray->SetCount((uint32_t)::strlen(givenValue));
 		for (int i = 0; givenValue[i] != '\0'; i++)
 			(*this->byteArray)[i] = givenValue[i];
@@ -795,6 +996,10 @@ namespace Yarc
 	{
 	}
 
+	SimpleErrorData::SimpleErrorData(const std::string& givenValue) : SimpleStringData(givenValue)
+	{
+	}
+
 	/*virtual*/ SimpleErrorData::~SimpleErrorData()
 	{
 	}
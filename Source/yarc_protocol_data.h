@@ -2,6 +2,7 @@
 
 #include "yarc_dynamic_array.h"
 #include "yarc_byte_stream.h"
+#include "yarc_shared_buffer.h"
 #include "yarc_linked_list.h"
 #include <stdint.h>
 #include <string>
@@ -17,15 +18,32 @@ namespace Yarc
 		virtual ~ProtocolData();
 
 		static std::string FindCommandKey(const ProtocolData* commandData);
+
+		// Is this EVAL, EVALSHA, FCALL, or one of their read-only forms?  These don't give their first key first.
+		static bool IsScriptCommand(const std::string& commandName);
+
+		// Is this command name (as it came in a command) the given one?  Case is ignored, but the given name must be in upper case.
+		static bool IsCommandName(const DynamicArray<uint8_t>& byteArray, const char* commandName);
+
 		static uint16_t CalcCommandHashSlot(const ProtocolData* commandData);
 		static uint16_t CalcKeyHashSlot(const std::string& keyStr);
 
+		// This is roughly how much memory the given command occupies, arguments and all.
+		static uint32_t CalcCommandSize(const ProtocolData* commandData);
+
 		static ProtocolData* ParseCommand(const char* commandFormat, ...);
 		static void Destroy(ProtocolData* protocolData);
 
 		static bool ParseTree(ByteStream* byteStream, ProtocolData*& protocolData);
 		static bool PrintTree(ByteStream* byteStream, const ProtocolData* protocolData);
 
+		// Make a deep copy of the given data by printing it out and parsing it back in.  Null is returned on failure.
+		static ProtocolData* Clone(const ProtocolData* protocolData);
+
+		// This is for handing a copy of a reply to another callback.  A callback can't be given null in place of
+		// a reply, so if the copy fails, it's given an error reply instead.  Null is only returned for null.
+		static ProtocolData* CloneReply(const ProtocolData* replyData);
+
 		virtual bool Parse(ByteStream* byteStream) = 0;
 		virtual bool Print(ByteStream* byteStream) const = 0;
 
@@ -106,6 +124,20 @@ namespace Yarc
 		bool GetToBuffer(uint8_t* buffer, uint32_t& bufferSize) const;
 		bool SetFromBuffer(const uint8_t* buffer, uint32_t bufferSize);
 
+		// Rather than copy a big value in, refer to it where it is, taking a reference to the given buffer.  It then
+		// goes from there to the socket without being copied along the way (see SimpleClient::SetZeroCopyThreshold()).
+		bool SetFromSharedBuffer(SharedBuffer* givenSharedBuffer);
+		SharedBuffer* GetSharedBuffer(void) const { return this->sharedBuffer; }
+
+		// Or refer to a stretch of an open file, which is sent from there (with sendfile() or splice(), where
+		// possible) without ever being read in.  Unless we're given the file, it has to stay open until the
+		// response comes back.  Note that the value isn't read until it's sent, so the file shouldn't change.
+		bool SetFromFile(int fileDescriptor, uint64_t offset, uint32_t length, bool ownsFile = false);
+		const FileRegion* GetFileRegion(void) const { return this->fileRegion; }
+
+		// Note that the byte array is left empty while we refer to a shared buffer or file.  This works either way.
+		uint32_t GetSize(void) const;
+
 		DynamicArray<uint8_t>& GetByteArray(void);
 		const DynamicArray<uint8_t>& GetByteArray(void) const;
 
@@ -115,7 +147,11 @@ namespace Yarc
 
 		bool ParseByteArrayData(ByteStream* byteStream, uint32_t count);
 
+		void ReleaseReferencedData(void);
+
 		DynamicArray<uint8_t>* byteArray;
+		SharedBuffer* sharedBuffer;
+		FileRegion* fileRegion;
 
 		bool isNull;
 	};
@@ -198,6 +234,7 @@ namespace Yarc
 	public:
 
 		SimpleErrorData();
+		SimpleErrorData(const std::string& givenValue);
 		virtual ~SimpleErrorData();
 
 		static SimpleErrorData* Create();
@@ -371,6 +408,9 @@ namespace Yarc
 		const ProtocolData* GetElement(uint32_t i) const;
 		bool SetElement(uint32_t i, ProtocolData* protocolData);
 
+		// The caller takes ownership of the element, which leaves a null in its place.
+		ProtocolData* TakeElement(uint32_t i);
+
 		virtual bool IsNull(void) const override { return this->isNull; }
 
 	protected:
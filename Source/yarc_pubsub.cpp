@@ -49,7 +49,7 @@ namespace Yarc
 
 	bool PubSub::Subscribe(const std::string& channel, ClientInterface::Callback callback)
 	{
-		return this->Subscribe(channel.c_str(), callback);
+		return this->Subscribe(channel.c_str(), std::move(callback));
 	}
 
 	bool PubSub::Subscribe(const char* channel, ClientInterface::Callback callback)
@@ -59,9 +59,9 @@ namespace Yarc
 			this->subscriptionMap->erase(iter);
 
 		SubscriptionData subData;
-		subData.callback = callback;
+		subData.callback = std::move(callback);
 		subData.subscribed = false;
-		this->subscriptionMap->insert(std::pair<std::string, SubscriptionData>(channel, subData));
+		this->subscriptionMap->insert(std::pair<std::string, SubscriptionData>(channel, std::move(subData)));
 		return true;
 	}
 
@@ -97,7 +97,7 @@ namespace Yarc
 		commandData->SetElement(0, new BlobStringData("PUBLISH"));
 		commandData->SetElement(1, new BlobStringData(channel));
 		commandData->SetElement(2, publishData);
-		return this->outputClient->MakeRequestAsync(commandData);
+		return this->outputClient->MakeRequestAsync(commandData) != 0;
 	}
 
 	bool PubSub::Publish(const std::string& channel, const uint8_t* buffer, uint32_t bufferSize)
@@ -141,7 +141,7 @@ namespace Yarc
 					SubscriptionMap::iterator iter = this->subscriptionMap->find(channel);
 					if (iter != this->subscriptionMap->end())
 					{
-						ClientInterface::Callback callback = iter->second.callback;
+						ClientInterface::Callback& callback = iter->second.callback;
 						deleteData = callback(messageData);
 					}
 				}
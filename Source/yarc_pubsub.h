@@ -18,6 +18,7 @@ namespace Yarc
 		static PubSub* Create(void);
 		static void Destroy(PubSub* pubSub);
 
+		// The given string may be an IP address or of the form "unix:/path/to/redis.sock".
 		void SetAddress(const Address& address);
 		void SetAddress(const char* address);
 
@@ -33,7 +33,7 @@ namespace Yarc
 
 			if (result == RESULT_DELETE)
 			{
-				delete object;
+				object->Release();
 				reductionObjectList->Remove(node);
 			}
 
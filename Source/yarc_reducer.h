@@ -25,6 +25,9 @@ namespace Yarc
 
 		virtual ReductionResult Reduce(void* userData) = 0;
 
+		// Objects that don't come from the heap can override this to go back where they came from.
+		virtual void Release(void) { delete this; }
+
 		static void ReduceList(ReductionObjectList* reductionObjectList, void* userData = nullptr);
 	};
 }
\ No newline at end of file
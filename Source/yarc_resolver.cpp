@@ -0,0 +1,220 @@
+#include "yarc_resolver.h"
+#include "yarc_misc.h"
+#include <string.h>
+#if defined __WINDOWS__
+#	include <WS2tcpip.h>
+#elif defined __LINUX__
+#	include <sys/types.h>
+#	include <sys/socket.h>
+#	include <netdb.h>
+#endif
+
+namespace Yarc
+{
+	static Resolver theResolver;
+
+	/*static*/ Resolver* Resolver::Get()
+	{
+		return &theResolver;
+	}
+
+	Resolver::Resolver() : refreshSemaphore(INT32_MAX)
+	{
+		this->entryMap = new EntryMap;
+		this->refreshList = new LinkedList<std::string>();
+		this->thread = nullptr;
+		this->threadExitSignal = false;
+		this->timeToLiveSeconds = 30.0;
+		this->negativeTimeToLiveSeconds = 5.0;
+
+#if defined __WINDOWS__
+		WSADATA data;
+		::WSAStartup(MAKEWORD(2, 2), &data);
+#endif
+	}
+
+	/*virtual*/ Resolver::~Resolver()
+	{
+		if (this->thread)
+		{
+			this->threadExitSignal = true;
+			this->refreshSemaphore.Increment();
+			this->thread->WaitForThreadExit();
+			delete this->thread;
+		}
+
+		this->Clear();
+
+		delete this->entryMap;
+		delete this->refreshList;
+
+#if defined __WINDOWS__
+		::WSACleanup();
+#endif
+	}
+
+	bool Resolver::Resolve(const char* hostname, char* ipAddress, uint32_t ipAddressSize)
+	{
+		double currentTime = GetMonotonicTimeSeconds();
+
+		{
+			MutexLocker locker(this->mutex);
+
+			EntryMap::iterator iter = this->entryMap->find(hostname);
+			if (iter != this->entryMap->end())
+			{
+				Entry* entry = iter->second;
+
+				// A good result that's gone stale is still better than making the caller wait.
+				if (entry->resolved && currentTime >= entry->expirationTime && !entry->refreshing)
+				{
+					entry->refreshing = true;
+					this->Refresh(hostname);
+				}
+
+				if (entry->resolved || currentTime < entry->expirationTime)
+				{
+					if (!entry->resolved || entry->ipAddress.length() >= ipAddressSize)
+						return false;
+
+					::strcpy(ipAddress, entry->ipAddress.c_str());
+					return true;
+				}
+			}
+		}
+
+		// We've never seen this one before (or it failed last time), so we have no choice but to wait on it.
+		// Note that we don't hold the lock while we do, so a few threads may look up the same new name at once.
+		std::string newIPAddress;
+		bool resolved = Lookup(hostname, newIPAddress);
+
+		{
+			MutexLocker locker(this->mutex);
+
+			Entry* entry = nullptr;
+			EntryMap::iterator iter = this->entryMap->find(hostname);
+			if (iter != this->entryMap->end())
+				entry = iter->second;
+			else
+			{
+				entry = new Entry;
+				entry->refreshing = false;
+				this->entryMap->insert(std::pair<std::string, Entry*>(hostname, entry));
+			}
+
+			entry->ipAddress = newIPAddress;
+			entry->resolved = resolved;
+			entry->expirationTime = currentTime + (resolved ? this->timeToLiveSeconds : this->negativeTimeToLiveSeconds);
+		}
+
+		if (!resolved || newIPAddress.length() >= ipAddressSize)
+			return false;
+
+		::strcpy(ipAddress, newIPAddress.c_str());
+		return true;
+	}
+
+	void Resolver::Clear(void)
+	{
+		MutexLocker locker(this->mutex);
+
+		for (EntryMap::iterator iter = this->entryMap->begin(); iter != this->entryMap->end(); iter++)
+			delete iter->second;
+
+		this->entryMap->clear();
+	}
+
+	/*static*/ bool Resolver::Lookup(const char* hostname, std::string& ipAddress)
+	{
+		struct addrinfo hints;
+		::memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_flags = AI_ADDRCONFIG;
+
+		struct addrinfo* addrInfoList = nullptr;
+		if (0 != ::getaddrinfo(hostname, nullptr, &hints, &addrInfoList))
+			return false;
+
+		// The system resolver has already sorted the results in order of preference, so we take the first we can use.
+		bool resolved = false;
+		for (struct addrinfo* addrInfo = addrInfoList; addrInfo && !resolved; addrInfo = addrInfo->ai_next)
+		{
+			if (addrInfo->ai_family != AF_INET && addrInfo->ai_family != AF_INET6)
+				continue;
+
+			char buffer[NI_MAXHOST];
+			if (0 == ::getnameinfo(addrInfo->ai_addr, (socklen_t)addrInfo->ai_addrlen, buffer, sizeof(buffer), nullptr, 0, NI_NUMERICHOST))
+			{
+				ipAddress = buffer;
+				resolved = true;
+			}
+		}
+
+		::freeaddrinfo(addrInfoList);
+		return resolved;
+	}
+
+	// The caller must have the lock.
+	void Resolver::Refresh(const std::string& hostname)
+	{
+		this->refreshList->AddTail(hostname);
+		this->refreshSemaphore.Increment();
+
+		if (!this->thread)
+		{
+			Thread::Options threadOptions;
+			threadOptions.name = "yarc-resolver";
+
+			this->thread = new Thread();
+			if (!this->thread->SpawnThread([this]() { this->ThreadFunc(); }, &threadOptions))
+			{
+				delete this->thread;
+				this->thread = nullptr;
+			}
+		}
+	}
+
+	void Resolver::ThreadFunc(void)
+	{
+		while (true)
+		{
+			this->refreshSemaphore.Decrement(-1.0);
+			if (this->threadExitSignal)
+				break;
+
+			std::string hostname;
+
+			{
+				MutexLocker locker(this->mutex);
+				if (this->refreshList->GetCount() == 0)
+					continue;
+
+				hostname = this->refreshList->GetHead()->value;
+				this->refreshList->Remove(this->refreshList->GetHead());
+			}
+
+			std::string newIPAddress;
+			bool resolved = Lookup(hostname.c_str(), newIPAddress);
+			double currentTime = GetMonotonicTimeSeconds();
+
+			MutexLocker locker(this->mutex);
+
+			// The entry may have been cleared out from under us, in which case there's nothing to update.
+			EntryMap::iterator iter = this->entryMap->find(hostname);
+			if (iter == this->entryMap->end())
+				continue;
+
+			// If the lookup fails, we keep using the last good result, and try again a little later.
+			Entry* entry = iter->second;
+			entry->refreshing = false;
+			if (resolved)
+			{
+				entry->ipAddress = newIPAddress;
+				entry->expirationTime = currentTime + this->timeToLiveSeconds;
+			}
+			else
+				entry->expirationTime = currentTime + this->negativeTimeToLiveSeconds;
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "yarc_api.h"
+#include "yarc_mutex.h"
+#include "yarc_semaphore.h"
+#include "yarc_thread.h"
+#include "yarc_linked_list.h"
+#include <stdint.h>
+#include <string>
+#include <map>
+
+namespace Yarc
+{
+	// This is a process-wide cache of hostname lookups, so that looking up an address on the request path
+	// doesn't mean a trip to a DNS server.  The system resolver doesn't tell us the real time-to-live of a
+	// record, so we use our own.  Once a result expires, it's still used while a background thread looks it
+	// up again, so only the very first lookup of a hostname ever waits on DNS.  Failed lookups are cached
+	// too, but for less time, and are retried in the foreground when they expire.  Results may be IPv4 or
+	// IPv6, whichever the system resolver prefers.
+	class YARC_API Resolver
+	{
+	public:
+
+		Resolver();
+		virtual ~Resolver();
+
+		static Resolver* Get();
+
+		// Write the numeric form of the given host's address into the given buffer.  False is returned if it
+		// couldn't be resolved, in which case the buffer is left alone.  This may be called from any thread.
+		bool Resolve(const char* hostname, char* ipAddress, uint32_t ipAddressSize);
+
+		void SetTimeToLiveSeconds(double givenTimeToLiveSeconds) { this->timeToLiveSeconds = givenTimeToLiveSeconds; }
+		double GetTimeToLiveSeconds(void) const { return this->timeToLiveSeconds; }
+
+		void SetNegativeTimeToLiveSeconds(double givenNegativeTimeToLiveSeconds) { this->negativeTimeToLiveSeconds = givenNegativeTimeToLiveSeconds; }
+		double GetNegativeTimeToLiveSeconds(void) const { return this->negativeTimeToLiveSeconds; }
+
+		// Forget everything, so that every hostname is looked up again the next time it's needed.
+		void Clear(void);
+
+	private:
+
+		struct Entry
+		{
+			std::string ipAddress;
+			bool resolved;
+			bool refreshing;
+			double expirationTime;
+		};
+
+		typedef std::map<std::string, Entry*> EntryMap;
+
+		static bool Lookup(const char* hostname, std::string& ipAddress);
+		void Refresh(const std::string& hostname);
+		void ThreadFunc(void);
+
+		Mutex mutex;
+		EntryMap* entryMap;
+		LinkedList<std::string>* refreshList;
+		Semaphore refreshSemaphore;
+		Thread* thread;
+		volatile bool threadExitSignal;
+		double timeToLiveSeconds;
+		double negativeTimeToLiveSeconds;
+	};
+}
\ No newline at end of file
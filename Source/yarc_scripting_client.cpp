@@ -0,0 +1,536 @@
+#include "yarc_scripting_client.h"
+#include "yarc_protocol_data.h"
+#include "yarc_sha1.h"
+#include <ctype.h>
+
+namespace Yarc
+{
+	ScriptingClient::ScriptingClient(ClientInterface* givenClient) : WrappingClient(givenClient)
+	{
+		this->clusterClient = nullptr;
+		this->entrySlab = new EntrySlab();
+		this->scriptMap = new ScriptMap();
+		this->bodyMap = new ScriptMap();
+		this->libraryMap = new ScriptMap();
+		this->numEvalsRewritten = 0;
+		this->numScriptsReloaded = 0;
+		this->numLibrariesReloaded = 0;
+	}
+
+	ScriptingClient::ScriptingClient(ClusterClient* givenClusterClient) : ScriptingClient((ClientInterface*)givenClusterClient)
+	{
+		// Nodes we find from here on get everything we know about before they're given any of our requests.
+		this->clusterClient = givenClusterClient;
+		this->clusterClient->SetNodeAddedCallback([this](ClientInterface* nodeClient) {
+			this->LoadEverything(nodeClient);
+		});
+	}
+
+	/*virtual*/ ScriptingClient::~ScriptingClient()
+	{
+		// Every entry is held by the callback of a request or load the client still has, so they all go with it.
+		delete this->client;
+
+		delete this->scriptMap;
+		delete this->bodyMap;
+		delete this->libraryMap;
+		delete this->entrySlab;
+	}
+
+	/*static*/ ScriptingClient* ScriptingClient::Create(ClientInterface* givenClient)
+	{
+		return new ScriptingClient(givenClient);
+	}
+
+	/*static*/ ScriptingClient* ScriptingClient::Create(ClusterClient* givenClusterClient)
+	{
+		return new ScriptingClient(givenClusterClient);
+	}
+
+	/*static*/ void ScriptingClient::Destroy(ScriptingClient* client)
+	{
+		delete client;
+	}
+
+	ScriptingClient::Entry::Entry(Callback givenCallback, ScriptingClient* givenScriptingClient) : WrappingClient::Entry(std::move(givenCallback), givenScriptingClient)
+	{
+		this->requestData = nullptr;
+		this->refCount = 1;
+		this->numLoadsPending = 0;
+		this->ownsRequestData = false;
+		this->retried = false;
+	}
+
+	ScriptingClient::Entry::~Entry()
+	{
+		if (this->ownsRequestData)
+			delete this->requestData;
+	}
+
+	ScriptingClient::EntryRef ScriptingClient::AllocEntry(Callback callback)
+	{
+		MutexLocker locker(this->entryMutex);
+		return EntryRef(this->entrySlab->Allocate(std::move(callback), this));
+	}
+
+	ScriptingClient::EntryRef ScriptingClient::AddRef(Entry* entry)
+	{
+		entry->refCount++;
+		return EntryRef(entry);
+	}
+
+	void ScriptingClient::ReleaseEntry(Entry* entry)
+	{
+		if (entry->refCount.fetch_sub(1) == 1)
+			this->FreeEntry(entry);
+	}
+
+	/*virtual*/ WrappingClient::Entry* ScriptingClient::LookupEntry(RequestHandle requestHandle)
+	{
+		return this->entrySlab->Lookup(requestHandle);
+	}
+
+	// The entry deletes its request if it's ours, which is only settled under the entry mutex (see MakeRequestAsync()).
+	/*virtual*/ void ScriptingClient::DeallocateEntry(WrappingClient::Entry* entry)
+	{
+		this->entrySlab->Deallocate((Entry*)entry);
+	}
+
+	// Loads go to every node of a cluster, since we can't know which of them will be asked to run what.
+	void ScriptingClient::ForEachTargetClient(std::function<void(ClientInterface*)> targetCallback)
+	{
+		if (this->clusterClient)
+			this->clusterClient->ForEachNode(std::move(targetCallback));
+		else
+			targetCallback(this->client);
+	}
+
+	static ProtocolData* MakeScriptLoadCommand(const std::string& scriptBody)
+	{
+		ArrayData* commandArrayData = new ArrayData();
+		commandArrayData->SetCount(3);
+		commandArrayData->SetElement(0, new BlobStringData("SCRIPT"));
+		commandArrayData->SetElement(1, new BlobStringData("LOAD"));
+		commandArrayData->SetElement(2, new BlobStringData(scriptBody));
+		return commandArrayData;
+	}
+
+	static ProtocolData* MakeFunctionLoadCommand(const std::string& libraryCode)
+	{
+		ArrayData* commandArrayData = new ArrayData();
+		commandArrayData->SetCount(4);
+		commandArrayData->SetElement(0, new BlobStringData("FUNCTION"));
+		commandArrayData->SetElement(1, new BlobStringData("LOAD"));
+		commandArrayData->SetElement(2, new BlobStringData("REPLACE"));
+		commandArrayData->SetElement(3, new BlobStringData(libraryCode));
+		return commandArrayData;
+	}
+
+	// Plain arguments are copied directly, since they're what just about every call is made of.  Clone() does the rest.
+	static ProtocolData* CopyArgument(const ProtocolData* argData)
+	{
+		const BlobStringData* argStringData = Cast<BlobStringData>(argData);
+		if (!argStringData || argStringData->GetFileRegion() || argStringData->GetSharedBuffer())
+			return ProtocolData::Clone(argData);
+
+		const DynamicArray<uint8_t>& byteArray = argStringData->GetByteArray();
+		return new BlobStringData(byteArray.GetBuffer(), byteArray.GetCount());
+	}
+
+	static std::string GetErrorText(const ProtocolData* responseData)
+	{
+		const SimpleErrorData* simpleErrorData = Cast<SimpleErrorData>(responseData);
+		if (simpleErrorData)
+			return simpleErrorData->GetValue();
+
+		const BlobErrorData* blobErrorData = Cast<BlobErrorData>(responseData);
+		if (blobErrorData)
+			return blobErrorData->GetValue();
+
+		return "";
+	}
+
+	// This is the only part of the command name we need, so there's no point in making a string of it.
+	static bool IsScriptRequest(const ProtocolData* requestData)
+	{
+		const ArrayData* commandArrayData = Cast<ArrayData>(requestData);
+		if (!commandArrayData || commandArrayData->GetCount() < 2)
+			return false;
+
+		const BlobStringData* nameStringData = Cast<BlobStringData>(commandArrayData->GetElement(0));
+		if (!nameStringData || nameStringData->GetByteArray().GetCount() == 0)
+			return false;
+
+		uint8_t firstChar = toupper(nameStringData->GetByteArray()[0]);
+		return (firstChar == 'E' || firstChar == 'F') && ProtocolData::IsScriptCommand(nameStringData->GetValue());
+	}
+
+	std::string ScriptingClient::RegisterScript(const std::string& scriptBody)
+	{
+		std::string sha;
+
+		{
+			MutexLocker locker(this->registryMutex);
+			ScriptMap::iterator iter = this->bodyMap->find(scriptBody);
+			if (iter != this->bodyMap->end())
+				return iter->second;
+
+			sha = Sha1Hex(scriptBody.c_str(), scriptBody.length());
+			(*this->bodyMap)[scriptBody] = sha;
+			(*this->scriptMap)[sha] = scriptBody;
+		}
+
+		this->ForEachTargetClient([&scriptBody](ClientInterface* targetClient) {
+			ProtocolData* commandData = MakeScriptLoadCommand(scriptBody);
+			if (0 == targetClient->MakeRequestAsync(commandData))
+				delete commandData;
+		});
+
+		return sha;
+	}
+
+	bool ScriptingClient::RegisterLibrary(const std::string& libraryCode)
+	{
+		// The first line looks like "#!lua name=mylib", and may go on to give other options after the name.
+		std::string firstLine = libraryCode.substr(0, libraryCode.find('\n'));
+		if (firstLine.compare(0, 2, "#!") != 0)
+			return false;
+
+		size_t i = firstLine.find("name=");
+		if (i == std::string::npos)
+			return false;
+
+		i += 5;
+		size_t j = firstLine.find_first_of(" \t\r", i);
+		std::string libraryName = firstLine.substr(i, j == std::string::npos ? std::string::npos : j - i);
+		if (libraryName.length() == 0)
+			return false;
+
+		{
+			MutexLocker locker(this->registryMutex);
+			(*this->libraryMap)[libraryName] = libraryCode;
+		}
+
+		this->ForEachTargetClient([&libraryCode](ClientInterface* targetClient) {
+			ProtocolData* commandData = MakeFunctionLoadCommand(libraryCode);
+			if (0 == targetClient->MakeRequestAsync(commandData))
+				delete commandData;
+		});
+
+		return true;
+	}
+
+	void ScriptingClient::LoadEverything(ClientInterface* targetClient)
+	{
+		DynamicArray<ProtocolData*> loadCommandArray;
+
+		{
+			MutexLocker locker(this->registryMutex);
+
+			loadCommandArray.SetCount((uint32_t)(this->scriptMap->size() + this->libraryMap->size()));
+			uint32_t i = 0;
+
+			for (const auto& pair : *this->scriptMap)
+				loadCommandArray[i++] = MakeScriptLoadCommand(pair.second);
+
+			for (const auto& pair : *this->libraryMap)
+				loadCommandArray[i++] = MakeFunctionLoadCommand(pair.second);
+		}
+
+		for (uint32_t i = 0; i < loadCommandArray.GetCount(); i++)
+			if (0 == targetClient->MakeRequestAsync(loadCommandArray[i]))
+				delete loadCommandArray[i];
+	}
+
+	// An EVAL of a script we already know goes out as an EVALSHA.  The first EVAL of a script goes out as it is,
+	// which loads the script on the server, and we just remember the script for next time.
+	ProtocolData* ScriptingClient::RewriteEval(const ProtocolData* requestData)
+	{
+		const ArrayData* commandArrayData = Cast<ArrayData>(requestData);
+		if (!commandArrayData || commandArrayData->GetCount() < 3)
+			return nullptr;
+
+		// A body given to us without a copy (in a shared buffer or a file) is left alone, since its caller clearly wants it sent as it is.
+		const BlobStringData* nameStringData = Cast<BlobStringData>(commandArrayData->GetElement(0));
+		const BlobStringData* bodyStringData = Cast<BlobStringData>(commandArrayData->GetElement(1));
+		if (!nameStringData || !bodyStringData || bodyStringData->GetFileRegion() || bodyStringData->GetSharedBuffer())
+			return nullptr;
+
+		bool readOnly = false;
+		if (ProtocolData::IsCommandName(nameStringData->GetByteArray(), "EVAL_RO"))
+			readOnly = true;
+		else if (!ProtocolData::IsCommandName(nameStringData->GetByteArray(), "EVAL"))
+			return nullptr;
+
+		const DynamicArray<uint8_t>& bodyByteArray = bodyStringData->GetByteArray();
+		std::string scriptBody((const char*)bodyByteArray.GetBuffer(), bodyByteArray.GetCount());
+		std::string sha;
+
+		{
+			MutexLocker locker(this->registryMutex);
+			ScriptMap::iterator iter = this->bodyMap->find(scriptBody);
+			if (iter == this->bodyMap->end())
+			{
+				sha = Sha1Hex(scriptBody.c_str(), scriptBody.length());
+				(*this->bodyMap)[scriptBody] = sha;
+				(*this->scriptMap)[sha] = scriptBody;
+				return nullptr;
+			}
+
+			sha = iter->second;
+		}
+
+		ArrayData* evalShaArrayData = new ArrayData();
+		evalShaArrayData->SetCount(commandArrayData->GetCount());
+		evalShaArrayData->SetElement(0, new BlobStringData(readOnly ? "EVALSHA_RO" : "EVALSHA"));
+		evalShaArrayData->SetElement(1, new BlobStringData(sha));
+		for (uint32_t i = 2; i < commandArrayData->GetCount(); i++)
+			evalShaArrayData->SetElement(i, CopyArgument(commandArrayData->GetElement(i)));
+
+		this->numEvalsRewritten++;
+		return evalShaArrayData;
+	}
+
+	// Given the error a script command came back with, make whatever commands would load what it was missing.
+	bool ScriptingClient::MakeLoadCommands(const ProtocolData* commandData, const ProtocolData* errorData, DynamicArray<ProtocolData*>& loadCommandArray)
+	{
+		std::string errorText = GetErrorText(errorData);
+
+		if (errorText.compare(0, 8, "NOSCRIPT") == 0)
+		{
+			const ArrayData* commandArrayData = Cast<ArrayData>(commandData);
+			const BlobStringData* shaStringData = commandArrayData ? Cast<BlobStringData>(commandArrayData->GetElement(1)) : nullptr;
+			if (!shaStringData)
+				return false;
+
+			std::string sha = shaStringData->GetValue();
+			for (char& ch : sha)
+				ch = ::tolower(ch);
+
+			MutexLocker locker(this->registryMutex);
+			ScriptMap::iterator iter = this->scriptMap->find(sha);
+			if (iter == this->scriptMap->end())
+				return false;
+
+			loadCommandArray.SetCount(1);
+			loadCommandArray[0] = MakeScriptLoadCommand(iter->second);
+			this->numScriptsReloaded++;
+			return true;
+		}
+
+		// We can't tell which library the function belongs to, so we load them all.
+		if (errorText.find("Function not found") != std::string::npos)
+		{
+			MutexLocker locker(this->registryMutex);
+			if (this->libraryMap->size() == 0)
+				return false;
+
+			loadCommandArray.SetCount((uint32_t)this->libraryMap->size());
+			uint32_t i = 0;
+			for (const auto& pair : *this->libraryMap)
+				loadCommandArray[i++] = MakeFunctionLoadCommand(pair.second);
+
+			this->numLibrariesReloaded += this->libraryMap->size();
+			return true;
+		}
+
+		return false;
+	}
+
+	/*virtual*/ ScriptingClient::RequestHandle ScriptingClient::MakeRequestAsync(const ProtocolData* requestData, Callback callback /*= [](const ProtocolData*) -> bool { return true; }*/, bool deleteData /*= true*/)
+	{
+		this->PrepareClient();
+
+		// Anything other than a script or function call can never be made again, so we don't need to keep it.
+		if (!IsScriptRequest(requestData))
+			return this->SendRequest(this->AllocEntry(std::move(callback)), requestData, deleteData);
+
+		ProtocolData* evalShaData = this->RewriteEval(requestData);
+
+		EntryRef entryRef = this->AllocEntry(std::move(callback));
+		Entry* entry = entryRef.get();
+		entry->requestData = evalShaData ? evalShaData : requestData;
+		entry->ownsRequestData = evalShaData != nullptr;
+
+		// If the client refuses the request, the entry goes with the callback, and the caller keeps the request.
+		RequestHandle requestHandle = this->SendRequest(std::move(entryRef), entry->requestData, false);
+		if (requestHandle == 0 || !deleteData)
+			return requestHandle;
+
+		if (evalShaData)
+		{
+			delete requestData;
+			return requestHandle;
+		}
+
+		// The request is ours now, but it may have already been answered (on another thread), in which case it's no longer needed.
+		bool entryFound = false;
+
+		{
+			MutexLocker locker(this->entryMutex);
+			Entry* foundEntry = this->entrySlab->Lookup(requestHandle);
+			if (foundEntry)
+			{
+				foundEntry->ownsRequestData = true;
+				entryFound = true;
+			}
+		}
+
+		if (!entryFound)
+			delete requestData;
+
+		return requestHandle;
+	}
+
+	ScriptingClient::RequestHandle ScriptingClient::SendRequest(EntryRef entryRef, const ProtocolData* requestData, bool deleteData)
+	{
+		Entry* entry = entryRef.get();
+		RequestHandle requestHandle = this->entrySlab->GetHandle(entry);
+
+		RequestHandle clientHandle = this->client->MakeRequestAsync(requestData, [this, entryRef = std::move(entryRef)](const ProtocolData* responseData) mutable -> bool {
+			return this->HandleReply(entryRef, responseData);
+		}, deleteData);
+
+		if (clientHandle == 0)
+			return 0;
+
+		this->SetClientHandle(requestHandle, clientHandle);
+		return requestHandle;
+	}
+
+	bool ScriptingClient::HandleReply(EntryRef& entryRef, const ProtocolData* responseData)
+	{
+		Entry* entry = entryRef.get();
+
+		// Only one more try is made, so that a script that can't be loaded (a syntax error, say) can't go around forever.
+		if (entry->requestData && !entry->retried && responseData && responseData->IsError())
+		{
+			bool canceled = false;
+
+			{
+				MutexLocker locker(this->entryMutex);
+				canceled = entry->canceled;
+			}
+
+			DynamicArray<ProtocolData*> loadCommandArray;
+			if (!canceled && this->MakeLoadCommands(entry->requestData, responseData, loadCommandArray))
+			{
+				this->ReloadAndRetry(entryRef, loadCommandArray);
+				return true;
+			}
+		}
+
+		Callback callback = this->TakeCallback(entry);
+		return callback ? callback(responseData) : true;
+	}
+
+	// Each load holds a reference to the entry, as does the failed request until we're done here, and whichever
+	// of them lets go last makes the request again.  That way, the request can't get ahead of any of the loads.
+	void ScriptingClient::ReloadAndRetry(EntryRef& entryRef, DynamicArray<ProtocolData*>& loadCommandArray)
+	{
+		Entry* entry = entryRef.get();
+		entry->retried = true;
+
+		{
+			MutexLocker locker(this->entryMutex);
+			entry->clientHandle = 0;
+		}
+
+		DynamicArray<ClientInterface*> targetClientArray;
+		this->ForEachTargetClient([&targetClientArray](ClientInterface* targetClient) {
+			uint32_t i = targetClientArray.GetCount();
+			targetClientArray.SetCount(i + 1);
+			targetClientArray[i] = targetClient;
+		});
+
+		entry->numLoadsPending = targetClientArray.GetCount() * loadCommandArray.GetCount() + 1;
+
+		for (uint32_t i = 0; i < targetClientArray.GetCount(); i++)
+		{
+			for (uint32_t j = 0; j < loadCommandArray.GetCount(); j++)
+			{
+				ProtocolData* commandData = ProtocolData::Clone(loadCommandArray[j]);
+				if (0 == targetClientArray[i]->MakeRequestAsync(commandData, [this, loadRef = this->AddRef(entry)](const ProtocolData*) mutable -> bool {
+					this->FinishLoad(loadRef);
+					return true;
+				}))
+				{
+					// A refused load is as good as done.  We'll find out soon enough if it was needed.
+					delete commandData;
+					entry->numLoadsPending--;
+				}
+			}
+		}
+
+		for (uint32_t i = 0; i < loadCommandArray.GetCount(); i++)
+			delete loadCommandArray[i];
+
+		this->FinishLoad(entryRef);
+	}
+
+	void ScriptingClient::FinishLoad(EntryRef& entryRef)
+	{
+		Entry* entry = entryRef.get();
+		if (entry->numLoadsPending.fetch_sub(1) != 1)
+			return;
+
+		{
+			MutexLocker locker(this->entryMutex);
+			if (entry->canceled)
+				return;
+		}
+
+		// We hang on to the entry in case the client refuses the request, since the caller still has to be answered.
+		EntryRef keepRef = this->AddRef(entry);
+		if (0 == this->SendRequest(std::move(entryRef), entry->requestData, false))
+		{
+			Callback callback = this->TakeCallback(entry);
+			if (callback)
+			{
+				ProtocolData* errorData = new SimpleErrorData("ERR yarc: request refused");
+				if (callback(errorData))
+					delete errorData;
+			}
+		}
+	}
+
+	/*virtual*/ bool ScriptingClient::MakeRequestSync(const ProtocolData* requestData, ProtocolData*& responseData, bool deleteData /*= true*/, double timeoutSeconds /*= 5.0*/)
+	{
+		ClientInterface* client = this->PrepareClient();
+
+		if (!IsScriptRequest(requestData))
+			return client->MakeRequestSync(requestData, responseData, deleteData, timeoutSeconds);
+
+		ProtocolData* evalShaData = this->RewriteEval(requestData);
+		const ProtocolData* commandData = evalShaData ? evalShaData : requestData;
+
+		bool success = client->MakeRequestSync(commandData, responseData, false, timeoutSeconds);
+
+		DynamicArray<ProtocolData*> loadCommandArray;
+		if (success && responseData && responseData->IsError() && this->MakeLoadCommands(commandData, responseData, loadCommandArray))
+		{
+			this->ForEachTargetClient([&loadCommandArray, timeoutSeconds](ClientInterface* targetClient) {
+				for (uint32_t i = 0; i < loadCommandArray.GetCount(); i++)
+				{
+					ProtocolData* loadResponseData = nullptr;
+					targetClient->MakeRequestSync(loadCommandArray[i], loadResponseData, false, timeoutSeconds);
+					delete loadResponseData;
+				}
+			});
+
+			for (uint32_t i = 0; i < loadCommandArray.GetCount(); i++)
+				delete loadCommandArray[i];
+
+			delete responseData;
+			responseData = nullptr;
+			success = client->MakeRequestSync(commandData, responseData, false, timeoutSeconds);
+		}
+
+		delete evalShaData;
+
+		if (deleteData)
+			delete requestData;
+
+		return success;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "yarc_api.h"
+#include "yarc_wrapping_client.h"
+#include "yarc_cluster_client.h"
+#include "yarc_dynamic_array.h"
+#include "yarc_mutex.h"
+#include "yarc_slab.h"
+#include <stdint.h>
+#include <string>
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+
+namespace Yarc
+{
+	// This sits in front of any other client and keeps a registry of Lua scripts and function libraries, so that their
+	// bodies don't have to go over the wire with every call.  An EVAL of a script we've seen before goes out as an EVALSHA
+	// of its SHA1 (worked out here, rather than asked of the server), and the first EVAL of a script registers it for
+	// next time.  If the server doesn't have a script (it was restarted, or SCRIPT FLUSH was called, or the key moved to
+	// another node), the NOSCRIPT error never reaches the caller: the script is loaded with SCRIPT LOAD and the call is
+	// made once more.  An FCALL that fails because its function isn't there is dealt with the same way, by loading every
+	// registered library with FUNCTION LOAD REPLACE before making the call once more.  When put in front of a cluster
+	// client, these loads go to every node, and scripts and libraries are also loaded on any node found later on, so
+	// that a change of topology doesn't cost each script a failed call per node.
+	//
+	// Scripts in a transaction or pipeline go out just as they are, since their replies come back to the caller all
+	// together, and there's no making just one of them again.  A request canceled while its script is being loaded is
+	// never made again.
+	//
+	// Scripts are loaded and calls made again from within the callbacks of the replies that asked for them, so in front
+	// of a cluster client, which has to be driven from a single thread, don't give us an executor.
+	class YARC_API ScriptingClient : public WrappingClient
+	{
+	public:
+
+		// Given a cluster client, we also need to know about its nodes, so that scripts can be loaded on all of them.
+		ScriptingClient(ClientInterface* givenClient);
+		ScriptingClient(ClusterClient* givenClusterClient);
+		virtual ~ScriptingClient();
+
+		// When used as a DLL, these ensure that the client is allocated and freed in the proper heap.
+		static ScriptingClient* Create(ClientInterface* givenClient);
+		static ScriptingClient* Create(ClusterClient* givenClusterClient);
+		static void Destroy(ScriptingClient* client);
+
+		virtual RequestHandle MakeRequestAsync(const ProtocolData* requestData, Callback callback = [](const ProtocolData*) -> bool { return true; }, bool deleteData = true) override;
+		virtual bool MakeRequestSync(const ProtocolData* requestData, ProtocolData*& responseData, bool deleteData = true, double timeoutSeconds = 5.0) override;
+
+		// Register a script up front, which also loads it on the server (or on every node of a cluster), and get back
+		// its SHA1 in hex, which can be given to EVALSHA directly.  Scripts given to EVAL are registered as they're seen,
+		// so this is optional.  Note that scripts built on the fly (rather than given their arguments) would each be
+		// registered and never let go of, but those are a bad idea with or without us.
+		std::string RegisterScript(const std::string& scriptBody);
+
+		// Register a function library, and load it, replacing any older version of it.  Its name is taken from its
+		// "#!lua name=<library>" line, and a library registered under a name we already have replaces the old one.
+		// This fails if the code has no such line.
+		bool RegisterLibrary(const std::string& libraryCode);
+
+		uint64_t GetNumEvalsRewritten(void) const { return this->numEvalsRewritten; }
+		uint64_t GetNumScriptsReloaded(void) const { return this->numScriptsReloaded; }
+		uint64_t GetNumLibrariesReloaded(void) const { return this->numLibrariesReloaded; }
+
+	private:
+
+		// Every request we're given gets one of these.  It keeps the command we sent, so that it can be sent again
+		// if the script (or function) it calls has to be loaded first.  While loads are under way, each of them holds
+		// a reference to it, and the last of them to get its reply sends it again.
+		struct Entry : public WrappingClient::Entry
+		{
+			Entry(Callback givenCallback, ScriptingClient* givenScriptingClient);
+			~Entry();
+
+			const ProtocolData* requestData;
+			std::atomic<uint32_t> refCount;
+			std::atomic<uint32_t> numLoadsPending;
+			bool ownsRequestData;
+			bool retried;
+		};
+
+		// Whoever holds one of these holds a reference to the entry, which is freed along with the last of them.
+		struct EntryReleaser
+		{
+			void operator()(Entry* entry) const { ((ScriptingClient*)entry->wrappingClient)->ReleaseEntry(entry); }
+		};
+
+		typedef std::unique_ptr<Entry, EntryReleaser> EntryRef;
+		typedef Slab<Entry> EntrySlab;
+		typedef std::unordered_map<std::string, std::string> ScriptMap;
+
+		virtual WrappingClient::Entry* LookupEntry(RequestHandle requestHandle) override;
+		virtual void DeallocateEntry(WrappingClient::Entry* entry) override;
+
+		void ForEachTargetClient(std::function<void(ClientInterface*)> targetCallback);
+		void LoadEverything(ClientInterface* targetClient);
+		ProtocolData* RewriteEval(const ProtocolData* requestData);
+		bool MakeLoadCommands(const ProtocolData* commandData, const ProtocolData* errorData, DynamicArray<ProtocolData*>& loadCommandArray);
+		RequestHandle SendRequest(EntryRef entryRef, const ProtocolData* requestData, bool deleteData);
+		bool HandleReply(EntryRef& entryRef, const ProtocolData* responseData);
+		void ReloadAndRetry(EntryRef& entryRef, DynamicArray<ProtocolData*>& loadCommandArray);
+		void FinishLoad(EntryRef& entryRef);
+		EntryRef AllocEntry(Callback callback);
+		EntryRef AddRef(Entry* entry);
+		void ReleaseEntry(Entry* entry);
+
+		ClusterClient* clusterClient;
+		EntrySlab* entrySlab;
+		ScriptMap* scriptMap;		// SHA1 to body.
+		ScriptMap* bodyMap;			// Body to SHA1, so we don't have to work it out every time.
+		ScriptMap* libraryMap;		// Name to code.
+		Mutex registryMutex;			// The counts below are bumped outside of this, so they're atomic.
+		std::atomic<uint64_t> numEvalsRewritten;
+		std::atomic<uint64_t> numScriptsReloaded;
+		std::atomic<uint64_t> numLibrariesReloaded;
+	};
+}
\ No newline at end of file
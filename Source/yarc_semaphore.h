@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdint.h>
 #if defined __WINDOWS__
 #	if !defined WIN32_LEAN_AND_MEAN
 #	   define WIN32_LEAN_AND_MEAN
@@ -7,6 +8,8 @@
 #   include <Windows.h>
 #elif defined __LINUX__
 #   include <pthread.h>
+#   include <time.h>
+#   include <errno.h>
 #endif
 
 namespace Yarc
@@ -19,7 +22,15 @@ namespace Yarc
 #if defined __WINDOWS__
 			this->semaphoreHandle = ::CreateSemaphore(NULL, 0, count, NULL);
 #elif defined __LINUX__
-			// TODO: Write this.
+			// Time-outs are measured against the monotonic clock so that they aren't thrown off by changes to the system time.
+			pthread_condattr_t condAttr;
+			pthread_condattr_init(&condAttr);
+			pthread_condattr_setclock(&condAttr, CLOCK_MONOTONIC);
+			pthread_cond_init(&this->cond, &condAttr);
+			pthread_condattr_destroy(&condAttr);
+			pthread_mutex_init(&this->mutex, NULL);
+			this->count = 0;
+			this->maxCount = count;
 #endif
 		}
 
@@ -27,6 +38,9 @@ namespace Yarc
 		{
 #if defined __WINDOWS__
 			::CloseHandle(this->semaphoreHandle);
+#elif defined __LINUX__
+			pthread_cond_destroy(&this->cond);
+			pthread_mutex_destroy(&this->mutex);
 #endif
 		}
 
@@ -34,6 +48,12 @@ namespace Yarc
 		{
 #if defined __WINDOWS__
 			::ReleaseSemaphore(this->semaphoreHandle, 1, NULL);
+#elif defined __LINUX__
+			pthread_mutex_lock(&this->mutex);
+			if (this->count < this->maxCount)
+				this->count++;
+			pthread_cond_signal(&this->cond);
+			pthread_mutex_unlock(&this->mutex);
 #endif
 		}
 
@@ -41,11 +61,49 @@ namespace Yarc
 		{
 #if defined __WINDOWS__
 			return WAIT_OBJECT_0 == ::WaitForSingleObject(this->semaphoreHandle, (timeoutMilliseconds >= 0.0f) ? (DWORD)timeoutMilliseconds : INFINITE);
+#elif defined __LINUX__
+			pthread_mutex_lock(&this->mutex);
+
+			if (this->count == 0 && timeoutMilliseconds != 0.0)
+			{
+				if (timeoutMilliseconds < 0.0)
+				{
+					while (this->count == 0)
+						pthread_cond_wait(&this->cond, &this->mutex);
+				}
+				else
+				{
+					timespec deadline;
+					clock_gettime(CLOCK_MONOTONIC, &deadline);
+					int64_t nanoseconds = int64_t(deadline.tv_nsec) + int64_t(timeoutMilliseconds * 1e6);
+					deadline.tv_sec += time_t(nanoseconds / 1000000000);
+					deadline.tv_nsec = long(nanoseconds % 1000000000);
+
+					while (this->count == 0)
+						if (pthread_cond_timedwait(&this->cond, &this->mutex, &deadline) == ETIMEDOUT)
+							break;
+				}
+			}
+
+			bool decremented = false;
+			if (this->count > 0)
+			{
+				this->count--;
+				decremented = true;
+			}
+
+			pthread_mutex_unlock(&this->mutex);
+			return decremented;
 #endif
 		}
 
 #if defined __WINDOWS__
 		HANDLE semaphoreHandle;
+#elif defined __LINUX__
+		pthread_mutex_t mutex;
+		pthread_cond_t cond;
+		int32_t count;
+		int32_t maxCount;
 #endif
 	};
 }
\ No newline at end of file
@@ -0,0 +1,114 @@
+#include "yarc_sha1.h"
+#include <string.h>
+
+namespace Yarc
+{
+	// SHA-1 as given in FIPS 180-4.  It's long since broken as a cryptographic hash, but we only use it as a name.
+
+	static inline uint32_t RotateLeft(uint32_t value, int bits)
+	{
+		return (value << bits) | (value >> (32 - bits));
+	}
+
+	static void ProcessBlock(uint32_t state[5], const uint8_t block[64])
+	{
+		uint32_t w[80];
+		for (int i = 0; i < 16; i++)
+			w[i] = (uint32_t(block[4 * i]) << 24) | (uint32_t(block[4 * i + 1]) << 16) | (uint32_t(block[4 * i + 2]) << 8) | uint32_t(block[4 * i + 3]);
+
+		for (int i = 16; i < 80; i++)
+			w[i] = RotateLeft(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+		uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+
+		for (int i = 0; i < 80; i++)
+		{
+			uint32_t f, k;
+			if (i < 20)
+			{
+				f = (b & c) | (~b & d);
+				k = 0x5a827999;
+			}
+			else if (i < 40)
+			{
+				f = b ^ c ^ d;
+				k = 0x6ed9eba1;
+			}
+			else if (i < 60)
+			{
+				f = (b & c) | (b & d) | (c & d);
+				k = 0x8f1bbcdc;
+			}
+			else
+			{
+				f = b ^ c ^ d;
+				k = 0xca62c1d6;
+			}
+
+			uint32_t temp = RotateLeft(a, 5) + f + e + k + w[i];
+			e = d;
+			d = c;
+			c = RotateLeft(b, 30);
+			b = a;
+			a = temp;
+		}
+
+		state[0] += a;
+		state[1] += b;
+		state[2] += c;
+		state[3] += d;
+		state[4] += e;
+	}
+
+	void Sha1(const char* buf, size_t len, uint8_t digest[20])
+	{
+		uint32_t state[5] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 };
+
+		const uint8_t* data = (const uint8_t*)buf;
+		size_t i = 0;
+		for (; i + 64 <= len; i += 64)
+			ProcessBlock(state, data + i);
+
+		// The message is padded with a one bit, then zeros, then its length in bits, to a whole number of blocks.
+		uint8_t block[128];
+		size_t remaining = len - i;
+		memcpy(block, data + i, remaining);
+		block[remaining] = 0x80;
+
+		size_t paddedLength = (remaining < 56) ? 64 : 128;
+		memset(block + remaining + 1, 0, paddedLength - remaining - 1);
+
+		uint64_t bitLength = uint64_t(len) * 8;
+		for (int j = 0; j < 8; j++)
+			block[paddedLength - 1 - j] = uint8_t(bitLength >> (8 * j));
+
+		ProcessBlock(state, block);
+		if (paddedLength == 128)
+			ProcessBlock(state, block + 64);
+
+		for (int j = 0; j < 5; j++)
+		{
+			digest[4 * j] = uint8_t(state[j] >> 24);
+			digest[4 * j + 1] = uint8_t(state[j] >> 16);
+			digest[4 * j + 2] = uint8_t(state[j] >> 8);
+			digest[4 * j + 3] = uint8_t(state[j]);
+		}
+	}
+
+	std::string Sha1Hex(const char* buf, size_t len)
+	{
+		static const char hexDigits[] = "0123456789abcdef";
+
+		uint8_t digest[20];
+		Sha1(buf, len, digest);
+
+		std::string hex(40, '0');
+		for (int i = 0; i < 20; i++)
+		{
+			hex[2 * i] = hexDigits[digest[i] >> 4];
+			hex[2 * i + 1] = hexDigits[digest[i] & 0xf];
+		}
+
+		return hex;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "yarc_api.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+namespace Yarc
+{
+	// This is what Redis names scripts by (see EVALSHA), so we can work out a script's name without asking.
+	extern YARC_API void Sha1(const char* buf, size_t len, uint8_t digest[20]);
+
+	// The digest as 40 lowercase hex digits, which is how Redis writes it.
+	extern YARC_API std::string Sha1Hex(const char* buf, size_t len);
+}
\ No newline at end of file
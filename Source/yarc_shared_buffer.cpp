@@ -0,0 +1,43 @@
+#include "yarc_shared_buffer.h"
+
+namespace Yarc
+{
+	SharedBuffer::SharedBuffer(uint8_t* givenData, uint32_t givenSize, Deleter givenDeleter)
+	{
+		this->data = givenData;
+		this->size = givenSize;
+		this->deleter = new Deleter(std::move(givenDeleter));
+		this->refCount = 1;
+	}
+
+	SharedBuffer::~SharedBuffer()
+	{
+		if (*this->deleter)
+			(*this->deleter)(this->data, this->size);
+		else
+			delete[] this->data;
+
+		delete this->deleter;
+	}
+
+	/*static*/ SharedBuffer* SharedBuffer::Create(uint32_t size)
+	{
+		return new SharedBuffer(new uint8_t[size], size, nullptr);
+	}
+
+	/*static*/ SharedBuffer* SharedBuffer::Wrap(uint8_t* data, uint32_t size, Deleter deleter /*= nullptr*/)
+	{
+		return new SharedBuffer(data, size, std::move(deleter));
+	}
+
+	void SharedBuffer::AddRef(void)
+	{
+		this->refCount++;
+	}
+
+	void SharedBuffer::Release(void)
+	{
+		if (--this->refCount == 0)
+			delete this;
+	}
+}
\ No newline at end of file
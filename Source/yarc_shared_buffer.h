@@ -0,0 +1,43 @@
+#pragma once
+
+#include "yarc_api.h"
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+
+namespace Yarc
+{
+	// This is a reference-counted block of memory for big values, which lets a request refer to the caller's data
+	// rather than copy it, and lets the socket hang on to it for as long as the kernel is still sending it.
+	// Whoever creates a buffer holds the first reference, and must release it when done with it.
+	class YARC_API SharedBuffer
+	{
+	public:
+
+		typedef std::function<void(uint8_t* data, uint32_t size)> Deleter;
+
+		// Allocate a buffer of the given size, for the caller to fill in.
+		static SharedBuffer* Create(uint32_t size);
+
+		// Take ownership of the caller's memory, which is given to the deleter (or to delete[], if there isn't one)
+		// once the last reference is released.  The memory must not be changed until then.
+		static SharedBuffer* Wrap(uint8_t* data, uint32_t size, Deleter deleter = nullptr);
+
+		void AddRef(void);
+		void Release(void);
+
+		uint8_t* GetData(void) { return this->data; }
+		const uint8_t* GetData(void) const { return this->data; }
+		uint32_t GetSize(void) const { return this->size; }
+
+	private:
+
+		SharedBuffer(uint8_t* givenData, uint32_t givenSize, Deleter givenDeleter);
+		~SharedBuffer();
+
+		uint8_t* data;
+		uint32_t size;
+		Deleter* deleter;
+		std::atomic<uint32_t> refCount;
+	};
+}
\ No newline at end of file
@@ -2,23 +2,66 @@
 #include "yarc_protocol_data.h"
 #include "yarc_connection_pool.h"
 #include "yarc_misc.h"
+#include <memory>
 
 namespace Yarc
 {
 	//------------------------------ SimpleClient ------------------------------
 
-	SimpleClient::SimpleClient(double connectionTimeoutSeconds /*= 0.5*/, double connectionRetrySeconds /*= 5.0*/) : servedRequestListSemaphore(MAXINT32)
+	SimpleClient::SimpleClient(double connectionTimeoutSeconds /*= 0.5*/, double connectionRetrySeconds /*= 5.0*/) : servedRequestListSemaphore(INT32_MAX)
 	{
 		this->numRequestsInFlight = 0;
+		this->numDispatchedCallbacks = 0;
+		this->connectionProfile = new ConnectionProfile();
+		this->connectionPoolKey = new std::string;
+		this->handshakeFailedCallback = new EventCallback;
+		this->handshakeError = new std::string;
+		this->handshakeStatus = HANDSHAKE_STATUS_NONE;
+		this->numHandshakeRequestsPending = 0;
+		this->handshakeFailureReported = false;
+		this->zeroCopyThreshold = 64 * 1024;
+		this->numRetainedBytes = 0;
 		this->connectionTimeoutSeconds = connectionTimeoutSeconds;
 		this->connectionRetrySeconds = connectionRetrySeconds;
-		this->lastFailedConnectionAttemptTime = 0;
+		this->syncSpinSeconds = 50e-6;
+		this->outputBuffer = new std::string();
+		this->maxQueuedRequests = 0;
+		this->maxQueuedBytes = 0;
+		this->numQueuedBytes = 0;
+		this->failFastSeconds = 0.0;
+		this->disconnectedTime = 0.0;
+		this->failingFast = false;
+		this->inlineCompletion = false;
+		this->updateWaiting = false;
+		this->backpressure = BACKPRESSURE_REFUSE;
+		this->blockTimeoutSeconds = 5.0;
+		this->nextConnectionAttemptTime = 0.0;
+		this->numConnectionFailures = 0;
+		this->numConnectionsMade = 0;
+		this->reconnectInitialDelaySeconds = 0.1;
+		this->keepAliveIdleSeconds = 0.0;
+		this->keepAliveIntervalSeconds = 1.0;
+		this->keepAliveProbeCount = 3;
+		this->heartbeatSeconds = 0.0;
+		this->responseTimeoutSeconds = 0.0;
+		this->heartbeatPending = false;
 		this->socketStream = nullptr;
+		this->receivingPipelineRequest = nullptr;
 		this->thread = nullptr;
+		this->threadOptions = new Thread::Options();
+		this->threadOptions->name = "yarc-reception";
+		this->busyPollSeconds = 0.0;
+		this->requestSlab = new RequestSlab();
 		this->unsentRequestList = new RequestList();
 		this->sentRequestList = new RequestList();
 		this->servedRequestList = new RequestList();
 		this->messageList = new MessageList();
+
+		// Requests hop from list to list over their lifetime, so have the lists keep their
+		// nodes around for reuse.  A warmed-up client then issues requests without any heap traffic.
+		this->unsentRequestList->SetMaxFreeNodes(1024);
+		this->sentRequestList->SetMaxFreeNodes(1024);
+		this->servedRequestList->SetMaxFreeNodes(1024);
 		this->postConnectCallback = new EventCallback;
 		this->preDisconnectCallback = new EventCallback;
 		this->threadExitSignal = false;
@@ -26,30 +69,43 @@ namespace Yarc
 
 	/*virtual*/ SimpleClient::~SimpleClient()
 	{
+		// This should cause our reception thread to exit.  Don't close or delete the socket stream
+		// out from under it until it has.  What it leaves unanswered is simply freed below.
+		this->threadExitSignal = true;
 		if (this->socketStream)
-		{
-			// This should cause our reception thread to exit.
-			this->socketStream->Disconnect();
-			delete this->socketStream;
-		}
+			this->socketStream->Shutdown();
 
 		if (this->thread)
 		{
 			this->thread->WaitForThreadExit();
 			delete this->thread;
 		}
+
+		// A flush can see the last of our callbacks finish just before its task is done with us.
+		while (this->numDispatchedCallbacks > 0)
+			Thread::Sleep(0);
+
+		if (this->socketStream)
+			ConnectionPool::Get()->DiscardSocketStream(this->socketStream);
 		
-		this->unsentRequestList->Delete();
-		this->sentRequestList->Delete();
-		this->servedRequestList->Delete();
+		this->DeallocRequestList(this->unsentRequestList);
+		this->DeallocRequestList(this->sentRequestList);
+		this->DeallocRequestList(this->servedRequestList);
 		this->messageList->Delete();
 
 		delete this->unsentRequestList;
 		delete this->sentRequestList;
 		delete this->servedRequestList;
 		delete this->messageList;
+		delete this->requestSlab;
+		delete this->outputBuffer;
+		delete this->threadOptions;
 		delete this->postConnectCallback;
 		delete this->preDisconnectCallback;
+		delete this->connectionProfile;
+		delete this->connectionPoolKey;
+		delete this->handshakeFailedCallback;
+		delete this->handshakeError;
 	}
 
 	/*static*/ SimpleClient* SimpleClient::Create()
@@ -65,26 +121,27 @@ namespace Yarc
 		delete client;
 	}
 
+	// A connection can only be handed on to someone else if nothing more is coming back on it, so we only
+	// recycle one that's idle.  There's no need to make sure with a round-trip to the server, since the
+	// reception thread, with nothing to wait on, is waiting in a way that we can interrupt.
 	void SimpleClient::TryToRecycleConnection()
 	{
-		if (this->thread && this->thread->IsStillRunning() && this->socketStream && this->socketStream->IsConnected())
-		{
-			if (this->Flush(5.0))
-			{
-				if (this->thread && this->thread->IsStillRunning() && this->socketStream && this->socketStream->IsConnected())
-				{
-					this->threadExitSignal = true;
+		if (!this->thread || !this->thread->IsStillRunning() || !this->socketStream || !this->socketStream->IsConnected())
+			return;
 
-					// Here the reception thread should exit without us having to close the socket.
-					ProtocolData* responseData = nullptr;
-					if (this->MakeRequestSync(ProtocolData::ParseCommand("PING"), responseData))
-					{
-						delete responseData;
-						ConnectionPool::Get()->CheckinSocketStream(this->socketStream);
-						this->socketStream = nullptr;
-					}
-				}
-			}
+		if (this->sentRequestList->GetCount() > 0)
+			return;
+
+		this->threadExitSignal = true;
+		this->socketStream->InterruptWait();
+		this->thread->WaitForThreadExit();
+		delete this->thread;
+		this->thread = nullptr;
+
+		if (this->sentRequestList->GetCount() == 0)
+		{
+			ConnectionPool::Get()->CheckinSocketStream(this->socketStream, *this->connectionPoolKey);
+			this->socketStream = nullptr;
 		}
 	}
 
@@ -110,28 +167,151 @@ namespace Yarc
 
 	/*virtual*/ bool SimpleClient::Update(double timeoutMilliseconds /*= 0.0*/)
 	{
-		// Are we still waiting between connection retry attempts?
-		if (this->lastFailedConnectionAttemptTime != 0)
+		bool connected = this->ManageConnection(timeoutMilliseconds);
+
+		if (this->handshakeStatus == HANDSHAKE_STATUS_FAILED && !this->handshakeFailureReported)
+		{
+			this->handshakeFailureReported = true;
+			if (*this->handshakeFailedCallback)
+				(*this->handshakeFailedCallback)(this);
+		}
+
+		if (connected)
+		{
+			this->disconnectedTime = 0.0;
+			this->failingFast = false;
+
+			// Flush all pending unsent requests.
+			this->SendUnsentRequests();
+		}
+		else
+		{
+			// Once we've been without a connection for long enough, stop letting requests pile up.
+			// Everything queued, and anything queued from now on, fails straight away until we reconnect.
+			double currentTime = GetMonotonicTimeSeconds();
+			if (this->disconnectedTime == 0.0)
+				this->disconnectedTime = currentTime;
+			else if (this->failFastSeconds > 0.0 && currentTime - this->disconnectedTime >= this->failFastSeconds)
+			{
+				this->failingFast = true;
+				this->FailQueuedRequests("ERR yarc: disconnected from server");
+			}
+
+			// Don't wait on responses, since there's no server to send them.
+			timeoutMilliseconds = 0.0;
+		}
+
+		// Serve pending requests for as long as they're coming off the queue.
+		this->updateWaiting = (timeoutMilliseconds != 0.0);
+		while (this->numRequestsInFlight > 0)
 		{
-			::clock_t currentTime = ::clock();
-			double elapsedTimeSeconds = (double(currentTime) - double(this->lastFailedConnectionAttemptTime)) / double(CLOCKS_PER_SEC);
-			if (elapsedTimeSeconds >= this->connectionRetrySeconds)
-				this->lastFailedConnectionAttemptTime = 0;
+			Request* request = nullptr;
+
+			// The typical time-out here is zero milliseconds so that a call to Update() is as fast as possible.
+			if (!this->servedRequestListSemaphore.Decrement(timeoutMilliseconds))
+				break;		// There is nothing to serve right now, so bail out.
 			else
+			{
+				request = this->servedRequestList->RemoveHead();
+				//assert(request != nullptr);
+			}
+			
+			if (request)
+			{
+				if (request->canceled)
+					request->ownsResponseDataMem = true;
+				else
+					request->ownsResponseDataMem = request->callback(request->responseData);
+
+				this->DeallocRequest(request);
+			}
+
+			// Each response opens the pipeline window back up, so keep it full.  Otherwise, with a
+			// time-out, we could wait here on responses to requests that haven't even been sent.
+			if (connected && this->unsentRequestList->GetCount() > 0)
+				this->SendUnsentRequests();
+		}
+
+		this->updateWaiting = false;
+
+		// Flush all pending messages.
+		while (true)
+		{
+			Message* message = this->messageList->RemoveHead();
+			if (!message)
+				break;
+			
+			if (*this->pushDataCallback)
+				message->ownsMessageData = (*this->pushDataCallback)(message->messageData);
+			else
+				message->ownsMessageData = true;
+
+			delete message;
+		}
+
+		return connected;
+	}
+
+	// Note that we never block here for longer than the given time-out, not even to connect.  A connection
+	// is started on one update, and finished on whichever later update finds that it has gone through.
+	bool SimpleClient::ManageConnection(double timeoutMilliseconds)
+	{
+		// Are we still backing off before the next connection attempt?
+		if (this->nextConnectionAttemptTime != 0.0)
+		{
+			if (GetMonotonicTimeSeconds() < this->nextConnectionAttemptTime)
 				return false;
+
+			this->nextConnectionAttemptTime = 0.0;
 		}
 
 		// Make sure we have a connection to the Redis database.
+		bool newlyConnected = false;
 		if (!this->socketStream)
 		{
-			this->socketStream = ConnectionPool::Get()->CheckoutSocketStream(this->address, this->connectionTimeoutSeconds);
+			// The profile may be changed at any time, but only takes effect on the next connection, so hang on to its key.
+			*this->connectionPoolKey = this->connectionProfile->MakePoolKey();
+			this->socketStream = ConnectionPool::Get()->CheckoutSocketStream(this->address, this->connectionTimeoutSeconds, false, *this->connectionPoolKey);
 			if (!this->socketStream)
 			{
-				this->lastFailedConnectionAttemptTime = ::clock();
+				this->ScheduleReconnect();
+				return false;
+			}
+
+			newlyConnected = !this->socketStream->IsConnecting();
+		}
+
+		if (this->socketStream->IsConnecting())
+		{
+			SocketStream::ConnectStatus connectStatus = this->socketStream->PollConnect(timeoutMilliseconds / 1000.0);
+			if (connectStatus == SocketStream::CONNECT_STATUS_PENDING)
+				return false;
+
+			if (connectStatus == SocketStream::CONNECT_STATUS_FAILED)
+			{
+				ConnectionPool::Get()->DiscardSocketStream(this->socketStream);
+				this->socketStream = nullptr;
+				this->ScheduleReconnect();
 				return false;
 			}
 
-			if (this->socketStream->IsConnected() && *this->postConnectCallback)
+			newlyConnected = true;
+		}
+
+		if (newlyConnected)
+		{
+			this->socketStream->SetBusyPollSeconds(this->busyPollSeconds);
+
+			// These are set either way, since a pooled connection may come with someone else's settings.
+			this->socketStream->SetKeepAlive(this->keepAliveIdleSeconds, this->keepAliveIntervalSeconds, this->keepAliveProbeCount);
+			this->socketStream->SetReadTimeout(this->responseTimeoutSeconds);
+
+			this->numConnectionFailures = 0;
+			this->numConnectionsMade++;
+			this->heartbeatPending = false;
+			this->QueueHandshake();
+
+			if (*this->postConnectCallback)
 				(*this->postConnectCallback)(this);
 		}
 		
@@ -145,11 +325,15 @@ namespace Yarc
 				this->thread = nullptr;
 			}
 
-			delete this->socketStream;
+			ConnectionPool::Get()->DiscardSocketStream(this->socketStream);
 			this->socketStream = nullptr;
 
-			// We must also purge our current list of sent requests since it has become invalid.
-			this->sentRequestList->Delete();
+			// The reception thread fails whatever was awaiting a response when it loses the connection,
+			// but anything sent after that (to no avail) is still here.
+			this->FailSentRequests("ERR yarc: connection lost");
+
+			// Don't come straight back, or everyone who lost the same server will all be back at once.
+			this->ScheduleReconnect();
 
 			return false;
 		}
@@ -158,7 +342,7 @@ namespace Yarc
 		if (!this->thread)
 		{
 			this->thread = new Thread();
-			if (!this->thread->SpawnThread([=]() { this->ThreadFunc(); }))
+			if (!this->thread->SpawnThread([this]() { this->ThreadFunc(); }, this->threadOptions))
 			{
 				delete this->thread;
 				this->thread = nullptr;
@@ -174,75 +358,361 @@ namespace Yarc
 			return false;
 		}
 
-		// Flush all pending unsent requests.
-		while (true)
+		this->QueueHeartbeat();
+		return true;
+	}
+
+	// A connection can die without our hearing about it, if the server's machine goes away, say, or something
+	// in between drops it.  The response time-out only catches that while we're waiting on something, so if we've
+	// been quiet a while, we give it something to wait on.
+	void SimpleClient::QueueHeartbeat(void)
+	{
+		if (this->heartbeatSeconds <= 0.0 || this->heartbeatPending)
+			return;
+
+		if (this->sentRequestList->GetCount() > 0 || this->unsentRequestList->GetCount() > 0)
+			return;
+
+		double lastReadTime = this->socketStream->GetLastReadTime();
+		double lastWriteTime = this->socketStream->GetLastWriteTime();
+		double lastActivityTime = (lastReadTime > lastWriteTime) ? lastReadTime : lastWriteTime;
+		if (GetMonotonicTimeSeconds() - lastActivityTime < this->heartbeatSeconds)
+			return;
+
+		Request* request = this->AllocRequest();
+		request->requestData = ProtocolData::ParseCommand("PING");
+		request->ownsRequestDataMem = true;
+		request->heartbeat = true;
+		this->heartbeatPending = true;
+		this->EnqueueRequest(request);
+	}
+
+	// Each failure doubles the wait, up to the retry time, and the wait is then cut by up to half at random.
+	void SimpleClient::ScheduleReconnect(void)
+	{
+		double delaySeconds = this->reconnectInitialDelaySeconds;
+		for (uint32_t i = 0; i < this->numConnectionFailures && delaySeconds < this->connectionRetrySeconds; i++)
+			delaySeconds *= 2.0;
+
+		if (delaySeconds > this->connectionRetrySeconds)
+			delaySeconds = this->connectionRetrySeconds;
+
+		delaySeconds *= 0.5 + 0.5 * RandomFraction();
+		this->nextConnectionAttemptTime = GetMonotonicTimeSeconds() + delaySeconds;
+		this->numConnectionFailures++;
+	}
+
+	void SimpleClient::SetKeepAlive(double idleSeconds, double intervalSeconds /*= 1.0*/, uint32_t probeCount /*= 3*/)
+	{
+		this->keepAliveIdleSeconds = idleSeconds;
+		this->keepAliveIntervalSeconds = intervalSeconds;
+		this->keepAliveProbeCount = probeCount;
+
+		if (this->socketStream && this->socketStream->IsConnected())
+			this->socketStream->SetKeepAlive(idleSeconds, intervalSeconds, probeCount);
+	}
+
+	void SimpleClient::SetHeartbeat(double givenHeartbeatSeconds, double givenResponseTimeoutSeconds)
+	{
+		this->heartbeatSeconds = givenHeartbeatSeconds;
+		this->responseTimeoutSeconds = givenResponseTimeoutSeconds;
+
+		if (this->socketStream && this->socketStream->IsConnected())
+			this->socketStream->SetReadTimeout(givenResponseTimeoutSeconds);
+	}
+
+	// This is what requests are printed to.  Everything is gathered up in the output buffer, except for big shared
+	// buffers and files, which are sent from where they are, once everything printed ahead of them has been written out.
+	class OutputStream : public StringStream
+	{
+	public:
+
+		OutputStream(std::string* givenStringBuffer, SocketStream* givenSocketStream, uint32_t givenZeroCopyThreshold) : StringStream(givenStringBuffer)
 		{
-			Request* request = this->unsentRequestList->RemoveHead();
+			this->socketStream = givenSocketStream;
+			this->zeroCopyThreshold = givenZeroCopyThreshold;
+		}
+
+		virtual bool WriteSharedBuffer(SharedBuffer* sharedBuffer) override
+		{
+			if (sharedBuffer->GetSize() < this->zeroCopyThreshold)
+				return StringStream::WriteSharedBuffer(sharedBuffer);
+
+			if (!this->WriteStringBuffer())
+				return false;
+
+			return this->socketStream->WriteZeroCopy(sharedBuffer);
+		}
+
+		// A file is always sent straight from the file.  Not touching the bytes is the whole point.
+		virtual bool WriteFileRegion(const FileRegion& fileRegion) override
+		{
+			if (!this->WriteStringBuffer())
+				return false;
+
+			return this->socketStream->WriteFileRegion(fileRegion);
+		}
+
+		bool WriteStringBuffer(void)
+		{
+			bool success = this->socketStream->WriteBufferNow((const uint8_t*)this->stringBuffer->c_str(), (uint32_t)this->stringBuffer->length());
+			this->stringBuffer->clear();
+			return success;
+		}
+
+		SocketStream* socketStream;
+		uint32_t zeroCopyThreshold;
+	};
+
+	void SimpleClient::SendUnsentRequests(void)
+	{
+		// Requests are gathered up and written in as few calls to the socket as possible.
+		// Writing each piece of each request as it's printed would cost a system call per
+		// piece, and worse, could leave part of a request stuck behind Nagle's algorithm.
+		OutputStream outputStream(this->outputBuffer, this->socketStream, this->zeroCopyThreshold);
+		this->outputBuffer->clear();
+
+		// Let go of any big buffers the kernel has finished sending since we were last here.
+		if (this->socketStream->GetNumZeroCopySendsPending() > 0)
+			this->socketStream->ReapZeroCopyCompletions();
+
+		double sendTime = GetMonotonicTimeSeconds();
+		uint32_t windowSize = this->pipelineWindow.GetSize();
+
+		while (this->sentRequestList->GetCount() < windowSize)
+		{
+			Request* request = this->DequeueRequest();
 			if (!request)
 				break;
+
+			// A request canceled before it was sent need never be sent at all.
+			if (request->canceled)
+			{
+				this->DeallocRequest(request);
+				continue;
+			}
 			
 			// Notice that we must add it to the sent list before printing it to the socket,
 			// because it's possible for the server to respond before it gets there, and the
 			// reception thread needs it to be there to match the request with the response.
+			request->sent = true;
+			request->sendTime = sendTime;
 			this->sentRequestList->AddTail(request);
-			ProtocolData::PrintTree(this->socketStream, request->requestData);
-		}
+			if (request->pipeline)
+				request->pipeline->Print(&outputStream);
+			else
+				ProtocolData::PrintTree(&outputStream, request->requestData);
 
-		// Serve pending requests for as long as they're coming off the queue.
-		while (this->numRequestsInFlight > 0)
-		{
-			Request* request = nullptr;
+			// A pipeline is ordered by its first command.
+			if (this->executor && this->executorOrdering == Executor::ORDERING_PER_KEY)
+				request->orderingKey = this->CalcOrderingKey(request->pipeline ? request->pipeline->GetCommand(0) : request->requestData);
 
-			// The typical time-out here is zero milliseconds so that a call to Update() is as fast as possible.
-			if (!this->servedRequestListSemaphore.Decrement(timeoutMilliseconds))
-				break;		// There is nothing to serve right now, so bail out.
+			// Nothing here ever resends a request, so once it's been printed, there's no reason to hang on to
+			// it for a whole round-trip.  That adds up when the pipeline is full of big requests.  If the memory
+			// isn't ours to free, though, it stays alive until the response comes back, so we count it.
+
+			if (request->ownsRequestDataMem)
+			{
+				delete request->requestData;
+				request->requestData = nullptr;
+				request->ownsRequestDataMem = false;
+			}
 			else
 			{
-				request = this->servedRequestList->RemoveHead();
-				//assert(request != nullptr);
+				request->retainedSize = request->size;
+				this->numRetainedBytes += request->retainedSize;
 			}
-			
-			if (request)
+
+			if (this->outputBuffer->length() >= 64 * 1024)
 			{
-				request->ownsResponseDataMem = request->callback(request->responseData);
-				this->DeallocRequest(request);
+				this->socketStream->WriteBufferNow((const uint8_t*)this->outputBuffer->c_str(), (uint32_t)this->outputBuffer->length());
+				this->outputBuffer->clear();
 			}
 		}
 
-		// Flush all pending messages.
+		if (this->outputBuffer->length() > 0)
+		{
+			this->socketStream->WriteBufferNow((const uint8_t*)this->outputBuffer->c_str(), (uint32_t)this->outputBuffer->length());
+			this->outputBuffer->clear();
+		}
+	}
+
+	// The profile's commands are put at the front of the queue, so that they go out ahead of anything
+	// made while we were connecting, and all in the same write.  They don't count against the queue limits.
+	void SimpleClient::QueueHandshake(void)
+	{
+		// If we lost the last connection before its handshake got out, what's left of it is still at the front.
 		while (true)
 		{
-			Message* message = this->messageList->RemoveHead();
-			if (!message)
+			Request* request = this->unsentRequestList->RemoveHead();
+			if (!request)
 				break;
-			
-			if (*this->pushDataCallback)
-				message->ownsMessageData = (*this->pushDataCallback)(message->messageData);
+
+			if (!request->handshake)
+			{
+				this->unsentRequestList->AddHead(request);
+				break;
+			}
+
+			this->DeallocRequest(request);
+		}
+
+		DynamicArray<ProtocolData*> commandArray;
+		this->connectionProfile->MakeCommands(commandArray);
+
+		this->handshakeError->clear();
+		this->handshakeFailureReported = false;
+		this->numHandshakeRequestsPending = commandArray.GetCount();
+		this->handshakeStatus = (commandArray.GetCount() > 0) ? HANDSHAKE_STATUS_PENDING : HANDSHAKE_STATUS_NONE;
+
+		for (uint32_t i = commandArray.GetCount(); i-- > 0;)
+		{
+			Request* request = this->AllocRequest();
+			request->requestData = commandArray[i];
+			request->ownsRequestDataMem = true;
+			request->handshake = true;
+			this->unsentRequestList->AddHead(request);
+		}
+	}
+
+	// This is called on the reception thread, which sees the responses in order, one at a time, so
+	// there's no need to bother the Update() thread (or an executor) with each of them.
+	void SimpleClient::CompleteHandshakeRequest(Request* request)
+	{
+		const ProtocolData* responseData = request->responseData;
+		if (responseData->IsError() && this->handshakeError->length() == 0)
+		{
+			const SimpleErrorData* simpleErrorData = Cast<SimpleErrorData>(responseData);
+			const BlobErrorData* blobErrorData = Cast<BlobErrorData>(responseData);
+			if (simpleErrorData)
+				*this->handshakeError = simpleErrorData->GetValue();
+			else if (blobErrorData)
+				*this->handshakeError = blobErrorData->GetValue();
 			else
-				message->ownsMessageData = true;
+				*this->handshakeError = "ERR yarc: handshake failed";
+		}
 
-			delete message;
+		request->ownsResponseDataMem = true;
+		this->DeallocRequest(request);
+
+		if (--this->numHandshakeRequestsPending == 0)
+		{
+			// The error has to be in place before anyone can see that we failed.
+			this->handshakeStatus = (this->handshakeError->length() > 0) ? HANDSHAKE_STATUS_FAILED : HANDSHAKE_STATUS_SUCCEEDED;
+			this->WakeUpdate();
 		}
+	}
 
-		return true;
+	// This is called on the reception thread too.  There's nothing to a PING's response, but that it came.
+	void SimpleClient::CompleteHeartbeatRequest(Request* request)
+	{
+		request->ownsResponseDataMem = true;
+		this->DeallocRequest(request);
+		this->heartbeatPending = false;
+	}
+
+	void SimpleClient::EnqueueRequest(Request* request)
+	{
+		this->numQueuedBytes += request->size;
+		this->unsentRequestList->AddTail(request);
+	}
+
+	SimpleClient::Request* SimpleClient::DequeueRequest(void)
+	{
+		Request* request = this->unsentRequestList->RemoveHead();
+		if (request)
+			this->numQueuedBytes -= request->size;
+
+		return request;
+	}
+
+	void SimpleClient::FailRequest(Request* request, const char* error)
+	{
+		request->responseData = new SimpleErrorData(error);
+
+		// A synchronous request is completed as if it had been sent, so that its caller gets the error.
+		if (request->completionSlot.IsArmed() && request->completionSlot.Complete())
+		{
+			request->sent = true;
+			return;
+		}
+
+		this->AddServedRequest(request);
+	}
+
+	// Internal requests have no one to tell, and canceled ones no one who cares.
+	void SimpleClient::FailSentRequests(const char* error)
+	{
+		while (true)
+		{
+			Request* request = this->sentRequestList->RemoveHead();
+			if (!request)
+				break;
+
+			if (request->handshake || request->heartbeat || request->canceled)
+				this->DeallocRequest(request);
+			else
+				this->FailRequest(request, error);
+		}
+	}
+
+	void SimpleClient::AddServedRequest(Request* request)
+	{
+		this->servedRequestList->AddTail(request);
+		this->servedRequestListSemaphore.Increment();
+	}
+
+	void SimpleClient::FailQueuedRequests(const char* error)
+	{
+		while (true)
+		{
+			Request* request = this->DequeueRequest();
+			if (!request)
+				break;
+
+			if (request->canceled)
+				this->DeallocRequest(request);
+			else
+				this->FailRequest(request, error);
+		}
 	}
 
 	SimpleClient::Request* SimpleClient::AllocRequest()
 	{
 		this->numRequestsInFlight++;
-		return new Request();
+		return this->requestSlab->Allocate();
 	}
 
 	void SimpleClient::DeallocRequest(Request* request)
 	{
-		delete request;
+		this->numRetainedBytes -= request->retainedSize;
+		this->requestSlab->Deallocate(request);
 		this->numRequestsInFlight--;
 	}
 
+	void SimpleClient::DeallocRequestList(RequestList* requestList)
+	{
+		while (true)
+		{
+			Request* request = requestList->RemoveHead();
+			if (!request)
+				break;
+
+			// Any response here was never handed to anyone, so it's ours to free.
+			request->ownsResponseDataMem = true;
+			this->DeallocRequest(request);
+		}
+	}
+
 	void SimpleClient::ThreadFunc(void)
 	{
 		while (this->socketStream->IsConnected() && !this->threadExitSignal)
 		{
+			// While nothing is awaiting a response, we wait on the socket a little at a time, so that
+			// we notice being asked to exit without anyone having to send us something to wake us up.
+			if (this->sentRequestList->GetCount() == 0 && !this->socketStream->WaitForReadable(0.05))
+				continue;
+
 			// Here we block on the socket until woken up.
 			ProtocolData* serverData = nullptr;
 			if (!ProtocolData::ParseTree(this->socketStream, serverData))
@@ -274,28 +744,148 @@ namespace Yarc
 				}
 				else
 				{
-					// In the usual case, the server data is a response to the next pending request.
-					Request* request = this->sentRequestList->RemoveHead();
+					// In the usual case, the server data is a response to the next pending request.  A pipeline
+					// takes as many responses as it has commands, so we hang on to it until it has them all.
+					Request* request = this->receivingPipelineRequest;
+					if (!request)
+						request = this->sentRequestList->RemoveHead();
+
 					if (!request)
 					{
 						// This *should* never happen.
 						//assert(false);
 					}
+					else if (request->pipeline && !request->pipeline->SetReply(request->numPipelineReplies++, serverData))
+						this->receivingPipelineRequest = request;
 					else
 					{
-						// Assign the payload and send it on its way!
-						request->responseData = serverData;
-						this->servedRequestList->AddTail(request);
-						this->servedRequestListSemaphore.Increment();
+						this->receivingPipelineRequest = nullptr;
+
+						// Assign the payload and send it on its way!  A synchronous request is
+						// handed straight to the thread waiting on it, unless that thread gave up,
+						// in which case it goes the usual route so that it can be cleaned up.
+						// With inline completion, we call the callback ourselves, right here.
+						this->pipelineWindow.RecordRoundTrip(GetMonotonicTimeSeconds() - request->sendTime);
+
+						// A pipeline's responses are already in the pipeline.
+						request->responseData = request->pipeline ? nullptr : serverData;
+						if (request->handshake)
+							this->CompleteHandshakeRequest(request);
+						else if (request->heartbeat)
+							this->CompleteHeartbeatRequest(request);
+						else if (request->completionSlot.IsArmed())
+						{
+							if (!request->completionSlot.Complete())
+								this->AddServedRequest(request);
+						}
+						else if (this->executor)
+							this->DispatchRequest(request);
+						else if (this->inlineCompletion)
+							this->CompleteRequestInline(request);
+						else
+							this->AddServedRequest(request);
 					}
 				}
 			}
 		}
+
+		// A pipeline we were partway through goes back where it was, and fails or is freed along with the rest.
+		if (this->receivingPipelineRequest)
+		{
+			this->sentRequestList->AddHead(this->receivingPipelineRequest);
+			this->receivingPipelineRequest = nullptr;
+		}
+
+		// If we lost the connection, rather than being asked to exit, no response is ever coming for what was sent,
+		// so we say so now, rather than leave anyone (a synchronous request especially) waiting until they time out.
+		if (!this->threadExitSignal)
+			this->FailSentRequests("ERR yarc: connection lost");
+	}
+
+	// This is called on the reception thread.  The request is freed before its callback is called, so that
+	// a cancellation racing with us either gets in first or finds nothing to cancel, and so that the
+	// callback is free to make (or cancel) other requests.
+	void SimpleClient::CompleteRequestInline(Request* request)
+	{
+		Callback callback;
+		ProtocolData* responseData = request->responseData;
+
+		{
+			MutexLocker locker(this->cancelMutex);
+			if (!request->canceled)
+				callback = std::move(request->callback);
+
+			request->responseData = nullptr;
+			this->DeallocRequest(request);
+		}
+
+		bool ownsResponseDataMem = callback ? callback(responseData) : true;
+		if (ownsResponseDataMem)
+			delete responseData;
+
+		this->WakeUpdate();
+	}
+
+	// This is also called on the reception thread.  Like inline completion, the request is freed right
+	// away, but it's still counted as in flight until its callback has run on the executor, so that a
+	// flush still waits on it.
+	void SimpleClient::DispatchRequest(Request* request)
+	{
+		Callback callback;
+		ProtocolData* responseData = request->responseData;
+		uint64_t orderingKey = 0;
+
+		// The request data is usually gone by now, so the key was worked out when it was sent.
+		if (this->executorOrdering == Executor::ORDERING_PER_KEY)
+			orderingKey = request->requestData ? this->CalcOrderingKey(request->requestData) : request->orderingKey;
+		else if (this->executorOrdering == Executor::ORDERING_PER_CONNECTION)
+			orderingKey = uint64_t(uintptr_t(this));
+
+		{
+			MutexLocker locker(this->cancelMutex);
+			if (!request->canceled)
+				callback = std::move(request->callback);
+
+			request->responseData = nullptr;
+			this->DeallocRequest(request);
+			this->numRequestsInFlight++;
+			this->numDispatchedCallbacks++;
+		}
+
+		this->executor->Submit([this, callback = std::move(callback), responseData]() {
+			bool ownsResponseDataMem = callback ? callback(responseData) : true;
+			if (ownsResponseDataMem)
+				delete responseData;
+
+			this->numRequestsInFlight--;
+			this->WakeUpdate();
+
+			// This has to be the last thing we touch, since it's what our destructor waits on.
+			this->numDispatchedCallbacks--;
+		}, orderingKey);
+	}
+
+	uint64_t SimpleClient::CalcOrderingKey(const ProtocolData* requestData)
+	{
+		// Zero means unordered, so keep clear of it.
+		return uint64_t(ProtocolData::CalcCommandHashSlot(requestData)) + 1;
+	}
+
+	uint64_t SimpleClient::GetInFlightMemoryBytes(void) const
+	{
+		return uint64_t(this->sentRequestList->GetCount()) * sizeof(Request) + this->numRetainedBytes;
+	}
+
+	// Wake up anyone waiting in Update() on requests to finish, since these don't come through the served list.
+	void SimpleClient::WakeUpdate(void)
+	{
+		if (this->updateWaiting)
+			this->servedRequestListSemaphore.Increment();
 	}
 
 	/*virtual*/ bool SimpleClient::Flush(double timeoutSeconds /*= 5.0*/)
 	{
-		clock_t startTime = ::clock();
+		double startTime = GetMonotonicTimeSeconds();
 
 		while (this->numRequestsInFlight > 0)
 		{
@@ -304,8 +894,7 @@ namespace Yarc
 
 			if (timeoutSeconds > 0.0)
 			{
-				clock_t currentTime = ::clock();
-				double elapsedTimeSeconds = double(currentTime - startTime) / double(CLOCKS_PER_SEC);
+				double elapsedTimeSeconds = GetMonotonicTimeSeconds() - startTime;
 				if (elapsedTimeSeconds >= timeoutSeconds)
 					return false;
 			}
@@ -314,56 +903,198 @@ namespace Yarc
 		return true;
 	}
 
-	// Note that it should be safe to call this from any thread.
-	/*virtual*/ int SimpleClient::MakeRequestAsync(const ProtocolData* requestData, Callback callback /*= [](const ProtocolData*) -> bool { return true; }*/, bool deleteData /*= true*/)
+	// Note that it should be safe to call this from any thread, unless we're set to block when the queue is full.
+	/*virtual*/ SimpleClient::RequestHandle SimpleClient::MakeRequestAsync(const ProtocolData* requestData, Callback callback /*= [](const ProtocolData*) -> bool { return true; }*/, bool deleteData /*= true*/)
+	{
+		uint32_t requestSize = ProtocolData::CalcCommandSize(requestData);
+
+		if (this->failingFast)
+			return this->QueueRequest(requestData, std::move(callback), deleteData, requestSize, "ERR yarc: disconnected from server");
+
+		if (!this->WaitForQueueRoom(1, requestSize))
+		{
+			if (this->backpressure != BACKPRESSURE_FAIL)
+				return 0;
+
+			return this->QueueRequest(requestData, std::move(callback), deleteData, requestSize, "ERR yarc: request queue is full");
+		}
+
+		return this->QueueRequest(requestData, std::move(callback), deleteData, requestSize);
+	}
+
+	SimpleClient::RequestHandle SimpleClient::MakeAnsweredRequestAsync(ProtocolData* responseData, Callback callback)
+	{
+		// This goes straight to the served list, just like a request failed before it was ever sent.
+		Request* request = this->AllocRequest();
+		request->responseData = responseData;
+		request->callback = std::move(callback);
+
+		RequestHandle requestHandle = this->requestSlab->GetHandle(request);
+		this->AddServedRequest(request);
+		return requestHandle;
+	}
+
+	// If an error is given, the request is failed with it rather than queued.  Its callback still gets called on the next update.
+	SimpleClient::RequestHandle SimpleClient::QueueRequest(const ProtocolData* requestData, Callback callback, bool deleteData, uint32_t requestSize, const char* error /*= nullptr*/)
 	{
 		Request* request = this->AllocRequest();
 		request->requestData = requestData;
 		request->ownsRequestDataMem = deleteData;
-		request->callback = callback;
+		request->callback = std::move(callback);
+		request->size = requestSize;
 
-		this->unsentRequestList->AddTail(request);
+		// Note that the handle must be taken before the request is queued, because
+		// from then on, it may be fulfilled and freed at any time by the Update() thread.
+		RequestHandle requestHandle = this->requestSlab->GetHandle(request);
+
+		if (error)
+			this->FailRequest(request, error);
+		else
+			this->EnqueueRequest(request);
 
-		return request->requestID;
+		return requestHandle;
 	}
 
-	/*virtual*/ bool SimpleClient::CancelAsyncRequest(int requestID)
+	bool SimpleClient::WaitForQueueRoom(uint32_t numRequests, uint64_t numBytes)
 	{
-		auto predicate = [=](Request* request) {
-			return request->requestID == requestID;
-		};
+		if (this->maxQueuedRequests == 0 && this->maxQueuedBytes == 0)
+			return true;
+
+		double deadlineSeconds = 0.0;
 
-		// There is a very small chance that a request in flight fails to be
-		// canceled because at the time of our checks, it was between lists.
-		// Therefore, make two passes; wait a bit before making the second pass.
-		// This doesn't necessarily solve the problem, but it makes me feel better.
-		for (int i = 0; i < 2; i++)
+		// Note that something too big for the queue is let in as long as the queue is empty.
+		while (true)
 		{
-			Request* request = this->unsentRequestList->Find(predicate, nullptr, true);
-			if (request)
-			{
-				this->DeallocRequest(request);
-				return true;
-			}
+			uint32_t numQueuedRequests = this->unsentRequestList->GetCount();
+			if (numQueuedRequests == 0)
+				break;
 
-			request = this->sentRequestList->Find(predicate, nullptr, false);
-			if (request)
-			{
-				request->callback = [](const ProtocolData*) -> bool { return true; };
-				return true;
-			}
+			bool countFits = this->maxQueuedRequests == 0 || numQueuedRequests + numRequests <= this->maxQueuedRequests;
+			bool bytesFit = this->maxQueuedBytes == 0 || this->numQueuedBytes + numBytes <= this->maxQueuedBytes;
+			if (countFits && bytesFit)
+				break;
 
-			request = this->servedRequestList->Find(predicate, nullptr, false);
-			if (request)
+			if (this->backpressure != BACKPRESSURE_BLOCK)
+				return false;
+
+			double currentTime = GetMonotonicTimeSeconds();
+			if (deadlineSeconds == 0.0)
+				deadlineSeconds = currentTime + this->blockTimeoutSeconds;
+			else if (currentTime >= deadlineSeconds)
+				return false;
+
+			// The queue only drains as responses come back and open up the pipeline window, so wait
+			// on those a bit.  If we're not connected, the update returns right away, so back off.
+			if (!this->Update(1.0))
+				Thread::Sleep(1.0);
+		}
+
+		return true;
+	}
+
+	void SimpleClient::SetMaxQueuedBytes(uint64_t givenMaxQueuedBytes)
+	{
+		this->maxQueuedBytes = givenMaxQueuedBytes;
+	}
+
+	void SimpleClient::SetFailFastSeconds(double givenFailFastSeconds)
+	{
+		this->failFastSeconds = givenFailFastSeconds;
+	}
+
+	void SimpleClient::SetBusyPollSeconds(double givenBusyPollSeconds)
+	{
+		this->busyPollSeconds = givenBusyPollSeconds;
+
+		// The reception thread may be blocked in a read right now, but it'll pick this up on the next one.
+		if (this->socketStream)
+			this->socketStream->SetBusyPollSeconds(givenBusyPollSeconds);
+	}
+
+	void SimpleClient::SetPipelineWindow(uint32_t maxWindowSize, bool adaptive /*= false*/, uint32_t minWindowSize /*= 8*/)
+	{
+		this->pipelineWindow.Configure(adaptive ? minWindowSize : maxWindowSize, maxWindowSize, adaptive);
+	}
+
+	void SimpleClient::SetMaxQueuedRequests(uint32_t givenMaxQueuedRequests, Backpressure givenBackpressure /*= BACKPRESSURE_REFUSE*/, double givenBlockTimeoutSeconds /*= 5.0*/)
+	{
+		this->maxQueuedRequests = givenMaxQueuedRequests;
+		this->backpressure = givenBackpressure;
+		this->blockTimeoutSeconds = givenBlockTimeoutSeconds;
+	}
+
+	// Unlike the general implementation, we don't wait for the next update to send the request,
+	// nor do we deliver the response through the served list.  The reception thread hands it
+	// directly to us through the request's completion slot, on which we spin and then park.
+	/*virtual*/ bool SimpleClient::MakeRequestSync(const ProtocolData* requestData, ProtocolData*& responseData, bool deleteData /*= true*/, double timeoutSeconds /*= 5.0*/)
+	{
+		responseData = nullptr;
+
+		double deadlineSeconds = GetMonotonicTimeSeconds() + timeoutSeconds;
+
+		Request* request = this->AllocRequest();
+		request->requestData = requestData;
+		request->ownsRequestDataMem = deleteData;
+		request->size = ProtocolData::CalcCommandSize(requestData);
+		request->completionSlot.Arm();
+		this->EnqueueRequest(request);
+
+		// An update writes out our request along with anything queued ahead of it.  We only need to
+		// keep updating if we don't yet have a connection, or if the pipeline window is full, in which
+		// case we wait a bit on responses to come back.  Note that nothing else can free the request
+		// out from under us here, since we are the update thread.
+		double updateTimeoutMilliseconds = 0.0;
+		while (true)
+		{
+			bool updated = this->Update(updateTimeoutMilliseconds);
+
+			if (request->sent)
+				break;
+
+			if (GetMonotonicTimeSeconds() >= deadlineSeconds)
 			{
-				request->callback = [](const ProtocolData*) -> bool { return true; };
-				return true;
+				// It never went out, so the next update will discard it.
+				request->canceled = true;
+				return false;
 			}
 
-			Thread::Sleep(100);
+			if (!updated)
+				Thread::Sleep(1.0);
+
+			updateTimeoutMilliseconds = 1.0;
 		}
-		
-		return false;
+
+		if (!request->completionSlot.Wait(deadlineSeconds, this->syncSpinSeconds))
+		{
+			// The reception thread will now route the request through the served list once its
+			// response finally arrives, and because it's canceled, it will be discarded there.
+			request->canceled = true;
+			request->callback = nullptr;
+			return false;
+		}
+
+		responseData = request->responseData;
+		this->DeallocRequest(request);
+		return true;
+	}
+
+	/*virtual*/ bool SimpleClient::CancelAsyncRequest(RequestHandle requestHandle)
+	{
+		// Requests are only ever freed by the Update() thread, which is also the thread
+		// calling us, so the request can't disappear out from under us here.  Wherever it
+		// is in its lifetime, we just flag it, and the Update() thread will discard it
+		// instead of sending it or instead of calling its callback.  We drop the callback
+		// right away so that anything it captured is released now rather than later.
+		// The one exception is inline completion, which frees requests on the reception
+		// thread, hence the lock.
+		MutexLocker locker(this->cancelMutex);
+		Request* request = this->requestSlab->Lookup(requestHandle);
+		if (!request || request->canceled)
+			return false;
+
+		request->canceled = true;
+		request->callback = nullptr;
+		return true;
 	}
 
 	/*virtual*/ bool SimpleClient::MakeTransactionRequestAsync(DynamicArray<const ProtocolData*>& requestDataArray, Callback callback /*= [](const ProtocolData*) -> bool { return true; }*/, bool deleteData /*= true*/)
@@ -372,7 +1103,27 @@ namespace Yarc
 
 		auto lambda = [&]() -> bool
 		{
-			this->MakeRequestAsync(ProtocolData::ParseCommand("MULTI"), [=](const ProtocolData* responseData) { return true; });
+			// The transaction goes into the queue as a whole or not at all.  If it fails, it fails as a whole through the EXEC callback.
+			uint64_t transactionSize = 0;
+			for (uint32_t j = 0; j < requestDataArray.GetCount(); j++)
+				transactionSize += ProtocolData::CalcCommandSize(requestDataArray[j]);
+
+			if (this->failingFast)
+			{
+				this->QueueRequest(nullptr, std::move(callback), false, 0, "ERR yarc: disconnected from server");
+				return true;
+			}
+
+			if (!this->WaitForQueueRoom(requestDataArray.GetCount() + 2, transactionSize))
+			{
+				if (this->backpressure != BACKPRESSURE_FAIL)
+					return false;
+
+				this->QueueRequest(nullptr, std::move(callback), false, 0, "ERR yarc: request queue is full");
+				return true;
+			}
+
+			this->QueueRequest(ProtocolData::ParseCommand("MULTI"), [=](const ProtocolData* responseData) { return true; }, true, 0);
 
 			// It's important to point out that while in typical asynchronous systems, requests are
 			// not guarenteed to be fulfilled in the same order that they were made, that is not
@@ -380,14 +1131,15 @@ namespace Yarc
 			// server in the same order that they're given here.
 			while(i < requestDataArray.GetCount())
 			{
-				this->MakeRequestAsync(requestDataArray[i++], [=](const ProtocolData* responseData) {
+				uint32_t requestSize = ProtocolData::CalcCommandSize(requestDataArray[i]);
+				this->QueueRequest(requestDataArray[i++], [=](const ProtocolData* responseData) {
 					// Note that we don't need to worry if there was an error queueing the command.
 					// The server will remember the error, and discard the transaction when EXEC is called.
 					return true;
-				});
+				}, deleteData, requestSize);
 			}
 
-			this->MakeRequestAsync(ProtocolData::ParseCommand("EXEC"), callback);
+			this->QueueRequest(ProtocolData::ParseCommand("EXEC"), std::move(callback), true, 0);
 			return true;
 		};
 
@@ -400,6 +1152,48 @@ namespace Yarc
 		return success;
 	}
 
+	/*virtual*/ bool SimpleClient::MakePipelineRequestAsync(Pipeline* pipeline, Pipeline::Callback callback /*= [](Pipeline*) -> bool { return true; }*/)
+	{
+		if (pipeline->GetCount() == 0)
+			return false;
+
+		uint32_t requestSize = pipeline->CalcSize();
+
+		const char* error = nullptr;
+		if (this->failingFast)
+			error = "ERR yarc: disconnected from server";
+		else if (!this->WaitForQueueRoom(1, requestSize))
+		{
+			if (this->backpressure != BACKPRESSURE_FAIL)
+				return false;
+
+			error = "ERR yarc: request queue is full";
+		}
+
+		pipeline->Begin(std::move(callback));
+
+		// The replies go straight into the pipeline as they come in, so by the time this is called, the only
+		// response there can be is an error failing the whole request.  Whatever the pipeline didn't get fails with it.
+		Request* request = this->AllocRequest();
+		request->pipeline = pipeline;
+		request->size = requestSize;
+		request->callback = [pipelineOwner = std::unique_ptr<Pipeline>(pipeline)](const ProtocolData* responseData) mutable {
+			Pipeline* pipeline = pipelineOwner.release();
+			const SimpleErrorData* errorData = responseData ? Cast<SimpleErrorData>(responseData) : nullptr;
+			if (errorData)
+				pipeline->Fail(errorData->GetValue().c_str());
+			pipeline->Complete();
+			return true;
+		};
+
+		if (error)
+			this->FailRequest(request, error);
+		else
+			this->EnqueueRequest(request);
+
+		return true;
+	}
+
 	/*virtual*/ bool SimpleClient::MakeTransactionRequestSync(DynamicArray<const ProtocolData*>& requestDataArray, ProtocolData*& responseData, bool deleteData /*= true*/, double timeoutSeconds /*= 5.0*/)
 	{
 		uint32_t i = 0;
@@ -448,15 +1242,22 @@ namespace Yarc
 
 	//------------------------------ SimpleClient::Request ------------------------------
 
-	int SimpleClient::Request::nextRequestID = 0;
-
 	SimpleClient::Request::Request()
 	{
-		this->requestID = this->nextRequestID++;
 		this->requestData = nullptr;
 		this->responseData = nullptr;
 		this->ownsRequestDataMem = false;
 		this->ownsResponseDataMem = false;
+		this->canceled = false;
+		this->sent = false;
+		this->sendTime = 0.0;
+		this->size = 0;
+		this->retainedSize = 0;
+		this->orderingKey = 0;
+		this->handshake = false;
+		this->heartbeat = false;
+		this->pipeline = nullptr;
+		this->numPipelineReplies = 0;
 	}
 
 	/*virtual*/ SimpleClient::Request::~Request()
@@ -481,4 +1282,111 @@ namespace Yarc
 		if (this->ownsMessageData)
 			delete this->messageData;
 	}
+
+	//------------------------------ SimpleClient::ConnectionProfile ------------------------------
+
+	SimpleClient::ConnectionProfile::ConnectionProfile()
+	{
+		this->database = 0;
+		this->protocolVersion = 0;
+		this->tracking = false;
+		this->trackingBroadcast = false;
+		this->trackingNoLoop = false;
+		this->readOnly = false;
+	}
+
+	// Credentials and names can have spaces in them, so we can't go through ParseCommand() here.
+	static ProtocolData* MakeCommand(const std::vector<std::string>& argArray)
+	{
+		ArrayData* commandData = new ArrayData();
+		commandData->SetCount((uint32_t)argArray.size());
+
+		for (uint32_t i = 0; i < (uint32_t)argArray.size(); i++)
+		{
+			BlobStringData* argData = new BlobStringData();
+			argData->SetValue(argArray[i]);
+			commandData->SetElement(i, argData);
+		}
+
+		return commandData;
+	}
+
+	void SimpleClient::ConnectionProfile::MakeCommands(DynamicArray<ProtocolData*>& commandArray) const
+	{
+		std::vector<std::vector<std::string>> argArrayArray;
+
+		std::string user = (this->username.length() > 0) ? this->username : "default";
+
+		if (this->protocolVersion != 0)
+		{
+			std::vector<std::string> argArray{"HELLO", std::to_string(this->protocolVersion)};
+
+			if (this->password.length() > 0)
+				argArray.insert(argArray.end(), {"AUTH", user, this->password});
+
+			if (this->clientName.length() > 0)
+				argArray.insert(argArray.end(), {"SETNAME", this->clientName});
+
+			argArrayArray.push_back(argArray);
+		}
+		else
+		{
+			if (this->password.length() > 0)
+			{
+				if (this->username.length() > 0)
+					argArrayArray.push_back({"AUTH", this->username, this->password});
+				else
+					argArrayArray.push_back({"AUTH", this->password});
+			}
+
+			if (this->clientName.length() > 0)
+				argArrayArray.push_back({"CLIENT", "SETNAME", this->clientName});
+		}
+
+		if (this->database != 0)
+			argArrayArray.push_back({"SELECT", std::to_string(this->database)});
+
+		if (this->tracking)
+		{
+			std::vector<std::string> argArray{"CLIENT", "TRACKING", "ON"};
+
+			if (this->trackingBroadcast)
+			{
+				argArray.push_back("BCAST");
+				for (const std::string& prefix : this->trackingPrefixArray)
+					argArray.insert(argArray.end(), {"PREFIX", prefix});
+			}
+
+			if (this->trackingNoLoop)
+				argArray.push_back("NOLOOP");
+
+			argArrayArray.push_back(argArray);
+		}
+
+		if (this->readOnly)
+			argArrayArray.push_back({"READONLY"});
+
+		for (const std::vector<std::string>& argArray : argArrayArray)
+		{
+			commandArray.SetCount(commandArray.GetCount() + 1);
+			commandArray[commandArray.GetCount() - 1] = MakeCommand(argArray);
+		}
+	}
+
+	// The commands themselves, as sent, say it all.
+	std::string SimpleClient::ConnectionProfile::MakePoolKey(void) const
+	{
+		DynamicArray<ProtocolData*> commandArray;
+		this->MakeCommands(commandArray);
+
+		std::string poolKey;
+		StringStream stringStream(&poolKey);
+		for (uint32_t i = 0; i < commandArray.GetCount(); i++)
+		{
+			commandArray[i]->Print(&stringStream);
+			delete commandArray[i];
+		}
+
+		return poolKey;
+	}
 }
\ No newline at end of file
@@ -7,8 +7,13 @@
 #include "yarc_socket_stream.h"
 #include "yarc_thread_safe_list.h"
 #include "yarc_semaphore.h"
+#include "yarc_slab.h"
+#include "yarc_completion_slot.h"
+#include "yarc_pipeline_window.h"
 #include <stdint.h>
 #include <string>
+#include <vector>
+#include <atomic>
 #include <time.h>
 
 namespace Yarc
@@ -20,20 +25,35 @@ namespace Yarc
 
 	public:
 
+		// Failed connection attempts are retried with a growing delay (see SetReconnectBackoff()) of at most the given retry time.
 		SimpleClient(double connectionTimeoutSeconds = 0.5, double connectionRetrySeconds = 5.0);
 		virtual ~SimpleClient();
 
 		// When used as a DLL, these ensure that the client is allocated and freed in the proper heap.
+		// The connection is only recycled if nothing is still awaiting a response, so flush first.  It goes back to
+		// the pool tagged with our connection profile, and only a client with the same profile will get it again.
+		// State set up by hand rather than through the profile (e.g., a SELECT request) goes with it, so don't
+		// recycle a connection on which you've done that.
 		static SimpleClient* Create();
 		static void Destroy(SimpleClient* client, bool tryToRecycleConnection = false);
 
 		virtual bool Update(double timeoutMilliseconds = 0.0) override;
 		virtual bool Flush(double timeoutSeconds = 5.0) override;
-		virtual int MakeRequestAsync(const ProtocolData* requestData, Callback callback = [](const ProtocolData*) -> bool { return true; }, bool deleteData = true) override;
-		virtual bool CancelAsyncRequest(int requestID) override;
+		virtual RequestHandle MakeRequestAsync(const ProtocolData* requestData, Callback callback = [](const ProtocolData*) -> bool { return true; }, bool deleteData = true) override;
+		virtual bool MakeRequestSync(const ProtocolData* requestData, ProtocolData*& responseData, bool deleteData = true, double timeoutSeconds = 5.0) override;
+		virtual bool CancelAsyncRequest(RequestHandle requestHandle) override;
 		virtual bool MakeTransactionRequestAsync(DynamicArray<const ProtocolData*>& requestDataArray, Callback callback = [](const ProtocolData*) -> bool { return true; }, bool deleteData = true) override;
 		virtual bool MakeTransactionRequestSync(DynamicArray<const ProtocolData*>& requestDataArray, ProtocolData*& responseData, bool deleteData = true, double timeoutSeconds = 5.0) override;
 
+		// The whole pipeline is a single request, printed all at once, so it goes out in one write (unless it's
+		// huge), and counts as just one request against the pipeline window and the queue limits.
+		virtual bool MakePipelineRequestAsync(Pipeline* pipeline, Pipeline::Callback callback = [](Pipeline*) -> bool { return true; }) override;
+
+		// This calls the given callback with the given response on the next update, just as if a request had been made
+		// and answered, with a handle that can be canceled like any other.  It's how a cache in front of us (see CachingClient)
+		// answers from memory.  We take ownership of the response.
+		RequestHandle MakeAnsweredRequestAsync(ProtocolData* responseData, Callback callback);
+
 		SocketStream* GetSocketStream() { return this->socketStream; }
 
 		typedef std::function<bool(SimpleClient*)> EventCallback;
@@ -44,6 +64,139 @@ namespace Yarc
 		EventCallback GetPostConnectCallback(void);
 		EventCallback GetPreDisconnectCallback(void);
 
+		// This describes how a connection should be set up before it's used.  Rather than do this in a post-connect
+		// callback, a round-trip at a time, we send all of it in one go, as soon as we connect, ahead of any requests.
+		// Requests made in the meantime just go out behind it.  Everything here is optional.
+		struct ConnectionProfile
+		{
+			ConnectionProfile();
+
+			std::string username;					// An ACL user (Redis 6 and up).  Empty means the default user.
+			std::string password;					// Empty means don't authenticate.
+			int database;							// Selected when not zero.
+			int protocolVersion;					// 2 or 3 sends a HELLO (Redis 6 and up), which also takes care of authentication and the client name.  Zero means don't.
+			std::string clientName;					// Empty means don't name the connection.
+			bool tracking;							// Turn on client-side caching invalidation messages.  These are pushed, so use protocol version 3.
+			bool trackingBroadcast;					// Be told about every key with one of the given prefixes, rather than just the keys we've read.
+			bool trackingNoLoop;					// Don't be told about keys changed through this very connection.
+			std::vector<std::string> trackingPrefixArray;	// Only used in broadcast mode.
+			bool readOnly;							// Allow reads from a cluster replica.
+
+			// Make the commands to send, in order, giving them to the caller.
+			void MakeCommands(DynamicArray<ProtocolData*>& commandArray) const;
+
+			// This names the state the commands leave a connection in, so that pooled connections aren't mixed up
+			// between clients with different profiles.  It's empty for a profile that sends nothing.
+			std::string MakePoolKey(void) const;
+		};
+
+		// This takes effect on the next connection (including any we get from the pool), so set it before making any requests.
+		void SetConnectionProfile(const ConnectionProfile& givenConnectionProfile) { *this->connectionProfile = givenConnectionProfile; }
+		const ConnectionProfile& GetConnectionProfile(void) const { return *this->connectionProfile; }
+
+		enum HandshakeStatus
+		{
+			HANDSHAKE_STATUS_NONE,			// There's nothing in the profile to send, or we haven't connected yet.
+			HANDSHAKE_STATUS_PENDING,
+			HANDSHAKE_STATUS_SUCCEEDED,
+			HANDSHAKE_STATUS_FAILED
+		};
+
+		// However many of the profile's commands fail, the given callback is called just once per connection, from
+		// within Update(), and the first error can then be had here.  Note that requests queued behind the profile
+		// have gone out regardless, so they are likely to fail too (e.g., with NOAUTH), each in its own callback.
+		void SetHandshakeFailedCallback(EventCallback givenCallback) { *this->handshakeFailedCallback = givenCallback; }
+		HandshakeStatus GetHandshakeStatus(void) const { return this->handshakeStatus; }
+		const std::string& GetHandshakeError(void) const { return *this->handshakeError; }
+
+		// A synchronous request busy-waits for up to this long for its response before
+		// parking the calling thread.  Zero means never spin.
+		void SetSyncSpinSeconds(double givenSyncSpinSeconds) { this->syncSpinSeconds = givenSyncSpinSeconds; }
+		double GetSyncSpinSeconds(void) const { return this->syncSpinSeconds; }
+
+		// At most this many requests are sent without yet having gotten a response.  The rest
+		// wait in the unsent queue until responses come back.  If adaptive, the window is instead
+		// tuned between the given bounds from observed round-trip times.  See PipelineWindow.
+		void SetPipelineWindow(uint32_t maxWindowSize, bool adaptive = false, uint32_t minWindowSize = 8);
+		uint32_t GetPipelineWindowSize(void) const { return this->pipelineWindow.GetSize(); }
+		double GetSmoothedRoundTripSeconds(void) const { return this->pipelineWindow.GetSmoothedRoundTripSeconds(); }
+
+		enum Backpressure
+		{
+			BACKPRESSURE_BLOCK,		// Drive the client until there's room, up to a time-out.  Only do this on the Update() thread.
+			BACKPRESSURE_REFUSE,	// Return a null handle straight away.  The caller keeps the request data.
+			BACKPRESSURE_FAIL		// Accept the request, but complete it with an error response on the next update.
+		};
+
+		// Limit the number of requests waiting to be sent.  What happens when a request is made
+		// while the queue is full depends on the given backpressure.  Zero means no limit.
+		void SetMaxQueuedRequests(uint32_t givenMaxQueuedRequests, Backpressure givenBackpressure = BACKPRESSURE_REFUSE, double givenBlockTimeoutSeconds = 5.0);
+
+		// Likewise, limit the memory taken up by requests waiting to be sent.  Zero means no limit.
+		void SetMaxQueuedBytes(uint64_t givenMaxQueuedBytes);
+
+		// Once we've been without a connection for this long, every queued request, and every request
+		// made from then on until we reconnect, is completed with an error response.  Zero means never.
+		void SetFailFastSeconds(double givenFailFastSeconds);
+
+		// Normally, callbacks are called from within Update(), on whatever thread calls it.  With inline
+		// completion, they are instead called on the reception thread as soon as each response is parsed,
+		// saving the wait for the next update.  This should be set before any requests are made.  Be aware
+		// that callbacks then run concurrently with the Update() thread, so anything they share with it must
+		// be synchronized.  They should also be quick, since no other response is received while one runs.
+		// A callback may make or cancel asynchronous requests (unless the client is set to block when its
+		// queue is full), but must not call Update(), Flush() or any synchronous method.  Synchronous requests
+		// and pushed messages are unaffected, and a cancellation either wins or finds the request gone.
+		void SetInlineCompletion(bool givenInlineCompletion) { this->inlineCompletion = givenInlineCompletion; }
+		bool GetInlineCompletion(void) const { return this->inlineCompletion; }
+
+		// The reception thread is spawned with these options, which can be used to pin it to a core, give it
+		// real-time priority, and so on.  They take effect the next time the thread is spawned, which is
+		// when we first connect, so set them before making any requests.  By default, the thread is only named.
+		void SetThreadOptions(const Thread::Options& givenThreadOptions) { *this->threadOptions = givenThreadOptions; }
+		const Thread::Options& GetThreadOptions(void) const { return *this->threadOptions; }
+
+		// Have the reception thread spin for up to this long waiting on the socket before it blocks.
+		// See SocketStream::SetBusyPollSeconds().  Zero (the default) means never spin.
+		void SetBusyPollSeconds(double givenBusyPollSeconds);
+		double GetBusyPollSeconds(void) const { return this->busyPollSeconds; }
+
+		// Arguments that refer to a shared buffer (see BlobStringData::SetFromSharedBuffer()) of at least this many bytes
+		// are sent straight from that buffer with zero-copy (see SocketStream::WriteZeroCopy()).  Smaller ones are just
+		// copied into the output buffer along with everything else, as copying them is cheaper than pinning them.
+		void SetZeroCopyThreshold(uint32_t givenZeroCopyThreshold) { this->zeroCopyThreshold = givenZeroCopyThreshold; }
+		uint32_t GetZeroCopyThreshold(void) const { return this->zeroCopyThreshold; }
+
+		// Turn on TCP keepalive for each connection we make.  See SocketStream::SetKeepAlive().  Zero (the default) turns it off.
+		void SetKeepAlive(double idleSeconds, double intervalSeconds = 1.0, uint32_t probeCount = 3);
+
+		// Once the connection has been quiet for the given heartbeat time, we send a PING, which keeps it from being
+		// dropped as idle by anything in between, and gives the response time-out something to go on.  If we're ever
+		// waiting on a response and hear nothing at all from the server for the response time-out, we take the
+		// connection for dead: it's dropped, everything awaiting a response fails, and we reconnect.  So make sure the
+		// response time-out is longer than the slowest command (blocking ones especially).  Zero turns either off.
+		void SetHeartbeat(double givenHeartbeatSeconds, double givenResponseTimeoutSeconds);
+
+		// After a failed connection attempt, we wait this long before trying again, then twice that after the next
+		// failure, and so on, up to the retry time given to the constructor.  Each wait is cut by up to half, at random,
+		// so that a crowd of clients that lost their server at the same moment don't all come back at the same moment.
+		// For the same reason, we wait up to this long before reconnecting after losing a connection.
+		void SetReconnectBackoff(double givenReconnectInitialDelaySeconds) { this->reconnectInitialDelaySeconds = givenReconnectInitialDelaySeconds; }
+
+		// This goes up by one each time we connect (or reconnect) to the server.
+		uint32_t GetNumConnectionsMade(void) const { return this->numConnectionsMade; }
+
+		uint32_t GetNumQueuedRequests(void) const { return this->unsentRequestList->GetCount(); }
+		uint64_t GetNumQueuedBytes(void) const { return this->numQueuedBytes; }
+		bool IsFailingFast(void) const { return this->failingFast; }
+		uint32_t GetNumRequestsAwaitingResponse(void) const { return this->sentRequestList->GetCount(); }
+
+		// This is roughly how much memory is being kept alive on behalf of requests that have been sent
+		// but not yet answered.  Requests we own are let go of as soon as they've been written out, leaving
+		// just their bookkeeping behind, but those whose memory belongs to the caller (who may want to resend
+		// them elsewhere, as the cluster client does on a redirect) stay put until the response comes back.
+		uint64_t GetInFlightMemoryBytes(void) const;
+
 	protected:
 
 		void TryToRecycleConnection();
@@ -59,8 +212,17 @@ namespace Yarc
 			Callback callback;
 			bool ownsRequestDataMem;
 			bool ownsResponseDataMem;
-			int requestID;
-			static int nextRequestID;
+			bool canceled;
+			bool sent;
+			double sendTime;
+			uint32_t size;
+			uint32_t retainedSize;
+			uint64_t orderingKey;
+			bool handshake;					// Sent from the connection profile, and dealt with by the reception thread.
+			bool heartbeat;					// Likewise, a PING sent to see that the connection is still alive.
+			Pipeline* pipeline;				// Sent in place of the request data, and owned by the callback.
+			uint32_t numPipelineReplies;	// How many replies the reception thread has given the pipeline so far.
+			CompletionSlot completionSlot;	// Only armed for synchronous requests.
 		};
 
 		class Message
@@ -75,6 +237,7 @@ namespace Yarc
 
 		typedef ThreadSafeList<Request*> RequestList;
 		typedef ThreadSafeList<Message*> MessageList;
+		typedef Slab<Request> RequestSlab;
 
 		RequestList* unsentRequestList;
 		RequestList* sentRequestList;
@@ -88,16 +251,74 @@ namespace Yarc
 		EventCallback* preDisconnectCallback;
 
 		void ThreadFunc(void);
+		bool ManageConnection(double timeoutMilliseconds);
+		void QueueHeartbeat(void);
+		void ScheduleReconnect(void);
+		void FailSentRequests(const char* error);
+		void CompleteHeartbeatRequest(Request* request);
+		void SendUnsentRequests(void);
+		bool WaitForQueueRoom(uint32_t numRequests, uint64_t numBytes);
+		RequestHandle QueueRequest(const ProtocolData* requestData, Callback callback, bool deleteData, uint32_t requestSize, const char* error = nullptr);
+		void EnqueueRequest(Request* request);
+		Request* DequeueRequest(void);
+		void QueueHandshake(void);
+		void CompleteHandshakeRequest(Request* request);
+		void FailRequest(Request* request, const char* error);
+		void FailQueuedRequests(const char* error);
+		void CompleteRequestInline(Request* request);
+		void DispatchRequest(Request* request);
+		void WakeUpdate(void);
+		uint64_t CalcOrderingKey(const ProtocolData* requestData);
+		void AddServedRequest(Request* request);
 
 		Request* AllocRequest();
 		void DeallocRequest(Request* request);
+		void DeallocRequestList(RequestList* requestList);
+
+		RequestSlab* requestSlab;
 
 		Thread* thread;
+		Thread::Options* threadOptions;
 		SocketStream* socketStream;
+		Request* receivingPipelineRequest;
+		double busyPollSeconds;
 		volatile bool threadExitSignal;
 		double connectionTimeoutSeconds;
 		double connectionRetrySeconds;
-		::clock_t lastFailedConnectionAttemptTime;
-		int numRequestsInFlight;
+		double syncSpinSeconds;
+		std::string* outputBuffer;
+		PipelineWindow pipelineWindow;
+		uint32_t maxQueuedRequests;
+		uint64_t maxQueuedBytes;
+		std::atomic<uint64_t> numQueuedBytes;
+		std::atomic<uint64_t> numRetainedBytes;
+		double failFastSeconds;
+		double disconnectedTime;
+		volatile bool failingFast;
+		bool inlineCompletion;
+		std::atomic<bool> updateWaiting;
+		Mutex cancelMutex;
+		Backpressure backpressure;
+		double blockTimeoutSeconds;
+		double nextConnectionAttemptTime;
+		uint32_t numConnectionFailures;
+		std::atomic<uint32_t> numConnectionsMade;
+		double reconnectInitialDelaySeconds;
+		double keepAliveIdleSeconds;
+		double keepAliveIntervalSeconds;
+		uint32_t keepAliveProbeCount;
+		double heartbeatSeconds;
+		double responseTimeoutSeconds;
+		volatile bool heartbeatPending;
+		std::atomic<int> numRequestsInFlight;
+		std::atomic<int> numDispatchedCallbacks;
+		ConnectionProfile* connectionProfile;
+		std::string* connectionPoolKey;		// That of the profile our current connection was set up with.
+		EventCallback* handshakeFailedCallback;
+		std::string* handshakeError;
+		std::atomic<HandshakeStatus> handshakeStatus;
+		uint32_t numHandshakeRequestsPending;
+		bool handshakeFailureReported;
+		uint32_t zeroCopyThreshold;
 	};
 }
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "yarc_api.h"
+#include "yarc_dynamic_array.h"
+#include "yarc_mutex.h"
+#include <stdint.h>
+#include <new>
+#include <utility>
+
+namespace Yarc
+{
+	// Objects handed out here are carved from blocks of slots that are never returned to
+	// the heap until the slab itself goes away.  Freed slots go onto a free-list and are
+	// reused by the next allocation, so once a slab has grown to its high-water mark,
+	// allocating and freeing objects costs no more than a mutex lock and a pointer swap.
+	// Constructors and destructors are called as usual, unlike the dynamic array.
+	//
+	// Every object can also be named by a handle made from its slot index and the slot's
+	// generation count.  The generation is bumped each time the slot is freed, so a handle
+	// to an object that has since gone away simply fails to resolve, even if its slot has
+	// been reused, and resolving a handle never requires a search.
+	template<typename T, uint32_t slotsPerBlock = 64>
+	class Slab
+	{
+	public:
+
+		Slab()
+		{
+			this->freeSlotList = nullptr;
+			this->numAllocated = 0;
+		}
+
+		virtual ~Slab()
+		{
+			// The caller is responsible for freeing all outstanding objects first.
+			assert(this->numAllocated == 0);
+
+			for (unsigned int i = 0; i < this->blockArray.GetCount(); i++)
+				delete[] this->blockArray[i];
+		}
+
+		template<typename... Args>
+		T* Allocate(Args&&... args)
+		{
+			Slot* slot = nullptr;
+
+			{
+				MutexLocker locker(this->mutex);
+
+				if (!this->freeSlotList)
+					this->AddBlock();
+
+				slot = this->freeSlotList;
+				this->freeSlotList = slot->nextFreeSlot;
+				slot->allocated = true;
+				this->numAllocated++;
+			}
+
+			return new (slot->objectMem) T(std::forward<Args>(args)...);
+		}
+
+		void Deallocate(T* object)
+		{
+			if (!object)
+				return;
+
+			object->~T();
+
+			Slot* slot = (Slot*)object;
+
+			MutexLocker locker(this->mutex);
+			slot->allocated = false;
+			slot->generation = (slot->generation == 0xFFFFFFFF) ? 1 : slot->generation + 1;
+			slot->nextFreeSlot = this->freeSlotList;
+			this->freeSlotList = slot;
+			this->numAllocated--;
+		}
+
+		// Note that zero is never a valid handle.
+		uint64_t GetHandle(const T* object)
+		{
+			const Slot* slot = (const Slot*)object;
+			return (uint64_t(slot->generation) << 32) | uint64_t(slot->index);
+		}
+
+		// Return the object named by the given handle, or null if it has since been freed.
+		T* Lookup(uint64_t handle)
+		{
+			uint32_t index = uint32_t(handle & 0xFFFFFFFF);
+			uint32_t generation = uint32_t(handle >> 32);
+
+			MutexLocker locker(this->mutex);
+
+			if (index / slotsPerBlock >= this->blockArray.GetCount())
+				return nullptr;
+
+			Slot* slot = &this->blockArray[index / slotsPerBlock][index % slotsPerBlock];
+			if (!slot->allocated || slot->generation != generation)
+				return nullptr;
+
+			return (T*)slot->objectMem;
+		}
+
+		uint32_t GetNumAllocated() const { return this->numAllocated; }
+		uint32_t GetCapacity() const { return this->blockArray.GetCount() * slotsPerBlock; }
+
+	private:
+
+		// The object memory must come first so that we can go from object pointer to slot pointer.
+		struct Slot
+		{
+			alignas(T) uint8_t objectMem[sizeof(T)];
+			Slot* nextFreeSlot;
+			uint32_t index;
+			uint32_t generation;
+			bool allocated;
+		};
+
+		void AddBlock()
+		{
+			Slot* block = new Slot[slotsPerBlock];
+			uint32_t firstIndex = this->blockArray.GetCount() * slotsPerBlock;
+
+			for (uint32_t i = 0; i < slotsPerBlock; i++)
+			{
+				block[i].nextFreeSlot = (i + 1 < slotsPerBlock) ? &block[i + 1] : this->freeSlotList;
+				block[i].index = firstIndex + i;
+				block[i].generation = 1;
+				block[i].allocated = false;
+			}
+
+			this->freeSlotList = &block[0];
+
+			this->blockArray.SetCount(this->blockArray.GetCount() + 1);
+			this->blockArray[this->blockArray.GetCount() - 1] = block;
+		}
+
+		Mutex mutex;
+		DynamicArray<Slot*> blockArray;
+		Slot* freeSlotList;
+		uint32_t numAllocated;
+	};
+}
\ No newline at end of file
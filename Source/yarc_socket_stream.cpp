@@ -1,20 +1,51 @@
 #include "yarc_socket_stream.h"
 #include "yarc_misc.h"
+#include "yarc_resolver.h"
+#include "yarc_shared_buffer.h"
 #include <time.h>
 #include <string.h>
+#include <errno.h>
 
 #if defined __WINDOWS__
+#	include <mstcpip.h>
 #	pragma comment(lib, "Ws2_32.lib")
+#elif defined __LINUX__
+#	include <sys/eventfd.h>
+#	include <poll.h>
+#	include <sys/sendfile.h>
+#	include <sys/stat.h>
+#	include <fcntl.h>
+#	include <linux/errqueue.h>
+#	if defined MSG_ZEROCOPY && defined SO_ZEROCOPY && defined SO_EE_ORIGIN_ZEROCOPY
+#		define YARC_HAS_ZERO_COPY
+#	endif
 #endif
 
 namespace Yarc
 {
+#if defined __LINUX__
+	// Round up so that a short wait doesn't turn into a busy loop.  A negative wait means wait forever.
+	static int PollTimeoutMilliseconds(double seconds)
+	{
+		if (seconds < 0.0)
+			return -1;
+
+		double milliseconds = seconds * 1000.0;
+		int roundedMilliseconds = int(milliseconds);
+		if (double(roundedMilliseconds) < milliseconds)
+			roundedMilliseconds++;
+
+		return roundedMilliseconds;
+	}
+#endif
+
 	//----------------------------------- Address -----------------------------------
 
 	Address::Address()
 	{
 		::strcpy(this->ipAddress, "127.0.0.1");
 		this->hostname[0] = '\0';
+		this->unixSocketPath[0] = '\0';
 		this->port = 6379;
 	}
 
@@ -24,85 +55,151 @@ namespace Yarc
 
 	bool Address::operator==(const Address& address) const
 	{
+		if (this->IsUnixSocket() || address.IsUnixSocket())
+			return 0 == ::strcmp(this->unixSocketPath, address.unixSocketPath);
+
 		if (this->port != address.port)
 			return false;
 
+		// The same name is the same place, so there's no need to resolve anything.
+		if (this->hostname[0] != '\0' && 0 == ::strcmp(this->hostname, address.hostname))
+			return true;
+
 		return 0 == ::strcmp(this->GetResolvedIPAddress(), address.GetResolvedIPAddress());
 	}
 
 	void Address::SetIPAddress(const char* givenIPAddress)
 	{
+		if (this->SetUnixSocketPath(givenIPAddress))
+			return;
+
 		::strcpy(this->ipAddress, givenIPAddress);
 	}
 
 	void Address::SetHostname(const char* givenHostname)
 	{
+		if (this->SetUnixSocketPath(givenHostname))
+			return;
+
 		::strcpy(this->hostname, givenHostname);
 	}
 
-	const char* Address::GetResolvedIPAddress() const
+	// Anything not of the form "unix:<path>" leaves us a TCP address, and false is returned.
+	bool Address::SetUnixSocketPath(const char* givenUnixSocketPath)
 	{
-		if (::strlen(this->hostname) > 0)
-		{
-#if defined __WINDOWS__
-			WSADATA data;
-			::WSAStartup(MAKEWORD(2, 2), &data);
-#endif
+		this->unixSocketPath[0] = '\0';
 
-			char portStr[16];
-			sprintf(portStr, "%d", this->port);
+		if (0 != ::strncmp(givenUnixSocketPath, "unix:", 5))
+			return false;
 
-			struct addrinfo* addrInfo = nullptr;
-			if (0 == getaddrinfo(this->hostname, portStr, nullptr, &addrInfo))
-			{
-				while (addrInfo)
-				{
-					if (addrInfo->ai_family == AF_INET)
-						break;
+		givenUnixSocketPath += 5;
+		if (*givenUnixSocketPath == '\0' || ::strlen(givenUnixSocketPath) >= sizeof(this->unixSocketPath))
+			return false;
 
-					addrInfo = addrInfo->ai_next;
-				}
+		::strcpy(this->unixSocketPath, givenUnixSocketPath);
+		return true;
+	}
 
-				if (addrInfo)
-				{
-#if defined __WINDOWS__
-					::sockaddr_in* sockAddr = (::sockaddr_in*)addrInfo->ai_addr;
-					::sprintf(this->ipAddress, "%d.%d.%d.%d",
-						sockAddr->sin_addr.S_un.S_un_b.s_b1,
-						sockAddr->sin_addr.S_un.S_un_b.s_b2,
-						sockAddr->sin_addr.S_un.S_un_b.s_b3,
-						sockAddr->sin_addr.S_un.S_un_b.s_b4);
-#elif defined __LINUX__
-					getnameinfo(addrInfo->ai_addr, addrInfo->ai_addrlen, this->ipAddress, sizeof(this->ipAddress), nullptr, 0, NI_NAMEREQD|NI_NUMERICHOST);
-#endif
-				}
-			}
-		}
+	// This is cheap enough to call on the request path, since lookups are cached.  If the hostname
+	// can't be resolved, we're left with whatever IP address we had before.
+	const char* Address::GetResolvedIPAddress() const
+	{
+		if (this->hostname[0] != '\0')
+			Resolver::Get()->Resolve(this->hostname, this->ipAddress, sizeof(this->ipAddress));
 
 		return this->ipAddress;
 	}
 
 	std::string Address::GetIPAddressAndPort() const
 	{
-		char ipPort[64];
-		sprintf(ipPort, "%s:%d", this->GetResolvedIPAddress(), this->port);
+		if (this->IsUnixSocket())
+			return std::string("unix:") + this->unixSocketPath;
+
+		char ipPort[128];
+		const char* resolvedIPAddress = this->GetResolvedIPAddress();
+
+		// An IPv6 address has to be bracketed, or its colons would run into the port's.
+		if (::strchr(resolvedIPAddress, ':'))
+			sprintf(ipPort, "[%s]:%d", resolvedIPAddress, this->port);
+		else
+			sprintf(ipPort, "%s:%d", resolvedIPAddress, this->port);
+
 		return ipPort;
 	}
 
+	bool Address::MakeSockAddr(sockaddr_storage& sockAddr, socklen_t& sockAddrLength) const
+	{
+		::memset(&sockAddr, 0, sizeof(sockAddr));
+
+		if (this->IsUnixSocket())
+		{
+			sockaddr_un* sockAddrUnix = (sockaddr_un*)&sockAddr;
+			sockAddrUnix->sun_family = AF_UNIX;
+			::strcpy(sockAddrUnix->sun_path, this->unixSocketPath);
+			sockAddrLength = sizeof(sockaddr_un);
+			return true;
+		}
+
+		const char* resolvedIPAddress = this->GetResolvedIPAddress();
+
+		if (::strchr(resolvedIPAddress, ':'))
+		{
+			sockaddr_in6* sockAddr6 = (sockaddr_in6*)&sockAddr;
+			sockAddr6->sin6_family = AF_INET6;
+			sockAddr6->sin6_port = htons(this->port);
+			sockAddrLength = sizeof(sockaddr_in6);
+			return 1 == inet_pton(AF_INET6, resolvedIPAddress, &sockAddr6->sin6_addr);
+		}
+
+		sockaddr_in* sockAddr4 = (sockaddr_in*)&sockAddr;
+		sockAddr4->sin_family = AF_INET;
+		sockAddr4->sin_port = htons(this->port);
+		sockAddrLength = sizeof(sockaddr_in);
+		return 1 == inet_pton(AF_INET, resolvedIPAddress, &sockAddr4->sin_addr);
+	}
+
 	//----------------------------------- SocketStream -----------------------------------
 
 	SocketStream::SocketStream()
 	{
 		this->sock = INVALID_SOCKET;
-		this->lastSocketReadWriteTime = 0;
+		this->lastReadTime = 0.0;
+		this->lastWriteTime = 0.0;
+		this->busyPollSeconds = 0.0;
+		this->connecting = false;
+		this->shutDown = false;
+		this->connectStartTime = 0.0;
+		this->connectTimeoutSeconds = -1.0;
+		this->zeroCopyState = ZERO_COPY_STATE_UNKNOWN;
+		this->zeroCopySendList = new ZeroCopySendList();
+		this->numZeroCopySendsPending = 0;
+		this->nextZeroCopySendId = 0;
+#if defined __LINUX__
+		this->interruptFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#endif
 	}
 
 	/*virtual*/ SocketStream::~SocketStream()
 	{
 		(void)this->Disconnect();
+
+#if defined __LINUX__
+		if (this->interruptFd >= 0)
+			close(this->interruptFd);
+#endif
+
+		delete this->zeroCopySendList;
 	}
 
 	bool SocketStream::Connect(const Address& givenAddress, double timeoutSeconds /*= -1.0*/)
+	{
+		if (!this->BeginConnect(givenAddress, timeoutSeconds))
+			return false;
+
+		return this->PollConnect(timeoutSeconds) == CONNECT_STATUS_SUCCEEDED;
+	}
+
+	bool SocketStream::BeginConnect(const Address& givenAddress, double timeoutSeconds /*= -1.0*/)
 	{
 		int result = 0;
 
@@ -113,112 +210,160 @@ namespace Yarc
 			if (this->sock != INVALID_SOCKET)
 				return false;
 
-			this->sock = ::socket(AF_INET, SOCK_STREAM, 0);
-			if (this->sock == INVALID_SOCKET)
+			sockaddr_storage sockAddr;
+			socklen_t sockAddrLength = 0;
+			if (!this->address.MakeSockAddr(sockAddr, sockAddrLength))
 				return false;
 
-			sockaddr_in sockaddr;
-			sockaddr.sin_family = AF_INET;
-#if defined __WINDOWS__
-			::InetPtonA(sockaddr.sin_family, this->address.ipAddress, &sockaddr.sin_addr);
-#elif defined __LINUX__
-			inet_pton(sockaddr.sin_family, this->address.ipAddress, &sockaddr.sin_addr);
-#endif
-			sockaddr.sin_port = ::htons(this->address.port);
+			this->sock = ::socket(sockAddr.ss_family, SOCK_STREAM, 0);
+			if (this->sock == INVALID_SOCKET)
+				return false;
 
-			if (timeoutSeconds < 0.0)
+			// Requests are written out whole, so there's nothing for Nagle's algorithm to gain,
+			// and a small request held back waiting on an ACK is pure latency.
+			if (sockAddr.ss_family != AF_UNIX)
 			{
-				result = ::connect(this->sock, (SOCKADDR*)&sockaddr, sizeof(sockaddr));
-				if (result == SOCKET_ERROR)
-					return false;
+				int noDelay = 1;
+				::setsockopt(this->sock, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
 			}
-			else
-			{
-				u_long arg = 1;
-#if defined __WINDOWS__
-				result = ::ioctlsocket(this->sock, FIONBIO, &arg);
-#elif defined __LINUX__
-				result = ioctl(this->sock, FIONBIO, &arg);
-#endif
-				if (result != NO_ERROR)
-					return false;
 
-				result = ::connect(this->sock, (SOCKADDR*)&sockaddr, sizeof(sockaddr));
-				if (result != SOCKET_ERROR)
-					return false;
+			if (!this->SetBlocking(false))
+				return false;
+
+			this->connecting = true;
+			this->connectStartTime = GetMonotonicTimeSeconds();
+			this->connectTimeoutSeconds = timeoutSeconds;
+			this->zeroCopyState = ZERO_COPY_STATE_UNKNOWN;
+			this->nextZeroCopySendId = 0;
+
+			result = ::connect(this->sock, (SOCKADDR*)&sockAddr, sockAddrLength);
+			if (result != SOCKET_ERROR)
+				return true;	// That was quick.  We'll find out on the first poll.
 
 #if defined __WINDOWS__
-				int error = ::WSAGetLastError();
-				if (error != WSAEWOULDBLOCK)
-					return false;
+			if (::WSAGetLastError() != WSAEWOULDBLOCK)
+				return false;
 #elif defined __LINUX__
-				if(errno == EWOULDBLOCK)
-					return false;
+			if (errno != EINPROGRESS)
+				return false;
 #endif
 
-				bool timedOut = true;
-				double startTime = double(::clock()) / double(CLOCKS_PER_SEC);
-				double elapsedTime = 0.0f;
-				while (elapsedTime <= timeoutSeconds)
-				{
-					fd_set writeSet, excSet;
-					FD_ZERO(&writeSet);
-					FD_ZERO(&excSet);
-					FD_SET(this->sock, &writeSet);
-					FD_SET(this->sock, &excSet);
-
-					timeval timeVal;
-					timeVal.tv_sec = 0;
-					timeVal.tv_usec = 1000;
-
-					int32_t count = ::select(0, NULL, &writeSet, &excSet, &timeVal);
-					if (count == SOCKET_ERROR)
-						return false;
-
-					if (FD_ISSET(this->sock, &excSet))
-						return false;
-
-					// Is the socket writable?
-					if (FD_ISSET(this->sock, &writeSet))
-					{
-						timedOut = false;
-						break;
-					}
+			return true;
+		};
 
-					double currentTime = double(::clock()) / double(CLOCKS_PER_SEC);
-					elapsedTime = currentTime - startTime;
-				}
+		bool success = lambda();
 
-				if (timedOut)
-					return false;
+		if (!success)
+			this->Disconnect();
+
+		return success;
+	}
+
+	SocketStream::ConnectStatus SocketStream::PollConnect(double waitSeconds /*= 0.0*/)
+	{
+		if (!this->connecting)
+			return this->IsConnected() ? CONNECT_STATUS_SUCCEEDED : CONNECT_STATUS_FAILED;
+
+		auto lambda = [&]() -> ConnectStatus
+		{
+			// Don't wait past the connection time-out, if there is one.
+			if (this->connectTimeoutSeconds >= 0.0)
+			{
+				double remainingSeconds = this->connectStartTime + this->connectTimeoutSeconds - GetMonotonicTimeSeconds();
+				if (remainingSeconds < 0.0)
+					remainingSeconds = 0.0;
+
+				if (waitSeconds < 0.0 || waitSeconds > remainingSeconds)
+					waitSeconds = remainingSeconds;
+			}
 
-				arg = 0;
 #if defined __WINDOWS__
-				result = ::ioctlsocket(this->sock, FIONBIO, &arg);
+			fd_set writeSet, excSet;
+			FD_ZERO(&writeSet);
+			FD_ZERO(&excSet);
+			FD_SET(this->sock, &writeSet);
+			FD_SET(this->sock, &excSet);
+
+			timeval timeVal;
+			timeVal.tv_sec = long(waitSeconds);
+			timeVal.tv_usec = long((waitSeconds - double(timeVal.tv_sec)) * 1e6);
+
+			int32_t count = ::select(0, NULL, &writeSet, &excSet, (waitSeconds >= 0.0) ? &timeVal : NULL);
+			if (count == SOCKET_ERROR)
+				return CONNECT_STATUS_FAILED;
+
+			if (FD_ISSET(this->sock, &excSet))
+				return CONNECT_STATUS_FAILED;
+
+			bool writable = FD_ISSET(this->sock, &writeSet) != 0;
 #elif defined __LINUX__
-				result = ioctl(this->sock, FIONBIO, &arg);
+			// As in WaitForReadable(), poll() rather than select(), which can't handle descriptors past FD_SETSIZE.
+			pollfd pollFd;
+			pollFd.fd = this->sock;
+			pollFd.events = POLLOUT;
+			pollFd.revents = 0;
+
+			int32_t count = ::poll(&pollFd, 1, PollTimeoutMilliseconds(waitSeconds));
+			if (count == SOCKET_ERROR)
+				return CONNECT_STATUS_FAILED;
+
+			if ((pollFd.revents & (POLLERR | POLLHUP | POLLNVAL)) != 0)
+				return CONNECT_STATUS_FAILED;
+
+			bool writable = (pollFd.revents & POLLOUT) != 0;
 #endif
-				if (result != NO_ERROR)
-					return false;
+
+			if (!writable)
+			{
+				if (this->connectTimeoutSeconds >= 0.0 && GetMonotonicTimeSeconds() - this->connectStartTime >= this->connectTimeoutSeconds)
+					return CONNECT_STATUS_FAILED;
+
+				return CONNECT_STATUS_PENDING;
 			}
 
-			return true;
+			// A socket whose connection attempt failed is also reported as writable, so check.
+			int connectError = 0;
+			socklen_t connectErrorLength = sizeof(connectError);
+			int result = ::getsockopt(this->sock, SOL_SOCKET, SO_ERROR, (char*)&connectError, &connectErrorLength);
+			if (result == SOCKET_ERROR || connectError != 0)
+				return CONNECT_STATUS_FAILED;
+
+			// From here on, the socket is read and written by blocking calls.
+			if (!this->SetBlocking(true))
+				return CONNECT_STATUS_FAILED;
+
+			this->connecting = false;
+			this->lastReadTime = GetMonotonicTimeSeconds();
+			this->lastWriteTime = this->lastReadTime;
+			return CONNECT_STATUS_SUCCEEDED;
 		};
-		
-		bool success = lambda();
 
-		if(!success)
+		ConnectStatus connectStatus = lambda();
+
+		if (connectStatus == CONNECT_STATUS_FAILED)
 			this->Disconnect();
 
-		return success;
+		return connectStatus;
+	}
+
+	bool SocketStream::SetBlocking(bool blocking)
+	{
+		u_long arg = blocking ? 0 : 1;
+#if defined __WINDOWS__
+		int result = ::ioctlsocket(this->sock, FIONBIO, &arg);
+#elif defined __LINUX__
+		int result = ioctl(this->sock, FIONBIO, &arg);
+#endif
+		return result == NO_ERROR;
 	}
 
 	bool SocketStream::IsConnected(void)
 	{
 		// There's really no way to know until you try to read or write on the socket.
 		// But as far as we know, if we have a valid socket handle, then we should assume we're connected.
-		// If we try and fail to read or write on the socket, we'll set our socket handle to INVALID_SOCKET.
-		return this->sock != INVALID_SOCKET;
+		// If we try and fail to read or write on the socket, we shut it down, but it stays open until we're disconnected.
+		// A socket still in the middle of connecting isn't connected yet, of course.
+		return this->sock != INVALID_SOCKET && !this->connecting && !this->shutDown;
 	}
 
 	bool SocketStream::Disconnect(void)
@@ -228,32 +373,245 @@ namespace Yarc
 #if defined __WINDOWS__
 			::closesocket(this->sock);
 #elif defined __LINUX__
+			// Closing the socket alone won't wake up a thread blocked reading it, but shutting it down will.
+			shutdown(this->sock, SHUT_RDWR);
 			close(this->sock);
 #endif
 			this->sock = INVALID_SOCKET;
 		}
 
+		this->connecting = false;
+		this->shutDown = false;
+
+		// We won't hear any more from the kernel about what it was sending, and with the connection gone, it doesn't matter.
+		this->ReleaseZeroCopySends();
 		return true;
 	}
 
+	void SocketStream::Shutdown(void)
+	{
+		// The reading and writing sides may both fail at once, but only one of them needs to do this.
+		if (this->sock == INVALID_SOCKET || this->shutDown.exchange(true))
+			return;
+
+#if defined __WINDOWS__
+		::shutdown(this->sock, SD_BOTH);
+#elif defined __LINUX__
+		shutdown(this->sock, SHUT_RDWR);
+#endif
+	}
+
+	bool SocketStream::SetKeepAlive(double idleSeconds, double intervalSeconds, uint32_t probeCount)
+	{
+		// A local socket has nothing in between to time it out, and no way to probe it.
+		if (this->sock == INVALID_SOCKET || this->address.IsUnixSocket())
+			return false;
+
+		int enable = (idleSeconds > 0.0) ? 1 : 0;
+		if (0 != ::setsockopt(this->sock, SOL_SOCKET, SO_KEEPALIVE, (const char*)&enable, sizeof(enable)))
+			return false;
+
+		if (!enable)
+			return true;
+
+#if defined __WINDOWS__
+		// The number of probes is fixed (at 10) on Windows.
+		tcp_keepalive keepAlive;
+		keepAlive.onoff = 1;
+		keepAlive.keepalivetime = ULONG(idleSeconds * 1000.0);
+		keepAlive.keepaliveinterval = ULONG(intervalSeconds * 1000.0);
+		DWORD bytesReturned = 0;
+		return 0 == ::WSAIoctl(this->sock, SIO_KEEPALIVE_VALS, &keepAlive, sizeof(keepAlive), NULL, 0, &bytesReturned, NULL, NULL);
+#elif defined __LINUX__
+		// These only go down to the second.
+		int idle = (idleSeconds < 1.0) ? 1 : int(idleSeconds);
+		int interval = (intervalSeconds < 1.0) ? 1 : int(intervalSeconds);
+		int count = int(probeCount);
+		bool success = true;
+		success = (0 == setsockopt(this->sock, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle))) && success;
+		success = (0 == setsockopt(this->sock, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval))) && success;
+		success = (0 == setsockopt(this->sock, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count))) && success;
+		return success;
+#endif
+	}
+
+	bool SocketStream::SetReadTimeout(double timeoutSeconds)
+	{
+		if (this->sock == INVALID_SOCKET)
+			return false;
+
+#if defined __WINDOWS__
+		DWORD timeout = DWORD(timeoutSeconds * 1000.0);
+#elif defined __LINUX__
+		timeval timeout;
+		timeout.tv_sec = time_t(timeoutSeconds);
+		timeout.tv_usec = suseconds_t((timeoutSeconds - double(timeout.tv_sec)) * 1e6);
+#endif
+		return 0 == ::setsockopt(this->sock, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+	}
+
+	bool SocketStream::IsAlive(void)
+	{
+		if (!this->IsConnected())
+			return false;
+
+		// If there's anything to read, either the other end hung up, or it sent us something we didn't ask for.
+		return !this->WaitForReadable(0.0);
+	}
+
+	bool SocketStream::WaitForReadable(double timeoutSeconds)
+	{
+		if (!this->IsConnected())
+			return true;
+
+		double startTime = GetMonotonicTimeSeconds();
+		double deadlineSeconds = startTime + timeoutSeconds;
+		double spinDeadlineSeconds = startTime + ((this->busyPollSeconds < timeoutSeconds) ? this->busyPollSeconds : timeoutSeconds);
+
+		while (true)
+		{
+			// Only block once we're done spinning, if we spin at all.
+			double currentTime = GetMonotonicTimeSeconds();
+			double blockSeconds = (currentTime < spinDeadlineSeconds) ? 0.0 : deadlineSeconds - currentTime;
+			if (blockSeconds < 0.0)
+				blockSeconds = 0.0;
+
+#if defined __WINDOWS__
+			fd_set readSet;
+			FD_ZERO(&readSet);
+			FD_SET(this->sock, &readSet);
+
+			timeval timeVal;
+			timeVal.tv_sec = long(blockSeconds);
+			timeVal.tv_usec = long((blockSeconds - double(timeVal.tv_sec)) * 1e6);
+
+			int32_t count = ::select(0, &readSet, NULL, NULL, &timeVal);
+			bool sockReadable = count > 0 && FD_ISSET(this->sock, &readSet);
+#elif defined __LINUX__
+			// We use poll() here, because select() can't cope with descriptors at or above FD_SETSIZE,
+			// which a busy process can easily hand out.
+			pollfd pollFdArray[2];
+			nfds_t numPollFds = 1;
+			pollFdArray[0].fd = this->sock;
+			pollFdArray[0].events = POLLIN;
+			pollFdArray[0].revents = 0;
+			if (this->interruptFd >= 0)
+			{
+				pollFdArray[1].fd = this->interruptFd;
+				pollFdArray[1].events = POLLIN;
+				pollFdArray[1].revents = 0;
+				numPollFds = 2;
+			}
+
+			int32_t count = ::poll(pollFdArray, numPollFds, PollTimeoutMilliseconds(blockSeconds));
+			bool sockReadable = count > 0 && pollFdArray[0].revents != 0;
+
+			if (count > 0 && numPollFds == 2 && (pollFdArray[1].revents & POLLIN) != 0)
+			{
+				uint64_t value = 0;
+				(void)read(this->interruptFd, &value, sizeof(value));
+				if (!sockReadable)
+					return false;
+			}
+#endif
+
+			// Zero-copy completions make the socket look readable too, so clear those out, and then make sure there's
+			// really something there.  Otherwise, a read would block where we're supposed to be interruptible.
+			if (this->nextZeroCopySendId > 0 && sockReadable)
+			{
+				this->ReapZeroCopyCompletions();
+				if (!this->HasDataToRead())
+					continue;
+			}
+
+			if (count != 0)
+				return true;	// Readable, or an error that the next read will run into.
+
+			if (currentTime >= spinDeadlineSeconds)
+				return false;
+
+			CpuRelax();
+		}
+	}
+
+	void SocketStream::InterruptWait(void)
+	{
+#if defined __LINUX__
+		if (this->interruptFd >= 0)
+		{
+			uint64_t value = 1;
+			(void)write(this->interruptFd, &value, sizeof(value));
+		}
+#endif
+	}
+
+	void SocketStream::SetBusyPollSeconds(double givenBusyPollSeconds)
+	{
+		this->busyPollSeconds = givenBusyPollSeconds;
+
+#if defined __LINUX__
+		// Where the driver supports it, this also has the kernel poll the device queue for us, rather than
+		// wait on an interrupt.  Raising it above the system default takes CAP_NET_ADMIN, so failure is fine.
+		if (this->sock != INVALID_SOCKET)
+		{
+			int busyPollMicroseconds = int(givenBusyPollSeconds * 1e6);
+			setsockopt(this->sock, SOL_SOCKET, SO_BUSY_POLL, &busyPollMicroseconds, sizeof(busyPollMicroseconds));
+		}
+#endif
+	}
+
+	// Spin until something can be read without blocking, or until we run out of time.  True is returned
+	// if the read is done, in which case the given count is what recv() gave us (which may be an error).
+	bool SocketStream::BusyPoll(uint8_t* buffer, uint32_t bufferSize, uint32_t& readCount)
+	{
+		double deadlineSeconds = 0.0;
+		uint32_t i = 0;
+
+		while (true)
+		{
+#if defined __WINDOWS__
+			u_long numBytesAvailable = 0;
+			if (::ioctlsocket(this->sock, FIONREAD, &numBytesAvailable) != NO_ERROR || numBytesAvailable > 0)
+				return false;	// Let the blocking read take it from here; it won't block.
+#elif defined __LINUX__
+			readCount = ::recv(this->sock, (char*)buffer, bufferSize, MSG_DONTWAIT);
+			if (readCount != uint32_t(SOCKET_ERROR) || (errno != EAGAIN && errno != EWOULDBLOCK))
+				return true;
+#endif
+			// Note that the clock is only read every so often, and not at all if data was already waiting.
+			if (deadlineSeconds == 0.0)
+				deadlineSeconds = GetMonotonicTimeSeconds() + this->busyPollSeconds;
+			else if ((++i & 15) == 0 && GetMonotonicTimeSeconds() >= deadlineSeconds)
+				return false;
+
+			CpuRelax();
+		}
+	}
+
 	/*virtual*/ uint32_t SocketStream::ReadBuffer(uint8_t* buffer, uint32_t bufferSize)
 	{
 		if (!this->IsConnected())
 			return -1;
 
-		uint32_t readCount = ::recv(this->sock, (char*)buffer, bufferSize, 0);
+		uint32_t readCount = 0;
+		if (this->busyPollSeconds <= 0.0 || !this->BusyPoll(buffer, bufferSize, readCount))
+			readCount = ::recv(this->sock, (char*)buffer, bufferSize, 0);
+
 #if defined __WINDOWS__
 		if (readCount == uint32_t(SOCKET_ERROR))
 #elif defined __LINUX__
 		if (readCount == 0 || readCount == uint32_t(SOCKET_ERROR))
 #endif
 		{
-			this->sock = INVALID_SOCKET;
+			// Reads are made on the reception thread, while another thread may be writing, so the socket isn't ours to close
+			// here.  Shutting it down is enough to fail those writes, and if the read only timed out, to let the server know
+			// we've given up on it.
+			this->Shutdown();
 			return -1;
 		}
 
 		if(readCount > 0)
-			this->lastSocketReadWriteTime = ::clock();
+			this->lastReadTime = GetMonotonicTimeSeconds();
 
 		return readCount;
 	}
@@ -266,13 +624,198 @@ namespace Yarc
 		uint32_t writeCount = ::send(this->sock, (const char*)buffer, bufferSize, 0);
 		if (writeCount == uint32_t(SOCKET_ERROR))
 		{
-			this->sock = INVALID_SOCKET;
+			this->Shutdown();
 			return -1;
 		}
 
 		if(writeCount > 0)
-			this->lastSocketReadWriteTime = ::clock();
+			this->lastWriteTime = GetMonotonicTimeSeconds();
 
 		return writeCount;
 	}
+
+	bool SocketStream::HasDataToRead(void)
+	{
+#if defined __WINDOWS__
+		u_long numBytesAvailable = 0;
+		return ::ioctlsocket(this->sock, FIONREAD, &numBytesAvailable) != NO_ERROR || numBytesAvailable > 0;
+#elif defined __LINUX__
+		uint8_t byte = 0;
+		ssize_t readCount = ::recv(this->sock, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+		return readCount >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK);	// Hang-ups and errors count, since a read would find them.
+#endif
+	}
+
+	bool SocketStream::WriteZeroCopy(SharedBuffer* sharedBuffer)
+	{
+		const uint8_t* buffer = sharedBuffer->GetData();
+		uint32_t remainingBytes = sharedBuffer->GetSize();
+
+#if defined YARC_HAS_ZERO_COPY
+		if (this->zeroCopyState == ZERO_COPY_STATE_UNKNOWN && this->IsConnected())
+		{
+			int enable = 1;
+			if (0 == setsockopt(this->sock, SOL_SOCKET, SO_ZEROCOPY, &enable, sizeof(enable)))
+				this->zeroCopyState = ZERO_COPY_STATE_ENABLED;
+			else
+				this->zeroCopyState = ZERO_COPY_STATE_UNAVAILABLE;
+		}
+
+		bool sentAny = false;
+		while (this->zeroCopyState == ZERO_COPY_STATE_ENABLED && remainingBytes > 0 && this->IsConnected())
+		{
+			ssize_t writeCount = ::send(this->sock, buffer, remainingBytes, MSG_ZEROCOPY);
+			if (writeCount < 0)
+			{
+				if (errno == EINTR)
+					continue;
+
+				// There's a limit on how much memory a socket can have pinned at once.  Past that,
+				// the rest goes out the usual way.  Anything else means we've lost the connection.
+				if (errno != ENOBUFS)
+					this->Shutdown();
+
+				break;
+			}
+
+			// The kernel numbers each send that went out this way, and tells us about them by number.
+			buffer += writeCount;
+			remainingBytes -= uint32_t(writeCount);
+			this->nextZeroCopySendId++;
+			this->lastWriteTime = GetMonotonicTimeSeconds();
+			sentAny = true;
+		}
+
+		if (sentAny)
+		{
+			sharedBuffer->AddRef();
+
+			MutexLocker locker(this->zeroCopyMutex);
+			this->zeroCopySendList->AddTail(ZeroCopySend{sharedBuffer, this->nextZeroCopySendId - 1});
+			this->numZeroCopySendsPending = this->zeroCopySendList->GetCount();
+		}
+
+		this->ReapZeroCopyCompletions();
+#endif
+
+		if (remainingBytes == 0)
+			return this->IsConnected();
+
+		return this->WriteBufferNow(buffer, remainingBytes);
+	}
+
+	/*virtual*/ bool SocketStream::WriteFileRegion(const FileRegion& fileRegion)
+	{
+		if (!this->IsConnected())
+			return false;
+
+#if defined __LINUX__
+		struct stat fileStat;
+		if (0 != fstat(fileRegion.fileDescriptor, &fileStat))
+			return false;
+
+		bool isPipe = S_ISFIFO(fileStat.st_mode);
+		off_t offset = off_t(fileRegion.offset);
+		uint32_t remainingBytes = fileRegion.length;
+
+		while (remainingBytes > 0)
+		{
+			ssize_t writeCount = 0;
+			if (isPipe)
+				writeCount = splice(fileRegion.fileDescriptor, nullptr, this->sock, nullptr, remainingBytes, SPLICE_F_MOVE | SPLICE_F_MORE);
+			else
+				writeCount = sendfile(this->sock, fileRegion.fileDescriptor, &offset, remainingBytes);
+
+			if (writeCount < 0 && errno == EINTR)
+				continue;
+
+			if (writeCount < 0 && (errno == EINVAL || errno == ENOSYS) && remainingBytes == fileRegion.length)
+				break;		// This kind of file can't be sent this way, but we haven't sent anything yet, so fall back.
+
+			if (writeCount <= 0)
+			{
+				// The file came up short or the connection failed, and either way, the stream is now out of sync.
+				this->Shutdown();
+				return false;
+			}
+
+			remainingBytes -= uint32_t(writeCount);
+		}
+
+		if (remainingBytes == 0)
+		{
+			this->lastWriteTime = GetMonotonicTimeSeconds();
+			return true;
+		}
+#endif
+
+		return ByteStream::WriteFileRegion(fileRegion);
+	}
+
+	void SocketStream::ReapZeroCopyCompletions(void)
+	{
+#if defined YARC_HAS_ZERO_COPY
+		if (this->numZeroCopySendsPending == 0 || this->sock == INVALID_SOCKET)
+			return;
+
+		MutexLocker locker(this->zeroCopyMutex);
+
+		while (this->zeroCopySendList->GetCount() > 0)
+		{
+			char control[128];
+			msghdr message;
+			::memset(&message, 0, sizeof(message));
+			message.msg_control = control;
+			message.msg_controllen = sizeof(control);
+
+			if (recvmsg(this->sock, &message, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+				break;
+
+			for (cmsghdr* controlMessage = CMSG_FIRSTHDR(&message); controlMessage; controlMessage = CMSG_NXTHDR(&message, controlMessage))
+			{
+				bool ipError = (controlMessage->cmsg_level == SOL_IP && controlMessage->cmsg_type == IP_RECVERR);
+				bool ipv6Error = (controlMessage->cmsg_level == SOL_IPV6 && controlMessage->cmsg_type == IPV6_RECVERR);
+				if (!ipError && !ipv6Error)
+					continue;
+
+				const sock_extended_err* extendedError = (const sock_extended_err*)CMSG_DATA(controlMessage);
+				if (extendedError->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+					continue;
+
+				// If the kernel had to copy the data anyway (over loopback, say), then pinning pages and
+				// fielding these notifications is all cost and no gain, so stop doing it on this socket.
+				if (extendedError->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+					this->zeroCopyState = ZERO_COPY_STATE_UNAVAILABLE;
+
+				// Each notification covers a range of sends, ending with this one.  Over TCP, they complete in order.
+				uint32_t lastCompletedSendId = extendedError->ee_data;
+				while (this->zeroCopySendList->GetCount() > 0)
+				{
+					ZeroCopySendList::Node* node = this->zeroCopySendList->GetHead();
+					if (int32_t(node->value.lastSendId - lastCompletedSendId) > 0)
+						break;
+
+					node->value.sharedBuffer->Release();
+					this->zeroCopySendList->Remove(node);
+				}
+
+				this->numZeroCopySendsPending = this->zeroCopySendList->GetCount();
+			}
+		}
+#endif
+	}
+
+	void SocketStream::ReleaseZeroCopySends(void)
+	{
+		MutexLocker locker(this->zeroCopyMutex);
+
+		while (this->zeroCopySendList->GetCount() > 0)
+		{
+			ZeroCopySendList::Node* node = this->zeroCopySendList->GetHead();
+			node->value.sharedBuffer->Release();
+			this->zeroCopySendList->Remove(node);
+		}
+
+		this->numZeroCopySendsPending = 0;
+	}
 }
\ No newline at end of file
@@ -1,8 +1,11 @@
 #pragma once
 
 #include "yarc_byte_stream.h"
+#include "yarc_linked_list.h"
+#include "yarc_mutex.h"
 #if defined __WINDOWS__
 #	include <WS2tcpip.h>
+#	include <afunix.h>
 #	if !defined WIN32_LEAN_AND_MEAN
 #		define WIN32_LEAN_AND_MEAN
 #	endif
@@ -13,10 +16,14 @@
 #	include <sys/ioctl.h>
 #	include <netdb.h>
 #	include <arpa/inet.h>
+#	include <netinet/in.h>
+#	include <netinet/tcp.h>
+#	include <sys/un.h>
 #	include <unistd.h>
 #endif
 #include <string>
 #include <functional>
+#include <atomic>
 #include <time.h>
 
 #if defined __LINUX__
@@ -36,14 +43,26 @@ namespace Yarc
 
 		bool operator==(const Address& address) const;
 
+		// Either of these also takes an address of the form "unix:/path/to/redis.sock".
 		void SetIPAddress(const char* givenIPAddress);
 		void SetHostname(const char* givenHostname);
 
+		// Talk to a server on this machine through a Unix domain socket rather than over TCP.  This skips
+		// the whole TCP/IP stack, which makes a noticeable dent in the round-trip time.  The port is ignored.
+		bool SetUnixSocketPath(const char* givenUnixSocketPath);
+		bool IsUnixSocket() const { return this->unixSocketPath[0] != '\0'; }
+
 		const char* GetResolvedIPAddress() const;
 		std::string GetIPAddressAndPort() const;
 
+		// Fill in a socket address, IPv4, IPv6 or Unix as the case may be, for connecting to this address.
+		bool MakeSockAddr(sockaddr_storage& sockAddr, socklen_t& sockAddrLength) const;
+
+		// If a hostname is given, it's resolved (through the Resolver cache) into the IP address as needed.
+		// Either way, the IP address is kept in numeric form, and may be IPv4 or IPv6.
 		char hostname[64];
-		mutable char ipAddress[32];
+		mutable char ipAddress[64];
+		char unixSocketPath[108];
 		uint16_t port;
 	};
 
@@ -54,21 +73,121 @@ namespace Yarc
 		SocketStream();
 		virtual ~SocketStream();
 
+		// Connect to the given address, blocking until we do, or until the given time-out.  A negative time-out means no time-out.
 		bool Connect(const Address& givenAddress, double timeoutSeconds = -1.0);
+
+		enum ConnectStatus
+		{
+			CONNECT_STATUS_PENDING,
+			CONNECT_STATUS_SUCCEEDED,
+			CONNECT_STATUS_FAILED
+		};
+
+		// These do the same as Connect(), but without blocking.  Start connecting, then poll until the connection
+		// succeeds or fails, optionally waiting a bit each time.  Many connections can be made at once this way.
+		// A failed or timed-out connection attempt leaves us disconnected.
+		bool BeginConnect(const Address& givenAddress, double timeoutSeconds = -1.0);
+		ConnectStatus PollConnect(double waitSeconds = 0.0);
+		bool IsConnecting(void) const { return this->connecting; }
+
 		bool IsConnected(void);
 		bool Disconnect(void);
 
+		// Shut the connection down, but leave the socket open.  This wakes up a thread blocked on it, and every read and
+		// write fails from then on, but the descriptor can't be handed out again until Disconnect() closes it, which
+		// only the stream's owner should do, once nobody else is using it.
+		void Shutdown(void);
+
+		// Unlike IsConnected(), this actually checks the socket, without blocking, to see that the other end hasn't
+		// hung up on us.  It's meant for a connection that should be quiet, so any data waiting to be read counts
+		// against it too, since whatever it is, it would be mistaken for the response to the next request.
+		bool IsAlive(void);
+
+		// Wait for up to the given time for there to be something to read (or for the socket to fail).
+		// A busy-polling socket spins for a while before it blocks here too.
+		bool WaitForReadable(double timeoutSeconds);
+
+		// Cut short a wait in WaitForReadable() on another thread, or the next one, if none is underway.
+		// This only works on Linux.  Elsewhere, the waiter just finds out when its time is up.
+		void InterruptWait(void);
+
 		virtual uint32_t ReadBuffer(uint8_t* buffer, uint32_t bufferSize) override;
 		virtual uint32_t WriteBuffer(const uint8_t* buffer, uint32_t bufferSize) override;
 
+		// Send the given buffer without the kernel copying it into the socket's buffers (MSG_ZEROCOPY, on Linux).
+		// Instead, the pages are pinned and sent from where they are, so we keep a reference to the buffer until
+		// the kernel tells us it's done with them.  That only pays off for big buffers, and only over a real network
+		// device.  Where zero-copy isn't supported (e.g., other platforms, Unix sockets), or where the kernel would
+		// just copy anyway (e.g., loopback), the buffer is sent the usual way.
+		bool WriteZeroCopy(SharedBuffer* sharedBuffer);
+
+		// Have the kernel move the bytes straight from the file to the socket, with sendfile() (or splice(), for a pipe),
+		// on Linux.  Elsewhere, or if the file can't be sent that way, it's read in and written out a chunk at a time.
+		virtual bool WriteFileRegion(const FileRegion& fileRegion) override;
+
+		// Let go of whatever buffers the kernel has finished sending.  This never blocks.
+		void ReapZeroCopyCompletions(void);
+		uint32_t GetNumZeroCopySendsPending(void) const { return this->numZeroCopySendsPending; }
+
 		const Address& GetAddress() const { return this->address; }
 
-		clock_t GetLastSocketReadWriteTime() { return this->lastSocketReadWriteTime; }
+		// When nothing has arrived yet, a read normally blocks straight away, and then pays for the
+		// scheduler to wake the thread back up once something does.  With busy-polling, a read instead
+		// spins on non-blocking reads for up to the given time before it blocks.  This burns a CPU core
+		// to shave latency, so it's only worth it for a thread with a core to itself.  Zero turns it off.
+		void SetBusyPollSeconds(double givenBusyPollSeconds);
+		double GetBusyPollSeconds(void) const { return this->busyPollSeconds; }
+
+		// These are the last times (see GetMonotonicTimeSeconds()) that anything was read from or written to the socket.
+		double GetLastReadTime() const { return this->lastReadTime; }
+		double GetLastWriteTime() const { return this->lastWriteTime; }
+
+		// Have the OS probe the connection once it's been idle for the given time, every given interval, giving up
+		// (and failing the connection) after the given number of unanswered probes.  This catches a peer that's gone
+		// away without a word, and keeps NAT and load balancer mappings from timing out.  Zero idle time turns it off.
+		bool SetKeepAlive(double idleSeconds, double intervalSeconds, uint32_t probeCount);
+
+		// A read that blocks for longer than this fails, and takes the connection with it.  Zero means wait forever.
+		bool SetReadTimeout(double timeoutSeconds);
 
 	protected:
 
+		bool BusyPoll(uint8_t* buffer, uint32_t bufferSize, uint32_t& readCount);
+		bool SetBlocking(bool blocking);
+		bool HasDataToRead(void);
+		void ReleaseZeroCopySends(void);
+
+		enum ZeroCopyState
+		{
+			ZERO_COPY_STATE_UNKNOWN,
+			ZERO_COPY_STATE_ENABLED,
+			ZERO_COPY_STATE_UNAVAILABLE
+		};
+
+		struct ZeroCopySend
+		{
+			SharedBuffer* sharedBuffer;
+			uint32_t lastSendId;		// The buffer can go once the kernel is done with this send and all those before it.
+		};
+
+		typedef LinkedList<ZeroCopySend> ZeroCopySendList;
+
 		SOCKET sock;
+#if defined __LINUX__
+		int interruptFd;
+#endif
 		Address address;
-		clock_t lastSocketReadWriteTime;
+		volatile double lastReadTime;
+		volatile double lastWriteTime;
+		volatile double busyPollSeconds;
+		bool connecting;
+		std::atomic<bool> shutDown;
+		double connectStartTime;
+		double connectTimeoutSeconds;
+		std::atomic<ZeroCopyState> zeroCopyState;
+		ZeroCopySendList* zeroCopySendList;
+		std::atomic<uint32_t> numZeroCopySendsPending;		// This follows the list's count, so it can be checked without the lock.
+		std::atomic<uint32_t> nextZeroCopySendId;
+		Mutex zeroCopyMutex;		// Completions are reaped on both the sending and the receiving side.
 	};
 }
\ No newline at end of file
@@ -0,0 +1,200 @@
+#include "yarc_striped_client.h"
+#include "yarc_protocol_data.h"
+#include "yarc_misc.h"
+
+namespace Yarc
+{
+	// The stripe index is tucked into the top bits of the slot index half of a stripe's request handle.
+	// A stripe would need millions of requests outstanding at once before those bits got used, and
+	// we refuse requests rather than let that happen.
+	#define STRIPE_HANDLE_SHIFT		24
+	#define STRIPE_HANDLE_MASK		(uint64_t(MAX_STRIPES - 1) << STRIPE_HANDLE_SHIFT)
+
+	StripedClient::StripedClient(uint32_t numStripes /*= 4*/, double connectionTimeoutSeconds /*= 0.5*/, double connectionRetrySeconds /*= 5.0*/)
+	{
+		if (numStripes == 0)
+			numStripes = 1;
+		else if (numStripes > MAX_STRIPES)
+			numStripes = MAX_STRIPES;
+
+		this->stripeArray.SetCount(numStripes);
+		for (uint32_t i = 0; i < numStripes; i++)
+			this->stripeArray[i] = new SimpleClient(connectionTimeoutSeconds, connectionRetrySeconds);
+
+		this->nextStripe = 0;
+	}
+
+	/*virtual*/ StripedClient::~StripedClient()
+	{
+		for (uint32_t i = 0; i < this->stripeArray.GetCount(); i++)
+			delete this->stripeArray[i];
+	}
+
+	/*static*/ StripedClient* StripedClient::Create(uint32_t numStripes /*= 4*/)
+	{
+		return new StripedClient(numStripes);
+	}
+
+	/*static*/ void StripedClient::Destroy(StripedClient* client)
+	{
+		delete client;
+	}
+
+	// Our address may be changed at any time before we connect, so it's handed down to a stripe whenever we go to use it.
+	SimpleClient* StripedClient::PrepareStripe(uint32_t i)
+	{
+		SimpleClient* stripe = this->stripeArray[i];
+		stripe->address = this->address;
+		return stripe;
+	}
+
+	uint32_t StripedClient::FindStripeForRequest(const ProtocolData* requestData)
+	{
+		std::string key = ProtocolData::FindCommandKey(requestData);
+		if (key.length() == 0)
+			return this->nextStripe++ % this->stripeArray.GetCount();
+
+		// Going by hash slot rather than by the key itself means hash tags keep related keys together here too.
+		return ProtocolData::CalcKeyHashSlot(key) % this->stripeArray.GetCount();
+	}
+
+	/*virtual*/ bool StripedClient::Update(double timeoutMilliseconds /*= 0.0*/)
+	{
+		// Any time we're given to wait on responses is split evenly between the stripes.
+		double stripeTimeoutMilliseconds = timeoutMilliseconds / double(this->stripeArray.GetCount());
+
+		bool connected = true;
+		for (uint32_t i = 0; i < this->stripeArray.GetCount(); i++)
+			if (!this->PrepareStripe(i)->Update(stripeTimeoutMilliseconds))
+				connected = false;
+
+		return connected;
+	}
+
+	/*virtual*/ bool StripedClient::Flush(double timeoutSeconds /*= 5.0*/)
+	{
+		double startTime = GetMonotonicTimeSeconds();
+
+		for (uint32_t i = 0; i < this->stripeArray.GetCount(); i++)
+		{
+			double remainingSeconds = timeoutSeconds - (GetMonotonicTimeSeconds() - startTime);
+			if (remainingSeconds < 0.0)
+				remainingSeconds = 0.0;
+
+			if (!this->PrepareStripe(i)->Flush(remainingSeconds))
+				return false;
+		}
+
+		return true;
+	}
+
+	/*virtual*/ StripedClient::RequestHandle StripedClient::MakeRequestAsync(const ProtocolData* requestData, Callback callback /*= [](const ProtocolData*) -> bool { return true; }*/, bool deleteData /*= true*/)
+	{
+		return this->MakeRequestAsyncInLane(this->FindStripeForRequest(requestData), requestData, std::move(callback), deleteData);
+	}
+
+	StripedClient::RequestHandle StripedClient::MakeRequestAsyncInLane(uint32_t lane, const ProtocolData* requestData, Callback callback /*= [](const ProtocolData*) -> bool { return true; }*/, bool deleteData /*= true*/)
+	{
+		uint32_t i = lane % this->stripeArray.GetCount();
+		SimpleClient* stripe = this->PrepareStripe(i);
+
+		// Slots are reused before new ones are made, so a stripe's slot indices stay below the number of
+		// requests it has outstanding at its busiest.  Just as with a full queue, the caller keeps the request data.
+		if (stripe->GetNumQueuedRequests() + stripe->GetNumRequestsAwaitingResponse() >= MAX_STRIPE_REQUESTS)
+			return 0;
+
+		RequestHandle requestHandle = stripe->MakeRequestAsync(requestData, std::move(callback), deleteData);
+		if (requestHandle == 0)
+			return 0;
+
+		assert((requestHandle & STRIPE_HANDLE_MASK) == 0);
+		return requestHandle | (uint64_t(i) << STRIPE_HANDLE_SHIFT);
+	}
+
+	/*virtual*/ bool StripedClient::MakeRequestSync(const ProtocolData* requestData, ProtocolData*& responseData, bool deleteData /*= true*/, double timeoutSeconds /*= 5.0*/)
+	{
+		return this->PrepareStripe(this->FindStripeForRequest(requestData))->MakeRequestSync(requestData, responseData, deleteData, timeoutSeconds);
+	}
+
+	/*virtual*/ bool StripedClient::CancelAsyncRequest(RequestHandle requestHandle)
+	{
+		uint32_t i = uint32_t((requestHandle & STRIPE_HANDLE_MASK) >> STRIPE_HANDLE_SHIFT);
+		if (i >= this->stripeArray.GetCount())
+			return false;
+
+		return this->stripeArray[i]->CancelAsyncRequest(requestHandle & ~STRIPE_HANDLE_MASK);
+	}
+
+	// A transaction goes wherever its first command would have gone.
+	/*virtual*/ bool StripedClient::MakeTransactionRequestAsync(DynamicArray<const ProtocolData*>& requestDataArray, Callback callback /*= [](const ProtocolData*) -> bool { return true; }*/, bool deleteData /*= true*/)
+	{
+		uint32_t lane = (requestDataArray.GetCount() > 0) ? this->FindStripeForRequest(requestDataArray[0]) : 0;
+		return this->MakeTransactionRequestAsyncInLane(lane, requestDataArray, std::move(callback), deleteData);
+	}
+
+	bool StripedClient::MakeTransactionRequestAsyncInLane(uint32_t lane, DynamicArray<const ProtocolData*>& requestDataArray, Callback callback /*= [](const ProtocolData*) -> bool { return true; }*/, bool deleteData /*= true*/)
+	{
+		return this->PrepareStripe(lane % this->stripeArray.GetCount())->MakeTransactionRequestAsync(requestDataArray, std::move(callback), deleteData);
+	}
+
+	/*virtual*/ bool StripedClient::MakeTransactionRequestSync(DynamicArray<const ProtocolData*>& requestDataArray, ProtocolData*& responseData, bool deleteData /*= true*/, double timeoutSeconds /*= 5.0*/)
+	{
+		uint32_t i = (requestDataArray.GetCount() > 0) ? this->FindStripeForRequest(requestDataArray[0]) : 0;
+		return this->PrepareStripe(i)->MakeTransactionRequestSync(requestDataArray, responseData, deleteData, timeoutSeconds);
+	}
+
+	// A pipeline goes out whole on one connection if that keeps every request on a key going out on the same connection,
+	// which it does if all of its keys hash to the same stripe.  Otherwise, each of its commands goes its own way.
+	/*virtual*/ bool StripedClient::MakePipelineRequestAsync(Pipeline* pipeline, Pipeline::Callback callback /*= [](Pipeline*) -> bool { return true; }*/)
+	{
+		uint32_t numStripes = this->stripeArray.GetCount();
+		uint32_t lane = numStripes;
+
+		for (uint32_t i = 0; i < pipeline->GetCount(); i++)
+		{
+			std::string key = ProtocolData::FindCommandKey(pipeline->GetCommand(i));
+			if (key.length() == 0)
+				continue;
+
+			uint32_t stripe = ProtocolData::CalcKeyHashSlot(key) % numStripes;
+			if (lane == numStripes)
+				lane = stripe;
+			else if (lane != stripe)
+				return ClientInterface::MakePipelineRequestAsync(pipeline, std::move(callback));
+		}
+
+		if (lane == numStripes)
+			lane = this->nextStripe++ % numStripes;
+
+		return this->MakePipelineRequestAsyncInLane(lane, pipeline, std::move(callback));
+	}
+
+	bool StripedClient::MakePipelineRequestAsyncInLane(uint32_t lane, Pipeline* pipeline, Pipeline::Callback callback /*= [](Pipeline*) -> bool { return true; }*/)
+	{
+		return this->PrepareStripe(lane % this->stripeArray.GetCount())->MakePipelineRequestAsync(pipeline, std::move(callback));
+	}
+
+	// Callbacks can't be copied, so each stripe is given one that calls ours.
+	/*virtual*/ bool StripedClient::RegisterPushDataCallback(Callback givenPushDataCallback)
+	{
+		*this->pushDataCallback = std::move(givenPushDataCallback);
+
+		for (uint32_t i = 0; i < this->stripeArray.GetCount(); i++)
+		{
+			this->stripeArray[i]->RegisterPushDataCallback([this](const ProtocolData* messageData) -> bool {
+				return *this->pushDataCallback ? (*this->pushDataCallback)(messageData) : true;
+			});
+		}
+
+		return true;
+	}
+
+	// Per-connection ordering is then per stripe, which is what we want.
+	/*virtual*/ void StripedClient::SetExecutor(Executor* givenExecutor, Executor::Ordering givenExecutorOrdering /*= Executor::ORDERING_NONE*/)
+	{
+		ClientInterface::SetExecutor(givenExecutor, givenExecutorOrdering);
+
+		for (uint32_t i = 0; i < this->stripeArray.GetCount(); i++)
+			this->stripeArray[i]->SetExecutor(givenExecutor, givenExecutorOrdering);
+	}
+}
\ No newline at end of file
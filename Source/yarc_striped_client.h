@@ -0,0 +1,63 @@
+#pragma once
+
+#include "yarc_api.h"
+#include "yarc_client_iface.h"
+#include "yarc_simple_client.h"
+#include "yarc_dynamic_array.h"
+#include <stdint.h>
+#include <atomic>
+
+namespace Yarc
+{
+	// This spreads requests over a number of connections (stripes) to the same server, each with a simple
+	// client of its own.  More connections get more out of a server running I/O threads, and keep a small
+	// request from getting stuck behind a big response on the same connection.  Requests are routed by key,
+	// so requests on the same key go out on the same connection and are fulfilled in order.  Requests without
+	// a key are dealt out round-robin.  A caller that needs some other set of requests kept in order can put
+	// them all in the same lane.  A transaction always goes out whole on one connection.  Note that callbacks
+	// are still only ever called from Update(), but responses on different connections may come back in any order.
+	class YARC_API StripedClient : public ClientInterface
+	{
+	public:
+
+		StripedClient(uint32_t numStripes = 4, double connectionTimeoutSeconds = 0.5, double connectionRetrySeconds = 5.0);
+		virtual ~StripedClient();
+
+		// When used as a DLL, these ensure that the client is allocated and freed in the proper heap.
+		static StripedClient* Create(uint32_t numStripes = 4);
+		static void Destroy(StripedClient* client);
+
+		virtual bool Update(double timeoutMilliseconds = 0.0) override;
+		virtual bool Flush(double timeoutSeconds = 5.0) override;
+		virtual RequestHandle MakeRequestAsync(const ProtocolData* requestData, Callback callback = [](const ProtocolData*) -> bool { return true; }, bool deleteData = true) override;
+		virtual bool MakeRequestSync(const ProtocolData* requestData, ProtocolData*& responseData, bool deleteData = true, double timeoutSeconds = 5.0) override;
+		virtual bool CancelAsyncRequest(RequestHandle requestHandle) override;
+		virtual bool MakeTransactionRequestAsync(DynamicArray<const ProtocolData*>& requestDataArray, Callback callback = [](const ProtocolData*) -> bool { return true; }, bool deleteData = true) override;
+		virtual bool MakeTransactionRequestSync(DynamicArray<const ProtocolData*>& requestDataArray, ProtocolData*& responseData, bool deleteData = true, double timeoutSeconds = 5.0) override;
+		virtual bool MakePipelineRequestAsync(Pipeline* pipeline, Pipeline::Callback callback = [](Pipeline*) -> bool { return true; }) override;
+		virtual bool RegisterPushDataCallback(Callback givenPushDataCallback) override;
+		virtual void SetExecutor(Executor* givenExecutor, Executor::Ordering givenExecutorOrdering = Executor::ORDERING_NONE) override;
+
+		// Requests made in the same lane go out on the same connection, and so are fulfilled in the order made.
+		RequestHandle MakeRequestAsyncInLane(uint32_t lane, const ProtocolData* requestData, Callback callback = [](const ProtocolData*) -> bool { return true; }, bool deleteData = true);
+		bool MakeTransactionRequestAsyncInLane(uint32_t lane, DynamicArray<const ProtocolData*>& requestDataArray, Callback callback = [](const ProtocolData*) -> bool { return true; }, bool deleteData = true);
+		bool MakePipelineRequestAsyncInLane(uint32_t lane, Pipeline* pipeline, Pipeline::Callback callback = [](Pipeline*) -> bool { return true; });
+
+		// Each stripe can be configured just like any other simple client (pipeline window, thread options, and so on).
+		uint32_t GetNumStripes(void) const { return this->stripeArray.GetCount(); }
+		SimpleClient* GetStripe(uint32_t i) { return this->stripeArray[i]; }
+
+		// The stripe index goes in the handle, and there are only so many bits to spare for it.  That leaves room in
+		// the handle for a stripe's first MAX_STRIPE_REQUESTS request slots, so a stripe with that many requests
+		// outstanding refuses any more, returning a null handle, until some of them are done.
+		enum { MAX_STRIPES = 256, MAX_STRIPE_REQUESTS = 1 << 24 };
+
+	private:
+
+		uint32_t FindStripeForRequest(const ProtocolData* requestData);
+		SimpleClient* PrepareStripe(uint32_t i);
+
+		DynamicArray<SimpleClient*> stripeArray;
+		std::atomic<uint32_t> nextStripe;	// Requests without a key may be made from any thread.
+	};
+}
\ No newline at end of file
@@ -1,5 +1,10 @@
 #include "yarc_thread.h"
 #include <string.h>
+#if defined __LINUX__
+#   include <time.h>
+#   include <errno.h>
+#   include <sched.h>
+#endif
 
 namespace Yarc
 {
@@ -10,9 +15,18 @@ namespace Yarc
 #elif defined __LINUX__
         memset(&this->thread, 0, sizeof(this->thread));
         this->threadRunning = false;
+        this->threadJoinable = false;
 #endif
     }
 
+    Thread::Options::Options()
+    {
+        this->cpuAffinity = -1;
+        this->stackSize = 0;
+        this->schedulingPolicy = SCHEDULING_POLICY_NORMAL;
+        this->schedulingPriority = 1;
+    }
+
     /*virtual*/ Thread::~Thread()
     {
         this->KillThread();
@@ -23,11 +37,16 @@ namespace Yarc
 #if defined __WINDOWS__
         ::Sleep((DWORD)timeoutMilliseconds);
 #elif defined __LINUX__
-        // TODO: Write this.
+        timespec timeSpec;
+        timeSpec.tv_sec = time_t(timeoutMilliseconds / 1000.0);
+        timeSpec.tv_nsec = long((timeoutMilliseconds - double(timeSpec.tv_sec) * 1000.0) * 1e6);
+        while (nanosleep(&timeSpec, &timeSpec) != 0 && errno == EINTR)
+        {
+        }
 #endif
     }
 
-    bool Thread::SpawnThread(Func func)
+    bool Thread::SpawnThread(Func func, const Options* options /*= nullptr*/)
     {
         this->cachedFunc = func;
 
@@ -35,22 +54,90 @@ namespace Yarc
         if(this->threadHandle)
             return false;
         
-        this->threadHandle = ::CreateThread(nullptr, 0, &Thread::ThreadMain, this, 0, nullptr);
+        SIZE_T stackSize = options ? options->stackSize : 0;
+        this->threadHandle = ::CreateThread(nullptr, stackSize, &Thread::ThreadMain, this, (stackSize > 0) ? STACK_SIZE_PARAM_IS_A_RESERVATION : 0, nullptr);
         if(!threadHandle)
             return false;
 #elif defined __LINUX__
-        if(this->threadRunning)
-            return false;
-        
-        int result = pthread_create(&this->thread, nullptr, &Thread::ThreadMain, this);
+        if(this->threadJoinable)
+        {
+            if(this->threadRunning)
+                return false;
+
+            // The last thread we ran is done, but still needs to be reaped.
+            pthread_join(this->thread, nullptr);
+            this->threadJoinable = false;
+        }
+
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        if(options && options->stackSize > 0)
+            pthread_attr_setstacksize(&attr, options->stackSize);
+
+        // Note that this has to be set before the thread starts, or it could finish before we do.
+        this->threadRunning = true;
+
+        int result = pthread_create(&this->thread, &attr, &Thread::ThreadMain, this);
+        pthread_attr_destroy(&attr);
         if(result != 0)
+        {
+            this->threadRunning = false;
             return false;
+        }
         
-        this->threadRunning = true;
+        this->threadJoinable = true;
 #endif
+        this->ApplyOptions(options);
         return true;
     }
 
+    // The thread is already running by the time we get here, but the things we set here
+    // only matter to a long-running thread anyway, and this way, failing to set one of
+    // them doesn't keep the thread from running.
+    void Thread::ApplyOptions(const Options* options)
+    {
+        if(!options)
+            return;
+
+#if defined __WINDOWS__
+        if(options->cpuAffinity >= 0)
+            ::SetThreadAffinityMask(this->threadHandle, DWORD_PTR(1) << options->cpuAffinity);
+
+        if(options->name.length() > 0)
+        {
+            std::wstring name(options->name.begin(), options->name.end());
+            ::SetThreadDescription(this->threadHandle, name.c_str());
+        }
+
+        // Windows doesn't have real-time policies as such, so the best we can do is bump the priority.
+        if(options->schedulingPolicy != SCHEDULING_POLICY_NORMAL)
+            ::SetThreadPriority(this->threadHandle, THREAD_PRIORITY_TIME_CRITICAL);
+#elif defined __LINUX__
+        if(options->cpuAffinity >= 0)
+        {
+            cpu_set_t cpuSet;
+            CPU_ZERO(&cpuSet);
+            CPU_SET(options->cpuAffinity, &cpuSet);
+            pthread_setaffinity_np(this->thread, sizeof(cpuSet), &cpuSet);
+        }
+
+        if(options->name.length() > 0)
+        {
+            // Linux refuses names longer than this outright, so truncate them instead.
+            std::string name = options->name.substr(0, 15);
+            pthread_setname_np(this->thread, name.c_str());
+        }
+
+        if(options->schedulingPolicy != SCHEDULING_POLICY_NORMAL)
+        {
+            sched_param schedParam;
+            memset(&schedParam, 0, sizeof(schedParam));
+            schedParam.sched_priority = options->schedulingPriority;
+            pthread_setschedparam(this->thread, (options->schedulingPolicy == SCHEDULING_POLICY_FIFO) ? SCHED_FIFO : SCHED_RR, &schedParam);
+        }
+#endif
+    }
+
 	bool Thread::WaitForThreadExit(void)
     {
 #if defined __WINDOWS__
@@ -60,7 +147,7 @@ namespace Yarc
         ::WaitForSingleObject(this->threadHandle, INFINITE);
         this->threadHandle = nullptr;
 #elif defined __LINUX__
-        if(!this->threadRunning)
+        if(!this->threadJoinable)
             return false;
         
         int result = pthread_join(this->thread, nullptr);
@@ -68,6 +155,7 @@ namespace Yarc
             return false;
 
         this->threadRunning = false;
+        this->threadJoinable = false;
 #endif
         return true;
     }
@@ -81,7 +169,17 @@ namespace Yarc
             this->threadHandle = nullptr;
         }
 #elif defined __LINUX__
-        // TODO: Write this.
+        if(this->threadJoinable)
+        {
+            // A canceled thread unwinds from wherever it's blocked (in recv(), say), and then we reap it.
+            // If it has already exited, this just reaps it.
+            if(this->threadRunning)
+                pthread_cancel(this->thread);
+
+            pthread_join(this->thread, nullptr);
+            this->threadRunning = false;
+            this->threadJoinable = false;
+        }
 #endif
     }
 
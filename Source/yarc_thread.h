@@ -1,6 +1,8 @@
 #pragma once
 
 #include <functional>
+#include <string>
+#include <stdint.h>
 #if defined __WINDOWS__
 #	include <WS2tcpip.h>
 #	include <Windows.h>
@@ -19,8 +21,28 @@ namespace Yarc
 
 		typedef std::function<void(void)> Func;
 
+		enum SchedulingPolicy
+		{
+			SCHEDULING_POLICY_NORMAL,
+			SCHEDULING_POLICY_FIFO,			// Real-time; runs until it blocks or something of higher priority wants the CPU.
+			SCHEDULING_POLICY_ROUND_ROBIN	// Real-time; like FIFO, but takes turns with threads of equal priority.
+		};
+
+		// These are all best-effort.  If the OS won't let us have what we asked for (real-time scheduling
+		// usually takes special privileges, for example), the thread is still spawned, just without it.
+		struct Options
+		{
+			Options();
+
+			int cpuAffinity;					// The CPU to pin the thread to, or -1 to let it float.
+			std::string name;					// Shows up in debuggers and tools like top.  At most 15 characters on Linux.
+			uint32_t stackSize;					// In bytes, or zero for the OS default.
+			SchedulingPolicy schedulingPolicy;
+			int schedulingPriority;				// Only used by the real-time policies.  1 (low) to 99 (high) on Linux.
+		};
+
 		// Just spawn a thread to run the given lambda function.
-		bool SpawnThread(Func func);
+		bool SpawnThread(Func func, const Options* options = nullptr);
 
 		// The caller should signal the thread to shutdown before calling this.
 		bool WaitForThreadExit(void);
@@ -35,6 +57,8 @@ namespace Yarc
 
 private:
 
+		void ApplyOptions(const Options* options);
+
 #if defined __WINDOWS__
 		static DWORD __stdcall ThreadMain(LPVOID param);
 		HANDLE threadHandle;
@@ -42,6 +66,7 @@ private:
 		static void* ThreadMain(void* arg);
 		pthread_t thread;
 		volatile bool threadRunning;
+		bool threadJoinable;
 #endif
 		Func cachedFunc;
 	};
@@ -69,6 +69,12 @@ namespace Yarc
 			return value;
 		}
 
+		void SetMaxFreeNodes(unsigned int maxFreeNodes)
+		{
+			MutexLocker locker(this->mutex);
+			this->linkedList.SetMaxFreeNodes(maxFreeNodes);
+		}
+
 		void Delete()
 		{
 			MutexLocker locker(this->mutex);
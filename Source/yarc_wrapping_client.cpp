@@ -0,0 +1,141 @@
+#include "yarc_wrapping_client.h"
+
+namespace Yarc
+{
+	WrappingClient::WrappingClient(ClientInterface* givenClient)
+	{
+		this->client = givenClient;
+		this->address = givenClient->address;
+		this->clientAddress = givenClient->address;
+	}
+
+	/*virtual*/ WrappingClient::~WrappingClient()
+	{
+	}
+
+	WrappingClient::Entry::Entry(Callback givenCallback, WrappingClient* givenWrappingClient) : callback(std::move(givenCallback))
+	{
+		this->wrappingClient = givenWrappingClient;
+		this->clientHandle = 0;
+		this->canceled = false;
+	}
+
+	/*virtual*/ WrappingClient::Entry* WrappingClient::LookupEntry(RequestHandle requestHandle)
+	{
+		return nullptr;
+	}
+
+	/*virtual*/ void WrappingClient::DeallocateEntry(Entry* entry)
+	{
+	}
+
+	// The address may just as well have been given to the client directly, so we only hand ours down if it's been changed.
+	ClientInterface* WrappingClient::PrepareClient(void)
+	{
+		if (!(this->address == this->clientAddress))
+		{
+			this->clientAddress = this->address;
+			this->client->address = this->address;
+		}
+
+		return this->client;
+	}
+
+	/*virtual*/ bool WrappingClient::Update(double timeoutMilliseconds /*= 0.0*/)
+	{
+		return this->PrepareClient()->Update(timeoutMilliseconds);
+	}
+
+	/*virtual*/ bool WrappingClient::Flush(double timeoutSeconds /*= 5.0*/)
+	{
+		return this->PrepareClient()->Flush(timeoutSeconds);
+	}
+
+	WrappingClient::RequestHandle WrappingClient::PassRequestThrough(EntryPtr entry, RequestHandle requestHandle, const ProtocolData* requestData, bool deleteData)
+	{
+		RequestHandle clientHandle = this->PrepareClient()->MakeRequestAsync(requestData, [entry = std::move(entry)](const ProtocolData* responseData) mutable -> bool {
+			Callback callback = entry->wrappingClient->TakeCallback(entry.get());
+			return callback ? callback(responseData) : true;
+		}, deleteData);
+
+		if (clientHandle == 0)
+			return 0;
+
+		this->SetClientHandle(requestHandle, clientHandle);
+		return requestHandle;
+	}
+
+	void WrappingClient::SetClientHandle(RequestHandle requestHandle, RequestHandle clientHandle)
+	{
+		// The client may have already answered the request (on another thread) and let go of its entry.
+		MutexLocker locker(this->entryMutex);
+		Entry* entry = this->LookupEntry(requestHandle);
+		if (entry)
+			entry->clientHandle = clientHandle;
+	}
+
+	/*virtual*/ bool WrappingClient::CancelAsyncRequest(RequestHandle requestHandle)
+	{
+		Callback canceledCallback;
+		RequestHandle clientHandle = 0;
+
+		{
+			MutexLocker locker(this->entryMutex);
+			Entry* entry = this->LookupEntry(requestHandle);
+			if (!entry || entry->canceled)
+				return false;
+
+			// Whatever the derived client is still doing with the request carries on, but the callback is gone.
+			entry->canceled = true;
+			canceledCallback = std::move(entry->callback);
+			clientHandle = entry->clientHandle;
+		}
+
+		// The client then lets go of the entry for us.
+		if (clientHandle != 0)
+			return this->client->CancelAsyncRequest(clientHandle);
+
+		return true;
+	}
+
+	/*virtual*/ bool WrappingClient::MakeTransactionRequestAsync(DynamicArray<const ProtocolData*>& requestDataArray, Callback callback /*= [](const ProtocolData*) -> bool { return true; }*/, bool deleteData /*= true*/)
+	{
+		return this->PrepareClient()->MakeTransactionRequestAsync(requestDataArray, std::move(callback), deleteData);
+	}
+
+	/*virtual*/ bool WrappingClient::MakeTransactionRequestSync(DynamicArray<const ProtocolData*>& requestDataArray, ProtocolData*& responseData, bool deleteData /*= true*/, double timeoutSeconds /*= 5.0*/)
+	{
+		return this->PrepareClient()->MakeTransactionRequestSync(requestDataArray, responseData, deleteData, timeoutSeconds);
+	}
+
+	/*virtual*/ bool WrappingClient::MakePipelineRequestAsync(Pipeline* pipeline, Pipeline::Callback callback /*= [](Pipeline*) -> bool { return true; }*/)
+	{
+		return this->PrepareClient()->MakePipelineRequestAsync(pipeline, std::move(callback));
+	}
+
+	/*virtual*/ bool WrappingClient::RegisterPushDataCallback(Callback givenPushDataCallback)
+	{
+		return this->client->RegisterPushDataCallback(std::move(givenPushDataCallback));
+	}
+
+	/*virtual*/ void WrappingClient::SetExecutor(Executor* givenExecutor, Executor::Ordering givenExecutorOrdering /*= Executor::ORDERING_NONE*/)
+	{
+		// Our callbacks are called from within the client's, so its executor is ours too.
+		this->client->SetExecutor(givenExecutor, givenExecutorOrdering);
+	}
+
+	WrappingClient::Callback WrappingClient::TakeCallback(Entry* entry)
+	{
+		MutexLocker locker(this->entryMutex);
+		return std::move(entry->callback);
+	}
+
+	void WrappingClient::FreeEntry(Entry* entry)
+	{
+		// The callback may own something that comes back to us as it's freed, so it goes before we lock.
+		entry->callback = nullptr;
+
+		MutexLocker locker(this->entryMutex);
+		this->DeallocateEntry(entry);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "yarc_api.h"
+#include "yarc_client_iface.h"
+#include "yarc_mutex.h"
+#include <memory>
+
+namespace Yarc
+{
+	// This is what the clients that sit in front of another client (the coalescing, caching, aggregating and scripting
+	// clients) have in common.  It holds the client, hands our address down to it, and passes along anything the derived
+	// client has nothing to add to.  Derived clients that hand out handles of their own give each request an entry, kept
+	// in a slab of their own (see below), and for a request passed straight through, the entry keeps the client's handle,
+	// so that canceling ours cancels theirs.
+	class YARC_API WrappingClient : public ClientInterface
+	{
+	public:
+
+		// The given client is ours from here on, but it's up to the derived client to delete it, since the callbacks
+		// it lets go of as it goes may still need the derived client.  Configure it through GetClient().
+		WrappingClient(ClientInterface* givenClient);
+		virtual ~WrappingClient();
+
+		virtual bool Update(double timeoutMilliseconds = 0.0) override;
+		virtual bool Flush(double timeoutSeconds = 5.0) override;
+		virtual bool CancelAsyncRequest(RequestHandle requestHandle) override;
+		virtual bool MakeTransactionRequestAsync(DynamicArray<const ProtocolData*>& requestDataArray, Callback callback = [](const ProtocolData*) -> bool { return true; }, bool deleteData = true) override;
+		virtual bool MakeTransactionRequestSync(DynamicArray<const ProtocolData*>& requestDataArray, ProtocolData*& responseData, bool deleteData = true, double timeoutSeconds = 5.0) override;
+		virtual bool MakePipelineRequestAsync(Pipeline* pipeline, Pipeline::Callback callback = [](Pipeline*) -> bool { return true; }) override;
+		virtual bool RegisterPushDataCallback(Callback givenPushDataCallback) override;
+		virtual void SetExecutor(Executor* givenExecutor, Executor::Ordering givenExecutorOrdering = Executor::ORDERING_NONE) override;
+
+		ClientInterface* GetClient(void) { return this->client; }
+
+	protected:
+
+		// Derived clients add whatever else they need to know about a request to this.
+		struct Entry
+		{
+			Entry(Callback givenCallback, WrappingClient* givenWrappingClient);
+
+			Callback callback;
+			WrappingClient* wrappingClient;
+			RequestHandle clientHandle;		// Only set while the request is in the client's hands as it was given to us.
+			bool canceled;
+		};
+
+		// Whoever holds one of these frees the entry (and the entry's callback along with it) by letting go of it.
+		struct EntryDeleter
+		{
+			void operator()(Entry* entry) const { entry->wrappingClient->FreeEntry(entry); }
+		};
+
+		typedef std::unique_ptr<Entry, EntryDeleter> EntryPtr;
+
+		// Each derived client keeps its entries in a slab of its own kind of entry, and finds and frees them through these,
+		// which are only called with the entry mutex held.  A client that hands out the client's handles needs neither.
+		virtual Entry* LookupEntry(RequestHandle requestHandle);
+		virtual void DeallocateEntry(Entry* entry);
+
+		// Our address may be changed at any time before we connect, so this is called before the client is used.
+		ClientInterface* PrepareClient(void);
+
+		// Send the request on to the client just as it is.  The client owns the entry from here on, and should it refuse
+		// the request, the entry goes with the callback, and the caller keeps the request.
+		RequestHandle PassRequestThrough(EntryPtr entry, RequestHandle requestHandle, const ProtocolData* requestData, bool deleteData);
+		void SetClientHandle(RequestHandle requestHandle, RequestHandle clientHandle);
+
+		Callback TakeCallback(Entry* entry);
+		void FreeEntry(Entry* entry);
+
+		ClientInterface* client;
+		Address clientAddress;
+		Mutex entryMutex;
+	};
+}
\ No newline at end of file
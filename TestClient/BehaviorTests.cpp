@@ -0,0 +1,582 @@
+#include "BehaviorTests.h"
+#include <yarc_simple_client.h>
+#include <yarc_executor.h>
+#include <yarc_striped_client.h>
+#include <yarc_connection_pool.h>
+#include <yarc_coalescing_client.h>
+#include <yarc_caching_client.h>
+#include <yarc_aggregating_client.h>
+#include <yarc_scripting_client.h>
+#include <yarc_coroutine.h>
+#include <yarc_protocol_data.h>
+#include <yarc_misc.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#if defined __LINUX__
+#	include <dirent.h>
+#endif
+
+using namespace Yarc;
+
+#define TEST_CHECK(condition) \
+	do \
+	{ \
+		if (!(condition)) \
+		{ \
+			std::cout << "    Check failed: " << #condition << " (line " << __LINE__ << ")" << std::endl; \
+			return false; \
+		} \
+	} while (false)
+
+static std::string PrintData(const ProtocolData* protocolData)
+{
+	std::string protocolDataStr;
+	StringStream stringStream(&protocolDataStr);
+	if (protocolData)
+		ProtocolData::PrintTree(&stringStream, protocolData);
+	return protocolDataStr;
+}
+
+//----------------------------------------- Coroutines -----------------------------------------
+
+#if defined __cpp_impl_coroutine
+
+static Task AwaitPing(ClientInterface* client, bool& resumed, ProtocolData*& responseData)
+{
+	responseData = co_await client->AwaitRequest(ProtocolData::ParseCommand("PING"));
+	resumed = true;
+}
+
+// A refused request must resume the coroutine straight away with a null result, rather than leave it suspended forever.
+static bool TestRefusedAwait(const Address& address)
+{
+	SimpleClient* client = new SimpleClient();
+	client->address = address;
+	client->SetMaxQueuedRequests(1, SimpleClient::BACKPRESSURE_REFUSE);
+
+	// Nothing drives the client until we're done awaiting, so this fills its queue.
+	bool pingAnswered = false;
+	TEST_CHECK(0 != client->MakeRequestAsync(ProtocolData::ParseCommand("PING"), [&pingAnswered](const ProtocolData*) -> bool { pingAnswered = true; return true; }));
+
+	bool resumed = false;
+	ProtocolData* responseData = nullptr;
+	AwaitPing(client, resumed, responseData).Spawn();
+	TEST_CHECK(resumed);
+	TEST_CHECK(responseData == nullptr);
+
+	// Once there's room again, awaiting works as usual.
+	TEST_CHECK(client->Flush());
+	TEST_CHECK(pingAnswered);
+
+	resumed = false;
+	AwaitPing(client, resumed, responseData).Spawn();
+	TEST_CHECK(client->Flush());
+	TEST_CHECK(resumed);
+	TEST_CHECK(PrintData(responseData) == "+PONG\r\n");
+	delete responseData;
+
+	delete client;
+	return true;
+}
+
+#endif //__cpp_impl_coroutine
+
+//----------------------------------------- Simple client -----------------------------------------
+
+static uint32_t CountOpenDescriptors(void)
+{
+	uint32_t count = 0;
+#if defined __LINUX__
+	DIR* dir = opendir("/proc/self/fd");
+	if (dir)
+	{
+		while (readdir(dir))
+			count++;
+
+		closedir(dir);
+	}
+#endif
+	return count;
+}
+
+// Every connection the server drops must have its socket closed by the time we've made a new one.
+static bool TestLostConnectionsClosed(const Address& address)
+{
+	SimpleClient* client = new SimpleClient();
+	client->address = address;
+	client->SetReconnectBackoff(0.0);
+
+	ProtocolData* responseData = nullptr;
+	TEST_CHECK(client->MakeRequestSync(ProtocolData::ParseCommand("PING"), responseData));
+	delete responseData;
+	uint32_t numOpen = CountOpenDescriptors();
+
+	for (uint32_t i = 0; i < 5; i++)
+	{
+		TEST_CHECK(client->MakeRequestSync(ProtocolData::ParseCommand("QUIT"), responseData));
+		delete responseData;
+
+		// It may take us a try or two to notice that the connection is gone.
+		for (uint32_t j = 0; j < 100 && client->GetNumConnectionsMade() < i + 2; j++)
+		{
+			if (client->MakeRequestSync(ProtocolData::ParseCommand("PING"), responseData))
+				delete responseData;
+		}
+		TEST_CHECK(client->GetNumConnectionsMade() == i + 2);
+	}
+
+	// Idle pooled connections left by other tests may be closed meanwhile, so there may be fewer, but never more.
+	TEST_CHECK(CountOpenDescriptors() <= numOpen);
+
+	delete client;
+	return true;
+}
+
+// Waiting on a request made through the general synchronous path mustn't change where anyone else's callbacks run.
+static bool TestSyncKeepsExecutor(const Address& address)
+{
+	Executor* executor = new Executor(2);
+	SimpleClient* client = new SimpleClient();
+	client->address = address;
+	client->SetExecutor(executor);
+
+	std::thread::id callbackThreadId;
+	TEST_CHECK(0 != client->MakeRequestAsync(ProtocolData::ParseCommand("PING"), [&callbackThreadId](const ProtocolData*) -> bool {
+		callbackThreadId = std::this_thread::get_id();
+		return true;
+	}));
+
+	ProtocolData* responseData = nullptr;
+	TEST_CHECK(client->ClientInterface::MakeRequestSync(ProtocolData::ParseCommand("PING"), responseData));
+	TEST_CHECK(PrintData(responseData) == "+PONG\r\n");
+	delete responseData;
+
+	TEST_CHECK(client->Flush());
+	TEST_CHECK(executor->WaitForIdle(5.0));
+	TEST_CHECK(callbackThreadId != std::thread::id() && callbackThreadId != std::this_thread::get_id());
+
+	delete client;
+	delete executor;
+	return true;
+}
+
+//----------------------------------------- Connection pool -----------------------------------------
+
+static SimpleClient* MakeClientWithDatabase(const Address& address, int database)
+{
+	SimpleClient* client = new SimpleClient();
+	client->address = address;
+
+	SimpleClient::ConnectionProfile connectionProfile;
+	connectionProfile.database = database;
+	client->SetConnectionProfile(connectionProfile);
+	return client;
+}
+
+// A connection recycled by a client that selected another database must not be handed to a client that didn't.
+static bool TestPooledConnectionProfile(const Address& address)
+{
+	ConnectionPool* connectionPool = ConnectionPool::Get();
+	ProtocolData* responseData = nullptr;
+
+	SimpleClient* client = MakeClientWithDatabase(address, 1);
+	TEST_CHECK(client->MakeRequestSync(ProtocolData::ParseCommand("SET yarc_test_pooled db1"), responseData));
+	delete responseData;
+	SimpleClient::Destroy(client, true);
+
+	uint32_t numIdle = connectionPool->GetNumIdleSocketStreams(address);
+	TEST_CHECK(numIdle > 0);
+
+	// This one has to make a connection of its own, and so sees database zero.
+	client = MakeClientWithDatabase(address, 0);
+	TEST_CHECK(client->MakeRequestSync(ProtocolData::ParseCommand("GET yarc_test_pooled"), responseData));
+	TEST_CHECK(responseData && responseData->IsNull());
+	TEST_CHECK(connectionPool->GetNumIdleSocketStreams(address) == numIdle);
+	delete responseData;
+	SimpleClient::Destroy(client, true);
+
+	// Whereas this one can have the first one's connection back, and sees database one.
+	client = MakeClientWithDatabase(address, 1);
+	TEST_CHECK(client->MakeRequestSync(ProtocolData::ParseCommand("GET yarc_test_pooled"), responseData));
+	TEST_CHECK(PrintData(responseData) == "$3\r\ndb1\r\n");
+	delete responseData;
+	TEST_CHECK(client->MakeRequestSync(ProtocolData::ParseCommand("DEL yarc_test_pooled"), responseData));
+	delete responseData;
+	SimpleClient::Destroy(client, true);
+
+	return true;
+}
+
+//----------------------------------------- Coalescing client -----------------------------------------
+
+// Make a request whose callback keeps its reply, to be deleted later.
+static bool MakeKeepingRequest(ClientInterface* client, const char* command, std::vector<ProtocolData*>& keptArray, uint32_t i)
+{
+	return 0 != client->MakeRequestAsync(ProtocolData::ParseCommand(command), [&keptArray, i](const ProtocolData* responseData) -> bool {
+		keptArray[i] = const_cast<ProtocolData*>(responseData);
+		return false;
+	});
+}
+
+static void DeleteKept(std::vector<ProtocolData*>& keptArray)
+{
+	for (ProtocolData* protocolData : keptArray)
+		delete protocolData;
+}
+
+// Callbacks of combined requests that keep their replies must each be given one of their own.
+static bool TestCoalescedRepliesKept(const Address& address)
+{
+	CoalescingClient* client = new CoalescingClient(new SimpleClient());
+	client->address = address;
+
+	ProtocolData* responseData = nullptr;
+	TEST_CHECK(client->MakeRequestSync(ProtocolData::ParseCommand("MSET yarc_test_coalesced_a a yarc_test_coalesced_b b"), responseData));
+	delete responseData;
+
+	// The GETs go out as one MGET, whose reply is split up, and the EXISTS as one EXISTS, whose reply is copied.
+	std::vector<ProtocolData*> keptArray(5, nullptr);
+	TEST_CHECK(MakeKeepingRequest(client, "GET yarc_test_coalesced_a", keptArray, 0));
+	TEST_CHECK(MakeKeepingRequest(client, "GET yarc_test_coalesced_b", keptArray, 1));
+	TEST_CHECK(MakeKeepingRequest(client, "GET yarc_test_coalesced_a", keptArray, 2));
+	TEST_CHECK(MakeKeepingRequest(client, "EXISTS yarc_test_coalesced_a", keptArray, 3));
+	TEST_CHECK(MakeKeepingRequest(client, "EXISTS yarc_test_coalesced_a", keptArray, 4));
+	TEST_CHECK(client->Flush());
+
+	TEST_CHECK(client->GetNumBatchesSent() == 2);
+	TEST_CHECK(PrintData(keptArray[0]) == "$1\r\na\r\n");
+	TEST_CHECK(PrintData(keptArray[1]) == "$1\r\nb\r\n");
+	TEST_CHECK(PrintData(keptArray[2]) == "$1\r\na\r\n");
+	TEST_CHECK(keptArray[3] && keptArray[4] && keptArray[3] != keptArray[4]);
+	TEST_CHECK(PrintData(keptArray[3]) == PrintData(keptArray[4]));
+	DeleteKept(keptArray);
+
+	TEST_CHECK(client->MakeRequestSync(ProtocolData::ParseCommand("DEL yarc_test_coalesced_a yarc_test_coalesced_b"), responseData));
+	delete responseData;
+
+	delete client;
+	return true;
+}
+
+// The same goes for identical reads folded into one flight, every one of which is answered by the same reply.
+static bool TestSingleFlightRepliesKept(const Address& address)
+{
+	CoalescingClient* client = new CoalescingClient(new SimpleClient());
+	client->address = address;
+	client->SetSingleFlight(true);
+
+	ProtocolData* responseData = nullptr;
+	TEST_CHECK(client->MakeRequestSync(ProtocolData::ParseCommand("SET yarc_test_flight f"), responseData));
+	delete responseData;
+
+	std::vector<ProtocolData*> keptArray(3, nullptr);
+	for (uint32_t i = 0; i < keptArray.size(); i++)
+		TEST_CHECK(MakeKeepingRequest(client, "GET yarc_test_flight", keptArray, i));
+	TEST_CHECK(client->Flush());
+
+	TEST_CHECK(client->GetNumDuplicatesSuppressed() == 2);
+	for (uint32_t i = 0; i < keptArray.size(); i++)
+	{
+		TEST_CHECK(PrintData(keptArray[i]) == "$1\r\nf\r\n");
+		for (uint32_t j = 0; j < i; j++)
+			TEST_CHECK(keptArray[i] != keptArray[j]);
+	}
+	DeleteKept(keptArray);
+
+	TEST_CHECK(client->MakeRequestSync(ProtocolData::ParseCommand("DEL yarc_test_flight"), responseData));
+	delete responseData;
+
+	delete client;
+	return true;
+}
+
+//----------------------------------------- Caching client -----------------------------------------
+
+// A read cached in one database must not answer the same read once another database has been selected.  Every hit
+// must also be a reply of its own.  The server tells us about keys by name alone, whatever the database, so the key is
+// written in database one before we ever read it, and nothing but the SELECT can tell us to forget what we read.
+static bool TestCacheAcrossSelect(const Address& address)
+{
+	ProtocolData* responseData = nullptr;
+
+	SimpleClient* otherClient = MakeClientWithDatabase(address, 1);
+	TEST_CHECK(otherClient->MakeRequestSync(ProtocolData::ParseCommand("SET yarc_test_cached db1"), responseData));
+	delete responseData;
+
+	CachingClient* client = new CachingClient(new SimpleClient());
+	client->address = address;
+	TEST_CHECK(client->MakeRequestSync(ProtocolData::ParseCommand("SET yarc_test_cached db0"), responseData));
+	delete responseData;
+
+	std::vector<ProtocolData*> keptArray(3, nullptr);
+	for (uint32_t i = 0; i < keptArray.size(); i++)
+	{
+		TEST_CHECK(MakeKeepingRequest(client, "GET yarc_test_cached", keptArray, i));
+		TEST_CHECK(client->Flush());
+		TEST_CHECK(PrintData(keptArray[i]) == "$3\r\ndb0\r\n");
+	}
+	TEST_CHECK(client->GetNumHits() == 2);
+	DeleteKept(keptArray);
+
+	TEST_CHECK(client->MakeRequestSync(ProtocolData::ParseCommand("SELECT 1"), responseData));
+	delete responseData;
+	TEST_CHECK(client->GetNumCachedReplies() == 0);
+
+	TEST_CHECK(client->MakeRequestSync(ProtocolData::ParseCommand("GET yarc_test_cached"), responseData));
+	TEST_CHECK(PrintData(responseData) == "$3\r\ndb1\r\n");
+	delete responseData;
+
+	TEST_CHECK(client->MakeRequestSync(ProtocolData::ParseCommand("DEL yarc_test_cached"), responseData));
+	delete responseData;
+	TEST_CHECK(client->MakeRequestSync(ProtocolData::ParseCommand("SELECT 0"), responseData));
+	delete responseData;
+	TEST_CHECK(client->MakeRequestSync(ProtocolData::ParseCommand("DEL yarc_test_cached"), responseData));
+	delete responseData;
+
+	delete client;
+	delete otherClient;
+	return true;
+}
+
+// A synchronous read must be answered from the cache just as an asynchronous one is, with a reply of its own, and a
+// synchronous write must keep what it replaced from being read back.
+static bool TestCacheSyncRequests(const Address& address)
+{
+	CachingClient* client = new CachingClient(new SimpleClient());
+	client->address = address;
+
+	ProtocolData* responseData = nullptr;
+	TEST_CHECK(client->MakeRequestSync(ProtocolData::ParseCommand("SET yarc_test_cached_sync one"), responseData));
+	delete responseData;
+
+	ProtocolData* missData = nullptr;
+	TEST_CHECK(client->MakeRequestSync(ProtocolData::ParseCommand("GET yarc_test_cached_sync"), missData));
+	TEST_CHECK(client->GetNumCachedReplies() == 1);
+
+	ProtocolData* hitData = nullptr;
+	TEST_CHECK(client->MakeRequestSync(ProtocolData::ParseCommand("GET yarc_test_cached_sync"), hitData));
+	TEST_CHECK(client->GetNumHits() == 1);
+	TEST_CHECK(hitData != missData);
+	TEST_CHECK(PrintData(missData) == "$3\r\none\r\n");
+	TEST_CHECK(PrintData(hitData) == "$3\r\none\r\n");
+	delete missData;
+	delete hitData;
+
+	TEST_CHECK(client->MakeRequestSync(ProtocolData::ParseCommand("SET yarc_test_cached_sync two"), responseData));
+	delete responseData;
+	TEST_CHECK(client->MakeRequestSync(ProtocolData::ParseCommand("GET yarc_test_cached_sync"), responseData));
+	TEST_CHECK(PrintData(responseData) == "$3\r\ntwo\r\n");
+	delete responseData;
+
+	TEST_CHECK(client->MakeRequestSync(ProtocolData::ParseCommand("DEL yarc_test_cached_sync"), responseData));
+	delete responseData;
+
+	delete client;
+	return true;
+}
+
+//----------------------------------------- Aggregating client -----------------------------------------
+
+// Merged counter updates must still each get the reply they'd have gotten alone, and a sum that would overflow must
+// send what's held so far, rather than wrap.  Merged set updates must each be given a reply of their own.
+static bool TestAggregatorOverflow(const Address& address)
+{
+	AggregatingClient* client = new AggregatingClient(new SimpleClient());
+	client->address = address;
+	client->SetFlushInterval(60.0);
+	client->SetMaxPendingUpdates(3);
+
+	ProtocolData* responseData = nullptr;
+	TEST_CHECK(client->MakeRequestSync(ProtocolData::ParseCommand("DEL yarc_test_aggregated yarc_test_aggregated_big yarc_test_aggregated_set"), responseData));
+	delete responseData;
+
+	// The third update fills the batch, so all three go out as one INCRBY.
+	std::vector<ProtocolData*> keptArray(3, nullptr);
+	TEST_CHECK(MakeKeepingRequest(client, "INCRBY yarc_test_aggregated 1", keptArray, 0));
+	TEST_CHECK(MakeKeepingRequest(client, "INCRBY yarc_test_aggregated 1", keptArray, 1));
+	TEST_CHECK(client->GetNumCommandsSent() == 0);
+	TEST_CHECK(MakeKeepingRequest(client, "INCRBY yarc_test_aggregated 5", keptArray, 2));
+	TEST_CHECK(client->GetNumCommandsSent() == 1);
+	TEST_CHECK(client->Flush());
+	TEST_CHECK(PrintData(keptArray[0]) == ":1\r\n");
+	TEST_CHECK(PrintData(keptArray[1]) == ":2\r\n");
+	TEST_CHECK(PrintData(keptArray[2]) == ":7\r\n");
+	DeleteKept(keptArray);
+
+	TEST_CHECK(client->MakeRequestSync(ProtocolData::ParseCommand("SET yarc_test_aggregated_big -10"), responseData));
+	delete responseData;
+
+	// The second update can't be added to the first without overflowing, so the first goes out on its own.
+	keptArray.assign(2, nullptr);
+	TEST_CHECK(MakeKeepingRequest(client, "INCRBY yarc_test_aggregated_big 9223372036854775807", keptArray, 0));
+	TEST_CHECK(MakeKeepingRequest(client, "INCRBY yarc_test_aggregated_big 5", keptArray, 1));
+	TEST_CHECK(client->GetNumCommandsSent() == 2);
+	TEST_CHECK(client->Flush());
+	TEST_CHECK(client->GetNumCommandsSent() == 3);
+	TEST_CHECK(PrintData(keptArray[0]) == ":9223372036854775797\r\n");
+	TEST_CHECK(PrintData(keptArray[1]) == ":9223372036854775802\r\n");
+	DeleteKept(keptArray);
+
+	keptArray.assign(2, nullptr);
+	TEST_CHECK(MakeKeepingRequest(client, "SADD yarc_test_aggregated_set a", keptArray, 0));
+	TEST_CHECK(MakeKeepingRequest(client, "SADD yarc_test_aggregated_set b", keptArray, 1));
+	TEST_CHECK(client->Flush());
+	TEST_CHECK(keptArray[0] && keptArray[1] && keptArray[0] != keptArray[1]);
+	TEST_CHECK(PrintData(keptArray[0]) == PrintData(keptArray[1]));
+	DeleteKept(keptArray);
+
+	TEST_CHECK(client->MakeRequestSync(ProtocolData::ParseCommand("DEL yarc_test_aggregated yarc_test_aggregated_big yarc_test_aggregated_set"), responseData));
+	delete responseData;
+
+	delete client;
+	return true;
+}
+
+// An increment Redis wouldn't take on its own (a leading zero, or a negative zero) mustn't be merged with others,
+// where it would quietly succeed, but sent as it is, to be turned down.
+static bool TestAggregatorStrictIntegers(const Address& address)
+{
+	AggregatingClient* client = new AggregatingClient(new SimpleClient());
+	client->address = address;
+	client->SetFlushInterval(60.0);
+
+	ProtocolData* responseData = nullptr;
+	TEST_CHECK(client->MakeRequestSync(ProtocolData::ParseCommand("DEL yarc_test_aggregated"), responseData));
+	delete responseData;
+
+	std::vector<ProtocolData*> keptArray(3, nullptr);
+	TEST_CHECK(MakeKeepingRequest(client, "INCRBY yarc_test_aggregated 5", keptArray, 0));
+	TEST_CHECK(MakeKeepingRequest(client, "INCRBY yarc_test_aggregated 007", keptArray, 1));
+	TEST_CHECK(MakeKeepingRequest(client, "INCRBY yarc_test_aggregated -0", keptArray, 2));
+	TEST_CHECK(client->Flush());
+	TEST_CHECK(PrintData(keptArray[0]) == ":5\r\n");
+	TEST_CHECK(Cast<SimpleErrorData>(keptArray[1]) != nullptr);
+	TEST_CHECK(Cast<SimpleErrorData>(keptArray[2]) != nullptr);
+	DeleteKept(keptArray);
+
+	TEST_CHECK(client->MakeRequestSync(ProtocolData::ParseCommand("GET yarc_test_aggregated"), responseData));
+	TEST_CHECK(PrintData(responseData) == "$1\r\n5\r\n");
+	delete responseData;
+
+	TEST_CHECK(client->MakeRequestSync(ProtocolData::ParseCommand("DEL yarc_test_aggregated"), responseData));
+	delete responseData;
+
+	delete client;
+	return true;
+}
+
+//----------------------------------------- Scripting client -----------------------------------------
+
+// An EVALSHA the server has forgotten the script for (after SCRIPT FLUSH, say) must load it and try once more, so the
+// caller never sees the NOSCRIPT error.
+static bool TestScriptReloaded(const Address& address)
+{
+	ScriptingClient* client = new ScriptingClient(new SimpleClient());
+	client->address = address;
+
+	// This is also the SHA1 Redis itself gives the script.  It's loaded asynchronously, so wait for that first.
+	std::string sha = client->RegisterScript("return #KEYS");
+	TEST_CHECK(sha == "cb35aa5ca859d59b3e50fa6f9efbe7e14b5215dd");
+	TEST_CHECK(client->Flush());
+
+	SimpleClient* otherClient = new SimpleClient();
+	otherClient->address = address;
+	ProtocolData* responseData = nullptr;
+	TEST_CHECK(otherClient->MakeRequestSync(ProtocolData::ParseCommand("SCRIPT FLUSH"), responseData));
+	delete responseData;
+
+	TEST_CHECK(client->MakeRequestSync(ProtocolData::ParseCommand("EVALSHA %s 1 yarc_test_script", sha.c_str()), responseData));
+	TEST_CHECK(PrintData(responseData) == ":1\r\n");
+	delete responseData;
+	TEST_CHECK(client->GetNumScriptsReloaded() == 1);
+
+	delete client;
+	delete otherClient;
+	return true;
+}
+
+//----------------------------------------- Striped client -----------------------------------------
+
+// A request on a key must go out on the stripe its hash slot picks, and its handle must find its way back there.
+static bool TestStripedRouting(const Address& address)
+{
+	StripedClient* client = new StripedClient(4);
+	client->address = address;
+
+	bool getAnswered = false;
+	ClientInterface::RequestHandle requestHandle = client->MakeRequestAsync(ProtocolData::ParseCommand("GET yarc_test_striped"), [&getAnswered](const ProtocolData*) -> bool { getAnswered = true; return true; });
+	TEST_CHECK(requestHandle != 0);
+
+	uint32_t keyStripe = ProtocolData::CalcKeyHashSlot("yarc_test_striped") % client->GetNumStripes();
+	for (uint32_t i = 0; i < client->GetNumStripes(); i++)
+		TEST_CHECK(client->GetStripe(i)->GetNumQueuedRequests() == ((i == keyStripe) ? 1 : 0));
+
+	TEST_CHECK(client->CancelAsyncRequest(requestHandle));
+	TEST_CHECK(!client->CancelAsyncRequest(requestHandle));
+
+	// Requests without a key are dealt out round-robin.  The canceled request is still queued, just flagged.
+	uint32_t numPongs = 0;
+	for (uint32_t i = 0; i < client->GetNumStripes(); i++)
+	{
+		TEST_CHECK(0 != client->MakeRequestAsync(ProtocolData::ParseCommand("PING"), [&numPongs](const ProtocolData* responseData) -> bool {
+			if (PrintData(responseData) == "+PONG\r\n")
+				numPongs++;
+			return true;
+		}));
+	}
+
+	for (uint32_t i = 0; i < client->GetNumStripes(); i++)
+		TEST_CHECK(client->GetStripe(i)->GetNumQueuedRequests() == ((i == keyStripe) ? 2 : 1));
+
+	TEST_CHECK(client->Flush());
+	TEST_CHECK(numPongs == client->GetNumStripes());
+	TEST_CHECK(!getAnswered);
+
+	delete client;
+	return true;
+}
+
+//----------------------------------------- RunBehaviorTests -----------------------------------------
+
+struct BehaviorTest
+{
+	const char* name;
+	bool (*function)(const Address& address);
+};
+
+bool RunBehaviorTests(const Address& address)
+{
+	static BehaviorTest behaviorTestArray[] =
+	{
+#if defined __cpp_impl_coroutine
+		{ "refused await", TestRefusedAwait },
+#endif
+		{ "lost connections closed", TestLostConnectionsClosed },
+		{ "sync keeps executor", TestSyncKeepsExecutor },
+		{ "pooled connection profiles", TestPooledConnectionProfile },
+		{ "coalesced replies kept", TestCoalescedRepliesKept },
+		{ "single-flight replies kept", TestSingleFlightRepliesKept },
+		{ "cache across SELECT", TestCacheAcrossSelect },
+		{ "cache sync requests", TestCacheSyncRequests },
+		{ "aggregator overflow", TestAggregatorOverflow },
+		{ "aggregator strict integers", TestAggregatorStrictIntegers },
+		{ "script reloaded", TestScriptReloaded },
+		{ "striped handle routing", TestStripedRouting },
+	};
+
+	int numFailed = 0;
+	for (const BehaviorTest& behaviorTest : behaviorTestArray)
+	{
+		std::cout << "Testing " << behaviorTest.name << "..." << std::endl;
+		if (!behaviorTest.function(address))
+		{
+			std::cout << "    FAILED!" << std::endl;
+			numFailed++;
+		}
+	}
+
+	std::cout << (numFailed == 0 ? "All tests passed." : "Some tests failed!") << std::endl;
+	return numFailed == 0;
+}
\ No newline at end of file
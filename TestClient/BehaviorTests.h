@@ -0,0 +1,7 @@
+#pragma once
+
+#include <yarc_socket_stream.h>
+
+// These exercise the behavior of the various clients against a running Redis server.  They leave
+// behind nothing but a few keys prefixed with "yarc_test_", in databases 0 and 1.
+bool RunBehaviorTests(const Yarc::Address& address);
\ No newline at end of file
@@ -5,11 +5,24 @@
 #include <yarc_protocol_data.h>
 #include <yarc_connection_pool.h>
 #include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "BehaviorTests.h"
 
 using namespace Yarc;
 
-int main()
+// Usage: TestClient [test [ip-address] [port]]
+int main(int argc, char** argv)
 {
+	// Rather than take commands, run the behavior tests and report how they went.
+	if (argc >= 2 && 0 == strcmp(argv[1], "test"))
+	{
+		Address address;
+		address.SetIPAddress(argc >= 3 ? argv[2] : "127.0.0.1");
+		address.port = argc >= 4 ? atoi(argv[3]) : 6379;
+		return RunBehaviorTests(address) ? 0 : 1;
+	}
+
 	ClientInterface* client = new SimpleClient();
 
 	while(true)